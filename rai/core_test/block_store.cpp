@@ -875,6 +875,38 @@ TEST (block_store, upgrade_v7_v8)
 	}
 }
 
+TEST (block_store, upgrade_v8_v9)
+{
+	auto path (rai::unique_path ());
+	rai::keypair key1;
+	rai::send_block send1 (0, key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	{
+		bool init (false);
+		rai::block_store store (init, path);
+		ASSERT_FALSE (init);
+		rai::ledger ledger (store);
+		rai::transaction transaction (store.environment, nullptr, true);
+		rai::genesis genesis;
+		genesis.initialize (transaction, store);
+		send1.hashables.previous = genesis.hash ();
+		send1.signature = rai::sign_message (rai::test_genesis_key.prv, rai::test_genesis_key.pub, send1.hash ());
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send1).code);
+		ASSERT_EQ (0, mdb_drop (transaction, store.block_heights, 0));
+		store.version_put (transaction, 8);
+	}
+	bool init (false);
+	rai::block_store store (init, path);
+	ASSERT_FALSE (init);
+	rai::transaction transaction (store.environment, nullptr, false);
+	rai::account account;
+	uint64_t height (0);
+	ASSERT_FALSE (store.block_height_get (transaction, send1.hash (), account, height));
+	ASSERT_EQ (rai::test_genesis_key.pub, account);
+	ASSERT_EQ (2, height);
+	ASSERT_FALSE (store.block_height_get (transaction, send1.hashables.previous, account, height));
+	ASSERT_EQ (1, height);
+}
+
 TEST (block_store, sequence_flush)
 {
 	auto path (rai::unique_path ());
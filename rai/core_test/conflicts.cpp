@@ -75,3 +75,82 @@ TEST (conflicts, add_two)
 	}
     ASSERT_EQ (2, node1.active.roots.size ());
 }
+
+TEST (conflicts, cached_tally)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	ASSERT_EQ (rai::process_result::progress, node1.process (*send1).code);
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		node1.active.start (transaction, send1);
+	}
+	auto election (node1.active.roots.find (send1->root ())->election);
+	rai::vote vote1 (key1.pub, key1.prv, 1, send1);
+	node1.active.vote (vote1);
+	ASSERT_EQ (0, election->totals [send1->hash ()]);
+	ASSERT_FALSE (election->confirmed);
+	rai::vote vote2 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 1, send1);
+	node1.active.vote (vote2);
+	rai::transaction transaction (node1.store.environment, nullptr, false);
+	ASSERT_EQ (node1.ledger.weight (transaction, rai::test_genesis_key.pub), election->totals [send1->hash ()]);
+	ASSERT_TRUE (election->confirmed);
+}
+
+TEST (conflicts, winner_changed)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::keypair key2;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	auto send2 (std::make_shared <rai::send_block> (genesis.hash (), key2.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	ASSERT_EQ (rai::process_result::progress, node1.process (*send1).code);
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		node1.active.start (transaction, send1);
+	}
+	ASSERT_TRUE (node1.active.active (send1->hash ()));
+	// The network confirms the fork, our block is rolled back and the election's winner follows
+	rai::vote vote1 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 1, send2);
+	node1.active.vote (vote1);
+	auto election (node1.active.roots.find (send1->root ())->election);
+	ASSERT_TRUE (election->confirmed);
+	ASSERT_EQ (*send2, *election->last_winner);
+	ASSERT_TRUE (node1.active.active (send2->hash ()));
+	ASSERT_FALSE (node1.active.active (send1->hash ()));
+}
+
+TEST (conflicts, capacity)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	node1.active.max = 1;
+	rai::genesis genesis;
+	rai::keypair key1;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	ASSERT_EQ (rai::process_result::progress, node1.process (*send1).code);
+	rai::keypair key2;
+	auto send2 (std::make_shared <rai::send_block> (send1->hash (), key2.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	ASSERT_EQ (rai::process_result::progress, node1.process (*send2).code);
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		node1.active.start (transaction, send1);
+		ASSERT_TRUE (node1.active.active (send1->hash ()));
+		node1.active.start (transaction, send2);
+	}
+	ASSERT_EQ (1, node1.active.roots.size ());
+	ASSERT_EQ (1, node1.active.dropped);
+	auto priority1 (node1.work.work_value (send1->root (), send1->block_work ()));
+	auto priority2 (node1.work.work_value (send2->root (), send2->block_work ()));
+	auto & kept (priority1 < priority2 ? send2 : send1);
+	auto & lost (priority1 < priority2 ? send1 : send2);
+	ASSERT_EQ (std::max (priority1, priority2), node1.active.roots.begin ()->priority);
+	ASSERT_TRUE (node1.active.active (kept->hash ()));
+	ASSERT_FALSE (node1.active.active (lost->hash ()));
+	ASSERT_FALSE (node1.active.active (*lost));
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <rai/node/testing.hpp>
+#include <thread>
 
 TEST (gap_cache, add_new)
 {
@@ -94,3 +95,179 @@ TEST (gap_cache, two_dependencies)
 	ASSERT_TRUE (system.nodes [0]->store.block_exists (transaction, send2->hash ()));
 	ASSERT_TRUE (system.nodes [0]->store.block_exists (transaction, open->hash ()));
 }
+
+TEST (gap_cache, memory_budget)
+{
+    rai::system system (24000, 1);
+    auto block1 (std::make_shared <rai::send_block> (0, 1, 2, rai::keypair ().prv, 4, 5));
+    auto block2 (std::make_shared <rai::send_block> (0, 1, 3, rai::keypair ().prv, 4, 5));
+    rai::transaction transaction (system.nodes [0]->store.environment, nullptr, true);
+    size_t entry;
+    {
+        rai::gap_cache cache (*system.nodes [0]);
+        cache.add (transaction, block1, 1);
+        entry = cache.memory_used ();
+        ASSERT_GT (entry, 0);
+        cache.fill (block1->hash ());
+        ASSERT_EQ (0, cache.memory_used ());
+        ASSERT_EQ (1, cache.filled);
+        ASSERT_EQ (1, cache.fill_time.count);
+    }
+    // Room for one entry, adding a second evicts the oldest
+    rai::gap_cache cache (*system.nodes [0], entry);
+    cache.add (transaction, block1, 1);
+    auto arrival (cache.blocks.get <1> ().begin ()->arrival);
+    auto iterations (0);
+    while (std::chrono::system_clock::now () == arrival)
+    {
+        std::this_thread::sleep_for (std::chrono::microseconds (10));
+        ++iterations;
+        ASSERT_LT (iterations, 1000);
+    }
+    cache.add (transaction, block2, 1);
+    ASSERT_EQ (1, cache.blocks.size ());
+    ASSERT_EQ (1, cache.evicted);
+    ASSERT_NE (cache.blocks.get <1> ().end (), cache.blocks.get <1> ().find (block2->hash ()));
+    ASSERT_EQ (entry, cache.memory_used ());
+}
+
+TEST (gap_cache, requested_clear)
+{
+    rai::system system (24000, 1);
+    auto block1 (std::make_shared <rai::send_block> (0, 1, 2, rai::keypair ().prv, 4, 5));
+    rai::gap_cache cache (*system.nodes [0]);
+    {
+        rai::transaction transaction (system.nodes [0]->store.environment, nullptr, true);
+        cache.add (transaction, block1, 1);
+    }
+    cache.blocks.modify (cache.blocks.begin (), [] (rai::gap_information & info)
+    {
+        info.requested = true;
+    });
+    // An attempt that ended without filling the gap lets the next vote schedule another pull
+    cache.requested_clear ();
+    ASSERT_FALSE (cache.blocks.begin ()->requested);
+}
+
+TEST (gap_cache, lazy_pull)
+{
+	rai::system system (24000, 2);
+	rai::keypair key;
+	rai::genesis genesis;
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (genesis.hash ())));
+	auto send2 (std::make_shared <rai::send_block> (send1->hash (), key.pub, rai::genesis_amount - 200, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (send1->hash ())));
+	system.nodes [0]->block_processor.process_receive_many (send1);
+	system.nodes [0]->block_processor.process_receive_many (send2);
+	// Node 1 only sees send2 and has to fetch send1 after node 0 votes for it
+	system.nodes [1]->block_processor.process_receive_many (send2);
+	ASSERT_EQ (1, system.nodes [1]->gap_cache.blocks.size ());
+	ASSERT_EQ (send1->hash (), system.nodes [1]->gap_cache.blocks.get <1> ().begin ()->missing);
+	rai::vote vote (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 1, send2);
+	system.nodes [1]->vote_processor.vote (vote, system.nodes [0]->network.endpoint ());
+	// Votes after the threshold was reached don't request the chain again
+	rai::vote vote2 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 2, send2);
+	system.nodes [1]->vote_processor.vote (vote2, system.nodes [0]->network.endpoint ());
+	auto iterations (0);
+	while (system.nodes [1]->balance (rai::genesis_account) != rai::genesis_amount - 200)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	std::lock_guard <std::mutex> lock (system.nodes [1]->gap_cache.mutex);
+	ASSERT_EQ (1, system.nodes [1]->gap_cache.pulls);
+	ASSERT_EQ (1, system.nodes [1]->gap_cache.filled);
+}
+
+TEST (dependency_graph, release_order)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::dependency_graph graph (node1.store);
+	auto block1 (std::make_shared <rai::send_block> (1, 1, 2, rai::keypair ().prv, 4, 5));
+	auto block2 (std::make_shared <rai::send_block> (1, 1, 3, rai::keypair ().prv, 4, 5));
+	auto block3 (std::make_shared <rai::send_block> (block1->hash (), 1, 2, rai::keypair ().prv, 4, 5));
+	rai::transaction transaction (node1.store.environment, nullptr, true);
+	graph.add (transaction, 1, block1);
+	graph.add (transaction, 1, block2);
+	graph.add (transaction, block1->hash (), block3);
+	graph.add (transaction, 1, block1);
+	ASSERT_EQ (3, graph.size ());
+	ASSERT_EQ (2, graph.depth ());
+	auto released (graph.release (transaction, 1));
+	ASSERT_EQ (2, released.size ());
+	ASSERT_EQ (*block1, *released [0]);
+	ASSERT_EQ (*block2, *released [1]);
+	ASSERT_EQ (1, graph.size ());
+	// block3 is now waiting on a block that isn't in the graph
+	ASSERT_EQ (1, graph.depth ());
+	ASSERT_TRUE (graph.release (transaction, 1).empty ());
+}
+
+TEST (dependency_graph, depth)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::dependency_graph graph (node1.store);
+	auto block1 (std::make_shared <rai::send_block> (1, 1, 2, rai::keypair ().prv, 4, 5));
+	auto block2 (std::make_shared <rai::send_block> (block1->hash (), 1, 2, rai::keypair ().prv, 4, 5));
+	auto block3 (std::make_shared <rai::send_block> (block2->hash (), 1, 2, rai::keypair ().prv, 4, 5));
+	rai::transaction transaction (node1.store.environment, nullptr, true);
+	ASSERT_EQ (0, graph.depth ());
+	// Children arrive before the blocks they wait on, the chain grows from its root
+	graph.add (transaction, block2->hash (), block3);
+	ASSERT_EQ (1, graph.depth ());
+	graph.add (transaction, block1->hash (), block2);
+	ASSERT_EQ (2, graph.depth ());
+	graph.add (transaction, 1, block1);
+	ASSERT_EQ (3, graph.depth ());
+	ASSERT_EQ (1, graph.release (transaction, 1).size ());
+	ASSERT_EQ (2, graph.depth ());
+	ASSERT_EQ (1, graph.release (transaction, block1->hash ()).size ());
+	ASSERT_EQ (1, graph.depth ());
+	ASSERT_EQ (1, graph.release (transaction, block2->hash ()).size ());
+	ASSERT_EQ (0, graph.depth ());
+}
+
+TEST (dependency_graph, spill)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	auto block1 (std::make_shared <rai::send_block> (1, 1, 2, rai::keypair ().prv, 4, 5));
+	auto block2 (std::make_shared <rai::send_block> (1, 1, 3, rai::keypair ().prv, 4, 5));
+	// Room for one entry
+	rai::dependency_graph graph (node1.store, rai::dependency_graph::entry_size (*block1));
+	rai::transaction transaction (node1.store.environment, nullptr, true);
+	graph.add (transaction, 1, block1);
+	graph.add (transaction, 1, block2);
+	ASSERT_EQ (1, graph.size ());
+	ASSERT_EQ (1, graph.spilled_count ());
+	ASSERT_EQ (1, node1.store.unchecked_get (transaction, 1).size ());
+	auto released (graph.release (transaction, 1));
+	ASSERT_EQ (2, released.size ());
+	ASSERT_EQ (*block1, *released [0]);
+	ASSERT_EQ (*block2, *released [1]);
+	ASSERT_EQ (0, graph.spilled_count ());
+	ASSERT_TRUE (node1.store.unchecked_get (transaction, 1).empty ());
+}
+
+TEST (dependency_graph, flush_load)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	auto block1 (std::make_shared <rai::send_block> (1, 1, 2, rai::keypair ().prv, 4, 5));
+	rai::transaction transaction (node1.store.environment, nullptr, true);
+	{
+		rai::dependency_graph graph (node1.store);
+		graph.add (transaction, 1, block1);
+		graph.flush (transaction);
+		ASSERT_EQ (0, graph.size ());
+	}
+	rai::dependency_graph graph (node1.store);
+	graph.load (transaction);
+	ASSERT_EQ (1, graph.spilled_count ());
+	auto released (graph.release (transaction, 1));
+	ASSERT_EQ (1, released.size ());
+	ASSERT_EQ (*block1, *released [0]);
+}
@@ -844,6 +844,185 @@ TEST (votes, add_old)
 	ASSERT_EQ (*send1, *winner.second);
 }
 
+TEST (vote_processor, queue)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	ASSERT_EQ (rai::process_result::progress, node1.process (*send1).code);
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		node1.active.start (transaction, send1);
+	}
+	auto votes1 (node1.active.roots.find (send1->root ())->election);
+	rai::keypair key2;
+	rai::vote vote1 (key2.pub, key2.prv, 2, send1);
+	rai::vote vote2 (key2.pub, key2.prv, 1, send1);
+	rai::vote vote3 (key1.pub, key2.prv, 1, send1);
+	node1.vote_processor.add (vote1, rai::endpoint ());
+	node1.vote_processor.flush ();
+	ASSERT_NE (votes1->votes.rep_votes.end (), votes1->votes.rep_votes.find (key2.pub));
+	node1.vote_processor.add (vote2, rai::endpoint ());
+	node1.vote_processor.add (vote3, rai::endpoint ());
+	node1.vote_processor.flush ();
+	ASSERT_EQ (1, node1.vote_processor.stale);
+	ASSERT_EQ (votes1->votes.rep_votes.end (), votes1->votes.rep_votes.find (key1.pub));
+	rai::transaction transaction (node1.store.environment, nullptr, false);
+	std::lock_guard <std::mutex> lock (node1.store.sequence_mutex);
+	ASSERT_EQ (2, node1.store.sequence_current (transaction, key2.pub));
+}
+
+TEST (vote_processor, by_hash)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	ASSERT_EQ (rai::process_result::progress, node1.process (*send1).code);
+	auto send2 (std::make_shared <rai::send_block> (send1->hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	ASSERT_EQ (rai::process_result::progress, node1.process (*send2).code);
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		node1.active.start (transaction, send1);
+		node1.active.start (transaction, send2);
+	}
+	auto votes1 (node1.active.roots.find (send1->root ())->election);
+	auto votes2 (node1.active.roots.find (send2->root ())->election);
+	rai::keypair key2;
+	std::vector <rai::block_hash> hashes ({send1->hash (), send2->hash (), rai::block_hash (1)});
+	rai::vote vote1 (key2.pub, key2.prv, 1, hashes);
+	node1.vote_processor.add (vote1, rai::endpoint ());
+	node1.vote_processor.flush ();
+	auto existing1 (votes1->votes.rep_votes.find (key2.pub));
+	ASSERT_NE (votes1->votes.rep_votes.end (), existing1);
+	ASSERT_EQ (*send1, *existing1->second);
+	auto existing2 (votes2->votes.rep_votes.find (key2.pub));
+	ASSERT_NE (votes2->votes.rep_votes.end (), existing2);
+	ASSERT_EQ (*send2, *existing2->second);
+	ASSERT_EQ (1, node1.vote_processor.unknown_hashes);
+}
+
+TEST (vote_processor, by_hash_fork_gap)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	ASSERT_EQ (rai::process_result::progress, node1.process (*send1).code);
+	auto fork1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, 1, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	auto gap1 (std::make_shared <rai::send_block> (rai::block_hash (1), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		node1.active.start (transaction, send1);
+		ASSERT_EQ (rai::process_result::fork, node1.block_processor.process_receive_one (transaction, fork1).code);
+		ASSERT_EQ (rai::process_result::gap_previous, node1.block_processor.process_receive_one (transaction, gap1).code);
+	}
+	ASSERT_NE (nullptr, node1.active.find (fork1->hash ()));
+	ASSERT_NE (nullptr, node1.gap_cache.find (gap1->hash ()));
+	auto votes1 (node1.active.roots.find (send1->root ())->election);
+	rai::keypair key2;
+	rai::endpoint endpoint (boost::asio::ip::address_v6::loopback (), 24001);
+	std::vector <rai::block_hash> hashes ({fork1->hash (), gap1->hash (), rai::block_hash (2)});
+	rai::vote vote1 (key2.pub, key2.prv, 1, hashes);
+	node1.vote_processor.add (vote1, endpoint);
+	node1.vote_processor.flush ();
+	auto existing1 (votes1->votes.rep_votes.find (key2.pub));
+	ASSERT_NE (votes1->votes.rep_votes.end (), existing1);
+	ASSERT_EQ (*fork1, *existing1->second);
+	{
+		std::lock_guard <std::mutex> lock (node1.gap_cache.mutex);
+		auto existing2 (node1.gap_cache.blocks.get <1> ().find (gap1->hash ()));
+		ASSERT_NE (node1.gap_cache.blocks.get <1> ().end (), existing2);
+		ASSERT_NE (existing2->votes->rep_votes.end (), existing2->votes->rep_votes.find (key2.pub));
+	}
+	// Only the hash nothing holds is requested from the voter
+	ASSERT_EQ (1, node1.vote_processor.unknown_hashes);
+	ASSERT_EQ (1, node1.pull_cache.requested);
+}
+
+TEST (ledger, confirmation_height)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::ledger ledger (store);
+	rai::genesis genesis;
+	rai::transaction transaction (store.environment, nullptr, true);
+	genesis.initialize (transaction, store);
+	rai::keypair key1;
+	rai::send_block send1 (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send1).code);
+	rai::send_block send2 (send1.hash (), key1.pub, rai::genesis_amount - 200, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send2).code);
+	rai::open_block open1 (send1.hash (), key1.pub, key1.pub, key1.prv, key1.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open1).code);
+	ASSERT_EQ (0, store.confirmation_height_get (transaction, key1.pub));
+	ASSERT_FALSE (ledger.confirmed (transaction, genesis.hash ()));
+	// Confirming the open confirms the send it received from and everything before that
+	ASSERT_EQ (3, ledger.confirm (transaction, open1.hash ()));
+	ASSERT_EQ (1, store.confirmation_height_get (transaction, key1.pub));
+	ASSERT_EQ (2, store.confirmation_height_get (transaction, rai::test_genesis_key.pub));
+	ASSERT_TRUE (ledger.confirmed (transaction, send1.hash ()));
+	ASSERT_FALSE (ledger.confirmed (transaction, send2.hash ()));
+	ASSERT_EQ (0, ledger.confirm (transaction, send1.hash ()));
+	ASSERT_EQ (1, ledger.confirm (transaction, send2.hash ()));
+	ASSERT_EQ (3, store.confirmation_height_get (transaction, rai::test_genesis_key.pub));
+	rai::account account;
+	uint64_t height (0);
+	ASSERT_FALSE (store.block_height_get (transaction, open1.hash (), account, height));
+	ASSERT_EQ (key1.pub, account);
+	ASSERT_EQ (1, height);
+	ASSERT_EQ (3, ledger.height (transaction, send2.hash (), account));
+	ASSERT_EQ (rai::test_genesis_key.pub, account);
+	// Rolling back confirmed blocks lowers the confirmation height to what's left of the chain
+	ledger.rollback (transaction, send1.hash ());
+	ASSERT_EQ (1, store.confirmation_height_get (transaction, rai::test_genesis_key.pub));
+	ASSERT_EQ (0, store.confirmation_height_get (transaction, key1.pub));
+	ASSERT_TRUE (store.block_height_get (transaction, send2.hash (), account, height));
+	ASSERT_TRUE (store.block_height_get (transaction, open1.hash (), account, height));
+}
+
+TEST (ledger, confirmation_height_bounded)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::ledger ledger (store);
+	rai::genesis genesis;
+	rai::transaction transaction (store.environment, nullptr, true);
+	genesis.initialize (transaction, store);
+	rai::keypair key1;
+	rai::send_block send1 (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send1).code);
+	rai::send_block send2 (send1.hash (), key1.pub, rai::genesis_amount - 200, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send2).code);
+	rai::send_block send3 (send2.hash (), key1.pub, rai::genesis_amount - 300, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send3).code);
+	rai::open_block open1 (send3.hash (), key1.pub, key1.pub, key1.prv, key1.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open1).code);
+	std::vector <rai::block_hash> remaining (1, open1.hash ());
+	// Two blocks per call, the open and the head of the genesis chain fit and the rest is left for later
+	ASSERT_EQ (1, ledger.confirm (transaction, remaining, 2));
+	ASSERT_EQ (1, store.confirmation_height_get (transaction, key1.pub));
+	ASSERT_EQ (0, store.confirmation_height_get (transaction, rai::test_genesis_key.pub));
+	ASSERT_FALSE (remaining.empty ());
+	uint64_t confirmed (1);
+	auto calls (0);
+	while (!remaining.empty ())
+	{
+		confirmed += ledger.confirm (transaction, remaining, 2);
+		++calls;
+		ASSERT_LT (calls, 10);
+	}
+	ASSERT_EQ (5, confirmed);
+	ASSERT_EQ (4, store.confirmation_height_get (transaction, rai::test_genesis_key.pub));
+	ASSERT_TRUE (ledger.confirmed (transaction, send3.hash ()));
+}
+
 // Query for block successor
 TEST (ledger, successor)
 {
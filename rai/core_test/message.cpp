@@ -54,8 +54,8 @@ TEST (message, publish_serialization)
     ASSERT_EQ (8, bytes.size ());
     ASSERT_EQ (0x52, bytes [0]);
     ASSERT_EQ (0x41, bytes [1]);
-    ASSERT_EQ (0x03, bytes [2]);
-    ASSERT_EQ (0x03, bytes [3]);
+    ASSERT_EQ (0x06, bytes [2]);
+    ASSERT_EQ (0x06, bytes [3]);
     ASSERT_EQ (0x01, bytes [4]);
     ASSERT_EQ (static_cast <uint8_t> (rai::message_type::publish), bytes [5]);
     ASSERT_EQ (0x02, bytes [6]);
@@ -68,8 +68,8 @@ TEST (message, publish_serialization)
     std::bitset <16> extensions;
     ASSERT_FALSE (rai::message::read_header (stream, version_max, version_using, version_min, type, extensions));
     ASSERT_EQ (0x01, version_min);
-    ASSERT_EQ (0x03, version_using);
-    ASSERT_EQ (0x03, version_max);
+    ASSERT_EQ (0x06, version_using);
+    ASSERT_EQ (0x06, version_max);
     ASSERT_EQ (rai::message_type::publish, type);
 }
 
@@ -89,3 +89,88 @@ TEST (message, confirm_ack_serialization)
 	ASSERT_FALSE (error);
     ASSERT_EQ (con1, con2);
 }
+
+TEST (message, confirm_ack_hash_serialization)
+{
+	rai::keypair key1;
+	std::vector <rai::block_hash> hashes;
+	for (size_t i (0); i < rai::vote::hashes_max; ++i)
+	{
+		hashes.push_back (rai::block_hash (i + 1));
+	}
+	rai::vote vote (key1.pub, key1.prv, 0, hashes);
+	rai::confirm_ack con1 (vote);
+	ASSERT_EQ (rai::block_type::not_a_block, con1.block_type ());
+	ASSERT_EQ (rai::vote::hashes_max, con1.hash_count ());
+	std::vector <uint8_t> bytes;
+	{
+		rai::vectorstream stream1 (bytes);
+		con1.serialize (stream1);
+	}
+	rai::bufferstream stream2 (bytes.data (), bytes.size ());
+	bool error;
+	rai::confirm_ack con2 (error, stream2);
+	ASSERT_FALSE (error);
+	ASSERT_EQ (con1, con2);
+	ASSERT_EQ (nullptr, con2.vote.block);
+	ASSERT_EQ (hashes, con2.vote.hashes);
+	ASSERT_FALSE (rai::validate_message (key1.pub, con2.vote.hash (), con2.vote.signature));
+}
+
+TEST (message, announce_serialization)
+{
+	std::vector <rai::block_hash> hashes;
+	for (size_t i (0); i < rai::announce::hashes_max; ++i)
+	{
+		hashes.push_back (rai::block_hash (i + 1));
+	}
+	rai::announce announce1 (hashes);
+	ASSERT_EQ (rai::announce::hashes_max, announce1.hash_count ());
+	std::vector <uint8_t> bytes;
+	{
+		rai::vectorstream stream1 (bytes);
+		announce1.serialize (stream1);
+	}
+	ASSERT_EQ (8 + hashes.size () * sizeof (rai::block_hash), bytes.size ());
+	ASSERT_EQ (static_cast <uint8_t> (rai::message_type::announce), bytes [5]);
+	rai::bufferstream stream2 (bytes.data (), bytes.size ());
+	rai::announce announce2;
+	ASSERT_FALSE (announce2.deserialize (stream2));
+	ASSERT_EQ (announce1, announce2);
+	ASSERT_EQ (hashes, announce2.hashes);
+}
+
+TEST (message, publish_req_serialization)
+{
+	std::vector <rai::block_hash> hashes (1, rai::block_hash (1));
+	rai::publish_req req1 (hashes);
+	ASSERT_EQ (1, req1.hash_count ());
+	std::vector <uint8_t> bytes;
+	{
+		rai::vectorstream stream1 (bytes);
+		req1.serialize (stream1);
+	}
+	ASSERT_EQ (8 + sizeof (rai::block_hash), bytes.size ());
+	ASSERT_EQ (static_cast <uint8_t> (rai::message_type::publish_req), bytes [5]);
+	rai::bufferstream stream2 (bytes.data (), bytes.size ());
+	rai::publish_req req2;
+	ASSERT_FALSE (req2.deserialize (stream2));
+	ASSERT_EQ (req1, req2);
+}
+
+TEST (message, realtime_req_serialization)
+{
+	rai::realtime_req req1 (24001);
+	std::vector <uint8_t> bytes;
+	{
+		rai::vectorstream stream1 (bytes);
+		req1.serialize (stream1);
+	}
+	ASSERT_EQ (8 + sizeof (uint16_t), bytes.size ());
+	ASSERT_EQ (static_cast <uint8_t> (rai::message_type::realtime_req), bytes [5]);
+	rai::bufferstream stream2 (bytes.data (), bytes.size ());
+	rai::realtime_req req2;
+	ASSERT_FALSE (req2.deserialize (stream2));
+	ASSERT_EQ (req1, req2);
+	ASSERT_EQ (24001, req2.port);
+}
@@ -12,16 +12,20 @@ public:
     confirm_ack_count (0),
     bulk_pull_count (0),
     bulk_push_count (0),
-    frontier_req_count (0)
+    frontier_req_count (0),
+    announce_count (0),
+    publish_req_count (0),
+    realtime_req_count (0)
     {
     }
     void keepalive (rai::keepalive const &)
     {
         ++keepalive_count;
     }
-    void publish (rai::publish const &)
+    void publish (rai::publish const & message_a)
     {
         ++publish_count;
+        block = message_a.block;
     }
     void confirm_req (rai::confirm_req const &)
     {
@@ -43,6 +47,20 @@ public:
     {
         ++frontier_req_count;
     }
+    void announce (rai::announce const & message_a)
+    {
+        ++announce_count;
+        hashes = message_a.hashes;
+    }
+    void publish_req (rai::publish_req const & message_a)
+    {
+        ++publish_req_count;
+        hashes = message_a.hashes;
+    }
+    void realtime_req (rai::realtime_req const &)
+    {
+        ++realtime_req_count;
+    }
     uint64_t keepalive_count;
     uint64_t publish_count;
     uint64_t confirm_req_count;
@@ -50,6 +68,11 @@ public:
     uint64_t bulk_pull_count;
     uint64_t bulk_push_count;
     uint64_t frontier_req_count;
+    uint64_t announce_count;
+    uint64_t publish_req_count;
+    uint64_t realtime_req_count;
+    std::shared_ptr <rai::block> block;
+    std::vector <rai::block_hash> hashes;
 };
 }
 
@@ -77,6 +100,75 @@ TEST (message_parser, exact_confirm_ack_size)
     ASSERT_TRUE (parser.error);
 }
 
+TEST (message_parser, exact_confirm_ack_hash_size)
+{
+    rai::system system (24000, 1);
+    test_visitor visitor;
+    rai::message_parser parser (visitor, system.work);
+	rai::vote vote (0, rai::keypair ().prv, 0, std::vector <rai::block_hash> (2, rai::block_hash (1)));
+    rai::confirm_ack message (vote);
+    std::vector <uint8_t> bytes;
+    {
+        rai::vectorstream stream (bytes);
+        message.serialize (stream);
+    }
+    parser.deserialize_confirm_ack (bytes.data (), bytes.size ());
+    ASSERT_EQ (1, visitor.confirm_ack_count);
+    ASSERT_FALSE (parser.error);
+    bytes.pop_back ();
+    parser.deserialize_confirm_ack (bytes.data (), bytes.size ());
+    ASSERT_EQ (1, visitor.confirm_ack_count);
+    ASSERT_TRUE (parser.error);
+}
+
+TEST (message_parser, exact_announce_size)
+{
+    rai::system system (24000, 1);
+    test_visitor visitor;
+    rai::message_parser parser (visitor, system.work);
+    std::vector <rai::block_hash> hashes ({ rai::block_hash (1), rai::block_hash (2) });
+    rai::announce message (hashes);
+    std::vector <uint8_t> bytes;
+    {
+        rai::vectorstream stream (bytes);
+        message.serialize (stream);
+    }
+    parser.deserialize_buffer (bytes.data (), bytes.size ());
+    ASSERT_EQ (1, visitor.announce_count);
+    ASSERT_FALSE (parser.error);
+    ASSERT_EQ (hashes, visitor.hashes);
+    bytes.pop_back ();
+    parser.deserialize_buffer (bytes.data (), bytes.size ());
+    ASSERT_EQ (1, visitor.announce_count);
+    ASSERT_TRUE (parser.error);
+}
+
+TEST (message_parser, exact_publish_req_size)
+{
+    rai::system system (24000, 1);
+    test_visitor visitor;
+    rai::message_parser parser (visitor, system.work);
+    rai::publish_req message (std::vector <rai::block_hash> (1, rai::block_hash (1)));
+    std::vector <uint8_t> bytes;
+    {
+        rai::vectorstream stream (bytes);
+        message.serialize (stream);
+    }
+    parser.deserialize_publish_req (bytes.data (), bytes.size ());
+    ASSERT_EQ (1, visitor.publish_req_count);
+    ASSERT_FALSE (parser.error);
+    bytes.push_back (0);
+    parser.deserialize_publish_req (bytes.data (), bytes.size ());
+    ASSERT_EQ (1, visitor.publish_req_count);
+    ASSERT_TRUE (parser.error);
+    // A header claiming no hashes is rejected even though the payload is empty
+    bytes.resize (rai::message_header::size);
+    bytes [7] &= 0x0f;
+    parser.deserialize_publish_req (bytes.data (), bytes.size ());
+    ASSERT_EQ (1, visitor.publish_req_count);
+    ASSERT_TRUE (parser.error);
+}
+
 TEST (message_parser, exact_confirm_req_size)
 {
     rai::system system (24000, 1);
@@ -144,3 +236,128 @@ TEST (message_parser, exact_keepalive_size)
     ASSERT_EQ (1, visitor.keepalive_count);
     ASSERT_TRUE (parser.error);
 }
+
+TEST (message_parser, block_types)
+{
+    rai::system system (24000, 1);
+    test_visitor visitor;
+    rai::message_parser parser (visitor, system.work);
+    rai::keypair key1;
+    std::vector <std::shared_ptr <rai::block>> blocks;
+    blocks.push_back (std::make_shared <rai::send_block> (1, 2, 3, key1.prv, key1.pub, system.work.generate (1)));
+    blocks.push_back (std::make_shared <rai::receive_block> (1, 2, key1.prv, key1.pub, system.work.generate (1)));
+    blocks.push_back (std::make_shared <rai::open_block> (1, 2, key1.pub, key1.prv, key1.pub, system.work.generate (key1.pub)));
+    blocks.push_back (std::make_shared <rai::change_block> (1, 2, key1.prv, key1.pub, system.work.generate (1)));
+    for (auto & block: blocks)
+    {
+        rai::publish message (block);
+        std::vector <uint8_t> bytes;
+        {
+            rai::vectorstream stream (bytes);
+            message.serialize (stream);
+        }
+        ASSERT_EQ (rai::message_header::size + rai::message_parser::block_size (block->type ()), bytes.size ());
+        parser.deserialize_buffer (bytes.data (), bytes.size ());
+        ASSERT_FALSE (parser.error);
+        ASSERT_NE (nullptr, visitor.block);
+        ASSERT_EQ (*block, *visitor.block);
+        // Every truncation is caught by the length check before anything is read
+        for (size_t i (0); i < bytes.size (); ++i)
+        {
+            parser.deserialize_buffer (bytes.data (), i);
+            ASSERT_TRUE (parser.error);
+        }
+    }
+    ASSERT_EQ (blocks.size (), visitor.publish_count);
+}
+
+TEST (message_parser, bad_header)
+{
+    rai::system system (24000, 1);
+    test_visitor visitor;
+    rai::message_parser parser (visitor, system.work);
+    rai::keepalive message;
+    std::vector <uint8_t> bytes;
+    {
+        rai::vectorstream stream (bytes);
+        message.serialize (stream);
+    }
+    auto bad_magic (bytes);
+    bad_magic [0] ^= 1;
+    parser.deserialize_buffer (bad_magic.data (), bad_magic.size ());
+    ASSERT_TRUE (parser.error);
+    // A publish header in front of a keepalive sized payload
+    auto bad_type (bytes);
+    bad_type [5] = static_cast <uint8_t> (rai::message_type::publish);
+    parser.deserialize_buffer (bad_type.data (), bad_type.size ());
+    ASSERT_TRUE (parser.error);
+    parser.deserialize_publish (bytes.data (), bytes.size ());
+    ASSERT_TRUE (parser.error);
+    ASSERT_EQ (0, visitor.keepalive_count);
+    ASSERT_EQ (0, visitor.publish_count);
+    parser.deserialize_buffer (bytes.data (), bytes.size ());
+    ASSERT_FALSE (parser.error);
+    ASSERT_EQ (1, visitor.keepalive_count);
+}
+
+TEST (message_parser, pool_allocator)
+{
+    void * first;
+    {
+        auto block (std::allocate_shared <rai::send_block> (rai::pool_allocator <rai::send_block> (), 1, 2, 3, rai::signature (4), 5));
+        ASSERT_EQ (5, block->work);
+        first = block.get ();
+    }
+    // The allocation released by the first block is handed to the next one
+    auto block (std::allocate_shared <rai::send_block> (rai::pool_allocator <rai::send_block> (), 1, 2, 3, rai::signature (4), 5));
+    ASSERT_EQ (first, block.get ());
+}
+
+// Compare decoding publish messages through a bufferstream, as the parser used to, against reading from the buffer directly
+TEST (message_parser, benchmark)
+{
+    rai::keypair key1;
+    std::vector <std::vector <uint8_t>> messages;
+    for (auto i (0); i < 64; ++i)
+    {
+        rai::publish message (std::make_shared <rai::send_block> (i, key1.pub, i, key1.prv, key1.pub, 0));
+        messages.push_back (std::vector <uint8_t> ());
+        rai::vectorstream stream (messages.back ());
+        message.serialize (stream);
+    }
+    size_t const iterations (200000);
+    uint64_t checksum1 (0);
+    auto begin1 (std::chrono::steady_clock::now ());
+    for (size_t i (0); i < iterations; ++i)
+    {
+        auto & bytes (messages [i % messages.size ()]);
+        rai::bufferstream header_stream (bytes.data (), bytes.size ());
+        uint8_t version_max;
+        uint8_t version_using;
+        uint8_t version_min;
+        rai::message_type type;
+        std::bitset <16> extensions;
+        ASSERT_FALSE (rai::message::read_header (header_stream, version_max, version_using, version_min, type, extensions));
+        rai::publish incoming;
+        rai::bufferstream stream (bytes.data (), bytes.size ());
+        ASSERT_FALSE (incoming.deserialize (stream));
+        checksum1 += incoming.block->block_work ();
+    }
+    auto end1 (std::chrono::steady_clock::now ());
+    uint64_t checksum2 (0);
+    auto begin2 (std::chrono::steady_clock::now ());
+    for (size_t i (0); i < iterations; ++i)
+    {
+        auto & bytes (messages [i % messages.size ()]);
+        rai::buffer_reader reader (bytes.data (), bytes.size ());
+        rai::message_header header;
+        ASSERT_FALSE (header.deserialize (reader));
+        ASSERT_EQ (rai::message_parser::block_size (header.block_type ()), reader.remaining);
+        rai::publish incoming (rai::message_parser::read_block (reader, header.block_type ()));
+        header.apply (incoming);
+        checksum2 += incoming.block->block_work ();
+    }
+    auto end2 (std::chrono::steady_clock::now ());
+    ASSERT_EQ (checksum1, checksum2);
+    std::cerr << boost::str (boost::format ("bufferstream %1% ns/message, buffer_reader %2% ns/message\n") % (std::chrono::duration_cast <std::chrono::nanoseconds> (end1 - begin1).count () / iterations) % (std::chrono::duration_cast <std::chrono::nanoseconds> (end2 - begin2).count () / iterations));
+}
@@ -89,6 +89,335 @@ TEST (network, send_keepalive)
     node1->stop ();
 }
 
+#ifdef SO_REUSEPORT
+TEST (network, multiple_sockets)
+{
+    rai::system system (24000, 1);
+    rai::node_init init1;
+    rai::node_config config (24001, system.logging);
+    config.peering_sockets = 4;
+    auto node1 (std::make_shared <rai::node> (init1, system.service, rai::unique_path (), system.alarm, config, system.work));
+    ASSERT_EQ (3, node1->network.receivers.size ());
+    for (auto & i: node1->network.receivers)
+    {
+        ASSERT_EQ (24001, i->socket.local_endpoint ().port ());
+    }
+    node1->start ();
+    rai::keepalive message;
+    std::vector <uint8_t> bytes;
+    {
+        rai::vectorstream stream (bytes);
+        message.serialize (stream);
+    }
+    // The kernel picks a socket by source address and port so several senders spread across the receivers
+    std::vector <std::unique_ptr <boost::asio::ip::udp::socket>> senders;
+    for (auto i (0); i < 8; ++i)
+    {
+        senders.push_back (std::unique_ptr <boost::asio::ip::udp::socket> (new boost::asio::ip::udp::socket (system.service, rai::endpoint (boost::asio::ip::address_v6::loopback (), 0))));
+        senders.back ()->send_to (boost::asio::buffer (bytes.data (), bytes.size ()), node1->network.endpoint ());
+    }
+    auto iterations (0);
+    while (node1->network.incoming.keepalive < senders.size ())
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+    node1->stop ();
+}
+#endif
+
+TEST (network, batched_io)
+{
+    rai::system system (24000, 1);
+    rai::node_init init1;
+    rai::node_config config (24001, system.logging);
+    config.batched_io = true;
+    config.peering_sockets = 2;
+    auto node1 (std::make_shared <rai::node> (init1, system.service, rai::unique_path (), system.alarm, config, system.work));
+    ASSERT_EQ (rai::batched_io_supported (), node1->network.batching);
+    node1->start ();
+    node1->network.send_keepalive (system.nodes [0]->network.endpoint ());
+    auto iterations (0);
+    while (node1->network.incoming.keepalive == 0 || system.nodes [0]->network.incoming.keepalive == 0)
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+    ASSERT_GE (node1->network.datagrams_sent, 1);
+    ASSERT_GE (node1->network.datagrams_received, 1);
+    ASSERT_GE (node1->network.receive_syscalls, 1);
+    ASSERT_EQ (1, node1->peers.size ());
+    node1->stop ();
+}
+
+TEST (network, send_queue_eviction)
+{
+    rai::system system (24000, 1);
+    rai::node_init init1;
+    rai::node_config config (24001, system.logging);
+    // One peer may queue 512 bytes and its bucket only refills a byte per second
+    config.send_queue_memory = 512 * rai::send_queue::peer_share;
+    config.peer_bandwidth_limit = 1;
+    auto node1 (std::make_shared <rai::node> (init1, system.service, rai::unique_path (), system.alarm, config, system.work));
+    node1->start ();
+    ASSERT_LT (rai::send_queue::drop_priority (rai::message_type::keepalive), rai::send_queue::drop_priority (rai::message_type::publish));
+    ASSERT_LT (rai::send_queue::drop_priority (rai::message_type::confirm_req), rai::send_queue::drop_priority (rai::message_type::confirm_ack));
+    auto buffer ([] (size_t size_a, rai::message_type type_a)
+    {
+        auto result (std::make_shared <std::vector <uint8_t>> (size_a, 0));
+        (*result) [5] = static_cast <uint8_t> (type_a);
+        return result;
+    });
+    auto endpoint (system.nodes [0]->network.endpoint ());
+    auto & queue (node1->network.send_queue);
+    std::atomic <unsigned> no_buffer (0);
+    std::atomic <bool> drained (false);
+    // Empty the peer's token bucket with one full sized datagram
+    auto full (buffer (512, rai::message_type::publish));
+    ASSERT_FALSE (queue.add (rai::send_info ({full->data (), full->size (), endpoint, [full, &drained] (boost::system::error_code const &, size_t)
+    {
+        drained = true;
+    }})));
+    auto iterations (0);
+    while (!drained)
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+    auto add ([&queue, &no_buffer, &endpoint, &buffer] (rai::message_type type_a)
+    {
+        auto bytes (buffer (100, type_a));
+        return queue.add (rai::send_info ({bytes->data (), bytes->size (), endpoint, [bytes, &no_buffer] (boost::system::error_code const & ec, size_t)
+        {
+            if (ec == boost::asio::error::no_buffer_space)
+            {
+                ++no_buffer;
+            }
+        }}));
+    });
+    ASSERT_FALSE (add (rai::message_type::keepalive));
+    for (auto i (0); i < 4; ++i)
+    {
+        ASSERT_FALSE (add (rai::message_type::publish));
+    }
+    ASSERT_EQ (0, no_buffer);
+    // The queued keepalive makes room for another publish
+    ASSERT_FALSE (add (rai::message_type::publish));
+    ASSERT_EQ (1, no_buffer);
+    // Nothing queued matters less than a keepalive so it is dropped itself
+    ASSERT_TRUE (add (rai::message_type::keepalive));
+    ASSERT_EQ (2, no_buffer);
+    ASSERT_EQ (5, queue.size ());
+    boost::property_tree::ptree tree;
+    queue.serialize (tree);
+    ASSERT_EQ ("2", tree.get <std::string> ("dropped"));
+    ASSERT_EQ ("500", tree.get <std::string> ("bytes"));
+    node1->stop ();
+}
+
+TEST (network, send_queue_global_eviction)
+{
+    rai::system system (24000, 1);
+    rai::node_init init1;
+    rai::node_config config (24001, system.logging);
+    // Each peer may queue 512 bytes, all of them 8192, and the global bucket only refills a byte per second
+    config.send_queue_memory = 512 * rai::send_queue::peer_share;
+    config.bandwidth_limit = 1;
+    auto node1 (std::make_shared <rai::node> (init1, system.service, rai::unique_path (), system.alarm, config, system.work));
+    node1->start ();
+    auto & queue (node1->network.send_queue);
+    std::atomic <unsigned> no_buffer (0);
+    std::atomic <bool> drained (false);
+    auto full (std::make_shared <std::vector <uint8_t>> (512, 0));
+    (*full) [5] = static_cast <uint8_t> (rai::message_type::publish);
+    ASSERT_FALSE (queue.add (rai::send_info ({full->data (), full->size (), system.nodes [0]->network.endpoint (), [full, &drained] (boost::system::error_code const &, size_t)
+    {
+        drained = true;
+    }})));
+    auto iterations (0);
+    while (!drained)
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+    auto add ([&queue, &no_buffer] (uint16_t port_a, size_t size_a, rai::message_type type_a)
+    {
+        auto bytes (std::make_shared <std::vector <uint8_t>> (size_a, 0));
+        (*bytes) [5] = static_cast <uint8_t> (type_a);
+        return queue.add (rai::send_info ({bytes->data (), bytes->size (), rai::endpoint (boost::asio::ip::address_v6::loopback (), port_a), [bytes, &no_buffer] (boost::system::error_code const & ec, size_t)
+        {
+            if (ec == boost::asio::error::no_buffer_space)
+            {
+                ++no_buffer;
+            }
+        }}));
+    });
+    // One peer queues keepalives and fifteen others publishes, 8000 bytes in all
+    for (auto i (0); i < 5; ++i)
+    {
+        ASSERT_FALSE (add (25000, 100, rai::message_type::keepalive));
+    }
+    for (uint16_t i (1); i < rai::send_queue::peer_share; ++i)
+    {
+        for (auto j (0); j < 5; ++j)
+        {
+            ASSERT_FALSE (add (25000 + i, 100, rai::message_type::publish));
+        }
+    }
+    ASSERT_EQ (0, no_buffer);
+    // A new peer is well within its own share, another peer's keepalive makes room in the global cap
+    ASSERT_FALSE (add (26000, 200, rai::message_type::publish));
+    ASSERT_EQ (1, no_buffer);
+    // Nothing queued matters less than a keepalive so it is dropped itself
+    ASSERT_TRUE (add (26000, 100, rai::message_type::keepalive));
+    ASSERT_EQ (2, no_buffer);
+    boost::property_tree::ptree tree;
+    queue.serialize (tree);
+    ASSERT_EQ ("8100", tree.get <std::string> ("bytes"));
+    // The eviction index tracks exactly the queued sends, the next one to go is the oldest remaining keepalive
+    {
+        std::lock_guard <std::mutex> lock (queue.mutex);
+        ASSERT_EQ (5 * rai::send_queue::peer_share, queue.evictable.size ());
+        ASSERT_EQ (rai::send_queue::drop_priority (rai::message_type::keepalive), queue.evictable.begin ()->first.first);
+        ASSERT_EQ (25000, queue.evictable.begin ()->second.first.port ());
+    }
+    node1->stop ();
+}
+
+TEST (network, send_queue_rate_limit)
+{
+    rai::system system (24000, 1);
+    rai::node_init init1;
+    rai::node_config config (24001, system.logging);
+    // Only the initial burst of 512 bytes leaves, three keepalives fit in it
+    config.peer_bandwidth_limit = 1;
+    auto node1 (std::make_shared <rai::node> (init1, system.service, rai::unique_path (), system.alarm, config, system.work));
+    node1->start ();
+    auto endpoint (system.nodes [0]->network.endpoint ());
+    for (auto i (0); i < 4; ++i)
+    {
+        node1->network.send_keepalive (endpoint);
+    }
+    auto iterations (0);
+    while (system.nodes [0]->network.incoming.keepalive < 3)
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+    for (auto i (0); i < 10; ++i)
+    {
+        system.poll ();
+    }
+    ASSERT_EQ (3, system.nodes [0]->network.incoming.keepalive.load ());
+    ASSERT_GE (node1->network.send_queue.size (), 1);
+    node1->stop ();
+}
+
+TEST (network, traffic_scheduler)
+{
+    ASSERT_EQ (rai::traffic_class::vote, rai::traffic_class_of (rai::message_type::confirm_ack));
+    ASSERT_EQ (rai::traffic_class::vote, rai::traffic_class_of (rai::message_type::confirm_req));
+    ASSERT_EQ (rai::traffic_class::publish, rai::traffic_class_of (rai::message_type::publish));
+    ASSERT_EQ (rai::traffic_class::keepalive, rai::traffic_class_of (rai::message_type::keepalive));
+    ASSERT_EQ (rai::traffic_class::keepalive, rai::traffic_class_of (rai::message_type::invalid));
+    rai::traffic_scheduler scheduler ({ 2, 1, 1 });
+    std::array <bool, rai::traffic_classes> pending ({ true, true, true });
+    std::vector <rai::traffic_class> order;
+    rai::traffic_class class_l;
+    for (auto i (0); i < 8; ++i)
+    {
+        ASSERT_FALSE (scheduler.next (pending, class_l));
+        order.push_back (class_l);
+    }
+    std::vector <rai::traffic_class> expected ({ rai::traffic_class::vote, rai::traffic_class::vote, rai::traffic_class::publish, rai::traffic_class::keepalive, rai::traffic_class::vote, rai::traffic_class::vote, rai::traffic_class::publish, rai::traffic_class::keepalive });
+    ASSERT_EQ (expected, order);
+    // Classes without anything queued don't hold back the others
+    pending [0] = false;
+    ASSERT_FALSE (scheduler.next (pending, class_l));
+    ASSERT_EQ (rai::traffic_class::publish, class_l);
+    ASSERT_FALSE (scheduler.next (pending, class_l));
+    ASSERT_EQ (rai::traffic_class::keepalive, class_l);
+    pending.fill (false);
+    ASSERT_TRUE (scheduler.next (pending, class_l));
+}
+
+TEST (network, send_queue_classes)
+{
+    rai::system system (24000, 1);
+    rai::node_init init1;
+    rai::node_config config (24001, system.logging);
+    // One 100 byte datagram every 100 milliseconds once the initial burst is spent
+    config.peer_bandwidth_limit = 1000;
+    auto node1 (std::make_shared <rai::node> (init1, system.service, rai::unique_path (), system.alarm, config, system.work));
+    node1->start ();
+    auto endpoint (system.nodes [0]->network.endpoint ());
+    auto & queue (node1->network.send_queue);
+    std::mutex mutex;
+    std::vector <rai::message_type> order;
+    auto add ([&queue, &endpoint, &mutex, &order] (size_t size_a, rai::message_type type_a)
+    {
+        auto bytes (std::make_shared <std::vector <uint8_t>> (size_a, 0));
+        (*bytes) [5] = static_cast <uint8_t> (type_a);
+        return queue.add (rai::send_info ({bytes->data (), bytes->size (), endpoint, [bytes, type_a, &mutex, &order] (boost::system::error_code const & ec, size_t)
+        {
+            if (!ec)
+            {
+                std::lock_guard <std::mutex> lock (mutex);
+                order.push_back (type_a);
+            }
+        }}));
+    });
+    // The full sized vote empties the peer's bucket whether or not it leaves before the rest are queued
+    ASSERT_FALSE (add (512, rai::message_type::confirm_req));
+    // Queued lowest class first, sent highest class first
+    ASSERT_FALSE (add (100, rai::message_type::keepalive));
+    ASSERT_FALSE (add (100, rai::message_type::publish));
+    ASSERT_FALSE (add (100, rai::message_type::confirm_ack));
+    auto iterations (0);
+    while (order.size () < 4)
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 400);
+    }
+    std::vector <rai::message_type> expected ({ rai::message_type::confirm_req, rai::message_type::confirm_ack, rai::message_type::publish, rai::message_type::keepalive });
+    ASSERT_EQ (expected, order);
+    auto & votes (node1->network.outgoing.classes [static_cast <size_t> (rai::traffic_class::vote)]);
+    ASSERT_EQ (2, votes.queued);
+    {
+        std::lock_guard <std::mutex> lock (votes.mutex);
+        ASSERT_EQ (2, votes.latency.count);
+    }
+    node1->stop ();
+}
+
+TEST (network, receive_queue_classes)
+{
+    rai::system system (24000, 2);
+    auto & incoming (system.nodes [1]->network.incoming);
+    auto iterations (0);
+    while (system.nodes [1]->network.incoming.keepalive == 0)
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+    auto & keepalives (incoming.classes [static_cast <size_t> (rai::traffic_class::keepalive)]);
+    ASSERT_GE (keepalives.queued, 1);
+    ASSERT_EQ (0, keepalives.dropped);
+    {
+        std::lock_guard <std::mutex> lock (keepalives.mutex);
+        ASSERT_GE (keepalives.latency.count, 1);
+    }
+    ASSERT_EQ (0, incoming.classes [static_cast <size_t> (rai::traffic_class::vote)].queued);
+    ASSERT_EQ (0, system.nodes [1]->network.receive_queue.size ());
+}
+
 TEST (network, keepalive_ipv4)
 {
     rai::system system (24000, 1);
@@ -410,6 +739,23 @@ TEST (bulk_pull, genesis_to_end)
     ASSERT_EQ (request->request->end, request->request->end);
 }
 
+TEST (bulk_pull, by_block)
+{
+    rai::system system (24000, 1);
+    rai::genesis genesis;
+    auto connection (std::make_shared <rai::bootstrap_server> (nullptr, system.nodes [0]));
+    std::unique_ptr <rai::bulk_pull> req (new rai::bulk_pull {});
+    req->start = genesis.hash ();
+    req->end.clear ();
+    connection->requests.push (std::unique_ptr <rai::message> {});
+    auto request (std::make_shared <rai::bulk_pull_server> (connection, std::move (req)));
+    ASSERT_EQ (genesis.hash (), request->current);
+    auto block (request->get_next ());
+    ASSERT_NE (nullptr, block);
+    ASSERT_EQ (genesis.hash (), block->hash ());
+    ASSERT_EQ (nullptr, request->get_next ());
+}
+
 // If we can't find the end block, send everything
 TEST (bulk_pull, no_end)
 {
@@ -890,3 +1236,376 @@ TEST (node, port_mapping)
 		system.poll ();
 	}
 }
+
+TEST (simulated_network, publish)
+{
+	rai::simulated_link link;
+	link.latency = std::chrono::milliseconds (5);
+	link.jitter = std::chrono::milliseconds (0);
+	rai::system system (24000, 2, link);
+	ASSERT_EQ (1, system.nodes [0]->peers.size ());
+	ASSERT_EQ (1, system.nodes [1]->peers.size ());
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	rai::keypair key1;
+	auto block (system.wallet (0)->send_action (rai::test_genesis_key.pub, key1.pub, 100));
+	ASSERT_NE (nullptr, block);
+	auto iterations (0);
+	while (!system.nodes [1]->ledger.block_exists (block->hash ()))
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	auto transport (std::static_pointer_cast <rai::simulated_transport> (system.nodes [0]->network.transport));
+	ASSERT_NE (0, transport->datagrams_sent);
+	ASSERT_NE (0, transport->bytes_received);
+	ASSERT_EQ (0, transport->datagrams_lost);
+}
+
+TEST (simulated_network, loss)
+{
+	rai::simulated_link link;
+	link.latency = std::chrono::milliseconds (1);
+	rai::system system (24000, 1, link);
+	rai::simulated_link lossy (link);
+	lossy.loss = 1.0;
+	rai::simulated_network network (system.service, lossy);
+	auto transport1 (network.transport (24001));
+	auto transport2 (network.transport (24002));
+	transport2->start (system.nodes [0]->network);
+	std::array <uint8_t, 16> data;
+	data.fill (0);
+	auto sent (0);
+	std::vector <rai::send_info> sends (1, rai::send_info ({data.data (), data.size (), transport2->endpoint (), [&sent] (boost::system::error_code const & ec, size_t) { ASSERT_FALSE (ec); ++sent; }}));
+	transport1->send (sends);
+	ASSERT_EQ (1, sent);
+	ASSERT_EQ (1, transport1->datagrams_lost);
+	ASSERT_EQ (16, transport1->bytes_sent);
+	std::this_thread::sleep_for (std::chrono::milliseconds (10));
+	ASSERT_EQ (0, transport2->datagrams_received);
+	transport2->stop ();
+}
+
+TEST (simulated_network, bootstrap)
+{
+	rai::simulated_link link;
+	link.latency = std::chrono::milliseconds (2);
+	rai::system system (24000, 1, link);
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	ASSERT_NE (nullptr, system.wallet (0)->send_action (rai::test_genesis_key.pub, rai::test_genesis_key.pub, 100));
+	rai::node_init init1;
+	rai::node_config config1 (24001, system.logging);
+	config1.transport = system.simulation->transport (24001);
+	auto node1 (std::make_shared <rai::node> (init1, system.service, rai::unique_path (), system.alarm, config1, system.work));
+	ASSERT_NE (node1->latest (rai::test_genesis_key.pub), system.nodes [0]->latest (rai::test_genesis_key.pub));
+	node1->start ();
+	node1->bootstrap_initiator.bootstrap (system.nodes [0]->network.endpoint ());
+	auto iterations (0);
+	while (node1->latest (rai::test_genesis_key.pub) != system.nodes [0]->latest (rai::test_genesis_key.pub))
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	node1->stop ();
+}
+
+TEST (simulated_network, stream_refused)
+{
+	rai::simulated_link link;
+	link.latency = std::chrono::milliseconds (1);
+	boost::asio::io_service service;
+	boost::asio::io_service::work work (service);
+	rai::simulated_network network (service, link);
+	auto transport1 (network.transport (24001));
+	auto stream (transport1->connection ());
+	boost::system::error_code result;
+	auto done (false);
+	stream->async_connect (rai::tcp_endpoint (boost::asio::ip::address_v6::loopback (), 24002), [&result, &done] (boost::system::error_code const & ec)
+	{
+		result = ec;
+		done = true;
+	});
+	auto iterations (0);
+	while (!done)
+	{
+		service.poll ();
+		std::this_thread::sleep_for (std::chrono::milliseconds (1));
+		++iterations;
+		ASSERT_LT (iterations, 1000);
+	}
+	ASSERT_EQ (boost::system::error_code (boost::asio::error::connection_refused), result);
+}
+
+TEST (network, announce_pull)
+{
+	rai::system system (24000, 2);
+	auto & node1 (*system.nodes [0]);
+	auto & node2 (*system.nodes [1]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (genesis.hash ())));
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		ASSERT_EQ (rai::process_result::progress, node1.ledger.process (transaction, *send1).code);
+	}
+	node1.network.send_announce (std::vector <rai::endpoint> (1, node2.network.endpoint ()), std::vector <rai::block_hash> (1, send1->hash ()));
+	auto iterations (0);
+	while (!node2.ledger.block_exists (send1->hash ()))
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (1, node2.network.incoming.announce);
+	ASSERT_EQ (1, node2.network.outgoing.publish_req);
+	ASSERT_EQ (1, node1.network.incoming.publish_req);
+	ASSERT_EQ (1, node2.pull_cache.requested);
+	// Processing the block ends the pull and cancels its retry
+	node2.block_processor.flush ();
+	ASSERT_EQ (0, node2.pull_cache.size ());
+	// Announcing a block the peer already has doesn't pull it again
+	node1.network.send_announce (std::vector <rai::endpoint> (1, node2.network.endpoint ()), std::vector <rai::block_hash> (1, send1->hash ()));
+	iterations = 0;
+	while (node2.network.incoming.announce < 2)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (1, node2.network.outgoing.publish_req);
+}
+
+TEST (publish_req_limiter, take)
+{
+	rai::publish_req_limiter limiter;
+	rai::endpoint endpoint1 (boost::asio::ip::address_v6::loopback (), 24001);
+	rai::endpoint endpoint2 (boost::asio::ip::address_v6::loopback (), 24002);
+	auto now (std::chrono::steady_clock::now ());
+	ASSERT_EQ (limiter.burst, limiter.take (endpoint1, limiter.burst, now));
+	ASSERT_EQ (0, limiter.take (endpoint1, 1, now));
+	ASSERT_EQ (1, limiter.refused);
+	// Each peer has its own bucket
+	ASSERT_EQ (1, limiter.take (endpoint2, 1, now));
+	// The bucket refills over time but never holds more than one burst
+	ASSERT_EQ (limiter.burst, limiter.take (endpoint1, limiter.burst + 5, now + std::chrono::seconds (5)));
+	ASSERT_EQ (6, limiter.refused);
+	ASSERT_EQ (2, limiter.size ());
+	limiter.purge (now + std::chrono::seconds (1));
+	ASSERT_EQ (1, limiter.size ());
+	// Higher configured rates raise the burst with them
+	rai::publish_req_limiter limiter2 (100);
+	ASSERT_EQ (100, limiter2.burst);
+	ASSERT_EQ (100, limiter2.take (endpoint1, 200, now));
+	ASSERT_EQ (50, limiter2.take (endpoint1, 200, now + std::chrono::milliseconds (500)));
+}
+
+TEST (pull_cache, retry_same_source)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::endpoint endpoint1 (boost::asio::ip::address_v6::loopback (), 24001);
+	rai::endpoint endpoint2 (boost::asio::ip::address_v6::loopback (), 24002);
+	rai::block_hash hash1 (1);
+	rai::block_hash hash2 (2);
+	ASSERT_TRUE (node1.pull_cache.add (hash1, endpoint1));
+	// The only source is asked again once before the hash is given up on
+	node1.pull_cache.retry (hash1);
+	ASSERT_EQ (1, node1.pull_cache.retried);
+	ASSERT_EQ (1, node1.pull_cache.size ());
+	node1.pull_cache.retry (hash1);
+	ASSERT_EQ (1, node1.pull_cache.abandoned);
+	ASSERT_EQ (0, node1.pull_cache.size ());
+	// The next source is only tried after the first has had its attempts
+	ASSERT_TRUE (node1.pull_cache.add (hash2, endpoint1));
+	ASSERT_FALSE (node1.pull_cache.add (hash2, endpoint2));
+	node1.pull_cache.retry (hash2);
+	{
+		std::lock_guard <std::mutex> lock (node1.pull_cache.mutex);
+		ASSERT_EQ (endpoint1, node1.pull_cache.pulls.get <1> ().find (hash2)->sources.front ());
+	}
+	node1.pull_cache.retry (hash2);
+	{
+		std::lock_guard <std::mutex> lock (node1.pull_cache.mutex);
+		ASSERT_EQ (endpoint2, node1.pull_cache.pulls.get <1> ().find (hash2)->sources.front ());
+	}
+	ASSERT_EQ (3, node1.pull_cache.retried);
+}
+
+TEST (network, publish_req_unknown_peer)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::publish_req req (std::vector <rai::block_hash> (1, genesis.hash ()));
+	std::vector <uint8_t> bytes;
+	{
+		rai::vectorstream stream (bytes);
+		req.serialize (stream);
+	}
+	// A request from an address we've never talked to is counted but not answered
+	rai::endpoint unknown (boost::asio::ip::address_v6::loopback (), 24099);
+	node1.network.process_packet (bytes.data (), bytes.size (), unknown);
+	ASSERT_EQ (1, node1.network.incoming.publish_req);
+	ASSERT_EQ (1, node1.network.publish_req_limits.refused);
+	ASSERT_EQ (0, node1.network.outgoing.publish);
+}
+
+TEST (network, realtime_channel)
+{
+	rai::system system (24000, 2);
+	auto & node1 (*system.nodes [0]);
+	auto & node2 (*system.nodes [1]);
+	node1.config.realtime_channels = 1;
+	node2.channels.connect (node1.network.endpoint ());
+	auto iterations (0);
+	while (node1.channels.size () != 1 || node2.channels.size () != 1)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_NE (nullptr, node1.channels.find (node2.network.endpoint ()));
+	ASSERT_NE (nullptr, node2.channels.find (node1.network.endpoint ()));
+	// Connecting again while a channel is open does nothing
+	node2.channels.connect (node1.network.endpoint ());
+	ASSERT_EQ (1, node2.channels.opened);
+	auto keepalives (node2.network.incoming.keepalive.load ());
+	node1.network.send_keepalive (node2.network.endpoint ());
+	iterations = 0;
+	while (node2.network.incoming.keepalive == keepalives)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_LT (0, node1.channels.frames_sent);
+	ASSERT_LT (0, node2.channels.frames_received);
+	node2.channels.find (node1.network.endpoint ())->close ();
+	iterations = 0;
+	while (node1.channels.size () != 0 || node2.channels.size () != 0)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+}
+
+TEST (network, realtime_channel_inbound)
+{
+	rai::system system (24000, 3);
+	auto & node1 (*system.nodes [0]);
+	auto & node2 (*system.nodes [1]);
+	auto & node3 (*system.nodes [2]);
+	// Realtime channels are off so node 1 refuses the channel and node 2's end closes
+	node2.channels.connect (node1.network.endpoint ());
+	auto iterations (0);
+	while (node2.channels.closed != 1)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (0, node1.channels.opened);
+	node1.config.realtime_channels = 1;
+	node2.channels.connect (node1.network.endpoint ());
+	iterations = 0;
+	while (node1.channels.size () != 1)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	// Node 3 shares node 2's address and only one inbound channel is kept per address
+	node3.channels.connect (node1.network.endpoint ());
+	iterations = 0;
+	while (node3.channels.closed != 1)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (1, node1.channels.size ());
+	ASSERT_EQ (1, node1.channels.opened);
+}
+
+TEST (network, realtime_channel_timeout)
+{
+	rai::system system (24000, 2);
+	auto & node1 (*system.nodes [0]);
+	auto & node2 (*system.nodes [1]);
+	node1.config.realtime_channels = 1;
+	node2.channels.connect (node1.network.endpoint ());
+	auto iterations (0);
+	while (node1.channels.size () != 1 || node2.channels.size () != 1)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	auto channel (node1.channels.find (node2.network.endpoint ()));
+	ASSERT_NE (nullptr, channel);
+	{
+		// Stand in for a peer that stopped reading or sending
+		std::lock_guard <std::mutex> lock (channel->mutex);
+		channel->start_timeout (channel->idle_timeout, std::chrono::seconds (1));
+	}
+	iterations = 0;
+	while (node1.channels.size () != 0 || node2.channels.size () != 0)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_TRUE (channel->closed);
+	ASSERT_EQ (nullptr, node1.channels.find (node2.network.endpoint ()));
+	// Sends go back to UDP
+	auto frames (node1.channels.frames_sent.load ());
+	auto keepalives (node2.network.incoming.keepalive.load ());
+	node1.network.send_keepalive (node2.network.endpoint ());
+	iterations = 0;
+	while (node2.network.incoming.keepalive == keepalives)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (frames, node1.channels.frames_sent);
+}
+
+TEST (peer_traffic_table, counts)
+{
+	rai::peer_traffic_table table (2);
+	rai::endpoint endpoint1 (boost::asio::ip::address_v6::loopback (), 24001);
+	rai::endpoint endpoint2 (boost::asio::ip::address_v6::loopback (), 24002);
+	rai::endpoint endpoint3 (boost::asio::ip::address_v6::loopback (), 24003);
+	rai::keepalive message;
+	std::vector <uint8_t> bytes;
+	{
+		rai::vectorstream stream (bytes);
+		message.serialize (stream);
+	}
+	table.received (endpoint1, bytes.data (), bytes.size ());
+	table.received (endpoint1, bytes.data (), bytes.size ());
+	table.sent (endpoint2, bytes.data (), bytes.size ());
+	table.dropped (endpoint2, rai::peer_drop::send_queue_full);
+	// Unparseable types are counted as invalid
+	std::vector <uint8_t> garbage (3, 0xff);
+	table.received (endpoint1, garbage.data (), garbage.size ());
+	ASSERT_EQ (2, table.size ());
+	// The table is full so a new endpoint lands in the overflow entry
+	table.received (endpoint3, bytes.data (), bytes.size ());
+	ASSERT_EQ (2, table.size ());
+	auto list (table.list ());
+	ASSERT_EQ (3, list.size ());
+	std::unordered_map <rai::endpoint, rai::peer_traffic> traffic (list.begin (), list.end ());
+	auto keepalive (static_cast <size_t> (rai::message_type::keepalive));
+	ASSERT_EQ (2, traffic [endpoint1].messages_in [keepalive]);
+	ASSERT_EQ (2 * bytes.size (), traffic [endpoint1].bytes_in [keepalive]);
+	ASSERT_EQ (1, traffic [endpoint1].messages_in [static_cast <size_t> (rai::message_type::invalid)]);
+	ASSERT_EQ (1, traffic [endpoint2].messages_out [keepalive]);
+	ASSERT_EQ (1, traffic [endpoint2].dropped [static_cast <size_t> (rai::peer_drop::send_queue_full)]);
+	ASSERT_EQ (1, traffic [rai::endpoint ()].messages_in [keepalive]);
+	table.purge (std::chrono::steady_clock::now () + std::chrono::seconds (1));
+	ASSERT_EQ (0, table.size ());
+}
@@ -491,6 +491,18 @@ TEST (node_config, serialization)
 	config1.callback_address = "test";
 	config1.callback_port = 10;
 	config1.callback_target = "test";
+	config1.signature_checker_threads = 10;
+	config1.online_weight_minimum = 10;
+	config1.peering_sockets = 10;
+	config1.batched_io = true;
+	config1.bandwidth_limit = 10;
+	config1.peer_bandwidth_limit = 10;
+	config1.send_queue_memory = 10;
+	config1.traffic_weights = { 10, 10, 10 };
+	config1.announce_blocks = false;
+	config1.realtime_channels = 10;
+	config1.receive_threads = 100;
+	config1.publish_req_rate = 100;
 	boost::property_tree::ptree tree;
 	config1.serialize_json (tree);
 	rai::logging logging2;
@@ -506,6 +518,18 @@ TEST (node_config, serialization)
 	ASSERT_NE (config2.callback_address, config1.callback_address);
 	ASSERT_NE (config2.callback_port, config1.callback_port);
 	ASSERT_NE (config2.callback_target, config1.callback_target);
+	ASSERT_NE (config2.signature_checker_threads, config1.signature_checker_threads);
+	ASSERT_NE (config2.online_weight_minimum, config1.online_weight_minimum);
+	ASSERT_NE (config2.peering_sockets, config1.peering_sockets);
+	ASSERT_NE (config2.batched_io, config1.batched_io);
+	ASSERT_NE (config2.bandwidth_limit, config1.bandwidth_limit);
+	ASSERT_NE (config2.peer_bandwidth_limit, config1.peer_bandwidth_limit);
+	ASSERT_NE (config2.send_queue_memory, config1.send_queue_memory);
+	ASSERT_NE (config2.traffic_weights, config1.traffic_weights);
+	ASSERT_NE (config2.announce_blocks, config1.announce_blocks);
+	ASSERT_NE (config2.realtime_channels, config1.realtime_channels);
+	ASSERT_NE (config2.receive_threads, config1.receive_threads);
+	ASSERT_NE (config2.publish_req_rate, config1.publish_req_rate);
 	
 	bool upgraded (false);
 	config2.deserialize_json (upgraded, tree);
@@ -519,6 +543,18 @@ TEST (node_config, serialization)
 	ASSERT_EQ (config2.callback_address, config1.callback_address);
 	ASSERT_EQ (config2.callback_port, config1.callback_port);
 	ASSERT_EQ (config2.callback_target, config1.callback_target);
+	ASSERT_EQ (config2.signature_checker_threads, config1.signature_checker_threads);
+	ASSERT_EQ (config2.online_weight_minimum, config1.online_weight_minimum);
+	ASSERT_EQ (config2.peering_sockets, config1.peering_sockets);
+	ASSERT_EQ (config2.batched_io, config1.batched_io);
+	ASSERT_EQ (config2.bandwidth_limit, config1.bandwidth_limit);
+	ASSERT_EQ (config2.peer_bandwidth_limit, config1.peer_bandwidth_limit);
+	ASSERT_EQ (config2.send_queue_memory, config1.send_queue_memory);
+	ASSERT_EQ (config2.traffic_weights, config1.traffic_weights);
+	ASSERT_EQ (config2.announce_blocks, config1.announce_blocks);
+	ASSERT_EQ (config2.realtime_channels, config1.realtime_channels);
+	ASSERT_EQ (config2.receive_threads, config1.receive_threads);
+	ASSERT_EQ (config2.publish_req_rate, config1.publish_req_rate);
 }
 
 TEST (node_config, v1_v2_upgrade)
@@ -630,6 +666,45 @@ TEST (node_config, v2_v3_upgrade)
 	ASSERT_GT (std::stoull (version), 2);
 }
 
+TEST (node_config, v7_upgrade)
+{
+	auto path (rai::unique_path ());
+	rai::node_config config1;
+	config1.logging.init (path);
+	boost::property_tree::ptree tree;
+	config1.serialize_json (tree);
+	// Strip everything added after version 7
+	tree.erase ("signature_checker_threads");
+	tree.erase ("online_weight_minimum");
+	tree.erase ("peering_sockets");
+	tree.erase ("batched_io");
+	tree.erase ("bandwidth_limit");
+	tree.erase ("peer_bandwidth_limit");
+	tree.erase ("send_queue_memory");
+	tree.erase ("traffic_weights");
+	tree.erase ("announce_blocks");
+	tree.erase ("realtime_channels");
+	tree.erase ("receive_threads");
+	tree.erase ("publish_req_rate");
+	tree.erase ("version");
+	tree.put ("version", "7");
+	bool upgraded (false);
+	rai::node_config config2;
+	config2.logging.init (path);
+	ASSERT_FALSE (config2.deserialize_json (upgraded, tree));
+	ASSERT_TRUE (upgraded);
+	ASSERT_EQ ("17", tree.get <std::string> ("version"));
+	ASSERT_EQ (config1.signature_checker_threads, config2.signature_checker_threads);
+	ASSERT_EQ (config1.online_weight_minimum, config2.online_weight_minimum);
+	ASSERT_EQ (config1.peering_sockets, config2.peering_sockets);
+	ASSERT_EQ (config1.send_queue_memory, config2.send_queue_memory);
+	ASSERT_EQ (config1.traffic_weights, config2.traffic_weights);
+	ASSERT_EQ (config1.announce_blocks, config2.announce_blocks);
+	ASSERT_EQ (config1.realtime_channels, config2.realtime_channels);
+	ASSERT_EQ (config1.receive_threads, config2.receive_threads);
+	ASSERT_EQ (config1.publish_req_rate, config2.publish_req_rate);
+}
+
 TEST (node, confirm_locked)
 {
 	rai::system system (24000, 1);
@@ -689,6 +764,57 @@ TEST (node, block_replace)
 	ASSERT_GT (system.work.work_value (block2->root (), block2->block_work ()), system.work.work_value (block1->root (), initial_work));
 }
 
+TEST (node, duplicate_fast_path)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (genesis.hash ())));
+	auto send2 (std::make_shared <rai::send_block> (*send1));
+	ASSERT_EQ (rai::process_result::progress, node1.process (*send1).code);
+	node1.block_processor.process_receive_many (send2);
+	ASSERT_EQ (0, node1.block_processor.duplicates_fast);
+	ASSERT_EQ (1, node1.block_processor.duplicates_slow);
+	auto iterations (0);
+	while (node1.block_processor.duplicates_fast == 0)
+	{
+		system.poll ();
+		node1.block_processor.process_receive_many (send2);
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (0, node1.block_processor.duplicates_replaced);
+}
+
+TEST (node, vote_cache)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	rai::genesis genesis;
+	rai::keypair key1;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	auto send2 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, 1, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	node1.network.republish_block (send1);
+	ASSERT_EQ (1, node1.vote_cache.signatures);
+	ASSERT_EQ (0, node1.vote_cache.hits);
+	node1.network.republish_block (send1);
+	ASSERT_EQ (1, node1.vote_cache.signatures);
+	ASSERT_EQ (1, node1.vote_cache.hits);
+	// A different winner on the same root is signed again
+	node1.network.republish_block (send2);
+	ASSERT_EQ (2, node1.vote_cache.signatures);
+	ASSERT_EQ (1, node1.vote_cache.votes.size ());
+	// Voting on another root raises our sequence and the cached vote would be a replay
+	auto open1 (std::make_shared <rai::open_block> (send2->hash (), 1, key1.pub, key1.prv, key1.pub, 0));
+	node1.network.republish_block (open1);
+	ASSERT_EQ (3, node1.vote_cache.signatures);
+	node1.network.republish_block (send2);
+	ASSERT_EQ (4, node1.vote_cache.signatures);
+	ASSERT_EQ (1, node1.vote_cache.hits);
+}
+
 TEST (node, fork_publish)
 {
     std::weak_ptr <rai::node> node0;
@@ -1052,6 +1178,10 @@ TEST (node, fork_no_vote_quorum)
 	{
 		system.poll ();
 	}
+	// Votes are tallied on the vote processor thread after the message is counted
+	node1.vote_processor.flush ();
+	node2.vote_processor.flush ();
+	node3.vote_processor.flush ();
 	ASSERT_TRUE (node1.latest (rai::test_genesis_key.pub) == send1.hash ());
 	ASSERT_TRUE (node2.latest (rai::test_genesis_key.pub) == send1.hash ());
 	ASSERT_TRUE (node3.latest (rai::test_genesis_key.pub) == send1.hash ());
@@ -1359,3 +1489,111 @@ TEST (node, send_callback)
     }
     ASSERT_EQ (std::numeric_limits <rai::uint128_t>::max () - system.nodes [0]->config.receive_minimum.number (), system.nodes [0]->balance (rai::test_genesis_key.pub));
 }
+
+TEST (block_processor, parallel_matches_serial)
+{
+	rai::keypair key1;
+	rai::keypair key2;
+	rai::work_pool work (std::numeric_limits <unsigned>::max (), nullptr);
+	rai::genesis genesis;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, work.generate (genesis.hash ())));
+	auto send2 (std::make_shared <rai::send_block> (send1->hash (), key2.pub, rai::genesis_amount - 200, rai::test_genesis_key.prv, rai::test_genesis_key.pub, work.generate (send1->hash ())));
+	auto open1 (std::make_shared <rai::open_block> (send1->hash (), key1.pub, key1.pub, key1.prv, key1.pub, work.generate (key1.pub)));
+	auto open2 (std::make_shared <rai::open_block> (send2->hash (), key2.pub, key2.pub, key2.prv, key2.pub, work.generate (key2.pub)));
+	auto send3 (std::make_shared <rai::send_block> (open1->hash (), key2.pub, 50, key1.prv, key1.pub, work.generate (open1->hash ())));
+	auto receive1 (std::make_shared <rai::receive_block> (open2->hash (), send3->hash (), key2.prv, key2.pub, work.generate (open2->hash ())));
+	auto change1 (std::make_shared <rai::change_block> (send2->hash (), key1.pub, key1.prv, key1.pub, work.generate (send2->hash ())));
+	auto change2 (std::make_shared <rai::change_block> (send2->hash (), key2.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, work.generate (send2->hash ())));
+	std::deque <std::pair <std::shared_ptr <rai::block>, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)>>> batch;
+	std::vector <rai::process_result> results [2];
+	for (auto block: std::vector <std::shared_ptr <rai::block>> ({open1, send1, send2, open2, send3, receive1, change1, change2}))
+	{
+		batch.push_back (std::make_pair (block, [] (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>) {}));
+	}
+	auto service (boost::make_shared <boost::asio::io_service> ());
+	rai::alarm alarm (*service);
+	std::vector <std::shared_ptr <rai::node>> nodes;
+	for (auto threads: {0, 4})
+	{
+		rai::node_init init;
+		auto path (rai::unique_path ());
+		rai::node_config config;
+		config.logging.init (path);
+		config.signature_checker_threads = threads;
+		auto node (std::make_shared <rai::node> (init, *service, path, alarm, config, work));
+		ASSERT_FALSE (init.error ());
+		ASSERT_EQ (threads, node->checker.threads.size ());
+		auto & results_l (results [nodes.size ()]);
+		for (auto & i: batch)
+		{
+			i.second = [&results_l] (MDB_txn *, rai::process_return result_a, std::shared_ptr <rai::block>)
+			{
+				results_l.push_back (result_a.code);
+			};
+		}
+		node->block_processor.process_batch (batch);
+		nodes.push_back (node);
+	}
+	ASSERT_EQ (results [0], results [1]);
+	ASSERT_EQ (rai::process_result::gap_source, results [1][0]);
+	// open1 is reported again when send1 releases it
+	ASSERT_EQ (10, results [1].size ());
+	ASSERT_EQ (rai::process_result::bad_signature, results [1][8]);
+	rai::transaction transaction0 (nodes [0]->store.environment, nullptr, false);
+	rai::transaction transaction1 (nodes [1]->store.environment, nullptr, false);
+	for (auto account: {rai::test_genesis_key.pub, key1.pub, key2.pub})
+	{
+		rai::account_info info0;
+		rai::account_info info1;
+		ASSERT_FALSE (nodes [0]->store.account_get (transaction0, account, info0));
+		ASSERT_FALSE (nodes [1]->store.account_get (transaction1, account, info1));
+		ASSERT_EQ (info0.head, info1.head);
+		ASSERT_EQ (info0.rep_block, info1.rep_block);
+		ASSERT_EQ (info0.balance, info1.balance);
+		ASSERT_EQ (info0.block_count, info1.block_count);
+		ASSERT_EQ (nodes [0]->ledger.weight (transaction0, account), nodes [1]->ledger.weight (transaction1, account));
+	}
+	ASSERT_EQ (receive1->hash (), nodes [1]->ledger.latest (transaction1, key2.pub));
+	ASSERT_EQ (change2->hash (), nodes [1]->ledger.latest (transaction1, rai::test_genesis_key.pub));
+	ASSERT_EQ (nodes [0]->store.block_count (transaction0).sum (), nodes [1]->store.block_count (transaction1).sum ());
+	for (auto & node: nodes)
+	{
+		node->stop ();
+	}
+}
+
+TEST (node, online_reps)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::keypair key1;
+	ASSERT_EQ (node1.config.online_weight_minimum.number (), node1.online_reps.online_stake ());
+	rai::transaction transaction (node1.store.environment, nullptr, false);
+	// Accounts without weight aren't counted
+	node1.online_reps.vote (transaction, key1.pub);
+	ASSERT_EQ (node1.config.online_weight_minimum.number (), node1.online_reps.online_stake ());
+	node1.online_reps.vote (transaction, rai::test_genesis_key.pub);
+	node1.online_reps.vote (transaction, rai::test_genesis_key.pub);
+	ASSERT_EQ (node1.ledger.weight (transaction, rai::test_genesis_key.pub), node1.online_reps.online_stake ());
+}
+
+TEST (observer_set, add_during_notification)
+{
+	rai::observer_set <int> observers;
+	std::atomic <int> total (0);
+	observers.add ([&observers, &total] (int value_a)
+	{
+		total += value_a;
+		// Observers added while notifying are seen by the next notification
+		observers.add ([&total] (int value_a)
+		{
+			total += value_a * 10;
+		});
+	});
+	observers (1);
+	ASSERT_EQ (1, total);
+	ASSERT_EQ (2, observers.size ());
+	observers (1);
+	ASSERT_EQ (12, total);
+	ASSERT_EQ (3, observers.size ());
+}
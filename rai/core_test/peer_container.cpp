@@ -139,3 +139,87 @@ TEST (peer_container, rep_weight)
 	ASSERT_EQ (100, reps [0].rep_weight.number ());
 	ASSERT_EQ (endpoint0, reps [0].endpoint);
 }
+
+TEST (peer_container, snapshot)
+{
+    rai::peer_container peers (rai::endpoint {});
+	rai::endpoint endpoint1 (boost::asio::ip::address_v6::loopback (), 24001);
+	auto snapshot1 (peers.snapshot ());
+	ASSERT_TRUE (snapshot1->peers.empty ());
+	peers.insert (endpoint1, 0);
+	// Readers holding an old snapshot keep seeing it unchanged
+	ASSERT_TRUE (snapshot1->peers.empty ());
+	ASSERT_EQ (nullptr, snapshot1->find (endpoint1));
+	auto snapshot2 (peers.snapshot ());
+	ASSERT_EQ (1, snapshot2->peers.size ());
+	ASSERT_NE (nullptr, snapshot2->find (endpoint1));
+	ASSERT_TRUE (snapshot2->by_weight.empty ());
+	peers.rep_response (endpoint1, rai::amount (100));
+	auto snapshot3 (peers.snapshot ());
+	ASSERT_EQ (1, snapshot3->by_weight.size ());
+	ASSERT_EQ (100, snapshot3->find (endpoint1)->rep_weight.number ());
+}
+
+TEST (peer_container, contact_batch)
+{
+    rai::peer_container peers (rai::endpoint {});
+	rai::endpoint endpoint1 (boost::asio::ip::address_v6::loopback (), 24001);
+	auto start (std::chrono::system_clock::now ());
+	peers.contacted (endpoint1, 0);
+	auto contact1 (peers.snapshot ()->find (endpoint1)->last_contact);
+	ASSERT_LE (start, contact1);
+	std::this_thread::sleep_for (std::chrono::milliseconds (10));
+	// A known peer with the same version is batched rather than changing the list
+	peers.contacted (endpoint1, 0);
+	{
+		std::lock_guard <std::mutex> lock (peers.contacts_mutex);
+		ASSERT_EQ (1, peers.contacts.size ());
+	}
+	ASSERT_EQ (contact1, peers.snapshot ()->find (endpoint1)->last_contact);
+	peers.flush_contacts ();
+	ASSERT_LT (contact1, peers.snapshot ()->find (endpoint1)->last_contact);
+	{
+		std::lock_guard <std::mutex> lock (peers.contacts_mutex);
+		ASSERT_TRUE (peers.contacts.empty ());
+	}
+	// A version change goes straight to the list
+	peers.contacted (endpoint1, 1);
+	ASSERT_EQ (1, peers.snapshot ()->find (endpoint1)->network_version);
+}
+
+TEST (peer_container, publish_batched)
+{
+    rai::peer_container peers (rai::endpoint {});
+	rai::endpoint endpoint1 (boost::asio::ip::address_v6::loopback (), 24001);
+	ASSERT_FALSE (peers.insert (endpoint1, 0));
+	auto snapshot1 (peers.snapshot ());
+	// Fields no snapshot reader uses don't publish
+	peers.rep_request (endpoint1);
+	peers.bootstrap_peer ();
+	ASSERT_EQ (snapshot1, peers.snapshot ());
+	// Another contact from a known peer waits for the next flush
+	ASSERT_TRUE (peers.insert (endpoint1, 0));
+	ASSERT_EQ (snapshot1, peers.snapshot ());
+	peers.flush_contacts ();
+	ASSERT_NE (snapshot1, peers.snapshot ());
+	// A version change is published at once
+	auto snapshot2 (peers.snapshot ());
+	ASSERT_TRUE (peers.insert (endpoint1, 1));
+	ASSERT_NE (snapshot2, peers.snapshot ());
+	ASSERT_EQ (1, peers.snapshot ()->find (endpoint1)->network_version);
+}
+
+TEST (peer_container, contact_batch_purge)
+{
+    rai::peer_container peers (rai::endpoint {});
+	rai::endpoint endpoint1 (boost::asio::ip::address_v6::loopback (), 24001);
+	peers.contacted (endpoint1, 0);
+	std::this_thread::sleep_for (std::chrono::milliseconds (10));
+	auto cutoff (std::chrono::system_clock::now ());
+	std::this_thread::sleep_for (std::chrono::milliseconds (10));
+	peers.contacted (endpoint1, 0);
+	// The pending contact is applied before purging so the peer survives
+	auto remaining (peers.purge_list (cutoff));
+	ASSERT_EQ (1, remaining.size ());
+	ASSERT_EQ (1, peers.size ());
+}
@@ -129,3 +129,81 @@ TEST (alarm, top_execution)
 	service.stop ();
 	thread.join ();
 }
+
+TEST (alarm, cancel)
+{
+	boost::asio::io_service service;
+	rai::alarm alarm (service);
+	std::atomic <int> value (0);
+	std::promise <bool> promise;
+	auto handle1 (alarm.add (std::chrono::system_clock::now () + std::chrono::milliseconds (20), [&] ()
+	{
+		value = 1;
+	}));
+	alarm.add (std::chrono::system_clock::now () + std::chrono::milliseconds (40), [&] ()
+	{
+		promise.set_value (false);
+	});
+	ASSERT_EQ (2, alarm.size ());
+	ASSERT_FALSE (alarm.cancel (handle1));
+	ASSERT_TRUE (alarm.cancel (handle1));
+	ASSERT_EQ (1, alarm.size ());
+	boost::asio::io_service::work work (service);
+	std::thread thread ([&service] ()
+	{
+		service.run ();
+	});
+	promise.get_future ().get ();
+	ASSERT_EQ (0, value);
+	ASSERT_EQ (0, alarm.size ());
+	service.stop ();
+	thread.join ();
+}
+
+// Operations past the first level of the wheel cascade down before running
+TEST (alarm, cascade)
+{
+	boost::asio::io_service service;
+	rai::alarm alarm (service);
+	std::promise <std::chrono::system_clock::time_point> promise;
+	auto wakeup (std::chrono::system_clock::now () + std::chrono::milliseconds (rai::alarm::slots * 2 + 10));
+	alarm.add (wakeup, [&] ()
+	{
+		promise.set_value (std::chrono::system_clock::now ());
+	});
+	boost::asio::io_service::work work (service);
+	std::thread thread ([&service] ()
+	{
+		service.run ();
+	});
+	auto ran (promise.get_future ().get ());
+	ASSERT_GE (ran, wakeup);
+	ASSERT_LT (ran, wakeup + std::chrono::seconds (1));
+	service.stop ();
+	thread.join ();
+}
+
+// An operation in an upper level that's due just after a level boundary runs on time, not a revolution later
+TEST (alarm, level_boundary)
+{
+	boost::asio::io_service service;
+	rai::alarm alarm (service);
+	std::promise <std::chrono::system_clock::time_point> promise;
+	auto now (std::chrono::system_clock::now ());
+	alarm.add (now + std::chrono::milliseconds (rai::alarm::slots - 1), [] () {});
+	auto wakeup (now + std::chrono::milliseconds (rai::alarm::slots + 44));
+	alarm.add (wakeup, [&] ()
+	{
+		promise.set_value (std::chrono::system_clock::now ());
+	});
+	boost::asio::io_service::work work (service);
+	std::thread thread ([&service] ()
+	{
+		service.run ();
+	});
+	auto ran (promise.get_future ().get ());
+	ASSERT_GE (ran, wakeup);
+	ASSERT_LT (ran, now + std::chrono::milliseconds (rai::alarm::slots * 2));
+	service.stop ();
+	thread.join ();
+}
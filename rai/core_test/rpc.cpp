@@ -2624,6 +2624,7 @@ TEST (rpc, account_info)
 	ASSERT_EQ (std::to_string (time), modified_timestamp);
 	std::string block_count (response.json.get <std::string> ("block_count"));
 	ASSERT_EQ ("2", block_count);
+	ASSERT_EQ ("0", response.json.get <std::string> ("confirmation_height"));
 }
 
 TEST (rpc, blocks_info)
@@ -2712,3 +2713,193 @@ TEST (rpc, work_peers_all)
 	peers_node = response3.json.get_child ("work_peers");
 	ASSERT_EQ (0, peers_node.size ());
 }
+
+TEST (rpc, unchecked_stats)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	auto block1 (std::make_shared <rai::send_block> (1, 1, 2, rai::keypair ().prv, 4, 5));
+	node1.block_processor.process_receive_many (block1);
+	rai::rpc rpc (system.service, node1, rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "unchecked_stats");
+	test_response response (request, rpc, system.service);
+	while (response.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response.status);
+	ASSERT_EQ ("1", response.json.get <std::string> ("waiting"));
+	ASSERT_EQ ("0", response.json.get <std::string> ("spilled"));
+	ASSERT_EQ ("1", response.json.get <std::string> ("depth"));
+}
+
+TEST (rpc, unchecked_in_memory)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	auto block1 (std::make_shared <rai::send_block> (1, 1, 2, rai::keypair ().prv, 4, 5));
+	node1.block_processor.process_receive_many (block1);
+	ASSERT_EQ (1, node1.block_processor.dependencies.size ());
+	rai::rpc rpc (system.service, node1, rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "unchecked");
+	request.put ("count", 2);
+	{
+		test_response response (request, rpc, system.service);
+		while (response.status == 0)
+		{
+			system.poll ();
+		}
+		ASSERT_EQ (200, response.status);
+		auto & blocks (response.json.get_child ("blocks"));
+		ASSERT_EQ (1, blocks.size ());
+		ASSERT_EQ (block1->hash ().to_string (), blocks.begin ()->first);
+	}
+	request.put ("action", "unchecked_get");
+	request.put ("hash", block1->hash ().to_string ());
+	{
+		test_response response (request, rpc, system.service);
+		while (response.status == 0)
+		{
+			system.poll ();
+		}
+		ASSERT_EQ (200, response.status);
+		ASSERT_FALSE (response.json.get <std::string> ("contents").empty ());
+	}
+	request.put ("action", "unchecked_keys");
+	request.put ("key", rai::block_hash (0).to_string ());
+	{
+		test_response response (request, rpc, system.service);
+		while (response.status == 0)
+		{
+			system.poll ();
+		}
+		ASSERT_EQ (200, response.status);
+		auto & unchecked (response.json.get_child ("unchecked"));
+		ASSERT_EQ (1, unchecked.size ());
+		ASSERT_EQ (rai::block_hash (1).to_string (), unchecked.begin ()->second.get <std::string> ("key"));
+		ASSERT_EQ (block1->hash ().to_string (), unchecked.begin ()->second.get <std::string> ("hash"));
+	}
+}
+
+TEST (rpc, confirmation_stats)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	ASSERT_EQ (rai::process_result::progress, node1.process (*send1).code);
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		node1.active.start (transaction, send1);
+	}
+	rai::vote vote1 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 1, send1);
+	node1.active.vote (vote1);
+	rai::rpc rpc (system.service, node1, rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "confirmation_stats");
+	test_response response (request, rpc, system.service);
+	while (response.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response.status);
+	ASSERT_EQ ("1", response.json.get <std::string> ("confirmed"));
+	ASSERT_EQ ("1", response.json.get <std::string> ("quorum"));
+	ASSERT_EQ ("0", response.json.get <std::string> ("cutoff"));
+	ASSERT_EQ ("1", response.json.get <std::string> ("to_quorum.count"));
+	ASSERT_EQ ("1", response.json.get <std::string> ("votes.max"));
+	ASSERT_EQ ("1", response.json.get <std::string> ("votes.buckets.2"));
+	ASSERT_EQ ("0", response.json.get <std::string> ("gaps.size"));
+	ASSERT_EQ ("0", response.json.get <std::string> ("gaps.fill_time.count"));
+}
+
+TEST (rpc, send_queue)
+{
+	rai::system system (24000, 2);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "send_queue");
+	test_response response (request, rpc, system.service);
+	while (response.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response.status);
+	ASSERT_EQ (std::to_string (system.nodes [0]->config.send_queue_memory), response.json.get <std::string> ("bytes_max"));
+	ASSERT_EQ ("0", response.json.get <std::string> ("dropped"));
+	ASSERT_EQ (1, response.json.get_child ("peers").size ());
+}
+
+TEST (rpc, traffic)
+{
+	rai::system system (24000, 2);
+	auto iterations (0);
+	while (system.nodes [0]->network.incoming.keepalive == 0)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "traffic");
+	test_response response (request, rpc, system.service);
+	while (response.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response.status);
+	ASSERT_NE ("0", response.json.get <std::string> ("incoming.keepalive"));
+	ASSERT_NE ("0", response.json.get <std::string> ("incoming.classes.keepalive.queued"));
+	ASSERT_EQ ("0", response.json.get <std::string> ("incoming.classes.vote.dropped"));
+	ASSERT_NE ("0", response.json.get <std::string> ("outgoing.classes.keepalive.latency.count"));
+}
+
+TEST (rpc, stats_peers)
+{
+	rai::system system (24000, 3);
+	auto iterations (0);
+	while (system.nodes [0]->network.peer_traffic.size () < 2)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "stats_peers");
+	request.put ("count", "1");
+	request.put ("sort", "messages_in");
+	request.put ("type", "keepalive");
+	test_response response (request, rpc, system.service);
+	while (response.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response.status);
+	ASSERT_EQ (std::to_string (system.nodes [0]->network.peer_traffic.size ()), response.json.get <std::string> ("tracked"));
+	ASSERT_EQ ("false", response.json.get <std::string> ("overflow"));
+	auto & peers (response.json.get_child ("peers"));
+	ASSERT_EQ (1, peers.size ());
+	auto & peer (peers.begin ()->second);
+	ASSERT_NE ("0", peer.get <std::string> ("types.keepalive.messages_in"));
+	ASSERT_NE ("0", peer.get <std::string> ("bytes_in"));
+	ASSERT_EQ ("0", peer.get <std::string> ("drops.parse_error"));
+	request.put ("sort", "latency");
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	ASSERT_EQ ("Invalid sort", response1.json.get <std::string> ("error"));
+}
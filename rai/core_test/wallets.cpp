@@ -69,4 +69,59 @@ TEST (wallets, DISABLED_remove)
 		ASSERT_FALSE (error);
 		ASSERT_EQ (0, wallets.items.size ());
 	}
-}
\ No newline at end of file
+}
+
+TEST (wallets, representative_index)
+{
+	rai::system system (24000, 1);
+	auto & node (*system.nodes [0]);
+	auto wallet (system.wallet (0));
+	rai::keypair key2;
+	wallet->insert_adhoc (rai::test_genesis_key.prv);
+	wallet->insert_adhoc (key2.prv);
+	{
+		std::lock_guard <std::mutex> lock (wallet->representatives_mutex);
+		ASSERT_EQ (1, wallet->representatives.size ());
+		ASSERT_NE (wallet->representatives.end (), wallet->representatives.find (rai::test_genesis_key.pub));
+	}
+	ASSERT_FALSE (wallet->change_sync (rai::test_genesis_key.pub, key2.pub));
+	{
+		std::lock_guard <std::mutex> lock (wallet->representatives_mutex);
+		ASSERT_NE (wallet->representatives.end (), wallet->representatives.find (key2.pub));
+	}
+	std::vector <rai::public_key> voters;
+	{
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		node.wallets.foreach_representative (transaction, [&voters] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
+		{
+			voters.push_back (pub_a);
+		});
+	}
+	ASSERT_EQ (1, voters.size ());
+	ASSERT_EQ (key2.pub, voters [0]);
+	node.wallets.compute_reps ();
+	std::lock_guard <std::mutex> lock (wallet->representatives_mutex);
+	ASSERT_EQ (1, wallet->representatives.size ());
+	ASSERT_EQ (1, wallet->representative_keys.size ());
+}
+
+TEST (wallets, representative_keys_lock)
+{
+	rai::system system (24000, 1);
+	auto wallet (system.wallet (0));
+	wallet->insert_adhoc (rai::test_genesis_key.prv);
+	ASSERT_FALSE (wallet->enter_password (""));
+	{
+		std::lock_guard <std::mutex> lock (wallet->representatives_mutex);
+		ASSERT_EQ (1, wallet->representative_keys.size ());
+	}
+	// Locking drops the decrypted keys straight away rather than on the next vote
+	wallet->lock ();
+	{
+		std::lock_guard <std::mutex> lock (wallet->representatives_mutex);
+		ASSERT_EQ (0, wallet->representative_keys.size ());
+	}
+	ASSERT_FALSE (wallet->enter_password (""));
+	std::lock_guard <std::mutex> lock (wallet->representatives_mutex);
+	ASSERT_EQ (1, wallet->representative_keys.size ());
+}
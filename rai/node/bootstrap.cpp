@@ -147,10 +147,40 @@ rai::sync_result rai::push_synchronization::target (MDB_txn * transaction_a, rai
 	return target_m (transaction_a, block_a);
 }
 
+rai::tcp_socket::tcp_socket (boost::asio::io_service & service_a) :
+socket (service_a)
+{
+}
+
+void rai::tcp_socket::async_connect (rai::tcp_endpoint const & endpoint_a, std::function <void (boost::system::error_code const &)> callback_a)
+{
+	socket.async_connect (endpoint_a, callback_a);
+}
+
+void rai::tcp_socket::async_read (uint8_t * data_a, size_t size_a, std::function <void (boost::system::error_code const &, size_t)> callback_a)
+{
+	boost::asio::async_read (socket, boost::asio::buffer (data_a, size_a), callback_a);
+}
+
+void rai::tcp_socket::async_write (uint8_t const * data_a, size_t size_a, std::function <void (boost::system::error_code const &, size_t)> callback_a)
+{
+	boost::asio::async_write (socket, boost::asio::buffer (data_a, size_a), callback_a);
+}
+
+void rai::tcp_socket::close ()
+{
+	socket.close ();
+}
+
+rai::tcp_endpoint rai::tcp_socket::remote_endpoint ()
+{
+	return socket.remote_endpoint ();
+}
+
 rai::bootstrap_client::bootstrap_client (std::shared_ptr <rai::node> node_a, std::shared_ptr <rai::bootstrap_attempt> attempt_a, rai::tcp_endpoint const & endpoint_a) :
 node (node_a),
 attempt (attempt_a),
-socket (node_a->service),
+socket (node_a->network.transport != nullptr ? node_a->network.transport->connection () : std::make_shared <rai::tcp_socket> (node_a->service)),
 endpoint (endpoint_a),
 timeout (node_a->service)
 {
@@ -174,7 +204,7 @@ void rai::bootstrap_client::start_timeout ()
 			if (this_l != nullptr)
 			{
                 BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Disconnecting from %1% due to timeout") % this_l->endpoint);
-				this_l->socket.close ();
+				this_l->socket->close ();
 			}
 		}
 	});
@@ -190,7 +220,7 @@ void rai::bootstrap_client::run ()
 {
     auto this_l (shared_from_this ());
 	start_timeout ();
-    socket.async_connect (endpoint, [this_l] (boost::system::error_code const & ec)
+    socket->async_connect (endpoint, [this_l] (boost::system::error_code const & ec)
     {
 		this_l->stop_timeout ();
 		if (!ec)
@@ -230,7 +260,7 @@ void rai::frontier_req_client::run ()
 	}
 	auto this_l (shared_from_this ());
 	connection->start_timeout ();
-	boost::asio::async_write (connection->socket, boost::asio::buffer (send_buffer->data (), send_buffer->size ()), [this_l, send_buffer] (boost::system::error_code const & ec, size_t size_a)
+	connection->socket->async_write (send_buffer->data (), send_buffer->size (), [this_l, send_buffer] (boost::system::error_code const & ec, size_t size_a)
 	{
 		this_l->connection->stop_timeout ();
 		if (!ec)
@@ -270,7 +300,7 @@ void rai::frontier_req_client::receive_frontier ()
 {
     auto this_l (shared_from_this ());
 	connection->start_timeout ();
-    boost::asio::async_read (connection->socket, boost::asio::buffer (connection->receive_buffer.data (), sizeof (rai::uint256_union) + sizeof (rai::uint256_union)), [this_l] (boost::system::error_code const & ec, size_t size_a)
+    connection->socket->async_read (connection->receive_buffer.data (), sizeof (rai::uint256_union) + sizeof (rai::uint256_union), [this_l] (boost::system::error_code const & ec, size_t size_a)
     {
 		this_l->connection->stop_timeout ();
         this_l->received_frontier (ec, size_a);
@@ -312,7 +342,7 @@ void rai::frontier_req_client::received_frontier (boost::system::error_code cons
 		if (next_report < now)
 		{
 			next_report = now + std::chrono::seconds (15);
-			BOOST_LOG (connection->node->log) << boost::str (boost::format ("Received %1% frontiers from %2%") % std::to_string (count) % connection->socket.remote_endpoint ());
+			BOOST_LOG (connection->node->log) << boost::str (boost::format ("Received %1% frontiers from %2%") % std::to_string (count) % connection->socket->remote_endpoint ());
 		}
         if (!account.is_zero ())
         {
@@ -461,7 +491,7 @@ void rai::bulk_pull_client::request (rai::pull_info const & pull_a)
 	}
 	auto this_l (shared_from_this ());
 	connection->start_timeout ();
-	boost::asio::async_write (connection->socket, boost::asio::buffer (buffer->data (), buffer->size ()), [this_l, buffer] (boost::system::error_code const & ec, size_t size_a)
+	connection->socket->async_write (buffer->data (), buffer->size (), [this_l, buffer] (boost::system::error_code const & ec, size_t size_a)
 	{
 		this_l->connection->stop_timeout ();
 		if (!ec)
@@ -479,7 +509,7 @@ void rai::bulk_pull_client::receive_block ()
 {
     auto this_l (shared_from_this ());
 	connection->start_timeout ();
-    boost::asio::async_read (connection->socket, boost::asio::buffer (connection->receive_buffer.data (), 1), [this_l] (boost::system::error_code const & ec, size_t size_a)
+    connection->socket->async_read (connection->receive_buffer.data (), 1, [this_l] (boost::system::error_code const & ec, size_t size_a)
     {
 		this_l->connection->stop_timeout ();
         if (!ec)
@@ -502,7 +532,7 @@ void rai::bulk_pull_client::received_type ()
         case rai::block_type::send:
         {
 			connection->start_timeout ();
-            boost::asio::async_read (connection->socket, boost::asio::buffer (connection->receive_buffer.data () + 1, rai::send_block::size), [this_l] (boost::system::error_code const & ec, size_t size_a)
+            connection->socket->async_read (connection->receive_buffer.data () + 1, rai::send_block::size, [this_l] (boost::system::error_code const & ec, size_t size_a)
             {
 				this_l->connection->stop_timeout ();
                 this_l->received_block (ec, size_a);
@@ -512,7 +542,7 @@ void rai::bulk_pull_client::received_type ()
         case rai::block_type::receive:
         {
 			connection->start_timeout ();
-            boost::asio::async_read (connection->socket, boost::asio::buffer (connection->receive_buffer.data () + 1, rai::receive_block::size), [this_l] (boost::system::error_code const & ec, size_t size_a)
+            connection->socket->async_read (connection->receive_buffer.data () + 1, rai::receive_block::size, [this_l] (boost::system::error_code const & ec, size_t size_a)
             {
 				this_l->connection->stop_timeout ();
                 this_l->received_block (ec, size_a);
@@ -522,7 +552,7 @@ void rai::bulk_pull_client::received_type ()
         case rai::block_type::open:
         {
 			connection->start_timeout ();
-            boost::asio::async_read (connection->socket, boost::asio::buffer (connection->receive_buffer.data () + 1, rai::open_block::size), [this_l] (boost::system::error_code const & ec, size_t size_a)
+            connection->socket->async_read (connection->receive_buffer.data () + 1, rai::open_block::size, [this_l] (boost::system::error_code const & ec, size_t size_a)
             {
 				this_l->connection->stop_timeout ();
                 this_l->received_block (ec, size_a);
@@ -532,7 +562,7 @@ void rai::bulk_pull_client::received_type ()
         case rai::block_type::change:
         {
 			connection->start_timeout ();
-            boost::asio::async_read (connection->socket, boost::asio::buffer (connection->receive_buffer.data () + 1, rai::change_block::size), [this_l] (boost::system::error_code const & ec, size_t size_a)
+            connection->socket->async_read (connection->receive_buffer.data () + 1, rai::change_block::size, [this_l] (boost::system::error_code const & ec, size_t size_a)
             {
 				this_l->connection->stop_timeout ();
                 this_l->received_block (ec, size_a);
@@ -575,29 +605,39 @@ void rai::bulk_pull_client::received_block (boost::system::error_code const & ec
 			{
 				expected = block->previous ();
 			}
-			auto attempt_l (connection->attempt);
-			attempt_l->node->block_processor.add (block, [attempt_l] (MDB_txn * transaction_a, rai::process_return result_a, std::shared_ptr <rai::block> block_a)
+			// A lazy pull starts from a hash whose account isn't known so it can't name an end, the first block we already have is our head for the account and the rest of the chain is old
+			auto reached_head (pull.account == pull.head && pull.end.is_zero () && hash != pull.head && connection->node->ledger.block_exists (hash));
+			if (reached_head)
+			{
+				pull = rai::pull_info ();
+				connection->socket->close ();
+			}
+			else
 			{
-				switch (result_a.code)
+				auto attempt_l (connection->attempt);
+				attempt_l->node->block_processor.add (block, [attempt_l] (MDB_txn * transaction_a, rai::process_return result_a, std::shared_ptr <rai::block> block_a)
 				{
-					case rai::process_result::progress:
-					case rai::process_result::old:
-						break;
-					case rai::process_result::fork:
+					switch (result_a.code)
 					{
-						auto node_l (attempt_l->node);
-						std::shared_ptr <rai::block> block (node_l->ledger.forked_block (transaction_a, *block_a));
-						node_l->active.start (transaction_a, block);
-						node_l->network.broadcast_confirm_req (block_a);
-						node_l->network.broadcast_confirm_req (block);
-						BOOST_LOG (node_l->log) << boost::str (boost::format ("Fork received in bootstrap between: %1% and %2% root %3%") % block_a->hash ().to_string () % block->hash ().to_string () % block_a->root ().to_string ());
-						break;
+						case rai::process_result::progress:
+						case rai::process_result::old:
+							break;
+						case rai::process_result::fork:
+						{
+							auto node_l (attempt_l->node);
+							std::shared_ptr <rai::block> block (node_l->ledger.forked_block (transaction_a, *block_a));
+							node_l->active.start (transaction_a, block);
+							node_l->network.broadcast_confirm_req (block_a);
+							node_l->network.broadcast_confirm_req (block);
+							BOOST_LOG (node_l->log) << boost::str (boost::format ("Fork received in bootstrap between: %1% and %2% root %3%") % block_a->hash ().to_string () % block->hash ().to_string () % block_a->root ().to_string ());
+							break;
+						}
+						default:
+							break;
 					}
-					default:
-						break;
-				}
-			});
-            receive_block ();
+				});
+				receive_block ();
+			}
 		}
         else
         {
@@ -634,7 +674,7 @@ void rai::bulk_push_client::start ()
     }
     auto this_l (shared_from_this ());
 	connection->start_timeout ();
-    boost::asio::async_write (connection->socket, boost::asio::buffer (buffer->data (), buffer->size ()), [this_l, buffer] (boost::system::error_code const & ec, size_t size_a)
+    connection->socket->async_write (buffer->data (), buffer->size (), [this_l, buffer] (boost::system::error_code const & ec, size_t size_a)
 	{
 		this_l->connection->stop_timeout ();
 		rai::transaction transaction (this_l->connection->node->store.environment, nullptr, true);
@@ -688,7 +728,7 @@ void rai::bulk_push_client::send_finished ()
         BOOST_LOG (connection->node->log) << "Bulk push finished";
     }
     auto this_l (shared_from_this ());
-    async_write (connection->socket, boost::asio::buffer (buffer->data (), 1), [this_l] (boost::system::error_code const & ec, size_t size_a)
+    connection->socket->async_write (buffer->data (), 1, [this_l] (boost::system::error_code const & ec, size_t size_a)
 	{
 		try
 		{
@@ -709,7 +749,7 @@ void rai::bulk_push_client::push_block (rai::block const & block_a)
     }
     auto this_l (shared_from_this ());
 	connection->start_timeout ();
-    boost::asio::async_write (connection->socket, boost::asio::buffer (buffer->data (), buffer->size ()), [this_l, buffer] (boost::system::error_code const & ec, size_t size_a)
+    connection->socket->async_write (buffer->data (), buffer->size (), [this_l, buffer] (boost::system::error_code const & ec, size_t size_a)
 	{
 		this_l->connection->stop_timeout ();
 		if (!ec)
@@ -746,14 +786,16 @@ attempts (0)
 {
 }
 
-rai::bootstrap_attempt::bootstrap_attempt (std::shared_ptr <rai::node> node_a) :
+rai::bootstrap_attempt::bootstrap_attempt (std::shared_ptr <rai::node> node_a, bool lazy_a) :
 connections (0),
 pulling (0),
 node (node_a),
 account_count (0),
+lazy (lazy_a),
+pulls_complete (false),
 stopped (false)
 {
-	BOOST_LOG (node->log) << "Starting bootstrap attempt";
+	BOOST_LOG (node->log) << (lazy ? "Starting lazy bootstrap attempt" : "Starting bootstrap attempt");
 }
 
 rai::bootstrap_attempt::~bootstrap_attempt ()
@@ -841,7 +883,7 @@ void rai::bootstrap_attempt::run ()
 {
 	populate_connections ();
 	std::unique_lock <std::mutex> lock (mutex);
-	auto frontier_failure (true);
+	auto frontier_failure (!lazy);
 	while (!stopped && frontier_failure)
 	{
         frontier_failure = request_frontier (lock);
@@ -857,11 +899,12 @@ void rai::bootstrap_attempt::run ()
             condition.wait (lock);
         }
 	}
+	pulls_complete = true;
     if (!stopped)
     {
         BOOST_LOG (node->log) << "Completed pulls";
     }
-	auto push_failure (true);
+	auto push_failure (!lazy);
 	while (!stopped && push_failure)
 	{
         push_failure = request_push (lock);
@@ -954,7 +997,7 @@ void rai::bootstrap_attempt::stop ()
 	{
 		if (auto client = i.lock ())
 		{
-			client->socket.close ();
+			client->socket->close ();
 		}
 	}
 	if (auto i = frontiers.lock ())
@@ -994,9 +1037,24 @@ void rai::bootstrap_attempt::requeue_pull (rai::pull_info const & pull_a)
 	}
 }
 
+bool rai::bootstrap_attempt::add_pull (rai::pull_info const & pull_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto result (stopped || pulls_complete);
+	if (!result)
+	{
+		pulls.push_back (pull_a);
+		condition.notify_all ();
+	}
+	return result;
+}
+
+size_t constexpr rai::bootstrap_initiator::lazy_peers_max;
+
 rai::bootstrap_initiator::bootstrap_initiator (rai::node & node_a) :
 node (node_a),
-stopped (false)
+stopped (false),
+bootstrap_queued (false)
 {
 }
 
@@ -1006,18 +1064,74 @@ rai::bootstrap_initiator::~bootstrap_initiator ()
 }
 
 void rai::bootstrap_initiator::bootstrap ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	if (!stopped)
+	{
+		if (attempt == nullptr)
+		{
+			start_attempt (false);
+		}
+		else if (attempt->lazy)
+		{
+			bootstrap_queued = true;
+		}
+	}
+}
+
+void rai::bootstrap_initiator::start_attempt (bool lazy_a)
+{
+	stop_attempt ();
+	attempt = std::make_shared <rai::bootstrap_attempt> (node.shared (), lazy_a);
+	if (lazy_a)
+	{
+		// Queued before the thread starts so the attempt doesn't finish with nothing to pull
+		for (auto & i: lazy_pulls)
+		{
+			attempt->add_pull (i);
+		}
+		lazy_pulls.clear ();
+	}
+	attempt_thread.reset (new std::thread ([this] ()
+	{
+		attempt->run ();
+		node.block_processor.flush ();
+		// Gaps the attempt didn't fill can schedule another pull
+		node.gap_cache.requested_clear ();
+		std::weak_ptr <rai::node> node_w (attempt->node);
+		attempt.reset ();
+		node.background ([node_w] ()
+		{
+			if (auto node_l = node_w.lock ())
+			{
+				node_l->bootstrap_initiator.run_queued ();
+			}
+		});
+	}));
+	if (lazy_a)
+	{
+		for (auto & i: lazy_peers)
+		{
+			attempt->add_connection (i);
+		}
+		lazy_peers.clear ();
+	}
+}
+
+void rai::bootstrap_initiator::run_queued ()
 {
 	std::lock_guard <std::mutex> lock (mutex);
 	if (attempt == nullptr && !stopped)
 	{
-        stop_attempt ();
-        attempt = std::make_shared <rai::bootstrap_attempt> (node.shared ());
-		attempt_thread.reset (new std::thread ([this] ()
-        {
-            attempt->run ();
-			node.block_processor.flush ();
-            attempt.reset ();
-        }));
+		if (bootstrap_queued)
+		{
+			bootstrap_queued = false;
+			start_attempt (false);
+		}
+		else if (!lazy_pulls.empty ())
+		{
+			start_attempt (true);
+		}
 	}
 }
 
@@ -1032,6 +1146,42 @@ void rai::bootstrap_initiator::bootstrap (rai::endpoint const & endpoint_a)
 	}
 }
 
+void rai::bootstrap_initiator::bootstrap_lazy (rai::block_hash const & hash_a, std::vector <rai::endpoint> const & peers_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	if (!stopped)
+	{
+		// Peers serve a bulk pull starting from a block hash as the chain from that block down to the account's open block
+		rai::pull_info pull (hash_a, hash_a, 0);
+		if (attempt == nullptr || attempt->add_pull (pull))
+		{
+			// The running attempt is past its pulls, keep this one for the attempt started after it
+			if (std::find_if (lazy_pulls.begin (), lazy_pulls.end (), [&hash_a] (rai::pull_info const & i) { return i.account == hash_a; }) == lazy_pulls.end ())
+			{
+				lazy_pulls.push_back (pull);
+			}
+			for (auto & i: peers_a)
+			{
+				if (lazy_peers.size () < lazy_peers_max && std::find (lazy_peers.begin (), lazy_peers.end (), i) == lazy_peers.end ())
+				{
+					lazy_peers.push_back (i);
+				}
+			}
+			if (attempt == nullptr)
+			{
+				start_attempt (true);
+			}
+		}
+		else
+		{
+			for (auto & i: peers_a)
+			{
+				attempt->add_connection (i);
+			}
+		}
+	}
+}
+
 void rai::bootstrap_initiator::add_observer (std::function <void (bool)> const & observer_a)
 {
 	std::lock_guard <std::mutex> lock (mutex);
@@ -1083,11 +1233,27 @@ node (node_a)
 
 void rai::bootstrap_listener::start ()
 {
-    acceptor.open (local.protocol ());
-    acceptor.set_option (boost::asio::ip::tcp::acceptor::reuse_address (true));
-    acceptor.bind (local);
-    acceptor.listen ();
-    accept_connection ();
+	if (node.network.transport != nullptr)
+	{
+		// The transport owns the bootstrap port, it stops accepting when the network stops it
+		std::weak_ptr <rai::node> node_w (node.shared ());
+		node.network.transport->listen ([node_w] (std::shared_ptr <rai::socket> socket_a)
+		{
+			if (auto node_l = node_w.lock ())
+			{
+				auto connection (std::make_shared <rai::bootstrap_server> (socket_a, node_l));
+				connection->receive ();
+			}
+		});
+	}
+	else
+	{
+		acceptor.open (local.protocol ());
+		acceptor.set_option (boost::asio::ip::tcp::acceptor::reuse_address (true));
+		acceptor.bind (local);
+		acceptor.listen ();
+		accept_connection ();
+	}
 }
 
 void rai::bootstrap_listener::stop ()
@@ -1098,14 +1264,14 @@ void rai::bootstrap_listener::stop ()
 
 void rai::bootstrap_listener::accept_connection ()
 {
-    auto socket (std::make_shared <boost::asio::ip::tcp::socket> (service));
-    acceptor.async_accept (*socket, [this, socket] (boost::system::error_code const & ec)
+    auto socket (std::make_shared <rai::tcp_socket> (service));
+    acceptor.async_accept (socket->socket, [this, socket] (boost::system::error_code const & ec)
     {
         accept_action (ec, socket);
     });
 }
 
-void rai::bootstrap_listener::accept_action (boost::system::error_code const & ec, std::shared_ptr <boost::asio::ip::tcp::socket> socket_a)
+void rai::bootstrap_listener::accept_action (boost::system::error_code const & ec, std::shared_ptr <rai::tcp_socket> socket_a)
 {
     if (!ec)
     {
@@ -1132,7 +1298,7 @@ rai::bootstrap_server::~bootstrap_server ()
     }
 }
 
-rai::bootstrap_server::bootstrap_server (std::shared_ptr <boost::asio::ip::tcp::socket> socket_a, std::shared_ptr <rai::node> node_a) :
+rai::bootstrap_server::bootstrap_server (std::shared_ptr <rai::socket> socket_a, std::shared_ptr <rai::node> node_a) :
 socket (socket_a),
 node (node_a)
 {
@@ -1141,7 +1307,7 @@ node (node_a)
 void rai::bootstrap_server::receive ()
 {
     auto this_l (shared_from_this ());
-    boost::asio::async_read (*socket, boost::asio::buffer (receive_buffer.data (), 8), [this_l] (boost::system::error_code const & ec, size_t size_a)
+    socket->async_read (receive_buffer.data (), 8, [this_l] (boost::system::error_code const & ec, size_t size_a)
     {
         this_l->receive_header_action (ec, size_a);
     });
@@ -1165,7 +1331,7 @@ void rai::bootstrap_server::receive_header_action (boost::system::error_code con
 				case rai::message_type::bulk_pull:
 				{
 					auto this_l (shared_from_this ());
-					boost::asio::async_read (*socket, boost::asio::buffer (receive_buffer.data () + 8, sizeof (rai::uint256_union) + sizeof (rai::uint256_union)), [this_l] (boost::system::error_code const & ec, size_t size_a)
+					socket->async_read (receive_buffer.data () + 8, sizeof (rai::uint256_union) + sizeof (rai::uint256_union), [this_l] (boost::system::error_code const & ec, size_t size_a)
 					{
 						this_l->receive_bulk_pull_action (ec, size_a);
 					});
@@ -1174,7 +1340,7 @@ void rai::bootstrap_server::receive_header_action (boost::system::error_code con
 				case rai::message_type::frontier_req:
 				{
 					auto this_l (shared_from_this ());
-					boost::asio::async_read (*socket, boost::asio::buffer (receive_buffer.data () + 8, sizeof (rai::uint256_union) + sizeof (uint32_t) + sizeof (uint32_t)), [this_l] (boost::system::error_code const & ec, size_t size_a)
+					socket->async_read (receive_buffer.data () + 8, sizeof (rai::uint256_union) + sizeof (uint32_t) + sizeof (uint32_t), [this_l] (boost::system::error_code const & ec, size_t size_a)
 					{
 						this_l->receive_frontier_req_action (ec, size_a);
 					});
@@ -1185,6 +1351,15 @@ void rai::bootstrap_server::receive_header_action (boost::system::error_code con
                     add_request (std::unique_ptr <rai::message> (new rai::bulk_push));
                     break;
                 }
+				case rai::message_type::realtime_req:
+				{
+					auto this_l (shared_from_this ());
+					socket->async_read (receive_buffer.data () + 8, sizeof (uint16_t), [this_l] (boost::system::error_code const & ec, size_t size_a)
+					{
+						this_l->receive_realtime_req_action (ec, size_a);
+					});
+					break;
+				}
 				default:
 				{
 					if (node->config.logging.network_logging ())
@@ -1250,6 +1425,28 @@ void rai::bootstrap_server::receive_frontier_req_action (boost::system::error_co
     }
 }
 
+void rai::bootstrap_server::receive_realtime_req_action (boost::system::error_code const & ec, size_t size_a)
+{
+	if (!ec)
+	{
+		std::unique_ptr <rai::realtime_req> request (new rai::realtime_req);
+		rai::bufferstream stream (receive_buffer.data (), 8 + sizeof (uint16_t));
+		auto error (request->deserialize (stream));
+		if (!error)
+		{
+			// The socket is handed to a realtime channel which does all further reading from it
+			add_request (std::unique_ptr <rai::message> (request.release ()));
+		}
+	}
+	else
+	{
+		if (node->config.logging.network_logging ())
+		{
+			BOOST_LOG (node->log) << boost::str (boost::format ("Error receiving realtime request %1%") % ec.message ());
+		}
+	}
+}
+
 void rai::bootstrap_server::add_request (std::unique_ptr <rai::message> message_a)
 {
 	std::lock_guard <std::mutex> lock (mutex);
@@ -1311,6 +1508,31 @@ public:
         auto response (std::make_shared <rai::frontier_req_server> (connection, std::unique_ptr <rai::frontier_req> (static_cast <rai::frontier_req *> (connection->requests.front ().release ()))));
         response->send_next ();
     }
+    void announce (rai::announce const &) override
+    {
+        assert (false);
+    }
+    void publish_req (rai::publish_req const &) override
+    {
+        assert (false);
+    }
+    void realtime_req (rai::realtime_req const & message_a) override
+    {
+        auto address (connection->socket->remote_endpoint ().address ());
+        if (address.is_v4 ())
+        {
+            address = boost::asio::ip::address_v6::v4_mapped (address.to_v4 ());
+        }
+        rai::endpoint endpoint (address, message_a.port);
+        if (message_a.version_using >= rai::message::realtime_version)
+        {
+            connection->node->channels.add (std::make_shared <rai::realtime_channel> (*connection->node, connection->socket, endpoint, true));
+        }
+        else
+        {
+            connection->socket->close ();
+        }
+    }
     std::shared_ptr <rai::bootstrap_server> connection;
 };
 }
@@ -1338,11 +1560,19 @@ void rai::bulk_pull_server::set_current_end ()
 	auto no_address (connection->node->store.account_get (transaction, request->start, info));
 	if (no_address)
 	{
-		if (connection->node->config.logging.bulk_pull_logging ())
+		if (connection->node->store.block_exists (transaction, request->start))
 		{
-			BOOST_LOG (connection->node->log) << boost::str (boost::format ("Request for unknown account: %1%") % request->start.to_account ());
+			// Start is a block hash rather than an account, send the chain from that block down
+			current = request->start;
+		}
+		else
+		{
+			if (connection->node->config.logging.bulk_pull_logging ())
+			{
+				BOOST_LOG (connection->node->log) << boost::str (boost::format ("Request for unknown account: %1%") % request->start.to_account ());
+			}
+			current = request->end;
 		}
-		current = request->end;
 	}
 	else
 	{
@@ -1380,7 +1610,7 @@ void rai::bulk_pull_server::send_next ()
         {
             BOOST_LOG (connection->node->log) << boost::str (boost::format ("Sending block: %1%") % block->hash ().to_string ());
         }
-        async_write (*connection->socket, boost::asio::buffer (send_buffer.data (), send_buffer.size ()), [this_l] (boost::system::error_code const & ec, size_t size_a)
+        connection->socket->async_write (send_buffer.data (), send_buffer.size (), [this_l] (boost::system::error_code const & ec, size_t size_a)
         {
             this_l->sent_action (ec, size_a);
         });
@@ -1433,7 +1663,7 @@ void rai::bulk_pull_server::send_finished ()
     {
         BOOST_LOG (connection->node->log) << "Bulk sending finished";
     }
-    async_write (*connection->socket, boost::asio::buffer (send_buffer.data (), 1), [this_l] (boost::system::error_code const & ec, size_t size_a)
+    connection->socket->async_write (send_buffer.data (), 1, [this_l] (boost::system::error_code const & ec, size_t size_a)
     {
         this_l->no_block_sent (ec, size_a);
     });
@@ -1467,7 +1697,7 @@ connection (connection_a)
 void rai::bulk_push_server::receive ()
 {
     auto this_l (shared_from_this ());
-    boost::asio::async_read (*connection->socket, boost::asio::buffer (receive_buffer.data (), 1), [this_l] (boost::system::error_code const & ec, size_t size_a)
+    connection->socket->async_read (receive_buffer.data (), 1, [this_l] (boost::system::error_code const & ec, size_t size_a)
 	{
 		if (!ec)
 		{
@@ -1488,7 +1718,7 @@ void rai::bulk_push_server::received_type ()
     {
         case rai::block_type::send:
         {
-            boost::asio::async_read (*connection->socket, boost::asio::buffer (receive_buffer.data () + 1, rai::send_block::size), [this_l] (boost::system::error_code const & ec, size_t size_a)
+            connection->socket->async_read (receive_buffer.data () + 1, rai::send_block::size, [this_l] (boost::system::error_code const & ec, size_t size_a)
 			{
 				this_l->received_block (ec, size_a);
 			});
@@ -1496,7 +1726,7 @@ void rai::bulk_push_server::received_type ()
         }
         case rai::block_type::receive:
         {
-            boost::asio::async_read (*connection->socket, boost::asio::buffer (receive_buffer.data () + 1, rai::receive_block::size), [this_l] (boost::system::error_code const & ec, size_t size_a)
+            connection->socket->async_read (receive_buffer.data () + 1, rai::receive_block::size, [this_l] (boost::system::error_code const & ec, size_t size_a)
 			{
 				this_l->received_block (ec, size_a);
 			});
@@ -1504,7 +1734,7 @@ void rai::bulk_push_server::received_type ()
         }
         case rai::block_type::open:
         {
-            boost::asio::async_read (*connection->socket, boost::asio::buffer (receive_buffer.data () + 1, rai::open_block::size), [this_l] (boost::system::error_code const & ec, size_t size_a)
+            connection->socket->async_read (receive_buffer.data () + 1, rai::open_block::size, [this_l] (boost::system::error_code const & ec, size_t size_a)
 			{
 				this_l->received_block (ec, size_a);
 			});
@@ -1512,7 +1742,7 @@ void rai::bulk_push_server::received_type ()
         }
         case rai::block_type::change:
         {
-            boost::asio::async_read (*connection->socket, boost::asio::buffer (receive_buffer.data () + 1, rai::change_block::size), [this_l] (boost::system::error_code const & ec, size_t size_a)
+            connection->socket->async_read (receive_buffer.data () + 1, rai::change_block::size, [this_l] (boost::system::error_code const & ec, size_t size_a)
 			{
 				this_l->received_block (ec, size_a);
 			});
@@ -1590,7 +1820,7 @@ void rai::frontier_req_server::send_next ()
             BOOST_LOG (connection->node->log) << boost::str (boost::format ("Sending frontier for %1% %2%") % current.to_account () % info.head.to_string ());
         }
 		next ();
-        async_write (*connection->socket, boost::asio::buffer (send_buffer.data (), send_buffer.size ()), [this_l] (boost::system::error_code const & ec, size_t size_a)
+        connection->socket->async_write (send_buffer.data (), send_buffer.size (), [this_l] (boost::system::error_code const & ec, size_t size_a)
         {
             this_l->sent_action (ec, size_a);
         });
@@ -1615,7 +1845,7 @@ void rai::frontier_req_server::send_finished ()
     {
         BOOST_LOG (connection->node->log) << "Frontier sending finished";
     }
-    async_write (*connection->socket, boost::asio::buffer (send_buffer.data (), send_buffer.size ()), [this_l] (boost::system::error_code const & ec, size_t size_a)
+    connection->socket->async_write (send_buffer.data (), send_buffer.size (), [this_l] (boost::system::error_code const & ec, size_t size_a)
     {
         this_l->no_block_sent (ec, size_a);
     });
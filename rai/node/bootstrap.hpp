@@ -64,7 +64,7 @@ class bulk_push_client;
 class bootstrap_attempt : public std::enable_shared_from_this <bootstrap_attempt>
 {
 public:
-	bootstrap_attempt (std::shared_ptr <rai::node> node_a);
+	bootstrap_attempt (std::shared_ptr <rai::node> node_a, bool = false);
 	~bootstrap_attempt ();
 	void run ();
 	std::shared_ptr <rai::bootstrap_client> connection (std::unique_lock <std::mutex> &);
@@ -77,6 +77,8 @@ public:
 	void pool_connection (std::shared_ptr <rai::bootstrap_client>);
 	void stop ();
 	void requeue_pull (rai::pull_info const &);
+	// Returns true if the attempt is past its pull phase and won't serve the pull
+	bool add_pull (rai::pull_info const &);
 	std::deque <std::weak_ptr <rai::bootstrap_client>> clients;
 	std::weak_ptr <rai::frontier_req_client> frontiers;
 	std::weak_ptr <rai::bulk_push_client> push;
@@ -86,6 +88,9 @@ public:
     std::atomic <unsigned> pulling;
 	std::shared_ptr <rai::node> node;
 	std::atomic <unsigned> account_count;
+	// Only pull the chains queued with add_pull, skipping the frontier scan and push
+	bool lazy;
+	bool pulls_complete;
 	bool stopped;
 	std::mutex mutex;
 	std::condition_variable condition;
@@ -122,6 +127,30 @@ public:
 	rai::block_hash expected;
 	rai::pull_info pull;
 };
+// Byte stream bootstrap connections run over, a rai::tcp_socket unless the node's rai::transport supplies its own
+class socket
+{
+public:
+	virtual ~socket () = default;
+	virtual void async_connect (rai::tcp_endpoint const &, std::function <void (boost::system::error_code const &)>) = 0;
+	// Calls back once the whole buffer is filled or the stream fails
+	virtual void async_read (uint8_t *, size_t, std::function <void (boost::system::error_code const &, size_t)>) = 0;
+	// Calls back once the whole buffer is written or the stream fails
+	virtual void async_write (uint8_t const *, size_t, std::function <void (boost::system::error_code const &, size_t)>) = 0;
+	virtual void close () = 0;
+	virtual rai::tcp_endpoint remote_endpoint () = 0;
+};
+class tcp_socket : public rai::socket
+{
+public:
+	tcp_socket (boost::asio::io_service &);
+	void async_connect (rai::tcp_endpoint const &, std::function <void (boost::system::error_code const &)>) override;
+	void async_read (uint8_t *, size_t, std::function <void (boost::system::error_code const &, size_t)>) override;
+	void async_write (uint8_t const *, size_t, std::function <void (boost::system::error_code const &, size_t)>) override;
+	void close () override;
+	rai::tcp_endpoint remote_endpoint () override;
+	boost::asio::ip::tcp::socket socket;
+};
 class bootstrap_client : public std::enable_shared_from_this <bootstrap_client>
 {
 public:
@@ -133,7 +162,7 @@ public:
 	void stop_timeout ();
     std::shared_ptr <rai::node> node;
 	std::shared_ptr <rai::bootstrap_attempt> attempt;
-    boost::asio::ip::tcp::socket socket;
+    std::shared_ptr <rai::socket> socket;
     std::array <uint8_t, 200> receive_buffer;
 	rai::tcp_endpoint endpoint;
 	boost::asio::deadline_timer timeout;
@@ -158,16 +187,27 @@ public:
 	~bootstrap_initiator ();
     void bootstrap (rai::endpoint const &);
     void bootstrap ();
+	// Pull the chain ending in hash from the given peers
+	void bootstrap_lazy (rai::block_hash const &, std::vector <rai::endpoint> const &);
 	void notify_listeners ();
 	void add_observer (std::function <void (bool)> const &);
 	bool in_progress ();
 	void stop ();
     void stop_attempt ();
+	// Start the bootstrap requested while the last attempt was running
+	void run_queued ();
 	rai::node & node;
 	std::shared_ptr <rai::bootstrap_attempt> attempt;
 	std::unique_ptr <std::thread> attempt_thread;
 	bool stopped;
+	// Lazy pulls the running attempt couldn't take and the peers to pull them from
+	std::deque <rai::pull_info> lazy_pulls;
+	std::vector <rai::endpoint> lazy_peers;
+	// A full bootstrap was requested while a lazy attempt was running
+	bool bootstrap_queued;
+	static size_t constexpr lazy_peers_max = 32;
 private:
+	void start_attempt (bool);
 	std::mutex mutex;
 	std::vector <std::function <void (bool)>> observers;
 };
@@ -178,7 +218,7 @@ public:
     void start ();
     void stop ();
     void accept_connection ();
-    void accept_action (boost::system::error_code const &, std::shared_ptr <boost::asio::ip::tcp::socket>);
+    void accept_action (boost::system::error_code const &, std::shared_ptr <rai::tcp_socket>);
     rai::tcp_endpoint endpoint ();
     boost::asio::ip::tcp::acceptor acceptor;
     rai::tcp_endpoint local;
@@ -190,18 +230,19 @@ class message;
 class bootstrap_server : public std::enable_shared_from_this <rai::bootstrap_server>
 {
 public:
-    bootstrap_server (std::shared_ptr <boost::asio::ip::tcp::socket>, std::shared_ptr <rai::node>);
+    bootstrap_server (std::shared_ptr <rai::socket>, std::shared_ptr <rai::node>);
     ~bootstrap_server ();
     void receive ();
     void receive_header_action (boost::system::error_code const &, size_t);
     void receive_bulk_pull_action (boost::system::error_code const &, size_t);
     void receive_frontier_req_action (boost::system::error_code const &, size_t);
     void receive_bulk_push_action ();
+    void receive_realtime_req_action (boost::system::error_code const &, size_t);
     void add_request (std::unique_ptr <rai::message>);
     void finish_request ();
     void run_next ();
     std::array <uint8_t, 128> receive_buffer;
-    std::shared_ptr <boost::asio::ip::tcp::socket> socket;
+    std::shared_ptr <rai::socket> socket;
     std::shared_ptr <rai::node> node;
     std::mutex mutex;
     std::queue <std::unique_ptr <rai::message>> requests;
@@ -6,10 +6,16 @@ std::array <uint8_t, 2> constexpr rai::message::magic_number;
 size_t constexpr rai::message::ipv4_only_position;
 size_t constexpr rai::message::bootstrap_server_position;
 std::bitset <16> constexpr rai::message::block_type_mask;
+std::bitset <16> constexpr rai::message::hash_count_mask;
+uint8_t constexpr rai::message::vote_by_hash_version;
+uint8_t constexpr rai::message::announce_version;
+uint8_t constexpr rai::message::realtime_version;
+size_t constexpr rai::hash_list_message::hashes_max;
+size_t constexpr rai::message_header::size;
 
 rai::message::message (rai::message_type type_a) :
-version_max (0x03),
-version_using (0x03),
+version_max (0x06),
+version_using (0x06),
 version_min (0x01),
 type (type_a)
 {
@@ -31,6 +37,18 @@ void rai::message::block_type_set (rai::block_type type_a)
     extensions |= std::bitset <16> (static_cast <unsigned long long> (type_a) << 8);
 }
 
+size_t rai::message::hash_count () const
+{
+    return ((extensions & hash_count_mask) >> 12).to_ullong ();
+}
+
+void rai::message::hash_count_set (size_t count_a)
+{
+    assert (count_a < 16);
+    extensions &= ~hash_count_mask;
+    extensions |= std::bitset <16> (static_cast <unsigned long long> (count_a) << 12);
+}
+
 bool rai::message::ipv4_only ()
 {
     return extensions.test (ipv4_only_position);
@@ -87,6 +105,44 @@ bool rai::message::read_header (rai::stream & stream_a, uint8_t & version_max_a,
     return result;
 }
 
+bool rai::message_header::deserialize (rai::buffer_reader & reader_a)
+{
+	std::array <uint8_t, 2> magic_number_l;
+	uint16_t extensions_l;
+	auto result (reader_a.remaining < size);
+	if (!result)
+	{
+		reader_a.read (magic_number_l);
+		reader_a.read (version_max);
+		reader_a.read (version_using);
+		reader_a.read (version_min);
+		reader_a.read (type);
+		reader_a.read (extensions_l);
+		extensions = extensions_l;
+		result = magic_number_l != rai::message::magic_number;
+	}
+	return result;
+}
+
+void rai::message_header::apply (rai::message & message_a) const
+{
+	message_a.version_max = version_max;
+	message_a.version_using = version_using;
+	message_a.version_min = version_min;
+	message_a.type = type;
+	message_a.extensions = extensions;
+}
+
+rai::block_type rai::message_header::block_type () const
+{
+	return static_cast <rai::block_type> (((extensions & rai::message::block_type_mask) >> 8).to_ullong ());
+}
+
+size_t rai::message_header::hash_count () const
+{
+	return ((extensions & rai::message::hash_count_mask) >> 12).to_ullong ();
+}
+
 rai::message_parser::message_parser (rai::message_visitor & visitor_a, rai::work_pool & pool_a) :
 visitor (visitor_a),
 pool (pool_a),
@@ -98,34 +154,40 @@ insufficient_work (false)
 void rai::message_parser::deserialize_buffer (uint8_t const * buffer_a, size_t size_a)
 {
     error = false;
-    rai::bufferstream header_stream (buffer_a, size_a);
-    uint8_t version_max;
-    uint8_t version_using;
-    uint8_t version_min;
-    rai::message_type type;
-    std::bitset <16> extensions;
-    if (!rai::message::read_header (header_stream, version_max, version_using, version_min, type, extensions))
+	rai::buffer_reader reader (buffer_a, size_a);
+	rai::message_header header;
+    if (!header.deserialize (reader))
     {
-        switch (type)
+        switch (header.type)
         {
             case rai::message_type::keepalive:
             {
-                deserialize_keepalive (buffer_a, size_a);
+                deserialize_keepalive (header, reader);
                 break;
             }
             case rai::message_type::publish:
             {
-                deserialize_publish (buffer_a, size_a);
+                deserialize_publish (header, reader);
                 break;
             }
             case rai::message_type::confirm_req:
             {
-                deserialize_confirm_req (buffer_a, size_a);
+                deserialize_confirm_req (header, reader);
                 break;
             }
             case rai::message_type::confirm_ack:
             {
-                deserialize_confirm_ack (buffer_a, size_a);
+                deserialize_confirm_ack (header, reader);
+                break;
+            }
+            case rai::message_type::announce:
+            {
+                deserialize_announce (header, reader);
+                break;
+            }
+            case rai::message_type::publish_req:
+            {
+                deserialize_publish_req (header, reader);
                 break;
             }
             default:
@@ -141,92 +203,316 @@ void rai::message_parser::deserialize_buffer (uint8_t const * buffer_a, size_t s
     }
 }
 
+bool rai::message_parser::read_header (rai::buffer_reader & reader_a, rai::message_header & header_a, rai::message_type type_a)
+{
+	auto result (header_a.deserialize (reader_a) || header_a.type != type_a);
+	if (result)
+	{
+		error = true;
+	}
+	return result;
+}
+
 void rai::message_parser::deserialize_keepalive (uint8_t const * buffer_a, size_t size_a)
 {
-    rai::keepalive incoming;
-    rai::bufferstream stream (buffer_a, size_a);
-    auto error_l (incoming.deserialize (stream));
-    if (!error_l && at_end (stream))
-    {
-        visitor.keepalive (incoming);
-    }
-    else
-    {
-        error = true;
-    }
+	rai::buffer_reader reader (buffer_a, size_a);
+	rai::message_header header;
+	if (!read_header (reader, header, rai::message_type::keepalive))
+	{
+		deserialize_keepalive (header, reader);
+	}
 }
 
 void rai::message_parser::deserialize_publish (uint8_t const * buffer_a, size_t size_a)
 {
-    rai::publish incoming;
-    rai::bufferstream stream (buffer_a, size_a);
-    auto error_l (incoming.deserialize (stream));
-    if (!error_l && at_end (stream))
-    {
-        if (!pool.work_validate (*incoming.block))
-        {
-            visitor.publish (incoming);
-        }
-        else
-        {
-            insufficient_work = true;
-        }
-    }
-    else
-    {
-        error = true;
-    }
+	rai::buffer_reader reader (buffer_a, size_a);
+	rai::message_header header;
+	if (!read_header (reader, header, rai::message_type::publish))
+	{
+		deserialize_publish (header, reader);
+	}
 }
 
 void rai::message_parser::deserialize_confirm_req (uint8_t const * buffer_a, size_t size_a)
 {
-    rai::confirm_req incoming;
-    rai::bufferstream stream (buffer_a, size_a);
-    auto error_l (incoming.deserialize (stream));
-    if (!error_l && at_end (stream))
-    {
-        if (!pool.work_validate (*incoming.block))
-        {
-            visitor.confirm_req (incoming);
-        }
-        else
-        {
-            insufficient_work = true;
-        }
-    }
-    else
-    {
-        error = true;
-    }
+	rai::buffer_reader reader (buffer_a, size_a);
+	rai::message_header header;
+	if (!read_header (reader, header, rai::message_type::confirm_req))
+	{
+		deserialize_confirm_req (header, reader);
+	}
 }
 
 void rai::message_parser::deserialize_confirm_ack (uint8_t const * buffer_a, size_t size_a)
 {
-	bool error_l;
-    rai::bufferstream stream (buffer_a, size_a);
-    rai::confirm_ack incoming (error_l, stream);
-    if (!error_l && at_end (stream))
-    {
-        if (!pool.work_validate (*incoming.vote.block))
-        {
-            visitor.confirm_ack (incoming);
-        }
-        else
-        {
-            insufficient_work = true;
-        }
-    }
-    else
-    {
-        error = true;
-    }
+	rai::buffer_reader reader (buffer_a, size_a);
+	rai::message_header header;
+	if (!read_header (reader, header, rai::message_type::confirm_ack))
+	{
+		deserialize_confirm_ack (header, reader);
+	}
+}
+
+void rai::message_parser::deserialize_announce (uint8_t const * buffer_a, size_t size_a)
+{
+	rai::buffer_reader reader (buffer_a, size_a);
+	rai::message_header header;
+	if (!read_header (reader, header, rai::message_type::announce))
+	{
+		deserialize_announce (header, reader);
+	}
+}
+
+void rai::message_parser::deserialize_publish_req (uint8_t const * buffer_a, size_t size_a)
+{
+	rai::buffer_reader reader (buffer_a, size_a);
+	rai::message_header header;
+	if (!read_header (reader, header, rai::message_type::publish_req))
+	{
+		deserialize_publish_req (header, reader);
+	}
+}
+
+void rai::message_parser::deserialize_keepalive (rai::message_header const & header_a, rai::buffer_reader & reader_a)
+{
+	rai::keepalive incoming;
+	if (reader_a.remaining == incoming.peers.size () * (16 + sizeof (uint16_t)))
+	{
+		header_a.apply (incoming);
+		for (auto i (incoming.peers.begin ()), n (incoming.peers.end ()); i != n; ++i)
+		{
+			std::array <uint8_t, 16> address;
+			uint16_t port;
+			reader_a.read (address);
+			reader_a.read (port);
+			*i = rai::endpoint (boost::asio::ip::address_v6 (address), port);
+		}
+		visitor.keepalive (incoming);
+	}
+	else
+	{
+		error = true;
+	}
+}
+
+void rai::message_parser::deserialize_publish (rai::message_header const & header_a, rai::buffer_reader & reader_a)
+{
+	auto size (block_size (header_a.block_type ()));
+	if (size != 0 && reader_a.remaining == size)
+	{
+		rai::publish incoming (read_block (reader_a, header_a.block_type ()));
+		header_a.apply (incoming);
+		if (!pool.work_validate (*incoming.block))
+		{
+			visitor.publish (incoming);
+		}
+		else
+		{
+			insufficient_work = true;
+		}
+	}
+	else
+	{
+		error = true;
+	}
+}
+
+void rai::message_parser::deserialize_confirm_req (rai::message_header const & header_a, rai::buffer_reader & reader_a)
+{
+	auto size (block_size (header_a.block_type ()));
+	if (size != 0 && reader_a.remaining == size)
+	{
+		rai::confirm_req incoming (read_block (reader_a, header_a.block_type ()));
+		header_a.apply (incoming);
+		if (!pool.work_validate (*incoming.block))
+		{
+			visitor.confirm_req (incoming);
+		}
+		else
+		{
+			insufficient_work = true;
+		}
+	}
+	else
+	{
+		error = true;
+	}
+}
+
+void rai::message_parser::deserialize_confirm_ack (rai::message_header const & header_a, rai::buffer_reader & reader_a)
+{
+	rai::vote vote;
+	auto type (header_a.block_type ());
+	auto count (header_a.hash_count ());
+	size_t size (sizeof (vote.account) + sizeof (vote.signature) + sizeof (vote.sequence));
+	if (type == rai::block_type::not_a_block)
+	{
+		size += count > 0 && count <= rai::vote::hashes_max ? count * sizeof (rai::block_hash) : reader_a.remaining + 1;
+	}
+	else
+	{
+		auto block_size_l (block_size (type));
+		size += block_size_l != 0 ? block_size_l : reader_a.remaining + 1;
+	}
+	if (reader_a.remaining == size)
+	{
+		reader_a.read (vote.account.bytes);
+		reader_a.read (vote.signature.bytes);
+		reader_a.read (vote.sequence);
+		if (type == rai::block_type::not_a_block)
+		{
+			vote.hashes.resize (count);
+			for (auto & i: vote.hashes)
+			{
+				reader_a.read (i.bytes);
+			}
+		}
+		else
+		{
+			vote.block = read_block (reader_a, type);
+		}
+		rai::confirm_ack incoming (vote);
+		header_a.apply (incoming);
+		// A vote-by-hash carries no block and so no work to check
+		if (incoming.vote.block == nullptr || !pool.work_validate (*incoming.vote.block))
+		{
+			visitor.confirm_ack (incoming);
+		}
+		else
+		{
+			insufficient_work = true;
+		}
+	}
+	else
+	{
+		error = true;
+	}
+}
+
+void rai::message_parser::deserialize_announce (rai::message_header const & header_a, rai::buffer_reader & reader_a)
+{
+	rai::announce incoming;
+	if (!read_hashes (header_a, reader_a, incoming.hashes))
+	{
+		header_a.apply (incoming);
+		visitor.announce (incoming);
+	}
+}
+
+void rai::message_parser::deserialize_publish_req (rai::message_header const & header_a, rai::buffer_reader & reader_a)
+{
+	rai::publish_req incoming;
+	if (!read_hashes (header_a, reader_a, incoming.hashes))
+	{
+		header_a.apply (incoming);
+		visitor.publish_req (incoming);
+	}
+}
+
+bool rai::message_parser::read_hashes (rai::message_header const & header_a, rai::buffer_reader & reader_a, std::vector <rai::block_hash> & hashes_a)
+{
+	auto count (header_a.hash_count ());
+	auto result (count == 0 || count > rai::hash_list_message::hashes_max || reader_a.remaining != count * sizeof (rai::block_hash));
+	if (!result)
+	{
+		hashes_a.resize (count);
+		for (auto & i: hashes_a)
+		{
+			reader_a.read (i.bytes);
+		}
+	}
+	else
+	{
+		error = true;
+	}
+	return result;
 }
 
-bool rai::message_parser::at_end (rai::bufferstream & stream_a)
+size_t rai::message_parser::block_size (rai::block_type type_a)
 {
-    uint8_t junk;
-    auto end (rai::read (stream_a, junk));
-    return end;
+	size_t result;
+	switch (type_a)
+	{
+		case rai::block_type::send:
+			result = rai::send_block::size;
+			break;
+		case rai::block_type::receive:
+			result = rai::receive_block::size;
+			break;
+		case rai::block_type::open:
+			result = rai::open_block::size;
+			break;
+		case rai::block_type::change:
+			result = rai::change_block::size;
+			break;
+		default:
+			result = 0;
+			break;
+	}
+	return result;
+}
+
+std::shared_ptr <rai::block> rai::message_parser::read_block (rai::buffer_reader & reader_a, rai::block_type type_a)
+{
+	assert (reader_a.remaining >= block_size (type_a));
+	std::shared_ptr <rai::block> result;
+	rai::signature signature;
+	uint64_t work;
+	switch (type_a)
+	{
+		case rai::block_type::send:
+		{
+			rai::block_hash previous;
+			rai::account destination;
+			rai::amount balance;
+			reader_a.read (previous.bytes);
+			reader_a.read (destination.bytes);
+			reader_a.read (balance.bytes);
+			reader_a.read (signature.bytes);
+			reader_a.read (work);
+			result = std::allocate_shared <rai::send_block> (rai::pool_allocator <rai::send_block> (), previous, destination, balance, signature, work);
+			break;
+		}
+		case rai::block_type::receive:
+		{
+			rai::block_hash previous;
+			rai::block_hash source;
+			reader_a.read (previous.bytes);
+			reader_a.read (source.bytes);
+			reader_a.read (signature.bytes);
+			reader_a.read (work);
+			result = std::allocate_shared <rai::receive_block> (rai::pool_allocator <rai::receive_block> (), previous, source, signature, work);
+			break;
+		}
+		case rai::block_type::open:
+		{
+			rai::block_hash source;
+			rai::account representative;
+			rai::account account;
+			reader_a.read (source.bytes);
+			reader_a.read (representative.bytes);
+			reader_a.read (account.bytes);
+			reader_a.read (signature.bytes);
+			reader_a.read (work);
+			result = std::allocate_shared <rai::open_block> (rai::pool_allocator <rai::open_block> (), source, representative, account, signature, work);
+			break;
+		}
+		case rai::block_type::change:
+		{
+			rai::block_hash previous;
+			rai::account representative;
+			reader_a.read (previous.bytes);
+			reader_a.read (representative.bytes);
+			reader_a.read (signature.bytes);
+			reader_a.read (work);
+			result = std::allocate_shared <rai::change_block> (rai::pool_allocator <rai::change_block> (), previous, representative, signature, work);
+			break;
+		}
+		default:
+			assert (false);
+			break;
+	}
+	return result;
 }
 
 rai::keepalive::keepalive () :
@@ -363,7 +649,7 @@ bool rai::confirm_req::operator == (rai::confirm_req const & other_a) const
 
 rai::confirm_ack::confirm_ack (bool & error_a, rai::stream & stream_a) :
 message (error_a, stream_a),
-vote (error_a, stream_a, block_type ())
+vote (error_a, stream_a, block_type (), hash_count ())
 {
 }
 
@@ -371,7 +657,15 @@ rai::confirm_ack::confirm_ack (rai::vote const & vote_a) :
 message (rai::message_type::confirm_ack),
 vote (vote_a)
 {
-    block_type_set (vote.block->type ());
+	if (vote.hashes.empty ())
+	{
+		block_type_set (vote.block->type ());
+	}
+	else
+	{
+		block_type_set (rai::block_type::not_a_block);
+		hash_count_set (vote.hashes.size ());
+	}
 }
 
 bool rai::confirm_ack::deserialize (rai::stream & stream_a)
@@ -390,8 +684,24 @@ bool rai::confirm_ack::deserialize (rai::stream & stream_a)
                 result = read (stream_a, vote.sequence);
                 if (!result)
                 {
-                    vote.block = rai::deserialize_block (stream_a, block_type ());
-                    result = vote.block == nullptr;
+                    vote.hashes.clear ();
+                    vote.block.reset ();
+                    if (block_type () == rai::block_type::not_a_block)
+                    {
+                        auto count (hash_count ());
+                        result = count == 0 || count > rai::vote::hashes_max;
+                        for (size_t i (0); !result && i < count; ++i)
+                        {
+                            rai::block_hash hash;
+                            result = read (stream_a, hash);
+                            vote.hashes.push_back (hash);
+                        }
+                    }
+                    else
+                    {
+                        vote.block = rai::deserialize_block (stream_a, block_type ());
+                        result = vote.block == nullptr;
+                    }
                 }
             }
         }
@@ -401,17 +711,31 @@ bool rai::confirm_ack::deserialize (rai::stream & stream_a)
 
 void rai::confirm_ack::serialize (rai::stream & stream_a)
 {
-    assert (block_type () == rai::block_type::send || block_type () == rai::block_type::receive || block_type () == rai::block_type::open || block_type () == rai::block_type::change);
+    assert (block_type () == rai::block_type::not_a_block || block_type () == rai::block_type::send || block_type () == rai::block_type::receive || block_type () == rai::block_type::open || block_type () == rai::block_type::change);
 	write_header (stream_a);
     write (stream_a, vote.account);
     write (stream_a, vote.signature);
     write (stream_a, vote.sequence);
-    vote.block->serialize (stream_a);
+    if (block_type () == rai::block_type::not_a_block)
+    {
+        for (auto & i: vote.hashes)
+        {
+            write (stream_a, i);
+        }
+    }
+    else
+    {
+        vote.block->serialize (stream_a);
+    }
 }
 
 bool rai::confirm_ack::operator == (rai::confirm_ack const & other_a) const
 {
-    auto result (vote.account == other_a.vote.account && *vote.block == *other_a.vote.block && vote.signature == other_a.vote.signature && vote.sequence == other_a.vote.sequence);
+    auto result (vote.account == other_a.vote.account && vote.hashes == other_a.vote.hashes && vote.signature == other_a.vote.signature && vote.sequence == other_a.vote.sequence);
+    if (result && vote.hashes.empty ())
+    {
+        result = *vote.block == *other_a.vote.block;
+    }
     return result;
 }
 
@@ -420,6 +744,90 @@ void rai::confirm_ack::visit (rai::message_visitor & visitor_a) const
     visitor_a.confirm_ack (*this);
 }
 
+rai::hash_list_message::hash_list_message (rai::message_type type_a) :
+message (type_a)
+{
+}
+
+rai::hash_list_message::hash_list_message (rai::message_type type_a, std::vector <rai::block_hash> const & hashes_a) :
+message (type_a),
+hashes (hashes_a)
+{
+	assert (!hashes.empty () && hashes.size () <= hashes_max);
+	hash_count_set (hashes.size ());
+}
+
+bool rai::hash_list_message::deserialize (rai::stream & stream_a)
+{
+	auto expected (type);
+	auto result (read_header (stream_a, version_max, version_using, version_min, type, extensions));
+	assert (!result);
+	assert (type == expected);
+	if (!result)
+	{
+		hashes.clear ();
+		auto count (hash_count ());
+		result = type != expected || count == 0 || count > hashes_max;
+		for (size_t i (0); !result && i < count; ++i)
+		{
+			rai::block_hash hash;
+			result = read (stream_a, hash);
+			hashes.push_back (hash);
+		}
+	}
+	return result;
+}
+
+void rai::hash_list_message::serialize (rai::stream & stream_a)
+{
+	assert (hash_count () == hashes.size ());
+	write_header (stream_a);
+	for (auto & i: hashes)
+	{
+		write (stream_a, i);
+	}
+}
+
+rai::announce::announce () :
+hash_list_message (rai::message_type::announce)
+{
+}
+
+rai::announce::announce (std::vector <rai::block_hash> const & hashes_a) :
+hash_list_message (rai::message_type::announce, hashes_a)
+{
+}
+
+void rai::announce::visit (rai::message_visitor & visitor_a) const
+{
+	visitor_a.announce (*this);
+}
+
+bool rai::announce::operator == (rai::announce const & other_a) const
+{
+	return hashes == other_a.hashes;
+}
+
+rai::publish_req::publish_req () :
+hash_list_message (rai::message_type::publish_req)
+{
+}
+
+rai::publish_req::publish_req (std::vector <rai::block_hash> const & hashes_a) :
+hash_list_message (rai::message_type::publish_req, hashes_a)
+{
+}
+
+void rai::publish_req::visit (rai::message_visitor & visitor_a) const
+{
+	visitor_a.publish_req (*this);
+}
+
+bool rai::publish_req::operator == (rai::publish_req const & other_a) const
+{
+	return hashes == other_a.hashes;
+}
+
 rai::frontier_req::frontier_req () :
 message (rai::message_type::frontier_req)
 {
@@ -520,3 +928,43 @@ void rai::bulk_push::visit (rai::message_visitor & visitor_a) const
 {
     visitor_a.bulk_push (*this);
 }
+
+rai::realtime_req::realtime_req () :
+message (rai::message_type::realtime_req),
+port (0)
+{
+}
+
+rai::realtime_req::realtime_req (uint16_t port_a) :
+message (rai::message_type::realtime_req),
+port (port_a)
+{
+}
+
+bool rai::realtime_req::deserialize (rai::stream & stream_a)
+{
+    auto result (read_header (stream_a, version_max, version_using, version_min, type, extensions));
+    assert (!result);
+    assert (rai::message_type::realtime_req == type);
+    if (!result)
+    {
+        result = read (stream_a, port);
+    }
+    return result;
+}
+
+void rai::realtime_req::serialize (rai::stream & stream_a)
+{
+    write_header (stream_a);
+    write (stream_a, port);
+}
+
+void rai::realtime_req::visit (rai::message_visitor & visitor_a) const
+{
+    visitor_a.realtime_req (*this);
+}
+
+bool rai::realtime_req::operator == (rai::realtime_req const & other_a) const
+{
+    return port == other_a.port;
+}
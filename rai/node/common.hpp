@@ -7,6 +7,8 @@
 #include <xxhash/xxhash.h>
 
 #include <bitset>
+#include <memory>
+#include <mutex>
 
 namespace rai
 {
@@ -17,6 +19,20 @@ using tcp_endpoint = boost::asio::ip::tcp::endpoint;
 bool parse_endpoint (std::string const &, rai::endpoint &);
 bool parse_tcp_endpoint (std::string const &, rai::tcp_endpoint &);
 bool reserved_address (rai::endpoint const &);
+class datagram
+{
+public:
+	uint8_t * data;
+	// Capacity going in to receive_batch, length of the datagram coming out
+	size_t size;
+	rai::endpoint endpoint;
+};
+// Whether receive_batch and send_batch move more than one datagram per system call on this platform
+bool batched_io_supported ();
+// Receive up to count datagrams without blocking, returns how many were received and sets would_block once the socket is empty
+size_t receive_batch (boost::asio::ip::udp::socket &, rai::datagram *, size_t, boost::system::error_code &);
+// Send up to count datagrams without blocking, returns how many were sent and sets the error of the first one that wasn't
+size_t send_batch (boost::asio::ip::udp::socket &, rai::datagram const *, size_t, boost::system::error_code &);
 }
 static uint64_t endpoint_hash_raw (rai::endpoint const & endpoint_a)
 {
@@ -91,7 +107,10 @@ enum class message_type : uint8_t
     confirm_ack,
     bulk_pull,
     bulk_push,
-    frontier_req
+    frontier_req,
+    announce,
+    publish_req,
+    realtime_req
 };
 class message_visitor;
 class message
@@ -107,6 +126,9 @@ public:
     virtual void visit (rai::message_visitor &) const = 0;
     rai::block_type block_type () const;
     void block_type_set (rai::block_type);
+    // Number of hashes in a vote-by-hash confirm_ack
+    size_t hash_count () const;
+    void hash_count_set (size_t);
     bool ipv4_only ();
     void ipv4_only_set (bool);
 	static std::array <uint8_t, 2> constexpr magic_number = rai::rai_network == rai::rai_networks::rai_test_network ? std::array <uint8_t, 2>({ 'R', 'A' }) : rai::rai_network == rai::rai_networks::rai_beta_network ? std::array <uint8_t, 2>({ 'R', 'B' }) : std::array <uint8_t, 2>({ 'R', 'C' });
@@ -118,8 +140,34 @@ public:
     static size_t constexpr ipv4_only_position = 1;
     static size_t constexpr bootstrap_server_position = 2;
     static std::bitset <16> constexpr block_type_mask = std::bitset <16> (0x0f00);
+    static std::bitset <16> constexpr hash_count_mask = std::bitset <16> (0xf000);
+    // First protocol version that understands confirm_ack with block type not_a_block carrying block hashes
+    static uint8_t constexpr vote_by_hash_version = 0x04;
+    // First protocol version that understands announce and publish_req
+    static uint8_t constexpr announce_version = 0x05;
+    // First protocol version that accepts realtime_req on the bootstrap port
+    static uint8_t constexpr realtime_version = 0x06;
+};
+// The fixed size header at the start of every message, read straight from a buffer
+class message_header
+{
+public:
+	// Returns true if the buffer is too short or the magic number is wrong
+	bool deserialize (rai::buffer_reader &);
+	// Copy the header onto a message constructed from its payload
+	void apply (rai::message &) const;
+	rai::block_type block_type () const;
+	size_t hash_count () const;
+	uint8_t version_max;
+	uint8_t version_using;
+	uint8_t version_min;
+	rai::message_type type;
+	std::bitset <16> extensions;
+	static size_t constexpr size = sizeof (rai::message::magic_number) + 4 * sizeof (uint8_t) + sizeof (uint16_t);
 };
 class work_pool;
+// Parses realtime messages out of a datagram, the whole length is checked against the header before any field is read
+// Fields are copied straight out of the buffer and blocks come from a pool_allocator
 class message_parser
 {
 public:
@@ -129,11 +177,26 @@ public:
     void deserialize_publish (uint8_t const *, size_t);
     void deserialize_confirm_req (uint8_t const *, size_t);
     void deserialize_confirm_ack (uint8_t const *, size_t);
-    bool at_end (rai::bufferstream &);
+    void deserialize_announce (uint8_t const *, size_t);
+    void deserialize_publish_req (uint8_t const *, size_t);
+    void deserialize_keepalive (rai::message_header const &, rai::buffer_reader &);
+    void deserialize_publish (rai::message_header const &, rai::buffer_reader &);
+    void deserialize_confirm_req (rai::message_header const &, rai::buffer_reader &);
+    void deserialize_confirm_ack (rai::message_header const &, rai::buffer_reader &);
+    void deserialize_announce (rai::message_header const &, rai::buffer_reader &);
+    void deserialize_publish_req (rai::message_header const &, rai::buffer_reader &);
+	// Size of a serialized block of this type, 0 if it isn't a block type
+	static size_t block_size (rai::block_type);
+	// Read a block whose size has already been checked, allocated from a pool
+	static std::shared_ptr <rai::block> read_block (rai::buffer_reader &, rai::block_type);
     rai::message_visitor & visitor;
 	rai::work_pool & pool;
     bool error;
     bool insufficient_work;
+private:
+	bool read_header (rai::buffer_reader &, rai::message_header &, rai::message_type);
+	// Read the hash list of an announce or publish_req, returns true if the count doesn't match the payload
+	bool read_hashes (rai::message_header const &, rai::buffer_reader &, std::vector <rai::block_hash> &);
 };
 class keepalive : public message
 {
@@ -178,6 +241,35 @@ public:
     bool operator == (rai::confirm_ack const &) const;
     rai::vote vote;
 };
+// A message carrying only block hashes, the count is stored in the header extensions
+class hash_list_message : public message
+{
+public:
+    hash_list_message (rai::message_type);
+    hash_list_message (rai::message_type, std::vector <rai::block_hash> const &);
+    bool deserialize (rai::stream &) override;
+    void serialize (rai::stream &) override;
+    std::vector <rai::block_hash> hashes;
+    static size_t constexpr hashes_max = 15;
+};
+// Tells a peer we have these blocks without sending them, it asks for the ones it's missing with publish_req
+class announce : public hash_list_message
+{
+public:
+    announce ();
+    announce (std::vector <rai::block_hash> const &);
+    void visit (rai::message_visitor &) const override;
+    bool operator == (rai::announce const &) const;
+};
+// Asks the peer that announced these hashes to publish the blocks back to us
+class publish_req : public hash_list_message
+{
+public:
+    publish_req ();
+    publish_req (std::vector <rai::block_hash> const &);
+    void visit (rai::message_visitor &) const override;
+    bool operator == (rai::publish_req const &) const;
+};
 class frontier_req : public message
 {
 public:
@@ -209,6 +301,19 @@ public:
     void serialize (rai::stream &) override;
     void visit (rai::message_visitor &) const override;
 };
+// Turns a bootstrap connection into a channel carrying realtime messages both ways
+// Carries the peering port of the sender so the receiver knows which peer the channel belongs to
+class realtime_req : public message
+{
+public:
+    realtime_req ();
+    realtime_req (uint16_t);
+    bool deserialize (rai::stream &) override;
+    void serialize (rai::stream &) override;
+    void visit (rai::message_visitor &) const override;
+    bool operator == (rai::realtime_req const &) const;
+    uint16_t port;
+};
 class message_visitor
 {
 public:
@@ -219,25 +324,40 @@ public:
     virtual void bulk_pull (rai::bulk_pull const &) = 0;
     virtual void bulk_push (rai::bulk_push const &) = 0;
     virtual void frontier_req (rai::frontier_req const &) = 0;
+    virtual void announce (rai::announce const &) = 0;
+    virtual void publish_req (rai::publish_req const &) = 0;
+    virtual void realtime_req (rai::realtime_req const &) = 0;
 };
+// Observers are published as an immutable snapshot that's replaced on add, notification doesn't hold a lock while observers run
 template <typename ... T>
 class observer_set
 {
 public:
+	observer_set () :
+	observers (std::make_shared <std::vector <std::function <void (T...)>>> ())
+	{
+	}
 	void add (std::function <void (T...)> const & observer_a)
 	{
 		std::lock_guard <std::mutex> lock (mutex);
-		observers.push_back (observer_a);
+		auto observers_l (std::make_shared <std::vector <std::function <void (T...)>>> (*std::atomic_load (&observers)));
+		observers_l->push_back (observer_a);
+		std::atomic_store (&observers, std::shared_ptr <std::vector <std::function <void (T...)>> const> (observers_l));
 	}
 	void operator () (T ... args)
 	{
-		std::lock_guard <std::mutex> lock (mutex);
-		for (auto & i: observers)
+		auto observers_l (std::atomic_load (&observers));
+		for (auto & i: *observers_l)
 		{
 			i (args...);
 		}
 	}
+	size_t size ()
+	{
+		return std::atomic_load (&observers)->size ();
+	}
+	// Serializes writers, readers only load the snapshot
 	std::mutex mutex;
-	std::vector <std::function <void (T...)>> observers;
+	std::shared_ptr <std::vector <std::function <void (T...)>> const> observers;
 };
 }
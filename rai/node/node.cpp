@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <future>
 #include <memory>
+#include <numeric>
 #include <sstream>
 #include <thread>
 #include <unordered_set>
@@ -27,2530 +28,5907 @@ double constexpr rai::node::free_cutoff;
 std::chrono::seconds constexpr rai::node::period;
 std::chrono::seconds constexpr rai::node::cutoff;
 std::chrono::minutes constexpr rai::node::backup_interval;
+std::chrono::minutes constexpr rai::node::wallet_reps_interval;
+size_t constexpr rai::node::confirm_batch;
 int constexpr rai::port_mapping::mapping_timeout;
 int constexpr rai::port_mapping::check_timeout;
 unsigned constexpr rai::active_transactions::announce_interval_ms;
+size_t constexpr rai::active_transactions::blocks_max;
+size_t constexpr rai::gap_cache::voters_max;
+size_t constexpr rai::datagram_batch::max;
+size_t constexpr rai::send_queue::peer_share;
+size_t constexpr rai::send_queue::batch_max;
+size_t constexpr rai::send_queue::burst_min;
+size_t constexpr rai::receive_queue::max;
+std::chrono::minutes constexpr rai::send_queue::idle_cutoff;
+size_t constexpr rai::alarm::slot_bits;
+size_t constexpr rai::alarm::slots;
+size_t constexpr rai::alarm::levels;
+std::chrono::milliseconds constexpr rai::alarm::tick_length;
+size_t constexpr rai::block_processor::work_values_max;
+size_t constexpr rai::block_processor::batch_max;
+size_t constexpr rai::signature_checker::chunk_size;
+size_t constexpr rai::vote_processor::max_votes;
+size_t constexpr rai::vote_generator::max_hashes;
+size_t constexpr rai::dependency_graph::entry_overhead;
+size_t constexpr rai::dependency_graph::bytes_max_default;
+size_t constexpr rai::publish_req_limiter::max;
+size_t constexpr rai::vote_processor::batch_max;
+size_t constexpr rai::vote_cache::max;
+std::chrono::seconds constexpr rai::vote_cache::max_age;
+size_t constexpr rai::pull_cache::max;
+size_t constexpr rai::pull_cache::sources_max;
+unsigned constexpr rai::pull_cache::attempts_max;
+std::chrono::milliseconds constexpr rai::pull_cache::retry_interval;
+unsigned constexpr rai::vote_generator::wait_ms;
+std::chrono::seconds constexpr rai::online_reps::window;
+size_t constexpr rai::peer_container::contacts_max;
+std::chrono::seconds constexpr rai::peer_container::contacts_interval;
+size_t constexpr rai::realtime_channel::queue_max;
+std::chrono::seconds constexpr rai::realtime_channel::write_cutoff;
+std::chrono::seconds constexpr rai::realtime_channel::idle_cutoff;
+size_t constexpr rai::realtime_channels::max;
+size_t constexpr rai::realtime_channels::inbound_max;
+std::chrono::seconds constexpr rai::realtime_channels::connect_interval;
+size_t constexpr rai::peer_traffic_table::shard_count;
 
 rai::message_statistics::message_statistics () :
 keepalive (0),
 publish (0),
 confirm_req (0),
-confirm_ack (0)
+confirm_ack (0),
+announce (0),
+publish_req (0)
 {
 }
 
-rai::network::network (rai::node & node_a, uint16_t port) :
-socket (node_a.service, rai::endpoint (boost::asio::ip::address_v6::any (), port)),
-resolver (node_a.service),
-node (node_a),
-bad_sender_count (0),
-on (true),
-insufficient_work_count (0),
-error_count (0)
+void rai::message_statistics::serialize (boost::property_tree::ptree & tree_a)
 {
+	tree_a.put ("keepalive", std::to_string (keepalive));
+	tree_a.put ("publish", std::to_string (publish));
+	tree_a.put ("confirm_req", std::to_string (confirm_req));
+	tree_a.put ("confirm_ack", std::to_string (confirm_ack));
+	tree_a.put ("announce", std::to_string (announce));
+	tree_a.put ("publish_req", std::to_string (publish_req));
+	boost::property_tree::ptree classes_l;
+	for (size_t i (0); i < classes.size (); ++i)
+	{
+		boost::property_tree::ptree entry;
+		classes [i].serialize (entry);
+		classes_l.add_child (rai::traffic_class_name (static_cast <rai::traffic_class> (i)), entry);
+	}
+	tree_a.add_child ("classes", classes_l);
 }
 
-void rai::network::receive ()
+rai::traffic_statistics::traffic_statistics () :
+queued (0),
+dropped (0)
 {
-    if (node.config.logging.network_packet_logging ())
-    {
-        BOOST_LOG (node.log) << "Receiving packet";
-    }
-    std::unique_lock <std::mutex> lock (socket_mutex);
-    socket.async_receive_from (boost::asio::buffer (buffer.data (), buffer.size ()), remote, [this] (boost::system::error_code const & error, size_t size_a)
-	{
-		receive_action (error, size_a);
-	});
 }
 
-void rai::network::stop ()
+void rai::traffic_statistics::add_latency (std::chrono::steady_clock::duration const & latency_a)
 {
-    on = false;
-    socket.close ();
-    resolver.cancel ();
+	std::lock_guard <std::mutex> lock (mutex);
+	latency.add (std::chrono::duration_cast <std::chrono::microseconds> (latency_a).count ());
 }
 
-void rai::network::send_keepalive (rai::endpoint const & endpoint_a)
+void rai::traffic_statistics::serialize (boost::property_tree::ptree & tree_a)
 {
-    assert (endpoint_a.address ().is_v6 ());
-    rai::keepalive message;
-    node.peers.random_fill (message.peers);
-    std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
-    {
-        rai::vectorstream stream (*bytes);
-        message.serialize (stream);
-    }
-    if (node.config.logging.network_keepalive_logging ())
-    {
-        BOOST_LOG (node.log) << boost::str (boost::format ("Keepalive req sent to %1%") % endpoint_a);
-    }
-    ++outgoing.keepalive;
-	std::weak_ptr <rai::node> node_w (node.shared ());
-    send_buffer (bytes->data (), bytes->size (), endpoint_a, [bytes, node_w, endpoint_a] (boost::system::error_code const & ec, size_t)
+	tree_a.put ("queued", std::to_string (queued));
+	tree_a.put ("dropped", std::to_string (dropped));
+	boost::property_tree::ptree latency_l;
 	{
-		if (auto node_l = node_w.lock ())
-		{
-			if (node_l->config.logging.network_keepalive_logging ())
-			{
-				if (ec)
-				{
-					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending keepalive to %1% %2%") % endpoint_a % ec.message ());
-				}
-			}
-		}
-	});
+		std::lock_guard <std::mutex> lock (mutex);
+		latency.serialize (latency_l);
+	}
+	tree_a.add_child ("latency", latency_l);
 }
 
-void rai::node::keepalive (std::string const & address_a, uint16_t port_a)
+rai::traffic_class rai::traffic_class_of (rai::message_type type_a)
 {
-	auto node_l (shared_from_this ());
-	network.resolver.async_resolve (boost::asio::ip::udp::resolver::query (address_a, std::to_string (port_a)), [node_l, address_a, port_a] (boost::system::error_code const & ec, boost::asio::ip::udp::resolver::iterator i_a)
+	rai::traffic_class result;
+	switch (type_a)
 	{
-		if (!ec)
-		{
-			for (auto i (i_a), n (boost::asio::ip::udp::resolver::iterator {}); i != n; ++i)
-			{
-			    auto endpoint (i->endpoint ());
-			    if (endpoint.address ().is_v4 ())
-			    {
-					endpoint = rai::endpoint (boost::asio::ip::address_v6::v4_mapped (endpoint.address ().to_v4 ()), endpoint.port ());
-			    }
-				node_l->send_keepalive (endpoint);
-			}
-		}
-		else
-		{
-			BOOST_LOG (node_l->log) << boost::str (boost::format ("Error resolving address: %1%:%2%, %3%") % address_a % port_a % ec.message ());
-		}
-	});
+		case rai::message_type::confirm_req:
+		case rai::message_type::confirm_ack:
+			result = rai::traffic_class::vote;
+			break;
+		case rai::message_type::publish:
+		case rai::message_type::announce:
+		case rai::message_type::publish_req:
+			result = rai::traffic_class::publish;
+			break;
+		default:
+			result = rai::traffic_class::keepalive;
+			break;
+	}
+	return result;
 }
 
-void rai::network::republish (rai::block_hash const & hash_a, std::shared_ptr <std::vector <uint8_t>> buffer_a, rai::endpoint endpoint_a)
+char const * rai::traffic_class_name (rai::traffic_class class_a)
 {
-	++outgoing.publish;
-	if (node.config.logging.network_publish_logging ())
+	char const * result;
+	switch (class_a)
 	{
-		BOOST_LOG (node.log) << boost::str (boost::format ("Publishing %1% to %2%") % hash_a.to_string () % endpoint_a);
+		case rai::traffic_class::vote:
+			result = "vote";
+			break;
+		case rai::traffic_class::publish:
+			result = "publish";
+			break;
+		default:
+			result = "keepalive";
+			break;
 	}
-    std::weak_ptr <rai::node> node_w (node.shared ());
-	send_buffer (buffer_a->data (), buffer_a->size (), endpoint_a, [buffer_a, node_w, endpoint_a] (boost::system::error_code const & ec, size_t size)
-	{
-		if (auto node_l = node_w.lock ())
-		{
-			if (node_l->config.logging.network_logging ())
-			{
-				if (ec)
-				{
-					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending publish: %1% to %2%") % ec.message () % endpoint_a);
-				}
-			}
-		}
-	});
+	return result;
 }
 
-void rai::network::rebroadcast_reps (std::shared_ptr <rai::block> block_a)
+rai::message_type rai::datagram_type (uint8_t const * data_a, size_t size_a)
 {
-	auto hash (block_a->hash ());
-	rai::publish message (block_a);
-	std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+	// Magic number and three version bytes come before the type in the header
+	return size_a > 5 ? static_cast <rai::message_type> (data_a [5]) : rai::message_type::invalid;
+}
+
+char const * rai::message_type_name (rai::message_type type_a)
+{
+	char const * result;
+	switch (type_a)
 	{
-		rai::vectorstream stream (*bytes);
-		message.serialize (stream);
+		case rai::message_type::not_a_type:
+			result = "not_a_type";
+			break;
+		case rai::message_type::keepalive:
+			result = "keepalive";
+			break;
+		case rai::message_type::publish:
+			result = "publish";
+			break;
+		case rai::message_type::confirm_req:
+			result = "confirm_req";
+			break;
+		case rai::message_type::confirm_ack:
+			result = "confirm_ack";
+			break;
+		case rai::message_type::bulk_pull:
+			result = "bulk_pull";
+			break;
+		case rai::message_type::bulk_push:
+			result = "bulk_push";
+			break;
+		case rai::message_type::frontier_req:
+			result = "frontier_req";
+			break;
+		case rai::message_type::announce:
+			result = "announce";
+			break;
+		case rai::message_type::publish_req:
+			result = "publish_req";
+			break;
+		case rai::message_type::realtime_req:
+			result = "realtime_req";
+			break;
+		default:
+			result = "invalid";
+			break;
 	}
-	auto representatives (node.peers.representatives (2 * node.peers.size_sqrt ()));
-	for (auto i : representatives)
+	return result;
+}
+
+char const * rai::peer_drop_name (rai::peer_drop reason_a)
+{
+	char const * result;
+	switch (reason_a)
 	{
-		republish (hash, bytes, i.endpoint);
+		case rai::peer_drop::receive_queue_full:
+			result = "receive_queue_full";
+			break;
+		case rai::peer_drop::send_queue_full:
+			result = "send_queue_full";
+			break;
+		case rai::peer_drop::parse_error:
+			result = "parse_error";
+			break;
+		case rai::peer_drop::insufficient_work:
+			result = "insufficient_work";
+			break;
+		default:
+			result = "send_error";
+			break;
 	}
+	return result;
 }
 
-template <typename T>
-bool confirm_block (rai::node & node_a, T & list_a, std::shared_ptr <rai::block> block_a)
+rai::peer_traffic::peer_traffic ()
 {
-    bool result (false);
-	if (node_a.config.enable_voting)
+	messages_in.fill (0);
+	bytes_in.fill (0);
+	messages_out.fill (0);
+	bytes_out.fill (0);
+	dropped.fill (0);
+}
+
+uint64_t rai::peer_traffic::total (std::array <uint64_t, rai::message_types> const & counts_a)
+{
+	return std::accumulate (counts_a.begin (), counts_a.end (), uint64_t (0));
+}
+
+uint64_t rai::peer_traffic::dropped_total () const
+{
+	return std::accumulate (dropped.begin (), dropped.end (), uint64_t (0));
+}
+
+void rai::peer_traffic::serialize (boost::property_tree::ptree & tree_a) const
+{
+	tree_a.put ("messages_in", std::to_string (total (messages_in)));
+	tree_a.put ("bytes_in", std::to_string (total (bytes_in)));
+	tree_a.put ("messages_out", std::to_string (total (messages_out)));
+	tree_a.put ("bytes_out", std::to_string (total (bytes_out)));
+	tree_a.put ("dropped", std::to_string (dropped_total ()));
+	boost::property_tree::ptree types_l;
+	for (size_t i (0); i < rai::message_types; ++i)
 	{
-		rai::transaction transaction (node_a.store.environment, nullptr, false);
-		node_a.wallets.foreach_representative (transaction, [&result, &block_a, &list_a, &node_a, &transaction] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
+		if (messages_in [i] != 0 || messages_out [i] != 0)
 		{
-			result = true;
-			auto sequence (node_a.store.sequence_atomic_inc (transaction, pub_a));
-			rai::vote vote (pub_a, prv_a, sequence, block_a);
-			rai::confirm_ack confirm (vote);
-			std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
-			{
-				rai::vectorstream stream (*bytes);
-				confirm.serialize (stream);
-			}
-			for (auto j (list_a.begin ()), m (list_a.end ()); j != m; ++j)
-			{
-				node_a.network.confirm_send (confirm, bytes, *j);
-			}
-		});
+			boost::property_tree::ptree entry;
+			entry.put ("messages_in", std::to_string (messages_in [i]));
+			entry.put ("bytes_in", std::to_string (bytes_in [i]));
+			entry.put ("messages_out", std::to_string (messages_out [i]));
+			entry.put ("bytes_out", std::to_string (bytes_out [i]));
+			types_l.add_child (rai::message_type_name (static_cast <rai::message_type> (i)), entry);
+		}
 	}
-    return result;
+	tree_a.add_child ("types", types_l);
+	boost::property_tree::ptree drops_l;
+	for (size_t i (0); i < rai::peer_drop_reasons; ++i)
+	{
+		drops_l.put (rai::peer_drop_name (static_cast <rai::peer_drop> (i)), std::to_string (dropped [i]));
+	}
+	tree_a.add_child ("drops", drops_l);
 }
 
-template <>
-bool confirm_block (rai::node & node_a, rai::endpoint & peer_a, std::shared_ptr <rai::block> block_a)
+rai::peer_traffic_table::peer_traffic_table (size_t entries_max_a) :
+entries_max (entries_max_a),
+entries (0)
 {
-	std::array <rai::endpoint, 1> endpoints;
-	endpoints [0] = peer_a;
-	auto result (confirm_block (node_a, endpoints, std::move (block_a)));
-	return result;
 }
 
-void rai::network::republish_block (std::shared_ptr <rai::block> block)
+size_t rai::peer_traffic_table::type_index (uint8_t const * data_a, size_t size_a)
 {
-	rebroadcast_reps (block);
-	auto hash (block->hash ());
-	auto list (node.peers.list_sqrt ());
-	// If we're a representative, broadcast a signed confirm, otherwise an unsigned publish
-    if (!confirm_block (node, list, block))
-    {
-        rai::publish message (block);
-        std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
-        {
-            rai::vectorstream stream (*bytes);
-            message.serialize (stream);
-        }
-		auto hash (block->hash ());
-        for (auto i (list.begin ()), n (list.end ()); i != n; ++i)
-        {
-			republish (hash, bytes, *i);
-        }
-		if (node.config.logging.network_logging ())
-		{
-			BOOST_LOG (node.log) << boost::str (boost::format ("Block %1% was republished to peers") % hash.to_string ());
-		}
-    }
+	auto result (static_cast <size_t> (rai::datagram_type (data_a, size_a)));
+	return result < rai::message_types ? result : static_cast <size_t> (rai::message_type::invalid);
+}
+
+rai::peer_traffic & rai::peer_traffic_table::find (rai::endpoint const & endpoint_a, std::unique_lock <std::mutex> & lock_a)
+{
+	auto & shard (shards [std::hash <rai::endpoint> () (endpoint_a) % shard_count]);
+	lock_a = std::unique_lock <std::mutex> (shard.mutex);
+	rai::peer_traffic * result;
+	auto existing (shard.peers.find (endpoint_a));
+	if (existing != shard.peers.end ())
+	{
+		result = &existing->second;
+	}
 	else
 	{
-		if (node.config.logging.network_logging ())
+		// Shards insert concurrently, only claim a slot if the count is still below the limit
+		auto entries_l (entries.load ());
+		while (entries_l < entries_max && !entries.compare_exchange_weak (entries_l, entries_l + 1))
+		{
+		}
+		if (entries_l < entries_max)
 		{
-			BOOST_LOG (node.log) << boost::str (boost::format ("Block %1% was confirmed to peers") % hash.to_string ());
+			result = &shard.peers [endpoint_a];
+		}
+		else
+		{
+			lock_a = std::unique_lock <std::mutex> (overflow_mutex);
+			result = &overflow;
 		}
 	}
+	result->last_seen = std::chrono::steady_clock::now ();
+	return *result;
 }
 
-// In order to rate limit network traffic we republish:
-// 1) Only if they are a non-replay vote of a block that's actively settling. Settling blocks are limited by block PoW
-// 2) Only if a vote for this block hasn't been received in the previous X second.  This prevents rapid publishing of votes with increasing sequence numbers.
-// 3) The rep has a weight > Y to prevent creating a lot of small-weight accounts to send out votes
-void rai::network::republish_vote (std::chrono::system_clock::time_point const & last_vote, rai::vote const & vote_a)
+void rai::peer_traffic_table::received (rai::endpoint const & endpoint_a, uint8_t const * data_a, size_t size_a)
+{
+	auto index (type_index (data_a, size_a));
+	std::unique_lock <std::mutex> lock;
+	auto & traffic (find (endpoint_a, lock));
+	++traffic.messages_in [index];
+	traffic.bytes_in [index] += size_a;
+}
+
+void rai::peer_traffic_table::sent (rai::endpoint const & endpoint_a, uint8_t const * data_a, size_t size_a)
+{
+	auto index (type_index (data_a, size_a));
+	std::unique_lock <std::mutex> lock;
+	auto & traffic (find (endpoint_a, lock));
+	++traffic.messages_out [index];
+	traffic.bytes_out [index] += size_a;
+}
+
+void rai::peer_traffic_table::dropped (rai::endpoint const & endpoint_a, rai::peer_drop reason_a)
+{
+	std::unique_lock <std::mutex> lock;
+	auto & traffic (find (endpoint_a, lock));
+	++traffic.dropped [static_cast <size_t> (reason_a)];
+}
+
+void rai::peer_traffic_table::purge (std::chrono::steady_clock::time_point const & cutoff_a)
 {
-	if (last_vote < std::chrono::system_clock::now () - std::chrono::seconds (1))
+	for (auto & i: shards)
 	{
-		if (node.weight (vote_a.account) > rai::Mxrb_ratio * 256)
+		std::lock_guard <std::mutex> lock (i.mutex);
+		for (auto j (i.peers.begin ()), n (i.peers.end ()); j != n;)
 		{
-			rai::confirm_ack confirm (vote_a);
-			std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+			if (j->second.last_seen < cutoff_a)
 			{
-				rai::vectorstream stream (*bytes);
-				confirm.serialize (stream);
+				j = i.peers.erase (j);
+				--entries;
 			}
-			auto list (node.peers.list_sqrt ());
-			for (auto j (list.begin ()), m (list.end ()); j != m; ++j)
+			else
 			{
-				node.network.confirm_send (confirm, bytes, *j);
+				++j;
 			}
 		}
 	}
 }
 
-void rai::network::broadcast_confirm_req (std::shared_ptr <rai::block> block_a)
+std::vector <std::pair <rai::endpoint, rai::peer_traffic>> rai::peer_traffic_table::list ()
 {
-	auto list (node.peers.representatives (std::numeric_limits <size_t>::max ()));
-	for (auto i (list.begin ()), j (list.end ()); i != j; ++i)
+	std::vector <std::pair <rai::endpoint, rai::peer_traffic>> result;
+	result.reserve (entries + 1);
+	for (auto & i: shards)
 	{
-		node.network.send_confirm_req (i->endpoint, block_a);
+		std::lock_guard <std::mutex> lock (i.mutex);
+		result.insert (result.end (), i.peers.begin (), i.peers.end ());
 	}
-    if (node.config.logging.network_logging ())
-    {
-        BOOST_LOG (node.log) << boost::str (boost::format ("Broadcasted confirm req to %1% representatives") % list.size ());
-    }
+	std::lock_guard <std::mutex> lock (overflow_mutex);
+	if (overflow.last_seen != std::chrono::steady_clock::time_point ())
+	{
+		result.push_back (std::make_pair (rai::endpoint (), overflow));
+	}
+	return result;
 }
 
-void rai::network::send_confirm_req (rai::endpoint const & endpoint_a, std::shared_ptr <rai::block> block)
+size_t rai::peer_traffic_table::size ()
 {
-    rai::confirm_req message (block);
-    std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
-    {
-        rai::vectorstream stream (*bytes);
-        message.serialize (stream);
-    }
-    if (node.config.logging.network_message_logging ())
-    {
-        BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm req to %1%") % endpoint_a);
-    }
-    std::weak_ptr <rai::node> node_w (node.shared ());
-	++outgoing.confirm_req;
-    send_buffer (bytes->data (), bytes->size (), endpoint_a, [bytes, node_w] (boost::system::error_code const & ec, size_t size)
+	return entries;
+}
+
+rai::traffic_scheduler::traffic_scheduler (std::array <unsigned, rai::traffic_classes> const & weights_a) :
+weights (weights_a),
+credits (weights_a)
+{
+}
+
+bool rai::traffic_scheduler::next (std::array <bool, rai::traffic_classes> const & pending_a, rai::traffic_class & class_a)
+{
+	auto result (true);
+	for (auto round (0); round < 2 && result; ++round)
 	{
-		if (auto node_l = node_w.lock ())
+		for (size_t i (0); i < credits.size () && result; ++i)
 		{
-			if (node_l->config.logging.network_logging ())
+			if (pending_a [i] && credits [i] > 0)
 			{
-				if (ec)
-				{
-					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending confirm request: %1%") % ec.message ());
-				}
+				--credits [i];
+				class_a = static_cast <rai::traffic_class> (i);
+				result = false;
 			}
 		}
-	});
+		if (result)
+		{
+			// Every pending class used up its turns, start a new round
+			credits = weights;
+		}
+	}
+	return result;
 }
 
-template <typename T>
-void rep_query (rai::node & node_a, T const & peers_a)
+namespace
 {
-	rai::transaction transaction (node_a.store.environment, nullptr, false);
-	std::shared_ptr <rai::block> block (node_a.store.block_random (transaction));
-	auto hash (block->hash ());
-	node_a.rep_crawler.add (hash);
-	for (auto i (peers_a.begin ()), n (peers_a.end ()); i != n; ++i)
+#ifdef SO_REUSEPORT
+using reuse_port = boost::asio::detail::socket_option::boolean <SOL_SOCKET, SO_REUSEPORT>;
+#endif
+void open_peering_socket (boost::asio::ip::udp::socket & socket_a, uint16_t port_a, bool shared_a)
+{
+	rai::endpoint endpoint (boost::asio::ip::address_v6::any (), port_a);
+	socket_a.open (endpoint.protocol ());
+#ifdef SO_REUSEPORT
+	if (shared_a)
 	{
-		node_a.peers.rep_request (*i);
-		node_a.network.send_confirm_req (*i, block);
+		socket_a.set_option (reuse_port (true));
 	}
-	std::weak_ptr <rai::node> node_w (node_a.shared ());
-	node_a.alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (5), [node_w, hash] ()
+#endif
+	socket_a.bind (endpoint);
+}
+boost::property_tree::ptree traffic_weights_tree (std::array <unsigned, rai::traffic_classes> const & weights_a)
+{
+	boost::property_tree::ptree result;
+	for (size_t i (0); i < weights_a.size (); ++i)
 	{
-		if (auto node_l = node_w.lock ())
-		{
-			node_l->rep_crawler.remove (hash);
-		}
-	});
+		result.put (rai::traffic_class_name (static_cast <rai::traffic_class> (i)), std::to_string (weights_a [i]));
+	}
+	return result;
+}
 }
 
-template <>
-void rep_query (rai::node & node_a, rai::endpoint const & peers_a)
+rai::datagram_batch::datagram_batch ()
 {
-	std::array <rai::endpoint, 1> peers;
-	peers [0] = peers_a;
-	rep_query (node_a, peers);
+	for (size_t i (0); i < max; ++i)
+	{
+		datagrams [i].data = buffers [i].data ();
+		datagrams [i].size = buffers [i].size ();
+	}
 }
 
-namespace
-{
-class network_message_visitor : public rai::message_visitor
+rai::udp_receiver::udp_receiver (rai::network & network_a, uint16_t port_a) :
+network (network_a),
+socket (network_a.node.service)
 {
-public:
-    network_message_visitor (rai::node & node_a, rai::endpoint const & sender_a) :
-    node (node_a),
-    sender (sender_a)
-    {
-    }
-    void keepalive (rai::keepalive const & message_a) override
-    {
-        if (node.config.logging.network_keepalive_logging ())
-        {
-            BOOST_LOG (node.log) << boost::str (boost::format ("Received keepalive message from %1%") % sender);
-        }
-        ++node.network.incoming.keepalive;
-        node.peers.contacted (sender, message_a.version_using);
-        node.network.merge_peers (message_a.peers);
-    }
-    void publish (rai::publish const & message_a) override
-    {
-        if (node.config.logging.network_message_logging ())
-        {
-            BOOST_LOG (node.log) << boost::str (boost::format ("Publish message from %1% for %2%") % sender % message_a.block->hash ().to_string ());
-        }
-        ++node.network.incoming.publish;
-        node.peers.contacted (sender, message_a.version_using);
-        node.peers.insert (sender, message_a.version_using);
-        node.process_receive_republish (message_a.block);
-    }
-    void confirm_req (rai::confirm_req const & message_a) override
-    {
-        if (node.config.logging.network_message_logging ())
-        {
-            BOOST_LOG (node.log) << boost::str (boost::format ("Confirm_req message from %1% for %2%") % sender % message_a.block->hash ().to_string ());
-        }
-        ++node.network.incoming.confirm_req;
-        node.peers.contacted (sender, message_a.version_using);
-        node.peers.insert (sender, message_a.version_using);
-        node.process_receive_republish (message_a.block);
-		if (node.ledger.block_exists (message_a.block->hash ()))
-        {
-            confirm_block (node, sender, message_a.block);
-        }
-    }
-    void confirm_ack (rai::confirm_ack const & message_a) override
-    {
-        if (node.config.logging.network_message_logging ())
-        {
-            BOOST_LOG (node.log) << boost::str (boost::format ("Received confirm_ack message from %1% for %2%") % sender % message_a.vote.block->hash ().to_string ());
-        }
-        ++node.network.incoming.confirm_ack;
-        node.peers.contacted (sender, message_a.version_using);
-        node.peers.insert (sender, message_a.version_using);
-        node.process_receive_republish (message_a.vote.block);
-        node.vote_processor.vote (message_a.vote, sender);
-    }
-    void bulk_pull (rai::bulk_pull const &) override
-    {
-        assert (false);
-    }
-    void bulk_push (rai::bulk_push const &) override
-    {
-        assert (false);
-    }
-    void frontier_req (rai::frontier_req const &) override
-    {
-        assert (false);
-    }
-    rai::node & node;
-    rai::endpoint sender;
-};
+	open_peering_socket (socket, port_a, true);
 }
 
-void rai::network::receive_action (boost::system::error_code const & error, size_t size_a)
+void rai::udp_receiver::receive ()
 {
-    if (!error && on)
-    {
-        if (!rai::reserved_address (remote) && remote != endpoint ())
-        {
-            network_message_visitor visitor (node, remote);
-            rai::message_parser parser (visitor, node.work);
-            parser.deserialize_buffer (buffer.data (), size_a);
-            if (parser.error)
-            {
-                ++error_count;
-            }
-            else if (parser.insufficient_work)
-            {
-                if (node.config.logging.insufficient_work_logging ())
-                {
-                    BOOST_LOG (node.log) << "Insufficient work in message";
-                }
-                ++insufficient_work_count;
-            }
-        }
-        else
-        {
-            if (node.config.logging.network_logging ())
-            {
-                BOOST_LOG (node.log) << boost::str (boost::format ("Reserved sender %1%") % remote.address ().to_string ());
-            }
-            ++bad_sender_count;
-        }
-        receive ();
-    }
-	else
+	if (network.batching)
 	{
-		if (error)
+		socket.async_receive (boost::asio::null_buffers (), [this] (boost::system::error_code const & error, size_t)
 		{
-			if (node.config.logging.network_logging ())
-			{
-				BOOST_LOG (node.log) << boost::str (boost::format ("UDP Receive error: %1%") % error.message ());
-			}
-		}
-		if (on)
+			receive_ready (error);
+		});
+	}
+	else
+	{
+		socket.async_receive_from (boost::asio::buffer (buffer.data (), buffer.size ()), remote, [this] (boost::system::error_code const & error, size_t size_a)
 		{
-			node.alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (5), [this] () { receive (); });
-		}
+			receive_action (error, size_a);
+		});
 	}
 }
 
-// Send keepalives to all the peers we've been notified of
-void rai::network::merge_peers (std::array <rai::endpoint, 8> const & peers_a)
+void rai::udp_receiver::receive_ready (boost::system::error_code const & error)
 {
-    for (auto i (peers_a.begin ()), j (peers_a.end ()); i != j; ++i)
-    {
-        if (!node.peers.not_a_peer (*i) && !node.peers.known_peer (*i))
-        {
-            send_keepalive (*i);
-        }
-    }
+	if (!error && network.on)
+	{
+		network.drain (socket, batch);
+		receive ();
+	}
+	else
+	{
+		receive_action (error, 0);
+	}
 }
 
-bool rai::operation::operator > (rai::operation const & other_a) const
+void rai::udp_receiver::receive_action (boost::system::error_code const & error, size_t size_a)
 {
-    return wakeup > other_a.wakeup;
+	if (!error && network.on)
+	{
+		++network.receive_syscalls;
+		++network.datagrams_received;
+		network.receive_packet (buffer.data (), size_a, remote);
+		receive ();
+	}
+	else
+	{
+		if (error && network.node.config.logging.network_logging ())
+		{
+			BOOST_LOG (network.node.log) << boost::str (boost::format ("UDP Receive error: %1%") % error.message ());
+		}
+		if (network.on)
+		{
+			network.node.alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (5), [this] () { receive (); });
+		}
+	}
 }
 
-rai::alarm::alarm (boost::asio::io_service & service_a) :
-service (service_a),
-thread ([this] () { run (); })
-{
+rai::network::network (rai::node & node_a, uint16_t port) :
+socket (node_a.service),
+resolver (node_a.service),
+node (node_a),
+transport (node_a.config.transport),
+batching (node_a.config.batched_io),
+receive_syscalls (0),
+send_syscalls (0),
+datagrams_received (0),
+datagrams_sent (0),
+bad_sender_count (0),
+on (true),
+insufficient_work_count (0),
+error_count (0),
+publish_req_limits (node_a.config.publish_req_rate),
+send_queue (*this, node_a.config.bandwidth_limit, node_a.config.peer_bandwidth_limit, node_a.config.send_queue_memory, node_a.config.traffic_weights),
+receive_queue (*this, node_a.config.traffic_weights, node_a.config.receive_threads)
+{
+	auto sockets (node.config.peering_sockets);
+#ifndef SO_REUSEPORT
+	if (sockets > 1)
+	{
+		BOOST_LOG (node.log) << "SO_REUSEPORT isn't supported on this platform, using a single peering socket";
+		sockets = 1;
+	}
+#endif
+	if (batching && !rai::batched_io_supported ())
+	{
+		BOOST_LOG (node.log) << "Batched datagram I/O isn't supported on this platform, using one system call per datagram";
+		batching = false;
+	}
+	if (transport == nullptr)
+	{
+		open_peering_socket (socket, port, sockets > 1);
+		// Port 0 picks an ephemeral port, the other sockets share whichever was chosen
+		auto port_l (socket.local_endpoint ().port ());
+		for (unsigned i (1); i < sockets; ++i)
+		{
+			receivers.push_back (std::unique_ptr <rai::udp_receiver> (new rai::udp_receiver (*this, port_l)));
+		}
+	}
 }
 
-rai::alarm::~alarm ()
+void rai::network::start ()
 {
-	add (std::chrono::system_clock::now (), nullptr);
-	thread.join ();
+	if (transport != nullptr)
+	{
+		transport->start (*this);
+	}
+	else
+	{
+		receive ();
+		for (auto & i: receivers)
+		{
+			i->receive ();
+		}
+	}
 }
 
-void rai::alarm::run ()
+void rai::network::receive ()
 {
-    std::unique_lock <std::mutex> lock (mutex);
-	auto done (false);
-    while (!done)
+    if (node.config.logging.network_packet_logging ())
     {
-        if (!operations.empty ())
-        {
-            auto & operation (operations.top ());
-			if (operation.function)
-			{
-				if (operation.wakeup <= std::chrono::system_clock::now ())
-				{
-					service.post (operation.function);
-					operations.pop ();
-				}
-				else
-				{
-					auto wakeup (operation.wakeup);
-					condition.wait_until (lock, wakeup);
-				}
-			}
-			else
-			{
-				done = true;
-			}
-        }
-        else
-        {
-            condition.wait (lock);
-        }
+        BOOST_LOG (node.log) << "Receiving packet";
     }
+    std::unique_lock <std::mutex> lock (socket_mutex);
+	if (batching)
+	{
+		// Wait for the socket to be readable and drain it ourselves
+		socket.async_receive (boost::asio::null_buffers (), [this] (boost::system::error_code const & error, size_t)
+		{
+			receive_ready (error);
+		});
+	}
+	else
+	{
+		socket.async_receive_from (boost::asio::buffer (buffer.data (), buffer.size ()), remote, [this] (boost::system::error_code const & error, size_t size_a)
+		{
+			receive_action (error, size_a);
+		});
+	}
 }
 
-void rai::alarm::add (std::chrono::system_clock::time_point const & wakeup_a, std::function <void ()> const & operation)
+void rai::network::receive_ready (boost::system::error_code const & error)
 {
-    std::lock_guard <std::mutex> lock (mutex);
-	operations.push (rai::operation ({wakeup_a, operation}));
-	condition.notify_all ();
+	if (!error && on)
+	{
+		drain (socket, batch);
+		receive ();
+	}
+	else
+	{
+		receive_action (error, 0);
+	}
 }
 
-rai::logging::logging () :
-ledger_logging_value (false),
-ledger_duplicate_logging_value (false),
-vote_logging_value (false),
-network_logging_value (true),
-network_message_logging_value (false),
-network_publish_logging_value (false),
-network_packet_logging_value (false),
-network_keepalive_logging_value (false),
-node_lifetime_tracing_value (false),
-insufficient_work_logging_value (true),
-log_rpc_value (true),
-bulk_pull_logging_value (false),
-work_generation_time_value (true),
-log_to_cerr_value (false),
-max_size (16 * 1024 * 1024)
+void rai::network::drain (boost::asio::ip::udp::socket & socket_a, rai::datagram_batch & batch_a)
 {
+	// Bounded so one busy socket doesn't hold an io thread forever, the socket is still readable when we rearm
+	auto remaining (16);
+	auto done (false);
+	while (!done && on && remaining > 0)
+	{
+		// Sizes come back as the received lengths, reset them to the buffer capacity
+		for (size_t i (0); i < batch_a.datagrams.size (); ++i)
+		{
+			batch_a.datagrams [i].size = batch_a.buffers [i].size ();
+		}
+		boost::system::error_code ec;
+		auto count (rai::receive_batch (socket_a, batch_a.datagrams.data (), batch_a.datagrams.size (), ec));
+		++receive_syscalls;
+		datagrams_received += count;
+		for (size_t i (0); i < count; ++i)
+		{
+			receive_packet (batch_a.datagrams [i].data, batch_a.datagrams [i].size, batch_a.datagrams [i].endpoint);
+		}
+		// A short batch means the socket is empty
+		done = ec || count < batch_a.datagrams.size ();
+		if (ec && ec != boost::asio::error::would_block && node.config.logging.network_logging ())
+		{
+			BOOST_LOG (node.log) << boost::str (boost::format ("UDP batch receive error: %1%") % ec.message ());
+		}
+		--remaining;
+	}
 }
 
-void rai::logging::init (boost::filesystem::path const & application_path_a)
+void rai::network::stop ()
 {
-	static std::atomic_flag logging_already_added = ATOMIC_FLAG_INIT;
-	if (!logging_already_added.test_and_set ())
+    on = false;
+	send_queue.stop ();
+	if (transport != nullptr)
 	{
-		boost::log::add_common_attributes ();
-		if (log_to_cerr ())
-		{
-			boost::log::add_console_log (std::cerr, boost::log::keywords::format = "[%TimeStamp%]: %Message%");
-		}
-		boost::log::add_file_log (boost::log::keywords::target = application_path_a / "log", boost::log::keywords::file_name = application_path_a / "log" / "log_%Y-%m-%d_%H-%M-%S.%N.log", boost::log::keywords::rotation_size = 4 * 1024 * 1024, boost::log::keywords::auto_flush = true, boost::log::keywords::scan_method = boost::log::sinks::file::scan_method::scan_matching, boost::log::keywords::max_size = max_size, boost::log::keywords::format = "[%TimeStamp%]: %Message%");
+		transport->stop ();
+	}
+	receive_queue.stop ();
+    socket.close ();
+	for (auto & i: receivers)
+	{
+		i->socket.close ();
 	}
+    resolver.cancel ();
 }
 
-void rai::logging::serialize_json (boost::property_tree::ptree & tree_a) const
+void rai::network::send_keepalive (rai::endpoint const & endpoint_a)
 {
-	tree_a.put ("version", "2");
-	tree_a.put ("ledger", ledger_logging_value);
-	tree_a.put ("ledger_duplicate", ledger_duplicate_logging_value);
-	tree_a.put ("vote", vote_logging_value);
-	tree_a.put ("network", network_logging_value);
-	tree_a.put ("network_message", network_message_logging_value);
-	tree_a.put ("network_publish", network_publish_logging_value);
-	tree_a.put ("network_packet", network_packet_logging_value);
-	tree_a.put ("network_keepalive", network_keepalive_logging_value);
-	tree_a.put ("node_lifetime_tracing", node_lifetime_tracing_value);
-	tree_a.put ("insufficient_work", insufficient_work_logging_value);
-	tree_a.put ("log_rpc", log_rpc_value);
-	tree_a.put ("bulk_pull", bulk_pull_logging_value);
-	tree_a.put ("work_generation_time", work_generation_time_value);
-	tree_a.put ("log_to_cerr", log_to_cerr_value);
-	tree_a.put ("max_size", max_size);
+    assert (endpoint_a.address ().is_v6 ());
+    rai::keepalive message;
+    node.peers.random_fill (message.peers);
+    std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+    {
+        rai::vectorstream stream (*bytes);
+        message.serialize (stream);
+    }
+    if (node.config.logging.network_keepalive_logging ())
+    {
+        BOOST_LOG (node.log) << boost::str (boost::format ("Keepalive req sent to %1%") % endpoint_a);
+    }
+    ++outgoing.keepalive;
+	std::weak_ptr <rai::node> node_w (node.shared ());
+    send_buffer (bytes->data (), bytes->size (), endpoint_a, [bytes, node_w, endpoint_a] (boost::system::error_code const & ec, size_t)
+	{
+		if (auto node_l = node_w.lock ())
+		{
+			if (node_l->config.logging.network_keepalive_logging ())
+			{
+				if (ec)
+				{
+					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending keepalive to %1% %2%") % endpoint_a % ec.message ());
+				}
+			}
+		}
+	});
 }
 
-bool rai::logging::upgrade_json (unsigned version_a, boost::property_tree::ptree & tree_a)
+void rai::node::keepalive (std::string const & address_a, uint16_t port_a)
 {
-	auto result (false);
-	switch (version_a)
+	auto node_l (shared_from_this ());
+	network.resolver.async_resolve (boost::asio::ip::udp::resolver::query (address_a, std::to_string (port_a)), [node_l, address_a, port_a] (boost::system::error_code const & ec, boost::asio::ip::udp::resolver::iterator i_a)
 	{
-	case 1:
-		tree_a.put ("vote", vote_logging_value);
-		tree_a.put ("version", "2");
-		result = true;
-	case 2:
-	break;
-	default:
-		throw std::runtime_error ("Unknown logging_config version");
-	break;
-	}
-	return result;
+		if (!ec)
+		{
+			for (auto i (i_a), n (boost::asio::ip::udp::resolver::iterator {}); i != n; ++i)
+			{
+			    auto endpoint (i->endpoint ());
+			    if (endpoint.address ().is_v4 ())
+			    {
+					endpoint = rai::endpoint (boost::asio::ip::address_v6::v4_mapped (endpoint.address ().to_v4 ()), endpoint.port ());
+			    }
+				node_l->send_keepalive (endpoint);
+			}
+		}
+		else
+		{
+			BOOST_LOG (node_l->log) << boost::str (boost::format ("Error resolving address: %1%:%2%, %3%") % address_a % port_a % ec.message ());
+		}
+	});
 }
 
-bool rai::logging::deserialize_json (bool & upgraded_a, boost::property_tree::ptree & tree_a)
+void rai::network::republish (rai::block_hash const & hash_a, std::shared_ptr <std::vector <uint8_t>> buffer_a, rai::endpoint endpoint_a)
 {
-	auto result (false);
-	try
+	++outgoing.publish;
+	if (node.config.logging.network_publish_logging ())
 	{
-		auto version_l (tree_a.get_optional <std::string> ("version"));
-		if (!version_l)
+		BOOST_LOG (node.log) << boost::str (boost::format ("Publishing %1% to %2%") % hash_a.to_string () % endpoint_a);
+	}
+    std::weak_ptr <rai::node> node_w (node.shared ());
+	send_buffer (buffer_a->data (), buffer_a->size (), endpoint_a, [buffer_a, node_w, endpoint_a] (boost::system::error_code const & ec, size_t size)
+	{
+		if (auto node_l = node_w.lock ())
 		{
-			tree_a.put ("version", "1");
-			version_l = "1";
-			auto work_peers_l (tree_a.get_child_optional ("work_peers"));
-			if (!work_peers_l)
+			if (node_l->config.logging.network_logging ())
 			{
-				tree_a.add_child ("work_peers", boost::property_tree::ptree ());
+				if (ec)
+				{
+					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending publish: %1% to %2%") % ec.message () % endpoint_a);
+				}
 			}
-			upgraded_a = true;
 		}
-		upgraded_a |= upgrade_json (std::stoull (version_l.get ()), tree_a);
-		ledger_logging_value = tree_a.get <bool> ("ledger");
-		ledger_duplicate_logging_value = tree_a.get <bool> ("ledger_duplicate");
-		vote_logging_value = tree_a.get <bool> ("vote");
-		network_logging_value = tree_a.get <bool> ("network");
-		network_message_logging_value = tree_a.get <bool> ("network_message");
-		network_publish_logging_value = tree_a.get <bool> ("network_publish");
-		network_packet_logging_value = tree_a.get <bool> ("network_packet");
-		network_keepalive_logging_value = tree_a.get <bool> ("network_keepalive");
-		node_lifetime_tracing_value = tree_a.get <bool> ("node_lifetime_tracing");
-		insufficient_work_logging_value = tree_a.get <bool> ("insufficient_work");
-		log_rpc_value = tree_a.get <bool> ("log_rpc");
-		bulk_pull_logging_value = tree_a.get <bool> ("bulk_pull");
-		work_generation_time_value = tree_a.get <bool> ("work_generation_time");
-		log_to_cerr_value = tree_a.get <bool> ("log_to_cerr");
-		max_size = tree_a.get <uintmax_t> ("max_size");
+	});
+}
+
+void rai::network::send_announce (std::vector <rai::endpoint> const & endpoints_a, std::vector <rai::block_hash> const & hashes_a)
+{
+	rai::announce message (hashes_a);
+	std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+	{
+		rai::vectorstream stream (*bytes);
+		message.serialize (stream);
 	}
-	catch (std::runtime_error const &)
+	std::weak_ptr <rai::node> node_w (node.shared ());
+	for (auto & i: endpoints_a)
 	{
-		result = true;
+		++outgoing.announce;
+		auto endpoint_l (i);
+		send_buffer (bytes->data (), bytes->size (), endpoint_l, [bytes, node_w, endpoint_l] (boost::system::error_code const & ec, size_t size)
+		{
+			if (auto node_l = node_w.lock ())
+			{
+				if (node_l->config.logging.network_logging ())
+				{
+					if (ec)
+					{
+						BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending announce: %1% to %2%") % ec.message () % endpoint_l);
+					}
+				}
+			}
+		});
 	}
-	return result;
 }
 
-bool rai::logging::ledger_logging () const
+rai::publish_req_limiter::publish_req_limiter (size_t blocks_per_second_a) :
+refused (0),
+blocks_per_second (blocks_per_second_a),
+burst (std::max <size_t> (blocks_per_second_a, rai::hash_list_message::hashes_max))
 {
-	return ledger_logging_value;
 }
 
-bool rai::logging::ledger_duplicate_logging () const
+size_t rai::publish_req_limiter::take (rai::endpoint const & endpoint_a, size_t count_a, std::chrono::steady_clock::time_point const & now_a)
 {
-	return ledger_logging () && ledger_duplicate_logging_value;
+	size_t result (0);
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (buckets.find (endpoint_a));
+	if (existing == buckets.end () && buckets.size () < max)
+	{
+		existing = buckets.insert (std::make_pair (endpoint_a, std::make_pair (static_cast <double> (burst), now_a))).first;
+	}
+	if (existing != buckets.end ())
+	{
+		auto & bucket (existing->second);
+		bucket.first = std::min <double> (burst, bucket.first + blocks_per_second * std::chrono::duration <double> (now_a - bucket.second).count ());
+		bucket.second = now_a;
+		result = std::min (count_a, static_cast <size_t> (bucket.first));
+		bucket.first -= result;
+	}
+	refused += count_a - result;
+	return result;
 }
 
-bool rai::logging::vote_logging () const
+void rai::publish_req_limiter::purge (std::chrono::steady_clock::time_point const & cutoff_a)
 {
-	return vote_logging_value;
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto i (buckets.begin ()), n (buckets.end ()); i != n;)
+	{
+		if (i->second.second < cutoff_a)
+		{
+			i = buckets.erase (i);
+		}
+		else
+		{
+			++i;
+		}
+	}
 }
 
-bool rai::logging::network_logging () const
+size_t rai::publish_req_limiter::size ()
 {
-	return network_logging_value;
+	std::lock_guard <std::mutex> lock (mutex);
+	return buckets.size ();
 }
 
-bool rai::logging::network_message_logging () const
+void rai::network::send_publish_req (rai::endpoint const & endpoint_a, std::vector <rai::block_hash> const & hashes_a)
 {
-	return network_logging () && network_message_logging_value;
+	rai::publish_req message (hashes_a);
+	std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+	{
+		rai::vectorstream stream (*bytes);
+		message.serialize (stream);
+	}
+	if (node.config.logging.network_message_logging ())
+	{
+		BOOST_LOG (node.log) << boost::str (boost::format ("Requesting %1% announced blocks from %2%") % hashes_a.size () % endpoint_a);
+	}
+	std::weak_ptr <rai::node> node_w (node.shared ());
+	++outgoing.publish_req;
+	send_buffer (bytes->data (), bytes->size (), endpoint_a, [bytes, node_w, endpoint_a] (boost::system::error_code const & ec, size_t size)
+	{
+		if (auto node_l = node_w.lock ())
+		{
+			if (node_l->config.logging.network_logging ())
+			{
+				if (ec)
+				{
+					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending publish request: %1% to %2%") % ec.message () % endpoint_a);
+				}
+			}
+		}
+	});
 }
 
-bool rai::logging::network_publish_logging () const
+void rai::network::rebroadcast_reps (std::shared_ptr <rai::block> block_a)
 {
-	return network_logging () && network_publish_logging_value;
+	auto hash (block_a->hash ());
+	rai::publish message (block_a);
+	std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+	{
+		rai::vectorstream stream (*bytes);
+		message.serialize (stream);
+	}
+	auto representatives (node.peers.representatives (2 * node.peers.size_sqrt ()));
+	for (auto i : representatives)
+	{
+		republish (hash, bytes, i.endpoint);
+	}
 }
 
-bool rai::logging::network_packet_logging () const
+template <typename T>
+bool confirm_block (rai::node & node_a, T & list_a, std::shared_ptr <rai::block> block_a)
 {
-	return network_logging () && network_packet_logging_value;
+    bool result (false);
+	if (node_a.config.enable_voting)
+	{
+		auto root (block_a->root ());
+		auto hash (block_a->hash ());
+		rai::transaction transaction (node_a.store.environment, nullptr, false);
+		auto votes (node_a.vote_cache.find (transaction, root, hash));
+		if (votes.empty ())
+		{
+			node_a.wallets.foreach_representative (transaction, [&votes, &block_a, &node_a, &transaction] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
+			{
+				auto sequence (node_a.store.sequence_atomic_inc (transaction, pub_a));
+				rai::vote vote (pub_a, prv_a, sequence, block_a);
+				++node_a.vote_cache.signatures;
+				auto confirm (std::make_shared <rai::confirm_ack> (vote));
+				std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+				{
+					rai::vectorstream stream (*bytes);
+					confirm->serialize (stream);
+				}
+				votes.push_back ({confirm, bytes});
+			});
+			if (!votes.empty ())
+			{
+				node_a.vote_cache.add (root, hash, votes);
+			}
+		}
+		else
+		{
+			node_a.vote_cache.hits += votes.size ();
+		}
+		for (auto & i: votes)
+		{
+			result = true;
+			for (auto j (list_a.begin ()), m (list_a.end ()); j != m; ++j)
+			{
+				node_a.network.confirm_send (*i.confirm, i.bytes, *j);
+			}
+		}
+	}
+    return result;
 }
 
-bool rai::logging::network_keepalive_logging () const
+template <>
+bool confirm_block (rai::node & node_a, rai::endpoint & peer_a, std::shared_ptr <rai::block> block_a)
 {
-	return network_logging () && network_keepalive_logging_value;
+	std::array <rai::endpoint, 1> endpoints;
+	endpoints [0] = peer_a;
+	auto result (confirm_block (node_a, endpoints, std::move (block_a)));
+	return result;
 }
 
-bool rai::logging::node_lifetime_tracing () const
+void rai::network::republish_block (std::shared_ptr <rai::block> block)
 {
-	return node_lifetime_tracing_value;
+	rebroadcast_reps (block);
+	auto hash (block->hash ());
+	std::vector <rai::endpoint> older;
+	std::vector <rai::endpoint> newer;
+	node.peers.partition_version (node.peers.list_sqrt (), rai::message::vote_by_hash_version, older, newer);
+	// Peers that understand announce only get the hash and pull the block if nobody else has sent it to them yet
+	std::vector <rai::endpoint> announced;
+	if (node.config.announce_blocks)
+	{
+		std::vector <rai::endpoint> unannounced;
+		node.peers.partition_version (newer, rai::message::announce_version, unannounced, announced);
+		newer.swap (unannounced);
+	}
+	// Peers that understand vote-by-hash get the block on its own, our votes for it follow batched with other hashes from vote_generator
+	// Older peers get a signed confirm with the block if we're a representative, otherwise an unsigned publish
+	auto confirmed (!older.empty () && confirm_block (node, older, block));
+	if (!confirmed)
+	{
+		newer.insert (newer.end (), older.begin (), older.end ());
+	}
+	if (node.config.enable_voting)
+	{
+		node.vote_generator.add (hash);
+	}
+    rai::publish message (block);
+    std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+    {
+        rai::vectorstream stream (*bytes);
+        message.serialize (stream);
+    }
+    for (auto i (newer.begin ()), n (newer.end ()); i != n; ++i)
+    {
+		republish (hash, bytes, *i);
+    }
+	if (!announced.empty ())
+	{
+		send_announce (announced, std::vector <rai::block_hash> (1, hash));
+	}
+	if (node.config.logging.network_logging ())
+	{
+		BOOST_LOG (node.log) << boost::str (boost::format ("Block %1% was republished to %2% peers, announced to %3% peers and confirmed to %4% peers") % hash.to_string () % newer.size () % announced.size () % (confirmed ? older.size () : 0));
+	}
 }
 
-bool rai::logging::insufficient_work_logging () const
+// In order to rate limit network traffic we republish:
+// 1) Only if they are a non-replay vote of a block that's actively settling. Settling blocks are limited by block PoW
+// 2) Only if a vote for this block hasn't been received in the previous X second.  This prevents rapid publishing of votes with increasing sequence numbers.
+// 3) The rep has a weight > Y to prevent creating a lot of small-weight accounts to send out votes
+// 1) and 2) are decided by the elections the vote reaches, vote_processor republishes each incoming vote at most once
+void rai::network::republish_vote (rai::vote const & vote_a)
 {
-	return network_logging () && insufficient_work_logging_value;
+	if (node.weight (vote_a.account) > rai::Mxrb_ratio * 256)
+	{
+		rai::confirm_ack confirm (vote_a);
+		std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+		{
+			rai::vectorstream stream (*bytes);
+			confirm.serialize (stream);
+		}
+		auto list (node.peers.list_sqrt ());
+		if (!vote_a.hashes.empty ())
+		{
+			// Older peers can't parse a vote-by-hash
+			std::vector <rai::endpoint> older;
+			std::vector <rai::endpoint> newer;
+			node.peers.partition_version (list, rai::message::vote_by_hash_version, older, newer);
+			list.swap (newer);
+		}
+		for (auto j (list.begin ()), m (list.end ()); j != m; ++j)
+		{
+			node.network.confirm_send (confirm, bytes, *j);
+		}
+	}
 }
 
-bool rai::logging::log_rpc () const
+void rai::network::broadcast_confirm_req (std::shared_ptr <rai::block> block_a)
 {
-	return network_logging () && log_rpc_value;
+	auto list (node.peers.representatives (std::numeric_limits <size_t>::max ()));
+	for (auto i (list.begin ()), j (list.end ()); i != j; ++i)
+	{
+		node.network.send_confirm_req (i->endpoint, block_a);
+	}
+    if (node.config.logging.network_logging ())
+    {
+        BOOST_LOG (node.log) << boost::str (boost::format ("Broadcasted confirm req to %1% representatives") % list.size ());
+    }
 }
 
-bool rai::logging::bulk_pull_logging () const
+void rai::network::send_confirm_req (rai::endpoint const & endpoint_a, std::shared_ptr <rai::block> block)
 {
-	return network_logging () && bulk_pull_logging_value;
+    rai::confirm_req message (block);
+    std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+    {
+        rai::vectorstream stream (*bytes);
+        message.serialize (stream);
+    }
+    if (node.config.logging.network_message_logging ())
+    {
+        BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm req to %1%") % endpoint_a);
+    }
+    std::weak_ptr <rai::node> node_w (node.shared ());
+	++outgoing.confirm_req;
+    send_buffer (bytes->data (), bytes->size (), endpoint_a, [bytes, node_w] (boost::system::error_code const & ec, size_t size)
+	{
+		if (auto node_l = node_w.lock ())
+		{
+			if (node_l->config.logging.network_logging ())
+			{
+				if (ec)
+				{
+					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending confirm request: %1%") % ec.message ());
+				}
+			}
+		}
+	});
 }
 
-bool rai::logging::callback_logging () const
+template <typename T>
+void rep_query (rai::node & node_a, T const & peers_a)
 {
-	return network_logging ();
+	rai::transaction transaction (node_a.store.environment, nullptr, false);
+	std::shared_ptr <rai::block> block (node_a.store.block_random (transaction));
+	auto hash (block->hash ());
+	node_a.rep_crawler.add (hash);
+	for (auto i (peers_a.begin ()), n (peers_a.end ()); i != n; ++i)
+	{
+		node_a.peers.rep_request (*i);
+		node_a.network.send_confirm_req (*i, block);
+	}
+	std::weak_ptr <rai::node> node_w (node_a.shared ());
+	node_a.alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (5), [node_w, hash] ()
+	{
+		if (auto node_l = node_w.lock ())
+		{
+			node_l->rep_crawler.remove (hash);
+		}
+	});
 }
 
-bool rai::logging::work_generation_time () const
+template <>
+void rep_query (rai::node & node_a, rai::endpoint const & peers_a)
 {
-	return work_generation_time_value;
+	std::array <rai::endpoint, 1> peers;
+	peers [0] = peers_a;
+	rep_query (node_a, peers);
 }
 
-bool rai::logging::log_to_cerr () const
+namespace
 {
-	return log_to_cerr_value;
+class network_message_visitor : public rai::message_visitor
+{
+public:
+    network_message_visitor (rai::node & node_a, rai::endpoint const & sender_a) :
+    node (node_a),
+    sender (sender_a)
+    {
+    }
+    void keepalive (rai::keepalive const & message_a) override
+    {
+        if (node.config.logging.network_keepalive_logging ())
+        {
+            BOOST_LOG (node.log) << boost::str (boost::format ("Received keepalive message from %1%") % sender);
+        }
+        ++node.network.incoming.keepalive;
+        node.peers.contacted (sender, message_a.version_using);
+        node.network.merge_peers (message_a.peers);
+    }
+    void publish (rai::publish const & message_a) override
+    {
+        if (node.config.logging.network_message_logging ())
+        {
+            BOOST_LOG (node.log) << boost::str (boost::format ("Publish message from %1% for %2%") % sender % message_a.block->hash ().to_string ());
+        }
+        ++node.network.incoming.publish;
+        node.peers.contacted (sender, message_a.version_using);
+        node.process_receive_republish (message_a.block);
+    }
+    void confirm_req (rai::confirm_req const & message_a) override
+    {
+        if (node.config.logging.network_message_logging ())
+        {
+            BOOST_LOG (node.log) << boost::str (boost::format ("Confirm_req message from %1% for %2%") % sender % message_a.block->hash ().to_string ());
+        }
+        ++node.network.incoming.confirm_req;
+        node.peers.contacted (sender, message_a.version_using);
+        node.process_receive_republish (message_a.block);
+		if (node.ledger.block_exists (message_a.block->hash ()))
+        {
+            confirm_block (node, sender, message_a.block);
+        }
+    }
+    void confirm_ack (rai::confirm_ack const & message_a) override
+    {
+        if (node.config.logging.network_message_logging ())
+        {
+            BOOST_LOG (node.log) << boost::str (boost::format ("Received confirm_ack message from %1% for %2%") % sender % (message_a.vote.block != nullptr ? message_a.vote.block->hash ().to_string () : std::to_string (message_a.vote.hashes.size ()) + " hashes"));
+        }
+        ++node.network.incoming.confirm_ack;
+        node.peers.contacted (sender, message_a.version_using);
+        if (message_a.vote.block != nullptr)
+        {
+            node.process_receive_republish (message_a.vote.block);
+        }
+        node.vote_processor.add (message_a.vote, sender);
+    }
+    void bulk_pull (rai::bulk_pull const &) override
+    {
+        assert (false);
+    }
+    void bulk_push (rai::bulk_push const &) override
+    {
+        assert (false);
+    }
+    void frontier_req (rai::frontier_req const &) override
+    {
+        assert (false);
+    }
+    void announce (rai::announce const & message_a) override
+    {
+        if (node.config.logging.network_message_logging ())
+        {
+            BOOST_LOG (node.log) << boost::str (boost::format ("Announce message from %1% for %2% hashes") % sender % message_a.hashes.size ());
+        }
+        ++node.network.incoming.announce;
+        node.peers.contacted (sender, message_a.version_using);
+        std::vector <rai::block_hash> missing;
+        {
+            rai::transaction transaction (node.store.environment, nullptr, false);
+            for (auto & i: message_a.hashes)
+            {
+                if (!node.store.block_exists (transaction, i) && !node.block_processor.have (i) && node.pull_cache.add (i, sender))
+                {
+                    missing.push_back (i);
+                }
+            }
+        }
+        if (!missing.empty ())
+        {
+            node.network.send_publish_req (sender, missing);
+        }
+    }
+    void publish_req (rai::publish_req const & message_a) override
+    {
+        if (node.config.logging.network_message_logging ())
+        {
+            BOOST_LOG (node.log) << boost::str (boost::format ("Publish_req message from %1% for %2% hashes") % sender % message_a.hashes.size ());
+        }
+        ++node.network.incoming.publish_req;
+        // Only peers we've been talking to are answered, a request is the first thing a spoofed sender would send us
+        auto known (node.peers.known_peer (sender));
+        node.peers.contacted (sender, message_a.version_using);
+        size_t allowed (0);
+        if (known)
+        {
+            allowed = node.network.publish_req_limits.take (sender, message_a.hashes.size ());
+        }
+        else
+        {
+            node.network.publish_req_limits.refused += message_a.hashes.size ();
+        }
+        std::vector <std::shared_ptr <rai::block>> blocks;
+        if (allowed > 0)
+        {
+            rai::transaction transaction (node.store.environment, nullptr, false);
+            for (auto i (message_a.hashes.begin ()), n (message_a.hashes.begin () + allowed); i != n; ++i)
+            {
+                std::shared_ptr <rai::block> block (node.store.block_get (transaction, *i));
+                if (block != nullptr)
+                {
+                    blocks.push_back (block);
+                }
+            }
+        }
+        for (auto & i: blocks)
+        {
+            rai::publish publish (i);
+            std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+            {
+                rai::vectorstream stream (*bytes);
+                publish.serialize (stream);
+            }
+            node.network.republish (i->hash (), bytes, sender);
+        }
+    }
+    void realtime_req (rai::realtime_req const &) override
+    {
+        assert (false);
+    }
+    rai::node & node;
+    rai::endpoint sender;
+};
 }
 
-rai::node_init::node_init () :
-block_store_init (false),
-wallet_init (false)
+void rai::network::receive_action (boost::system::error_code const & error, size_t size_a)
 {
+    if (!error && on)
+    {
+		++receive_syscalls;
+		++datagrams_received;
+		receive_packet (buffer.data (), size_a, remote);
+        receive ();
+    }
+	else
+	{
+		if (error)
+		{
+			if (node.config.logging.network_logging ())
+			{
+				BOOST_LOG (node.log) << boost::str (boost::format ("UDP Receive error: %1%") % error.message ());
+			}
+		}
+		if (on)
+		{
+			node.alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (5), [this] () { receive (); });
+		}
+	}
 }
 
-bool rai::node_init::error ()
+void rai::network::receive_packet (uint8_t const * data_a, size_t size_a, rai::endpoint const & remote_a)
 {
-    return block_store_init || wallet_init;
+	if (!rai::reserved_address (remote_a) && remote_a != endpoint ())
+	{
+		peer_traffic.received (remote_a, data_a, size_a);
+		if (receive_queue.add (data_a, size_a, remote_a))
+		{
+			peer_traffic.dropped (remote_a, rai::peer_drop::receive_queue_full);
+		}
+	}
+	else
+	{
+		if (node.config.logging.network_logging ())
+		{
+			BOOST_LOG (node.log) << boost::str (boost::format ("Reserved sender %1%") % remote_a.address ().to_string ());
+		}
+		++bad_sender_count;
+	}
 }
 
-rai::node_config::node_config () :
-node_config (rai::network::node_port, rai::logging ())
+void rai::network::process_packet (uint8_t const * data_a, size_t size_a, rai::endpoint const & remote_a)
 {
+	network_message_visitor visitor (node, remote_a);
+	rai::message_parser parser (visitor, node.work);
+	parser.deserialize_buffer (data_a, size_a);
+	if (parser.error)
+	{
+		++error_count;
+		peer_traffic.dropped (remote_a, rai::peer_drop::parse_error);
+	}
+	else if (parser.insufficient_work)
+	{
+		peer_traffic.dropped (remote_a, rai::peer_drop::insufficient_work);
+		if (node.config.logging.insufficient_work_logging ())
+		{
+			BOOST_LOG (node.log) << "Insufficient work in message";
+		}
+		++insufficient_work_count;
+	}
 }
 
-rai::node_config::node_config (uint16_t peering_port_a, rai::logging const & logging_a) :
-peering_port (peering_port_a),
-logging (logging_a),
-bootstrap_fraction_numerator (1),
-receive_minimum (rai::xrb_ratio),
-inactive_supply (0),
-password_fanout (1024),
-io_threads (std::max <unsigned> (4, std::thread::hardware_concurrency ())),
-work_threads (std::max <unsigned> (4, std::thread::hardware_concurrency ())),
-enable_voting (true),
-bootstrap_connections (16),
-callback_port (0)
+// Send keepalives to all the peers we've been notified of
+void rai::network::merge_peers (std::array <rai::endpoint, 8> const & peers_a)
 {
-	switch (rai::rai_network)
-	{
-		case rai::rai_networks::rai_test_network:
-			preconfigured_representatives.push_back (rai::genesis_account);
-			break;
-		case rai::rai_networks::rai_beta_network:
-			preconfigured_peers.push_back ("rai.raiblocks.net");
-			preconfigured_representatives.push_back (rai::account ("59750C057F42806F40C5D9EAA1E0263E9DB48FE385BD0172BFC573BD37EEC4A7"));
-			preconfigured_representatives.push_back (rai::account ("8B05C9B160DE9B006FA27DD6A368D7CA122A2EE7537C308CF22EFD3ABF5B36C3"));
-			preconfigured_representatives.push_back (rai::account ("91D51BF05F02698EBB4649FB06D1BBFD2E4AE2579660E8D784A002D9C0CB1BD2"));
-			preconfigured_representatives.push_back (rai::account ("CB35ED23D47E1A16667EDE415CD4CD05961481D7D23A43958FAE81FC12FA49FF"));
-			break;
-		case rai::rai_networks::rai_live_network:
-			preconfigured_peers.push_back ("rai.raiblocks.net");
-			preconfigured_representatives.push_back (rai::account ("A30E0A32ED41C8607AA9212843392E853FCBCB4E7CB194E35C94F07F91DE59EF"));
-			preconfigured_representatives.push_back (rai::account ("67556D31DDFC2A440BF6147501449B4CB9572278D034EE686A6BEE29851681DF"));
-			preconfigured_representatives.push_back (rai::account ("5C2FBB148E006A8E8BA7A75DD86C9FE00C83F5FFDBFD76EAA09531071436B6AF"));
-			preconfigured_representatives.push_back (rai::account ("AE7AC63990DAAAF2A69BF11C913B928844BF5012355456F2F164166464024B29"));
-			preconfigured_representatives.push_back (rai::account ("BD6267D6ECD8038327D2BCC0850BDF8F56EC0414912207E81BCF90DFAC8A4AAA"));
-			preconfigured_representatives.push_back (rai::account ("2399A083C600AA0572F5E36247D978FCFC840405F8D4B6D33161C0066A55F431"));
-			preconfigured_representatives.push_back (rai::account ("2298FAB7C61058E77EA554CB93EDEEDA0692CBFCC540AB213B2836B29029E23A"));
-			preconfigured_representatives.push_back (rai::account ("3FE80B4BC842E82C1C18ABFEEC47EA989E63953BC82AC411F304D13833D52A56"));
-			break;
-		default:
-			assert (false);
-			break;
-	}
+    for (auto i (peers_a.begin ()), j (peers_a.end ()); i != j; ++i)
+    {
+        if (!node.peers.not_a_peer (*i) && !node.peers.known_peer (*i))
+        {
+            send_keepalive (*i);
+        }
+    }
 }
 
-void rai::node_config::serialize_json (boost::property_tree::ptree & tree_a) const
+rai::alarm::alarm (boost::asio::io_service & service_a) :
+service (service_a),
+base (std::chrono::system_clock::now ()),
+current (0),
+waiting (std::numeric_limits <uint64_t>::max ()),
+id (0),
+stopped (false),
+thread ([this] () { run (); })
+{
+}
+
+rai::alarm::~alarm ()
 {
-	tree_a.put ("version", "7");
-	tree_a.put ("peering_port", std::to_string (peering_port));
-	tree_a.put ("bootstrap_fraction_numerator", std::to_string (bootstrap_fraction_numerator));
-	tree_a.put ("receive_minimum", receive_minimum.to_string_dec ());
-	boost::property_tree::ptree logging_l;
-	logging.serialize_json (logging_l);
-	tree_a.add_child ("logging", logging_l);
-	boost::property_tree::ptree work_peers_l;
-	for (auto i (work_peers.begin ()), n (work_peers.end ()); i != n; ++i)
-	{
-		boost::property_tree::ptree entry;
-		entry.put ("", boost::str (boost::format ("%1%:%2%") % i->first % i->second));
-		work_peers_l.push_back (std::make_pair ("", entry));
-	}
-	tree_a.add_child ("work_peers", work_peers_l);
-	boost::property_tree::ptree preconfigured_peers_l;
-	for (auto i (preconfigured_peers.begin ()), n (preconfigured_peers.end ()); i != n; ++i)
-	{
-		boost::property_tree::ptree entry;
-		entry.put ("", *i);
-		preconfigured_peers_l.push_back (std::make_pair ("", entry));
-	}
-	tree_a.add_child ("preconfigured_peers", preconfigured_peers_l);
-	boost::property_tree::ptree preconfigured_representatives_l;
-	for (auto i (preconfigured_representatives.begin ()), n (preconfigured_representatives.end ()); i != n; ++i)
 	{
-		boost::property_tree::ptree entry;
-		entry.put ("", i->to_account ());
-		preconfigured_representatives_l.push_back (std::make_pair ("", entry));
+		std::lock_guard <std::mutex> lock (mutex);
+		stopped = true;
+		condition.notify_all ();
 	}
-	tree_a.add_child ("preconfigured_representatives", preconfigured_representatives_l);
-	tree_a.put ("inactive_supply", inactive_supply.to_string_dec ());
-	tree_a.put ("password_fanout", std::to_string (password_fanout));
-	tree_a.put ("io_threads", std::to_string (io_threads));
-	tree_a.put ("work_threads", std::to_string (work_threads));
-	tree_a.put ("enable_voting", enable_voting);
-	tree_a.put ("bootstrap_connections", bootstrap_connections);
-	tree_a.put ("callback_address", callback_address);
-	tree_a.put ("callback_port", std::to_string (callback_port));
-	tree_a.put ("callback_target", callback_target);
+	thread.join ();
 }
 
-bool rai::node_config::upgrade_json (unsigned version, boost::property_tree::ptree & tree_a)
+void rai::alarm::run ()
 {
-	auto result (false);
-	switch (version)
-	{
-	case 1:
+    std::unique_lock <std::mutex> lock (mutex);
+    while (!stopped)
+    {
+		auto now (std::chrono::system_clock::now ());
+		uint64_t elapsed (now > base ? (now - base) / tick_length : 0);
+		if (handles.empty ())
+		{
+			// Nothing is waiting on the slots we'd pass so skip straight to now
+			current = std::max (current, elapsed + 1);
+			waiting = std::numeric_limits <uint64_t>::max ();
+			condition.wait (lock);
+		}
+		else
+		{
+			auto next (next_tick ());
+			if (next <= elapsed)
+			{
+				advance (elapsed);
+			}
+			else
+			{
+				waiting = next;
+				condition.wait_until (lock, base + tick_length * static_cast <int64_t> (next));
+			}
+		}
+    }
+}
+
+uint64_t rai::alarm::next_tick ()
+{
+	// Everything in the first level is due within one revolution of current
+	uint64_t result (((current >> slot_bits) + 1) << slot_bits);
+	if (current % slots == 0)
 	{
-		auto reps_l (tree_a.get_child ("preconfigured_representatives"));
-		boost::property_tree::ptree reps;
-		for (auto i (reps_l.begin ()), n (reps_l.end ()); i != n; ++i)
+		// The upper level slots that cascade at current can hold operations due before the next revolution
+		auto cascade (false);
+		auto done (false);
+		for (size_t level (1); level < levels && !done && !cascade; ++level)
 		{
-			rai::uint256_union account;
-			account.decode_account (i->second.get <std::string> (""));
-			boost::property_tree::ptree entry;
-			entry.put ("", account.to_account ());
-			reps.push_back (std::make_pair ("", entry));
+			cascade = !wheel [level][(current >> (slot_bits * level)) % slots].empty ();
+			done = (current >> (slot_bits * level)) % slots != 0;
+		}
+		if (cascade || (!done && !overflow.empty ()))
+		{
+			result = current;
 		}
-		tree_a.erase ("preconfigured_representatives");
-		tree_a.add_child ("preconfigured_representatives", reps);
-		tree_a.erase ("version");
-		tree_a.put ("version", "2");
-		result = true;
 	}
-	case 2:
+	for (uint64_t i (current), n (current + slots); i < n && result > i; ++i)
 	{
-		tree_a.put ("inactive_supply", rai::uint128_union (0).to_string_dec ());
-		tree_a.put ("password_fanout", std::to_string (1024));
-		tree_a.put ("io_threads", std::to_string (io_threads));
-		tree_a.put ("work_threads", std::to_string (work_threads));
-		tree_a.erase ("version");
-		tree_a.put ("version", "3");
-		result = true;
-	}
-	case 3:
-		tree_a.erase ("receive_minimum");
-		tree_a.put ("receive_minimum", rai::xrb_ratio.convert_to <std::string> ());
-		tree_a.erase ("version");
-		tree_a.put ("version", "4");
-		result = true;
-		break;
-	case 4:
-		tree_a.erase ("receive_minimum");
-		tree_a.put ("receive_minimum", rai::xrb_ratio.convert_to <std::string> ());
-		tree_a.erase ("version");
-		tree_a.put ("version", "5");
-		result = true;
-		break;
-	case 5:
-		tree_a.put ("enable_voting", enable_voting);
-		tree_a.erase ("packet_delay_microseconds");
-		tree_a.erase ("rebroadcast_delay");
-		tree_a.erase ("creation_rebroadcast");
-		tree_a.erase ("version");
-		tree_a.put ("version", "6");
-		result = true;
-		break;
-	case 6:
-		tree_a.put ("bootstrap_connections", 16);
-		tree_a.put ("callback_address", "");
-		tree_a.put ("callback_port", "0");
-		tree_a.put ("callback_target", "");
-		tree_a.erase ("version");
-		tree_a.put ("version", "7");
-		result = true;
-		break;
-	case 7:
-		break;
-	default:
-		throw std::runtime_error ("Unknown node_config version");
+		if (!wheel [0][i % slots].empty ())
+		{
+			result = i;
+		}
 	}
 	return result;
 }
 
-bool rai::node_config::deserialize_json (bool & upgraded_a, boost::property_tree::ptree & tree_a)
+void rai::alarm::advance (uint64_t elapsed_a)
 {
-	auto result (false);
-	try
+	while (current <= elapsed_a)
 	{
-		auto version_l (tree_a.get_optional <std::string> ("version"));
-		if (!version_l)
+		auto index (current % slots);
+		if (index == 0)
 		{
-			tree_a.put ("version", "1");
-			version_l = "1";
-			auto work_peers_l (tree_a.get_child_optional ("work_peers"));
-			if (!work_peers_l)
+			// Pull the next slot of each level down, a level only moves when the level below it has wrapped
+			std::list <rai::operation> pending;
+			auto done (false);
+			for (size_t level (1); level < levels && !done; ++level)
 			{
-				tree_a.add_child ("work_peers", boost::property_tree::ptree ());
+				auto & slot (wheel [level][(current >> (slot_bits * level)) % slots]);
+				pending.splice (pending.end (), slot);
+				done = (current >> (slot_bits * level)) % slots != 0;
 			}
-			upgraded_a = true;
-		}
-		upgraded_a |= upgrade_json (std::stoull (version_l.get ()), tree_a);
-		auto peering_port_l (tree_a.get <std::string> ("peering_port"));
-		auto bootstrap_fraction_numerator_l (tree_a.get <std::string> ("bootstrap_fraction_numerator"));
-		auto receive_minimum_l (tree_a.get <std::string> ("receive_minimum"));
-		auto & logging_l (tree_a.get_child ("logging"));
-		work_peers.clear ();
-		auto work_peers_l (tree_a.get_child ("work_peers"));
-		for (auto i (work_peers_l.begin ()), n (work_peers_l.end ()); i != n; ++i)
-		{
-			auto work_peer (i->second.get <std::string> (""));
-			boost::asio::ip::address address;
-			uint16_t port;
-			result |= rai::parse_address_port (work_peer, address, port);
-			if (!result)
+			if (!done)
 			{
-				work_peers.push_back (std::make_pair (address, port));
+				pending.splice (pending.end (), overflow);
+			}
+			while (!pending.empty ())
+			{
+				insert (pending, pending.begin ());
 			}
 		}
-		auto preconfigured_peers_l (tree_a.get_child ("preconfigured_peers"));
-		preconfigured_peers.clear ();
-		for (auto i (preconfigured_peers_l.begin ()), n (preconfigured_peers_l.end ()); i != n; ++i)
-		{
-			auto bootstrap_peer (i->second.get <std::string> (""));
-			preconfigured_peers.push_back (bootstrap_peer);
-		}
-		auto preconfigured_representatives_l (tree_a.get_child ("preconfigured_representatives"));
-		preconfigured_representatives.clear ();
-		for (auto i (preconfigured_representatives_l.begin ()), n (preconfigured_representatives_l.end ()); i != n; ++i)
-		{
-			rai::account representative (0);
-			result = result || representative.decode_account (i->second.get <std::string> (""));
-			preconfigured_representatives.push_back (representative);
-		}
-		if (preconfigured_representatives.empty ())
-		{
-			result = true;
-		}
-		auto inactive_supply_l (tree_a.get <std::string> ("inactive_supply"));
-		auto password_fanout_l (tree_a.get <std::string> ("password_fanout"));
-		auto io_threads_l (tree_a.get <std::string> ("io_threads"));
-		auto work_threads_l (tree_a.get <std::string> ("work_threads"));
-		enable_voting = tree_a.get <bool> ("enable_voting");
-		auto bootstrap_connections_l (tree_a.get <std::string> ("bootstrap_connections"));
-		callback_address = tree_a.get <std::string> ("callback_address");
-		auto callback_port_l (tree_a.get <std::string> ("callback_port"));
-		callback_target = tree_a.get <std::string> ("callback_target");
-		result |= parse_port (callback_port_l, callback_port);
-		try
+		std::list <rai::operation> due;
+		due.splice (due.end (), wheel [0][index]);
+		for (auto & i: due)
 		{
-			peering_port = std::stoul (peering_port_l);
-			bootstrap_fraction_numerator = std::stoul (bootstrap_fraction_numerator_l);
-			password_fanout = std::stoul (password_fanout_l);
-			io_threads = std::stoul (io_threads_l);
-			work_threads = std::stoul (work_threads_l);
-			bootstrap_connections = std::stoul (bootstrap_connections_l);
-			result |= peering_port > std::numeric_limits <uint16_t>::max ();
-			result |= logging.deserialize_json (upgraded_a, logging_l);
-			result |= receive_minimum.decode_dec (receive_minimum_l);
-			result |= inactive_supply.decode_dec (inactive_supply_l);
-			result |= password_fanout < 16;
-			result |= password_fanout > 1024 * 1024;
-			result |= io_threads == 0;
-			result |= work_threads == 0;
+			handles.erase (i.id);
+			service.post (std::move (i.function));
 		}
-		catch (std::logic_error const &)
+		++current;
+	}
+}
+
+void rai::alarm::insert (std::list <rai::operation> & source_a, std::list <rai::operation>::iterator operation_a)
+{
+	auto tick_l (std::max (operation_a->tick, current));
+	auto delta (tick_l - current);
+	auto destination (&overflow);
+	for (size_t level (0); level < levels && destination == &overflow; ++level)
+	{
+		if (delta < (uint64_t (1) << (slot_bits * (level + 1))))
 		{
-			result = true;
+			destination = &wheel [level][(tick_l >> (slot_bits * level)) % slots];
 		}
 	}
-	catch (std::runtime_error const &)
+	destination->splice (destination->end (), source_a, operation_a);
+	handles [operation_a->id] = std::make_pair (destination, operation_a);
+}
+
+uint64_t rai::alarm::tick (std::chrono::system_clock::time_point const & time_a)
+{
+	// Rounded up so an operation never runs before its wakeup time
+	uint64_t result (0);
+	if (time_a > base)
 	{
-		result = true;
+		result = (time_a - base + tick_length - std::chrono::system_clock::duration (1)) / tick_length;
 	}
 	return result;
 }
 
-rai::account rai::node_config::random_representative ()
+uint64_t rai::alarm::add (std::chrono::system_clock::time_point const & wakeup_a, std::function <void ()> const & operation)
 {
-	assert (preconfigured_representatives.size () > 0);
-	size_t index (rai::random_pool.GenerateWord32 (0, preconfigured_representatives.size () - 1));
-	auto result (preconfigured_representatives [index]);
+    std::lock_guard <std::mutex> lock (mutex);
+	auto result (++id);
+	std::list <rai::operation> pending;
+	pending.push_back (rai::operation ({result, tick (wakeup_a), operation}));
+	auto tick_l (pending.front ().tick);
+	insert (pending, pending.begin ());
+	if (tick_l < waiting)
+	{
+		condition.notify_all ();
+	}
 	return result;
 }
 
-rai::vote_processor::vote_processor (rai::node & node_a) :
-node (node_a)
+bool rai::alarm::cancel (uint64_t handle_a)
 {
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (handles.find (handle_a));
+	auto result (existing == handles.end ());
+	if (!result)
+	{
+		existing->second.first->erase (existing->second.second);
+		handles.erase (existing);
+	}
+	return result;
 }
 
-rai::vote_result rai::vote_processor::vote (rai::vote const & vote_a, rai::endpoint endpoint_a)
+size_t rai::alarm::size ()
 {
-	rai::vote_result result;
-	{
-		rai::transaction transaction (node.store.environment, nullptr, false);
-		result = vote_a.validate (transaction, node.store);
-	}
-	if (node.config.logging.vote_logging ())
-	{
-		char const * status;
-		switch (result)
+	std::lock_guard <std::mutex> lock (mutex);
+	return handles.size ();
+}
+
+rai::logging::logging () :
+ledger_logging_value (false),
+ledger_duplicate_logging_value (false),
+vote_logging_value (false),
+network_logging_value (true),
+network_message_logging_value (false),
+network_publish_logging_value (false),
+network_packet_logging_value (false),
+network_keepalive_logging_value (false),
+node_lifetime_tracing_value (false),
+insufficient_work_logging_value (true),
+log_rpc_value (true),
+bulk_pull_logging_value (false),
+work_generation_time_value (true),
+log_to_cerr_value (false),
+max_size (16 * 1024 * 1024)
+{
+}
+
+void rai::logging::init (boost::filesystem::path const & application_path_a)
+{
+	static std::atomic_flag logging_already_added = ATOMIC_FLAG_INIT;
+	if (!logging_already_added.test_and_set ())
+	{
+		boost::log::add_common_attributes ();
+		if (log_to_cerr ())
 		{
-			case rai::vote_result::invalid:
-				status = "Invalid";
-				break;
-			case rai::vote_result::replay:
-				status = "Replay";
-				break;
-			case rai::vote_result::vote:
-				status = "Vote";
-				break;
+			boost::log::add_console_log (std::cerr, boost::log::keywords::format = "[%TimeStamp%]: %Message%");
 		}
-		BOOST_LOG (node.log) << boost::str (boost::format ("Vote from: %1% sequence: %2% block: %3% status: %4%") % vote_a.account.to_account () % std::to_string (vote_a.sequence) % vote_a.block->hash ().to_string () % status);
+		boost::log::add_file_log (boost::log::keywords::target = application_path_a / "log", boost::log::keywords::file_name = application_path_a / "log" / "log_%Y-%m-%d_%H-%M-%S.%N.log", boost::log::keywords::rotation_size = 4 * 1024 * 1024, boost::log::keywords::auto_flush = true, boost::log::keywords::scan_method = boost::log::sinks::file::scan_method::scan_matching, boost::log::keywords::max_size = max_size, boost::log::keywords::format = "[%TimeStamp%]: %Message%");
 	}
-	switch (result)
+}
+
+void rai::logging::serialize_json (boost::property_tree::ptree & tree_a) const
+{
+	tree_a.put ("version", "2");
+	tree_a.put ("ledger", ledger_logging_value);
+	tree_a.put ("ledger_duplicate", ledger_duplicate_logging_value);
+	tree_a.put ("vote", vote_logging_value);
+	tree_a.put ("network", network_logging_value);
+	tree_a.put ("network_message", network_message_logging_value);
+	tree_a.put ("network_publish", network_publish_logging_value);
+	tree_a.put ("network_packet", network_packet_logging_value);
+	tree_a.put ("network_keepalive", network_keepalive_logging_value);
+	tree_a.put ("node_lifetime_tracing", node_lifetime_tracing_value);
+	tree_a.put ("insufficient_work", insufficient_work_logging_value);
+	tree_a.put ("log_rpc", log_rpc_value);
+	tree_a.put ("bulk_pull", bulk_pull_logging_value);
+	tree_a.put ("work_generation_time", work_generation_time_value);
+	tree_a.put ("log_to_cerr", log_to_cerr_value);
+	tree_a.put ("max_size", max_size);
+}
+
+bool rai::logging::upgrade_json (unsigned version_a, boost::property_tree::ptree & tree_a)
+{
+	auto result (false);
+	switch (version_a)
 	{
-		case rai::vote_result::vote:
-			node.observers.vote (vote_a, endpoint_a);
-		case rai::vote_result::replay:
-		case rai::vote_result::invalid:
-			break;
+	case 1:
+		tree_a.put ("vote", vote_logging_value);
+		tree_a.put ("version", "2");
+		result = true;
+	case 2:
+	break;
+	default:
+		throw std::runtime_error ("Unknown logging_config version");
+	break;
 	}
 	return result;
 }
 
-void rai::rep_crawler::add (rai::block_hash const & hash_a)
+bool rai::logging::deserialize_json (bool & upgraded_a, boost::property_tree::ptree & tree_a)
 {
-	std::lock_guard <std::mutex> lock (mutex);
-	active.insert (hash_a);
+	auto result (false);
+	try
+	{
+		auto version_l (tree_a.get_optional <std::string> ("version"));
+		if (!version_l)
+		{
+			tree_a.put ("version", "1");
+			version_l = "1";
+			auto work_peers_l (tree_a.get_child_optional ("work_peers"));
+			if (!work_peers_l)
+			{
+				tree_a.add_child ("work_peers", boost::property_tree::ptree ());
+			}
+			upgraded_a = true;
+		}
+		upgraded_a |= upgrade_json (std::stoull (version_l.get ()), tree_a);
+		ledger_logging_value = tree_a.get <bool> ("ledger");
+		ledger_duplicate_logging_value = tree_a.get <bool> ("ledger_duplicate");
+		vote_logging_value = tree_a.get <bool> ("vote");
+		network_logging_value = tree_a.get <bool> ("network");
+		network_message_logging_value = tree_a.get <bool> ("network_message");
+		network_publish_logging_value = tree_a.get <bool> ("network_publish");
+		network_packet_logging_value = tree_a.get <bool> ("network_packet");
+		network_keepalive_logging_value = tree_a.get <bool> ("network_keepalive");
+		node_lifetime_tracing_value = tree_a.get <bool> ("node_lifetime_tracing");
+		insufficient_work_logging_value = tree_a.get <bool> ("insufficient_work");
+		log_rpc_value = tree_a.get <bool> ("log_rpc");
+		bulk_pull_logging_value = tree_a.get <bool> ("bulk_pull");
+		work_generation_time_value = tree_a.get <bool> ("work_generation_time");
+		log_to_cerr_value = tree_a.get <bool> ("log_to_cerr");
+		max_size = tree_a.get <uintmax_t> ("max_size");
+	}
+	catch (std::runtime_error const &)
+	{
+		result = true;
+	}
+	return result;
 }
 
-void rai::rep_crawler::remove (rai::block_hash const & hash_a)
+bool rai::logging::ledger_logging () const
 {
-	std::lock_guard <std::mutex> lock (mutex);
-	active.erase (hash_a);
+	return ledger_logging_value;
 }
 
-bool rai::rep_crawler::exists (rai::block_hash const & hash_a)
+bool rai::logging::ledger_duplicate_logging () const
 {
-	std::lock_guard <std::mutex> lock (mutex);
-	return active.count (hash_a) != 0;
+	return ledger_logging () && ledger_duplicate_logging_value;
 }
 
-rai::block_processor::block_processor (rai::node & node_a) :
-stopped (false),
-idle (true),
-node (node_a),
-thread ([this] () { process_blocks (); })
+bool rai::logging::vote_logging () const
 {
+	return vote_logging_value;
 }
 
-rai::block_processor::~block_processor ()
+bool rai::logging::network_logging () const
 {
-    stop ();
-    thread.join ();
+	return network_logging_value;
 }
 
-void rai::block_processor::stop ()
+bool rai::logging::network_message_logging () const
 {
-	std::lock_guard <std::mutex> lock (mutex);
-	stopped = true;
-	condition.notify_all ();
+	return network_logging () && network_message_logging_value;
 }
 
-void rai::block_processor::flush ()
+bool rai::logging::network_publish_logging () const
 {
-    std::unique_lock <std::mutex> lock (mutex);
-    while (!stopped && (!blocks.empty () || !idle))
-    {
-        condition.wait (lock);
-    }
+	return network_logging () && network_publish_logging_value;
 }
 
-void rai::block_processor::add (std::shared_ptr <rai::block> block_a, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)> action_a)
+bool rai::logging::network_packet_logging () const
 {
-    std::lock_guard <std::mutex> lock (mutex);
-    blocks.push_back (std::make_pair (block_a, action_a));
-    condition.notify_all ();
+	return network_logging () && network_packet_logging_value;
 }
 
-void rai::block_processor::process_blocks ()
+bool rai::logging::network_keepalive_logging () const
 {
-	std::unique_lock <std::mutex> lock (mutex);
-	while (!stopped)
-	{
-		if (!blocks.empty ())
-		{
-            {
-                auto info (blocks.front ());
-                blocks.pop_front ();
-                lock.unlock ();
-                process_receive_many (info.first, info.second);
-            }
-            // Let other threads get an opportunity to transaction lock
-            std::this_thread::yield ();
-			lock.lock ();
-		}
-		else
-		{
-            idle = true;
-            condition.notify_all ();
-			condition.wait (lock);
-            idle = false;
-		}
-	}
+	return network_logging () && network_keepalive_logging_value;
 }
 
-void rai::block_processor::process_receive_many (std::shared_ptr <rai::block> block_a, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)> completed_a)
+bool rai::logging::node_lifetime_tracing () const
 {
-	std::vector <std::shared_ptr <rai::block>> blocks;
-	blocks.push_back (block_a);
-    while (!blocks.empty ())
-    {
-		{
-			rai::transaction transaction (node.store.environment, nullptr, true);
-			auto count (0);
-			while (!blocks.empty () && count < rai::blocks_per_transaction)
-			{
-				auto block (blocks.back ());
-				blocks.pop_back ();
-				auto hash (block->hash ());
-				auto process_result (process_receive_one (transaction, block));
-				completed_a (transaction, process_result, block);
-				switch (process_result.code)
-				{
-					case rai::process_result::progress:
-					case rai::process_result::old:
-					{
-						auto cached (node.store.unchecked_get (transaction, hash));
-						for (auto i (cached.begin ()), n (cached.end ()); i != n; ++i)
-						{
-							node.store.unchecked_del (transaction, hash, **i);
-							blocks.push_back (std::move (*i));
-						}
-						std::lock_guard <std::mutex> lock (node.gap_cache.mutex);
-						node.gap_cache.blocks.get <1> ().erase (hash);
-						break;
-					}
-					default:
-						break;
-				}
-				++count;
-			}
-		}
-    }
+	return node_lifetime_tracing_value;
 }
 
-rai::process_return rai::block_processor::process_receive_one (MDB_txn * transaction_a, std::shared_ptr <rai::block> block_a)
+bool rai::logging::insufficient_work_logging () const
 {
-	rai::process_return result;
-	result = node.ledger.process (transaction_a, *block_a);
-    switch (result.code)
-    {
-        case rai::process_result::progress:
-        {
-            if (node.config.logging.ledger_logging ())
-            {
-                std::string block;
-                block_a->serialize_json (block);
-                BOOST_LOG (node.log) << boost::str (boost::format ("Processing block %1% %2%") % block_a->hash ().to_string () % block);
-            }
-            break;
-        }
-        case rai::process_result::gap_previous:
-        {
-            if (node.config.logging.ledger_logging ())
-            {
-                BOOST_LOG (node.log) << boost::str (boost::format ("Gap previous for: %1%") % block_a->hash ().to_string ());
-            }
-			node.store.unchecked_put (transaction_a, block_a->previous (), block_a);
-			node.gap_cache.add (transaction_a, block_a);
-			break;
-        }
-        case rai::process_result::gap_source:
-        {
-            if (node.config.logging.ledger_logging ())
-            {
-                BOOST_LOG (node.log) << boost::str (boost::format ("Gap source for: %1%") % block_a->hash ().to_string ());
-            }
-			node.store.unchecked_put (transaction_a, block_a->source (), block_a);
-			node.gap_cache.add (transaction_a, block_a);
-            break;
-        }
-        case rai::process_result::old:
-        {
-			{
-				auto root (block_a->root ());
-				auto hash (block_a->hash ());
-				auto existing (node.store.block_get (transaction_a, hash));
-				if (existing != nullptr)
-				{
-					// Replace block with one that has higher work value
-					if (node.work.work_value (root, block_a->block_work ()) > node.work.work_value (root, existing->block_work ()))
-					{
-						node.store.block_put (transaction_a, hash, *block_a, node.store.block_successor (transaction_a, hash));
-					}
-				}
-				else
-				{
-					// Could have been rolled back, maybe
-				}
-			}
+	return network_logging () && insufficient_work_logging_value;
+}
+
+bool rai::logging::log_rpc () const
+{
+	return network_logging () && log_rpc_value;
+}
+
+bool rai::logging::bulk_pull_logging () const
+{
+	return network_logging () && bulk_pull_logging_value;
+}
+
+bool rai::logging::callback_logging () const
+{
+	return network_logging ();
+}
+
+bool rai::logging::work_generation_time () const
+{
+	return work_generation_time_value;
+}
+
+bool rai::logging::log_to_cerr () const
+{
+	return log_to_cerr_value;
+}
+
+rai::node_init::node_init () :
+block_store_init (false),
+wallet_init (false)
+{
+}
+
+bool rai::node_init::error ()
+{
+    return block_store_init || wallet_init;
+}
+
+rai::node_config::node_config () :
+node_config (rai::network::node_port, rai::logging ())
+{
+}
+
+rai::node_config::node_config (uint16_t peering_port_a, rai::logging const & logging_a) :
+peering_port (peering_port_a),
+logging (logging_a),
+bootstrap_fraction_numerator (1),
+receive_minimum (rai::xrb_ratio),
+inactive_supply (0),
+password_fanout (1024),
+io_threads (std::max <unsigned> (4, std::thread::hardware_concurrency ())),
+work_threads (std::max <unsigned> (4, std::thread::hardware_concurrency ())),
+enable_voting (true),
+bootstrap_connections (16),
+callback_port (0),
+signature_checker_threads (std::thread::hardware_concurrency () / 2),
+online_weight_minimum (rai::rai_network == rai::rai_networks::rai_live_network ? rai::Gxrb_ratio * 60 : 0),
+peering_sockets (1),
+receive_threads (std::max <unsigned> (1, std::thread::hardware_concurrency () / 2)),
+batched_io (false),
+bandwidth_limit (0),
+peer_bandwidth_limit (0),
+send_queue_memory (16 * 1024 * 1024),
+traffic_weights ({ 8, 4, 1 }),
+announce_blocks (true),
+realtime_channels (0),
+publish_req_rate (rai::hash_list_message::hashes_max)
+{
+	switch (rai::rai_network)
+	{
+		case rai::rai_networks::rai_test_network:
+			preconfigured_representatives.push_back (rai::genesis_account);
+			break;
+		case rai::rai_networks::rai_beta_network:
+			preconfigured_peers.push_back ("rai.raiblocks.net");
+			preconfigured_representatives.push_back (rai::account ("59750C057F42806F40C5D9EAA1E0263E9DB48FE385BD0172BFC573BD37EEC4A7"));
+			preconfigured_representatives.push_back (rai::account ("8B05C9B160DE9B006FA27DD6A368D7CA122A2EE7537C308CF22EFD3ABF5B36C3"));
+			preconfigured_representatives.push_back (rai::account ("91D51BF05F02698EBB4649FB06D1BBFD2E4AE2579660E8D784A002D9C0CB1BD2"));
+			preconfigured_representatives.push_back (rai::account ("CB35ED23D47E1A16667EDE415CD4CD05961481D7D23A43958FAE81FC12FA49FF"));
+			break;
+		case rai::rai_networks::rai_live_network:
+			preconfigured_peers.push_back ("rai.raiblocks.net");
+			preconfigured_representatives.push_back (rai::account ("A30E0A32ED41C8607AA9212843392E853FCBCB4E7CB194E35C94F07F91DE59EF"));
+			preconfigured_representatives.push_back (rai::account ("67556D31DDFC2A440BF6147501449B4CB9572278D034EE686A6BEE29851681DF"));
+			preconfigured_representatives.push_back (rai::account ("5C2FBB148E006A8E8BA7A75DD86C9FE00C83F5FFDBFD76EAA09531071436B6AF"));
+			preconfigured_representatives.push_back (rai::account ("AE7AC63990DAAAF2A69BF11C913B928844BF5012355456F2F164166464024B29"));
+			preconfigured_representatives.push_back (rai::account ("BD6267D6ECD8038327D2BCC0850BDF8F56EC0414912207E81BCF90DFAC8A4AAA"));
+			preconfigured_representatives.push_back (rai::account ("2399A083C600AA0572F5E36247D978FCFC840405F8D4B6D33161C0066A55F431"));
+			preconfigured_representatives.push_back (rai::account ("2298FAB7C61058E77EA554CB93EDEEDA0692CBFCC540AB213B2836B29029E23A"));
+			preconfigured_representatives.push_back (rai::account ("3FE80B4BC842E82C1C18ABFEEC47EA989E63953BC82AC411F304D13833D52A56"));
+			break;
+		default:
+			assert (false);
+			break;
+	}
+}
+
+void rai::node_config::serialize_json (boost::property_tree::ptree & tree_a) const
+{
+	tree_a.put ("version", "17");
+	tree_a.put ("peering_port", std::to_string (peering_port));
+	tree_a.put ("bootstrap_fraction_numerator", std::to_string (bootstrap_fraction_numerator));
+	tree_a.put ("receive_minimum", receive_minimum.to_string_dec ());
+	boost::property_tree::ptree logging_l;
+	logging.serialize_json (logging_l);
+	tree_a.add_child ("logging", logging_l);
+	boost::property_tree::ptree work_peers_l;
+	for (auto i (work_peers.begin ()), n (work_peers.end ()); i != n; ++i)
+	{
+		boost::property_tree::ptree entry;
+		entry.put ("", boost::str (boost::format ("%1%:%2%") % i->first % i->second));
+		work_peers_l.push_back (std::make_pair ("", entry));
+	}
+	tree_a.add_child ("work_peers", work_peers_l);
+	boost::property_tree::ptree preconfigured_peers_l;
+	for (auto i (preconfigured_peers.begin ()), n (preconfigured_peers.end ()); i != n; ++i)
+	{
+		boost::property_tree::ptree entry;
+		entry.put ("", *i);
+		preconfigured_peers_l.push_back (std::make_pair ("", entry));
+	}
+	tree_a.add_child ("preconfigured_peers", preconfigured_peers_l);
+	boost::property_tree::ptree preconfigured_representatives_l;
+	for (auto i (preconfigured_representatives.begin ()), n (preconfigured_representatives.end ()); i != n; ++i)
+	{
+		boost::property_tree::ptree entry;
+		entry.put ("", i->to_account ());
+		preconfigured_representatives_l.push_back (std::make_pair ("", entry));
+	}
+	tree_a.add_child ("preconfigured_representatives", preconfigured_representatives_l);
+	tree_a.put ("inactive_supply", inactive_supply.to_string_dec ());
+	tree_a.put ("password_fanout", std::to_string (password_fanout));
+	tree_a.put ("io_threads", std::to_string (io_threads));
+	tree_a.put ("work_threads", std::to_string (work_threads));
+	tree_a.put ("enable_voting", enable_voting);
+	tree_a.put ("bootstrap_connections", bootstrap_connections);
+	tree_a.put ("callback_address", callback_address);
+	tree_a.put ("callback_port", std::to_string (callback_port));
+	tree_a.put ("callback_target", callback_target);
+	tree_a.put ("signature_checker_threads", std::to_string (signature_checker_threads));
+	tree_a.put ("online_weight_minimum", online_weight_minimum.to_string_dec ());
+	tree_a.put ("peering_sockets", std::to_string (peering_sockets));
+	tree_a.put ("batched_io", batched_io);
+	tree_a.put ("bandwidth_limit", std::to_string (bandwidth_limit));
+	tree_a.put ("peer_bandwidth_limit", std::to_string (peer_bandwidth_limit));
+	tree_a.put ("send_queue_memory", std::to_string (send_queue_memory));
+	tree_a.add_child ("traffic_weights", traffic_weights_tree (traffic_weights));
+	tree_a.put ("announce_blocks", announce_blocks);
+	tree_a.put ("realtime_channels", std::to_string (realtime_channels));
+	tree_a.put ("receive_threads", std::to_string (receive_threads));
+	tree_a.put ("publish_req_rate", std::to_string (publish_req_rate));
+}
+
+bool rai::node_config::upgrade_json (unsigned version, boost::property_tree::ptree & tree_a)
+{
+	auto result (false);
+	switch (version)
+	{
+	case 1:
+	{
+		auto reps_l (tree_a.get_child ("preconfigured_representatives"));
+		boost::property_tree::ptree reps;
+		for (auto i (reps_l.begin ()), n (reps_l.end ()); i != n; ++i)
+		{
+			rai::uint256_union account;
+			account.decode_account (i->second.get <std::string> (""));
+			boost::property_tree::ptree entry;
+			entry.put ("", account.to_account ());
+			reps.push_back (std::make_pair ("", entry));
+		}
+		tree_a.erase ("preconfigured_representatives");
+		tree_a.add_child ("preconfigured_representatives", reps);
+		tree_a.erase ("version");
+		tree_a.put ("version", "2");
+		result = true;
+	}
+	case 2:
+	{
+		tree_a.put ("inactive_supply", rai::uint128_union (0).to_string_dec ());
+		tree_a.put ("password_fanout", std::to_string (1024));
+		tree_a.put ("io_threads", std::to_string (io_threads));
+		tree_a.put ("work_threads", std::to_string (work_threads));
+		tree_a.erase ("version");
+		tree_a.put ("version", "3");
+		result = true;
+	}
+	case 3:
+		tree_a.erase ("receive_minimum");
+		tree_a.put ("receive_minimum", rai::xrb_ratio.convert_to <std::string> ());
+		tree_a.erase ("version");
+		tree_a.put ("version", "4");
+		result = true;
+		break;
+	case 4:
+		tree_a.erase ("receive_minimum");
+		tree_a.put ("receive_minimum", rai::xrb_ratio.convert_to <std::string> ());
+		tree_a.erase ("version");
+		tree_a.put ("version", "5");
+		result = true;
+		break;
+	case 5:
+		tree_a.put ("enable_voting", enable_voting);
+		tree_a.erase ("packet_delay_microseconds");
+		tree_a.erase ("rebroadcast_delay");
+		tree_a.erase ("creation_rebroadcast");
+		tree_a.erase ("version");
+		tree_a.put ("version", "6");
+		result = true;
+		break;
+	case 6:
+		tree_a.put ("bootstrap_connections", 16);
+		tree_a.put ("callback_address", "");
+		tree_a.put ("callback_port", "0");
+		tree_a.put ("callback_target", "");
+		tree_a.erase ("version");
+		tree_a.put ("version", "7");
+		result = true;
+		break;
+	case 7:
+		tree_a.put ("signature_checker_threads", std::to_string (signature_checker_threads));
+		tree_a.erase ("version");
+		tree_a.put ("version", "8");
+		result = true;
+	case 8:
+		tree_a.put ("online_weight_minimum", online_weight_minimum.to_string_dec ());
+		tree_a.erase ("version");
+		tree_a.put ("version", "9");
+		result = true;
+	case 9:
+		tree_a.put ("peering_sockets", std::to_string (peering_sockets));
+		tree_a.erase ("version");
+		tree_a.put ("version", "10");
+		result = true;
+	case 10:
+		tree_a.put ("batched_io", batched_io);
+		tree_a.erase ("version");
+		tree_a.put ("version", "11");
+		result = true;
+	case 11:
+		tree_a.put ("bandwidth_limit", std::to_string (bandwidth_limit));
+		tree_a.put ("peer_bandwidth_limit", std::to_string (peer_bandwidth_limit));
+		tree_a.put ("send_queue_memory", std::to_string (send_queue_memory));
+		tree_a.erase ("version");
+		tree_a.put ("version", "12");
+		result = true;
+	case 12:
+		tree_a.add_child ("traffic_weights", traffic_weights_tree (traffic_weights));
+		tree_a.erase ("version");
+		tree_a.put ("version", "13");
+		result = true;
+	case 13:
+		tree_a.put ("announce_blocks", announce_blocks);
+		tree_a.erase ("version");
+		tree_a.put ("version", "14");
+		result = true;
+	case 14:
+		tree_a.put ("realtime_channels", std::to_string (realtime_channels));
+		tree_a.erase ("version");
+		tree_a.put ("version", "15");
+		result = true;
+	case 15:
+		tree_a.put ("receive_threads", std::to_string (receive_threads));
+		tree_a.erase ("version");
+		tree_a.put ("version", "16");
+		result = true;
+	case 16:
+		tree_a.put ("publish_req_rate", std::to_string (publish_req_rate));
+		tree_a.erase ("version");
+		tree_a.put ("version", "17");
+		result = true;
+	case 17:
+		break;
+	default:
+		throw std::runtime_error ("Unknown node_config version");
+	}
+	return result;
+}
+
+bool rai::node_config::deserialize_json (bool & upgraded_a, boost::property_tree::ptree & tree_a)
+{
+	auto result (false);
+	try
+	{
+		auto version_l (tree_a.get_optional <std::string> ("version"));
+		if (!version_l)
+		{
+			tree_a.put ("version", "1");
+			version_l = "1";
+			auto work_peers_l (tree_a.get_child_optional ("work_peers"));
+			if (!work_peers_l)
+			{
+				tree_a.add_child ("work_peers", boost::property_tree::ptree ());
+			}
+			upgraded_a = true;
+		}
+		upgraded_a |= upgrade_json (std::stoull (version_l.get ()), tree_a);
+		auto peering_port_l (tree_a.get <std::string> ("peering_port"));
+		auto bootstrap_fraction_numerator_l (tree_a.get <std::string> ("bootstrap_fraction_numerator"));
+		auto receive_minimum_l (tree_a.get <std::string> ("receive_minimum"));
+		auto & logging_l (tree_a.get_child ("logging"));
+		work_peers.clear ();
+		auto work_peers_l (tree_a.get_child ("work_peers"));
+		for (auto i (work_peers_l.begin ()), n (work_peers_l.end ()); i != n; ++i)
+		{
+			auto work_peer (i->second.get <std::string> (""));
+			boost::asio::ip::address address;
+			uint16_t port;
+			result |= rai::parse_address_port (work_peer, address, port);
+			if (!result)
+			{
+				work_peers.push_back (std::make_pair (address, port));
+			}
+		}
+		auto preconfigured_peers_l (tree_a.get_child ("preconfigured_peers"));
+		preconfigured_peers.clear ();
+		for (auto i (preconfigured_peers_l.begin ()), n (preconfigured_peers_l.end ()); i != n; ++i)
+		{
+			auto bootstrap_peer (i->second.get <std::string> (""));
+			preconfigured_peers.push_back (bootstrap_peer);
+		}
+		auto preconfigured_representatives_l (tree_a.get_child ("preconfigured_representatives"));
+		preconfigured_representatives.clear ();
+		for (auto i (preconfigured_representatives_l.begin ()), n (preconfigured_representatives_l.end ()); i != n; ++i)
+		{
+			rai::account representative (0);
+			result = result || representative.decode_account (i->second.get <std::string> (""));
+			preconfigured_representatives.push_back (representative);
+		}
+		if (preconfigured_representatives.empty ())
+		{
+			result = true;
+		}
+		auto inactive_supply_l (tree_a.get <std::string> ("inactive_supply"));
+		auto password_fanout_l (tree_a.get <std::string> ("password_fanout"));
+		auto io_threads_l (tree_a.get <std::string> ("io_threads"));
+		auto work_threads_l (tree_a.get <std::string> ("work_threads"));
+		enable_voting = tree_a.get <bool> ("enable_voting");
+		auto bootstrap_connections_l (tree_a.get <std::string> ("bootstrap_connections"));
+		callback_address = tree_a.get <std::string> ("callback_address");
+		auto callback_port_l (tree_a.get <std::string> ("callback_port"));
+		callback_target = tree_a.get <std::string> ("callback_target");
+		auto signature_checker_threads_l (tree_a.get <std::string> ("signature_checker_threads"));
+		auto online_weight_minimum_l (tree_a.get <std::string> ("online_weight_minimum"));
+		auto peering_sockets_l (tree_a.get <std::string> ("peering_sockets"));
+		batched_io = tree_a.get <bool> ("batched_io");
+		auto bandwidth_limit_l (tree_a.get <std::string> ("bandwidth_limit"));
+		auto peer_bandwidth_limit_l (tree_a.get <std::string> ("peer_bandwidth_limit"));
+		auto send_queue_memory_l (tree_a.get <std::string> ("send_queue_memory"));
+		auto traffic_weights_l (tree_a.get_child ("traffic_weights"));
+		announce_blocks = tree_a.get <bool> ("announce_blocks");
+		auto realtime_channels_l (tree_a.get <std::string> ("realtime_channels"));
+		auto receive_threads_l (tree_a.get <std::string> ("receive_threads"));
+		auto publish_req_rate_l (tree_a.get <std::string> ("publish_req_rate"));
+		result |= parse_port (callback_port_l, callback_port);
+		try
+		{
+			peering_port = std::stoul (peering_port_l);
+			bootstrap_fraction_numerator = std::stoul (bootstrap_fraction_numerator_l);
+			password_fanout = std::stoul (password_fanout_l);
+			io_threads = std::stoul (io_threads_l);
+			work_threads = std::stoul (work_threads_l);
+			bootstrap_connections = std::stoul (bootstrap_connections_l);
+			signature_checker_threads = std::stoul (signature_checker_threads_l);
+			peering_sockets = std::stoul (peering_sockets_l);
+			bandwidth_limit = std::stoull (bandwidth_limit_l);
+			peer_bandwidth_limit = std::stoull (peer_bandwidth_limit_l);
+			send_queue_memory = std::stoull (send_queue_memory_l);
+			realtime_channels = std::stoul (realtime_channels_l);
+			receive_threads = std::stoul (receive_threads_l);
+			publish_req_rate = std::stoul (publish_req_rate_l);
+			for (size_t i (0); i < traffic_weights.size (); ++i)
+			{
+				traffic_weights [i] = std::stoul (traffic_weights_l.get <std::string> (rai::traffic_class_name (static_cast <rai::traffic_class> (i))));
+				result |= traffic_weights [i] == 0;
+			}
+			result |= peering_port > std::numeric_limits <uint16_t>::max ();
+			result |= logging.deserialize_json (upgraded_a, logging_l);
+			result |= receive_minimum.decode_dec (receive_minimum_l);
+			result |= inactive_supply.decode_dec (inactive_supply_l);
+			result |= online_weight_minimum.decode_dec (online_weight_minimum_l);
+			result |= password_fanout < 16;
+			result |= password_fanout > 1024 * 1024;
+			result |= io_threads == 0;
+			result |= work_threads == 0;
+			result |= peering_sockets == 0;
+			result |= receive_threads == 0;
+			result |= publish_req_rate == 0;
+			result |= send_queue_memory == 0;
+		}
+		catch (std::logic_error const &)
+		{
+			result = true;
+		}
+	}
+	catch (std::runtime_error const &)
+	{
+		result = true;
+	}
+	return result;
+}
+
+rai::account rai::node_config::random_representative ()
+{
+	assert (preconfigured_representatives.size () > 0);
+	size_t index (rai::random_pool.GenerateWord32 (0, preconfigured_representatives.size () - 1));
+	auto result (preconfigured_representatives [index]);
+	return result;
+}
+
+rai::vote_processor::vote_processor (rai::node & node_a) :
+node (node_a),
+stale (0),
+overflow (0),
+unknown_hashes (0),
+stopped (false),
+idle (true),
+thread ([this] () { process_loop (); })
+{
+}
+
+rai::vote_processor::~vote_processor ()
+{
+	stop ();
+	thread.join ();
+}
+
+void rai::vote_processor::stop ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	stopped = true;
+	condition.notify_all ();
+}
+
+void rai::vote_processor::flush ()
+{
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!stopped && (!votes.empty () || !idle))
+	{
+		condition.wait (lock);
+	}
+}
+
+void rai::vote_processor::add (rai::vote const & vote_a, rai::endpoint const & endpoint_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	if (votes.size () < max_votes)
+	{
+		votes.push_back (std::make_pair (vote_a, endpoint_a));
+		condition.notify_all ();
+	}
+	else
+	{
+		++overflow;
+	}
+}
+
+void rai::vote_processor::process_loop ()
+{
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!stopped)
+	{
+		if (!votes.empty ())
+		{
+			std::deque <std::pair <rai::vote, rai::endpoint>> batch;
+			while (!votes.empty () && batch.size () < batch_max)
+			{
+				batch.push_back (std::move (votes.front ()));
+				votes.pop_front ();
+			}
+			lock.unlock ();
+			process_batch (batch);
+			lock.lock ();
+		}
+		else
+		{
+			idle = true;
+			condition.notify_all ();
+			condition.wait (lock);
+			idle = false;
+		}
+	}
+}
+
+void rai::vote_processor::process_batch (std::deque <std::pair <rai::vote, rai::endpoint>> & batch_a)
+{
+	std::vector <rai::vote_result> results (batch_a.size (), rai::vote_result::invalid);
+	std::vector <rai::signature_check> checks;
+	std::vector <size_t> indices;
+	// Range in accepted of each batch entry's expanded votes
+	std::vector <std::pair <size_t, size_t>> ranges (batch_a.size (), std::make_pair (0, 0));
+	{
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		std::lock_guard <std::mutex> lock (node.store.sequence_mutex);
+		for (size_t i (0), n (batch_a.size ()); i < n; ++i)
+		{
+			auto & vote (batch_a [i].first);
+			if (node.store.sequence_current (transaction, vote.account) > vote.sequence)
+			{
+				// A higher sequence has been seen from this account, don't spend a signature check on it
+				results [i] = rai::vote_result::replay;
+				++stale;
+			}
+			else
+			{
+				checks.push_back ({vote.account, vote.hash (), vote.signature, false});
+				indices.push_back (i);
+			}
+		}
+	}
+	// Shares the node's checker threads with the block processor, verify takes one batch at a time
+	node.checker.verify (checks);
+	std::vector <std::pair <rai::vote, rai::endpoint>> accepted;
+	{
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		for (size_t i (0), n (checks.size ()); i < n; ++i)
+		{
+			if (checks [i].valid)
+			{
+				auto index (indices [i]);
+				auto & vote (batch_a [index].first);
+				// Make sure this sequence number is > any we've seen from this account before
+				results [index] = node.store.sequence_atomic_observe (transaction, vote.account, vote.sequence) == vote.sequence ? rai::vote_result::vote : rai::vote_result::replay;
+				if (results [index] == rai::vote_result::vote)
+				{
+					ranges [index].first = accepted.size ();
+					expand (transaction, vote, batch_a [index].second, accepted);
+					ranges [index].second = accepted.size ();
+				}
+			}
+		}
+	}
+	{
+		// Voters count toward online weight before their votes are tallied
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		for (auto & i: accepted)
+		{
+			node.online_reps.vote (transaction, i.first.account);
+		}
+	}
+	for (size_t i (0), n (batch_a.size ()); i < n; ++i)
+	{
+		tally (batch_a [i].first, accepted.begin () + ranges [i].first, accepted.begin () + ranges [i].second);
+	}
+	for (size_t i (0), n (batch_a.size ()); i < n; ++i)
+	{
+		vote_completed (batch_a [i].first, results [i]);
+	}
+	for (auto & i: accepted)
+	{
+		node.observers.vote (i.first, i.second);
+	}
+}
+
+void rai::vote_processor::expand (MDB_txn * transaction_a, rai::vote const & vote_a, rai::endpoint const & endpoint_a, std::vector <std::pair <rai::vote, rai::endpoint>> & votes_a)
+{
+	if (vote_a.block != nullptr)
+	{
+		votes_a.push_back (std::make_pair (vote_a, endpoint_a));
+	}
+	else
+	{
+		// Each hash becomes its own vote carrying the block, hashes are kept so the signature still checks and republishing sends the original
+		// Forks and gaps aren't in the ledger, they're found in the elections and gap cache holding them
+		std::vector <rai::block_hash> missing;
+		for (auto & i: vote_a.hashes)
+		{
+			std::shared_ptr <rai::block> block (node.store.block_get (transaction_a, i));
+			if (block == nullptr)
+			{
+				block = node.active.find (i);
+			}
+			if (block == nullptr)
+			{
+				block = node.gap_cache.find (i);
+			}
+			if (block != nullptr)
+			{
+				votes_a.push_back (std::make_pair (vote_a, endpoint_a));
+				votes_a.back ().first.block = std::move (block);
+			}
+			else
+			{
+				++unknown_hashes;
+				if (endpoint_a.port () != 0 && !node.block_processor.have (i) && node.pull_cache.add (i, endpoint_a))
+				{
+					missing.push_back (i);
+				}
+			}
+		}
+		if (!missing.empty ())
+		{
+			// The voter has the block, the next vote for it can be matched once it arrives
+			node.network.send_publish_req (endpoint_a, missing);
+		}
+	}
+}
+
+rai::vote_result rai::vote_processor::vote (rai::vote const & vote_a, rai::endpoint endpoint_a)
+{
+	rai::vote_result result;
+	std::vector <std::pair <rai::vote, rai::endpoint>> votes_l;
+	{
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		result = vote_a.validate (transaction, node.store);
+		if (result == rai::vote_result::vote)
+		{
+			node.online_reps.vote (transaction, vote_a.account);
+			expand (transaction, vote_a, endpoint_a, votes_l);
+		}
+	}
+	tally (vote_a, votes_l.begin (), votes_l.end ());
+	vote_completed (vote_a, result);
+	for (auto & i: votes_l)
+	{
+		node.observers.vote (i.first, i.second);
+	}
+	return result;
+}
+
+void rai::vote_processor::tally (rai::vote const & vote_a, std::vector <std::pair <rai::vote, rai::endpoint>>::const_iterator begin_a, std::vector <std::pair <rai::vote, rai::endpoint>>::const_iterator end_a)
+{
+	auto republish (false);
+	for (auto i (begin_a); i != end_a; ++i)
+	{
+		republish |= node.active.vote (i->first);
+	}
+	if (republish)
+	{
+		// A vote-by-hash is republished whole, once, no matter how many elections it reached
+		node.network.republish_vote (vote_a);
+	}
+}
+
+void rai::vote_processor::vote_completed (rai::vote const & vote_a, rai::vote_result result_a)
+{
+	if (node.config.logging.vote_logging ())
+	{
+		char const * status;
+		switch (result_a)
+		{
+			case rai::vote_result::invalid:
+				status = "Invalid";
+				break;
+			case rai::vote_result::replay:
+				status = "Replay";
+				break;
+			case rai::vote_result::vote:
+				status = "Vote";
+				break;
+		}
+		BOOST_LOG (node.log) << boost::str (boost::format ("Vote from: %1% sequence: %2% block: %3% status: %4%") % vote_a.account.to_account () % std::to_string (vote_a.sequence) % (vote_a.block != nullptr ? vote_a.block->hash ().to_string () : std::to_string (vote_a.hashes.size ()) + " hashes") % status);
+	}
+}
+
+rai::online_reps::online_reps (rai::node & node_a) :
+node (node_a),
+online (0)
+{
+}
+
+void rai::online_reps::vote (MDB_txn * transaction_a, rai::account const & account_a)
+{
+	auto now (std::chrono::steady_clock::now ());
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (reps.get <1> ().find (account_a));
+	if (existing != reps.get <1> ().end ())
+	{
+		reps.get <1> ().modify (existing, [now] (rai::online_rep & rep_a)
+		{
+			rep_a.last_vote = now;
+		});
+	}
+	else
+	{
+		auto weight (node.ledger.weight (transaction_a, account_a));
+		if (!weight.is_zero ())
+		{
+			reps.insert ({account_a, weight, now});
+			online += weight;
+		}
+	}
+	trim (now);
+}
+
+void rai::online_reps::trim (std::chrono::steady_clock::time_point const & now_a)
+{
+	while (!reps.empty () && reps.begin ()->last_vote < now_a - window)
+	{
+		online -= reps.begin ()->weight;
+		reps.erase (reps.begin ());
+	}
+}
+
+rai::uint128_t rai::online_reps::online_stake ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	trim (std::chrono::steady_clock::now ());
+	return std::max (online, node.config.online_weight_minimum.number ());
+}
+
+rai::vote_generator::vote_generator (rai::node & node_a) :
+node (node_a),
+votes (0),
+hashes_voted (0),
+overflow (0),
+stopped (false),
+thread ([this] () { run (); })
+{
+}
+
+rai::vote_generator::~vote_generator ()
+{
+	stop ();
+	thread.join ();
+}
+
+void rai::vote_generator::stop ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	stopped = true;
+	condition.notify_all ();
+}
+
+void rai::vote_generator::add (rai::block_hash const & hash_a)
+{
+	if (node.wallets.have_representatives ())
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		if (hashes.size () < max_hashes)
+		{
+			hashes.push_back (hash_a);
+			if (hashes.size () >= rai::vote::hashes_max)
+			{
+				condition.notify_all ();
+			}
+		}
+		else
+		{
+			++overflow;
+		}
+	}
+}
+
+void rai::vote_generator::run ()
+{
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!stopped)
+	{
+		if (!hashes.empty ())
+		{
+			// Give other hashes a short window to join this batch
+			auto cutoff (std::chrono::steady_clock::now () + std::chrono::milliseconds (wait_ms));
+			while (!stopped && hashes.size () < rai::vote::hashes_max && std::chrono::steady_clock::now () < cutoff)
+			{
+				condition.wait_until (lock, cutoff);
+			}
+			std::vector <rai::block_hash> batch;
+			while (!hashes.empty () && batch.size () < rai::vote::hashes_max)
+			{
+				batch.push_back (hashes.front ());
+				hashes.pop_front ();
+			}
+			lock.unlock ();
+			send (batch);
+			lock.lock ();
+		}
+		else
+		{
+			condition.wait_for (lock, std::chrono::milliseconds (wait_ms));
+		}
+	}
+}
+
+void rai::vote_generator::send (std::vector <rai::block_hash> const & hashes_a)
+{
+	std::vector <rai::endpoint> older;
+	std::vector <rai::endpoint> newer;
+	node.peers.partition_version (node.peers.list_sqrt (), rai::message::vote_by_hash_version, older, newer);
+	rai::transaction transaction (node.store.environment, nullptr, false);
+	node.wallets.foreach_representative (transaction, [this, &hashes_a, &newer, &transaction] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
+	{
+		auto sequence (node.store.sequence_atomic_inc (transaction, pub_a));
+		rai::vote vote (pub_a, prv_a, sequence, hashes_a);
+		++votes;
+		hashes_voted += hashes_a.size ();
+		rai::confirm_ack confirm (vote);
+		std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+		{
+			rai::vectorstream stream (*bytes);
+			confirm.serialize (stream);
+		}
+		for (auto & i: newer)
+		{
+			node.network.confirm_send (confirm, bytes, i);
+		}
+	});
+}
+
+void rai::rep_crawler::add (rai::block_hash const & hash_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	active.insert (hash_a);
+}
+
+void rai::rep_crawler::remove (rai::block_hash const & hash_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	active.erase (hash_a);
+}
+
+bool rai::rep_crawler::exists (rai::block_hash const & hash_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	return active.count (hash_a) != 0;
+}
+
+rai::vote_cache::vote_cache (rai::node & node_a) :
+node (node_a),
+signatures (0),
+hits (0)
+{
+}
+
+std::vector <rai::generated_vote> rai::vote_cache::find (MDB_txn * transaction_a, rai::block_hash const & root_a, rai::block_hash const & hash_a)
+{
+	std::vector <rai::generated_vote> result;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		auto existing (votes.get <1> ().find (root_a));
+		if (existing != votes.get <1> ().end () && existing->hash == hash_a && existing->created + max_age > std::chrono::steady_clock::now ())
+		{
+			result = existing->votes;
+		}
+	}
+	if (!result.empty ())
+	{
+		// Once a representative signs anything else the cached vote is a replay to every peer that saw it
+		std::lock_guard <std::mutex> lock (node.store.sequence_mutex);
+		auto current (true);
+		for (auto i (result.begin ()), n (result.end ()); i != n && current; ++i)
+		{
+			auto & vote (i->confirm->vote);
+			current = node.store.sequence_current (transaction_a, vote.account) == vote.sequence;
+		}
+		if (!current)
+		{
+			result.clear ();
+		}
+	}
+	return result;
+}
+
+void rai::vote_cache::add (rai::block_hash const & root_a, rai::block_hash const & hash_a, std::vector <rai::generated_vote> const & votes_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (votes.get <1> ().find (root_a));
+	if (existing != votes.get <1> ().end ())
+	{
+		votes.get <1> ().erase (existing);
+	}
+	votes.push_back ({root_a, hash_a, std::chrono::steady_clock::now (), votes_a});
+	if (votes.size () > max)
+	{
+		votes.pop_front ();
+	}
+}
+
+rai::pull_cache::pull_cache (rai::node & node_a) :
+node (node_a),
+requested (0),
+retried (0),
+abandoned (0)
+{
+}
+
+bool rai::pull_cache::add (rai::block_hash const & hash_a, rai::endpoint const & endpoint_a)
+{
+	auto result (false);
+	uint64_t evicted (0);
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		auto existing (pulls.get <1> ().find (hash_a));
+		if (existing == pulls.get <1> ().end ())
+		{
+			pulls.push_back ({hash_a, std::chrono::steady_clock::now (), std::vector <rai::endpoint> (1, endpoint_a), 1, 0});
+			if (pulls.size () > max)
+			{
+				evicted = pulls.front ().alarm;
+				pulls.pop_front ();
+			}
+			++requested;
+			result = true;
+		}
+		else
+		{
+			pulls.get <1> ().modify (existing, [&endpoint_a] (rai::pull_information & info_a)
+			{
+				if (info_a.sources.size () < sources_max && std::find (info_a.sources.begin (), info_a.sources.end (), endpoint_a) == info_a.sources.end ())
+				{
+					info_a.sources.push_back (endpoint_a);
+				}
+			});
+		}
+	}
+	if (evicted != 0)
+	{
+		node.alarm.cancel (evicted);
+	}
+	if (result)
+	{
+		schedule (hash_a);
+	}
+	return result;
+}
+
+void rai::pull_cache::schedule (rai::block_hash const & hash_a)
+{
+	std::weak_ptr <rai::node> node_w (node.shared ());
+	auto alarm (node.alarm.add (std::chrono::system_clock::now () + retry_interval, [node_w, hash_a] ()
+	{
+		if (auto node_l = node_w.lock ())
+		{
+			node_l->pull_cache.retry (hash_a);
+		}
+	}));
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (pulls.get <1> ().find (hash_a));
+	if (existing != pulls.get <1> ().end ())
+	{
+		pulls.get <1> ().modify (existing, [alarm] (rai::pull_information & info_a)
+		{
+			info_a.alarm = alarm;
+		});
+	}
+}
+
+void rai::pull_cache::fill (rai::block_hash const & hash_a)
+{
+	uint64_t alarm (0);
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		auto existing (pulls.get <1> ().find (hash_a));
+		if (existing != pulls.get <1> ().end ())
+		{
+			alarm = existing->alarm;
+			pulls.get <1> ().erase (existing);
+		}
+	}
+	if (alarm != 0)
+	{
+		node.alarm.cancel (alarm);
+	}
+}
+
+void rai::pull_cache::retry (rai::block_hash const & hash_a)
+{
+	// A block that arrived and is waiting to be processed or on a dependency doesn't need pulling again
+	auto exists (node.ledger.block_exists (hash_a) || node.block_processor.have (hash_a));
+	auto send (false);
+	rai::endpoint next;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		auto existing (pulls.get <1> ().find (hash_a));
+		if (existing != pulls.get <1> ().end ())
+		{
+			if (exists)
+			{
+				pulls.get <1> ().erase (existing);
+			}
+			else if (existing->attempts < attempts_max || existing->sources.size () > 1)
+			{
+				pulls.get <1> ().modify (existing, [&next] (rai::pull_information & info_a)
+				{
+					if (info_a.attempts < attempts_max)
+					{
+						++info_a.attempts;
+					}
+					else
+					{
+						info_a.sources.erase (info_a.sources.begin ());
+						info_a.attempts = 1;
+					}
+					info_a.requested = std::chrono::steady_clock::now ();
+					next = info_a.sources.front ();
+				});
+				++retried;
+				send = true;
+			}
+			else
+			{
+				pulls.get <1> ().erase (existing);
+				++abandoned;
+			}
+		}
+	}
+	if (send)
+	{
+		node.network.send_publish_req (next, std::vector <rai::block_hash> (1, hash_a));
+		schedule (hash_a);
+	}
+}
+
+size_t rai::pull_cache::size ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	return pulls.size ();
+}
+
+void rai::pull_cache::serialize (boost::property_tree::ptree & tree_a)
+{
+	tree_a.put ("size", std::to_string (size ()));
+	tree_a.put ("requested", std::to_string (requested));
+	tree_a.put ("retried", std::to_string (retried));
+	tree_a.put ("abandoned", std::to_string (abandoned));
+}
+
+rai::signature_checker::signature_checker (unsigned threads_a) :
+checks (nullptr),
+next (0),
+remaining (0),
+stopped (false)
+{
+	for (unsigned i (0); i < threads_a; ++i)
+	{
+		threads.push_back (std::thread ([this] () { run (); }));
+	}
+}
+
+rai::signature_checker::~signature_checker ()
+{
+	stop ();
+	for (auto & i: threads)
+	{
+		i.join ();
+	}
+}
+
+void rai::signature_checker::stop ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	stopped = true;
+	condition.notify_all ();
+}
+
+void rai::signature_checker::verify (std::vector <rai::signature_check> & checks_a)
+{
+	std::unique_lock <std::mutex> lock (mutex);
+	while (checks != nullptr)
+	{
+		condition.wait (lock);
+	}
+	checks = &checks_a;
+	next = 0;
+	remaining = checks_a.size ();
+	condition.notify_all ();
+	while (verify_chunk (lock))
+	{
+	}
+	while (remaining != 0)
+	{
+		condition.wait (lock);
+	}
+	checks = nullptr;
+	condition.notify_all ();
+}
+
+bool rai::signature_checker::verify_chunk (std::unique_lock <std::mutex> & lock_a)
+{
+	auto result (checks != nullptr && next < checks->size ());
+	if (result)
+	{
+		auto & checks_l (*checks);
+		auto begin (next);
+		auto end (std::min (begin + chunk_size, checks_l.size ()));
+		next = end;
+		lock_a.unlock ();
+		auto count (end - begin);
+		std::vector <unsigned char const *> messages (count);
+		std::vector <size_t> lengths (count, sizeof (rai::uint256_union));
+		std::vector <unsigned char const *> public_keys (count);
+		std::vector <unsigned char const *> signatures (count);
+		std::vector <int> valid (count, 0);
+		for (size_t i (0); i < count; ++i)
+		{
+			auto & check (checks_l [begin + i]);
+			messages [i] = check.message.bytes.data ();
+			public_keys [i] = check.account.bytes.data ();
+			signatures [i] = check.signature.bytes.data ();
+		}
+		rai::validate_message_batch (messages.data (), lengths.data (), public_keys.data (), signatures.data (), count, valid.data ());
+		for (size_t i (0); i < count; ++i)
+		{
+			checks_l [begin + i].valid = valid [i] != 0;
+		}
+		lock_a.lock ();
+		remaining -= end - begin;
+		if (remaining == 0)
+		{
+			condition.notify_all ();
+		}
+	}
+	return result;
+}
+
+void rai::signature_checker::run ()
+{
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!stopped)
+	{
+		if (!verify_chunk (lock))
+		{
+			condition.wait (lock);
+		}
+	}
+}
+
+rai::block_processor::block_processor (rai::node & node_a) :
+dependencies (node_a.store),
+duplicates_fast (0),
+duplicates_slow (0),
+duplicates_replaced (0),
+stopped (false),
+idle (true),
+node (node_a),
+thread ([this] () { process_blocks (); })
+{
+}
+
+rai::block_processor::~block_processor ()
+{
+    stop ();
+    thread.join ();
+	if (dependencies.size () > 0)
+	{
+		rai::transaction transaction (node.store.environment, nullptr, true);
+		dependencies.flush (transaction);
+	}
+}
+
+void rai::block_processor::stop ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	stopped = true;
+	condition.notify_all ();
+}
+
+void rai::block_processor::flush ()
+{
+    std::unique_lock <std::mutex> lock (mutex);
+    while (!stopped && (!blocks.empty () || !idle))
+    {
+        condition.wait (lock);
+    }
+}
+
+void rai::block_processor::add (std::shared_ptr <rai::block> block_a, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)> action_a)
+{
+    auto hash (block_a->hash ());
+    std::lock_guard <std::mutex> lock (mutex);
+    blocks.push_back (std::make_pair (block_a, action_a));
+    queued.insert (hash);
+    condition.notify_all ();
+}
+
+bool rai::block_processor::have (rai::block_hash const & hash_a)
+{
+	auto result (false);
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		result = queued.count (hash_a) != 0;
+	}
+	// Entries spilled to the unchecked table are keyed by their dependency and can't be found by hash
+	result = result || dependencies.find (hash_a) != nullptr;
+	return result;
+}
+
+void rai::block_processor::process_blocks ()
+{
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!stopped)
+	{
+		if (!blocks.empty ())
+		{
+            {
+                std::deque <std::pair <std::shared_ptr <rai::block>, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)>>> batch;
+                while (!blocks.empty () && batch.size () < batch_max)
+                {
+                    batch.push_back (blocks.front ());
+                    blocks.pop_front ();
+                }
+                lock.unlock ();
+                process_batch (batch);
+                lock.lock ();
+                for (auto & i: batch)
+                {
+                    auto existing (queued.find (i.first->hash ()));
+                    if (existing != queued.end ())
+                    {
+                        queued.erase (existing);
+                    }
+                }
+                lock.unlock ();
+            }
+            // Let other threads get an opportunity to transaction lock
+            std::this_thread::yield ();
+			lock.lock ();
+		}
+		else
+		{
+            idle = true;
+            condition.notify_all ();
+			condition.wait (lock);
+            idle = false;
+		}
+	}
+}
+
+void rai::block_processor::process_batch (std::deque <std::pair <std::shared_ptr <rai::block>, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)>>> const & batch_a)
+{
+	if (batch_a.size () > 1 && !node.checker.threads.empty ())
+	{
+		auto validated (verify_batch (batch_a));
+		for (size_t i (0), n (batch_a.size ()); i < n; ++i)
+		{
+			process_receive_many (batch_a [i].first, batch_a [i].second, validated [i]);
+		}
+	}
+	else
+	{
+		for (auto & i: batch_a)
+		{
+			process_receive_many (i.first, i.second);
+		}
+	}
+}
+
+std::vector <rai::account> rai::block_processor::verify_batch (std::deque <std::pair <std::shared_ptr <rai::block>, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)>>> const & batch_a)
+{
+	std::vector <rai::account> result (batch_a.size (), rai::account (0));
+	std::vector <rai::signature_check> checks;
+	std::vector <size_t> indices;
+	{
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		// Accounts of blocks earlier in this batch, they aren't in the ledger yet
+		std::unordered_map <rai::block_hash, rai::account> batch_accounts;
+		for (size_t i (0), n (batch_a.size ()); i < n; ++i)
+		{
+			auto & block (*batch_a [i].first);
+			auto hash (block.hash ());
+			rai::account account (0);
+			auto previous (block.previous ());
+			if (previous.is_zero ())
+			{
+				// Open blocks are rooted on their own account
+				account = block.root ();
+			}
+			else
+			{
+				auto existing (batch_accounts.find (previous));
+				if (existing != batch_accounts.end ())
+				{
+					account = existing->second;
+				}
+				else
+				{
+					account = node.store.frontier_get (transaction, previous);
+				}
+			}
+			if (!account.is_zero ())
+			{
+				batch_accounts [hash] = account;
+				checks.push_back ({account, hash, block.block_signature (), false});
+				indices.push_back (i);
+			}
+		}
+	}
+	node.checker.verify (checks);
+	for (size_t i (0), n (checks.size ()); i < n; ++i)
+	{
+		if (checks [i].valid)
+		{
+			result [indices [i]] = checks [i].account;
+		}
+	}
+	return result;
+}
+
+void rai::block_processor::process_receive_many (std::shared_ptr <rai::block> block_a, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)> completed_a, rai::account const & validated_a)
+{
+	// Only the first block was checked ahead of time, dependents it releases are checked by the ledger
+	rai::account validated (validated_a);
+	std::vector <std::shared_ptr <rai::block>> blocks;
+	blocks.push_back (block_a);
+    while (!blocks.empty ())
+    {
+		{
+			rai::transaction transaction (node.store.environment, nullptr, true);
+			auto count (0);
+			while (!blocks.empty () && count < rai::blocks_per_transaction)
+			{
+				auto block (blocks.back ());
+				blocks.pop_back ();
+				auto hash (block->hash ());
+				auto process_result (process_receive_one (transaction, block, validated));
+				validated.clear ();
+				completed_a (transaction, process_result, block);
+				switch (process_result.code)
+				{
+					case rai::process_result::progress:
+					case rai::process_result::old:
+					{
+						auto released (dependencies.release (transaction, hash));
+						// Pushed in reverse so dependents are processed in the order they arrived
+						for (auto i (released.rbegin ()), n (released.rend ()); i != n; ++i)
+						{
+							blocks.push_back (std::move (*i));
+						}
+						node.gap_cache.fill (hash);
+						node.pull_cache.fill (hash);
+						break;
+					}
+					default:
+						break;
+				}
+				++count;
+			}
+		}
+    }
+}
+
+rai::process_return rai::block_processor::process_receive_one (MDB_txn * transaction_a, std::shared_ptr <rai::block> block_a, rai::account const & validated_a)
+{
+	rai::process_return result;
+	result = node.ledger.process (transaction_a, *block_a, validated_a);
+    switch (result.code)
+    {
+        case rai::process_result::progress:
+        {
+            if (node.config.logging.ledger_logging ())
+            {
+                std::string block;
+                block_a->serialize_json (block);
+                BOOST_LOG (node.log) << boost::str (boost::format ("Processing block %1% %2%") % block_a->hash ().to_string () % block);
+            }
+			stored_work_update (block_a->hash (), node.work.work_value (block_a->root (), block_a->block_work ()));
+			auto representative (block_a->representative ());
+			if (!representative.is_zero ())
+			{
+				node.wallets.representative_check (transaction_a, representative);
+			}
+            break;
+        }
+        case rai::process_result::gap_previous:
+        {
+            if (node.config.logging.ledger_logging ())
+            {
+                BOOST_LOG (node.log) << boost::str (boost::format ("Gap previous for: %1%") % block_a->hash ().to_string ());
+            }
+			dependencies.add (transaction_a, block_a->previous (), block_a);
+			node.gap_cache.add (transaction_a, block_a, block_a->previous ());
+			break;
+        }
+        case rai::process_result::gap_source:
+        {
+            if (node.config.logging.ledger_logging ())
+            {
+                BOOST_LOG (node.log) << boost::str (boost::format ("Gap source for: %1%") % block_a->hash ().to_string ());
+            }
+			dependencies.add (transaction_a, block_a->source (), block_a);
+			node.gap_cache.add (transaction_a, block_a, block_a->source ());
+            break;
+        }
+        case rai::process_result::old:
+        {
+			if (stored_work_covers (block_a->hash (), node.work.work_value (block_a->root (), block_a->block_work ())))
+			{
+				++duplicates_fast;
+			}
+			else
+			{
+				++duplicates_slow;
+				auto node_l (node.shared ());
+				node.background ([node_l, block_a] ()
+				{
+					node_l->block_processor.replace (block_a);
+				});
+			}
             if (node.config.logging.ledger_duplicate_logging ())
             {
                 BOOST_LOG (node.log) << boost::str (boost::format ("Old for: %1%") % block_a->hash ().to_string ());
             }
             break;
         }
-        case rai::process_result::bad_signature:
+        case rai::process_result::bad_signature:
+        {
+            if (node.config.logging.ledger_logging ())
+            {
+                BOOST_LOG (node.log) << boost::str (boost::format ("Bad signature for: %1%") % block_a->hash ().to_string ());
+            }
+            break;
+        }
+        case rai::process_result::overspend:
+        {
+            if (node.config.logging.ledger_logging ())
+            {
+                BOOST_LOG (node.log) << boost::str (boost::format ("Overspend for: %1%") % block_a->hash ().to_string ());
+            }
+            break;
+        }
+        case rai::process_result::unreceivable:
+        {
+            if (node.config.logging.ledger_logging ())
+            {
+                BOOST_LOG (node.log) << boost::str (boost::format ("Unreceivable for: %1%") % block_a->hash ().to_string ());
+            }
+            break;
+        }
+        case rai::process_result::not_receive_from_send:
+        {
+            if (node.config.logging.ledger_logging ())
+            {
+                BOOST_LOG (node.log) << boost::str (boost::format ("Not receive from send for: %1%") % block_a->hash ().to_string ());
+            }
+            break;
+        }
+        case rai::process_result::fork:
+        {
+			if (node.config.logging.ledger_logging ())
+			{
+				BOOST_LOG (node.log) << boost::str (boost::format ("Fork for: %1% root: %2%") % block_a->hash ().to_string () % block_a->root ().to_string ());
+			}
+			node.active.fork (block_a);
+            break;
+        }
+        case rai::process_result::account_mismatch:
+        {
+            if (node.config.logging.ledger_logging ())
+            {
+                BOOST_LOG (node.log) << boost::str (boost::format ("Account mismatch for: %1%") % block_a->hash ().to_string ());
+            }
+        }
+    }
+    return result;
+}
+
+// Replace the stored copy of a duplicate block if this one has a higher work value
+void rai::block_processor::replace (std::shared_ptr <rai::block> block_a)
+{
+	auto root (block_a->root ());
+	auto hash (block_a->hash ());
+	auto value (node.work.work_value (root, block_a->block_work ()));
+	auto replace (false);
+	{
+		// Most duplicates carry no better work, only take the write lock when the stored block is replaced
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		auto existing (node.store.block_get (transaction, hash));
+		if (existing != nullptr)
+		{
+			auto existing_value (node.work.work_value (root, existing->block_work ()));
+			replace = value > existing_value;
+			if (!replace)
+			{
+				stored_work_update (hash, existing_value);
+			}
+		}
+		else
+		{
+			// Could have been rolled back, maybe
+		}
+	}
+	if (replace)
+	{
+		rai::transaction transaction (node.store.environment, nullptr, true);
+		// Checked again, the block could have been replaced or rolled back since the read
+		auto existing (node.store.block_get (transaction, hash));
+		if (existing != nullptr)
+		{
+			auto existing_value (node.work.work_value (root, existing->block_work ()));
+			if (value > existing_value)
+			{
+				node.store.block_put (transaction, hash, *block_a, node.store.block_successor (transaction, hash));
+				++duplicates_replaced;
+				existing_value = value;
+			}
+			stored_work_update (hash, existing_value);
+		}
+	}
+}
+
+bool rai::block_processor::stored_work_covers (rai::block_hash const & hash_a, uint64_t value_a)
+{
+	std::lock_guard <std::mutex> lock (work_values_mutex);
+	auto result (false);
+	auto existing (work_values.get <1> ().find (hash_a));
+	if (existing != work_values.get <1> ().end ())
+	{
+		result = existing->value >= value_a;
+		work_values.relocate (work_values.end (), work_values.project <0> (existing));
+	}
+	return result;
+}
+
+void rai::block_processor::stored_work_update (rai::block_hash const & hash_a, uint64_t value_a)
+{
+	std::lock_guard <std::mutex> lock (work_values_mutex);
+	auto existing (work_values.get <1> ().find (hash_a));
+	if (existing != work_values.get <1> ().end ())
+	{
+		work_values.get <1> ().modify (existing, [value_a] (rai::work_value_information & info)
+		{
+			info.value = value_a;
+		});
+		work_values.relocate (work_values.end (), work_values.project <0> (existing));
+	}
+	else
+	{
+		work_values.push_back ({hash_a, value_a});
+		if (work_values.size () > work_values_max)
+		{
+			work_values.pop_front ();
+		}
+	}
+}
+
+rai::node::node (rai::node_init & init_a, boost::asio::io_service & service_a, uint16_t peering_port_a, boost::filesystem::path const & application_path_a, rai::alarm & alarm_a, rai::logging const & logging_a, rai::work_pool & work_a) :
+node (init_a, service_a, application_path_a, alarm_a, rai::node_config (peering_port_a, logging_a), work_a)
+{
+}
+
+rai::node::node (rai::node_init & init_a, boost::asio::io_service & service_a, boost::filesystem::path const & application_path_a, rai::alarm & alarm_a, rai::node_config const & config_a, rai::work_pool & work_a) :
+service (service_a),
+config (config_a),
+alarm (alarm_a),
+work (work_a),
+store (init_a.block_store_init, application_path_a / "data.ldb"),
+gap_cache (*this),
+ledger (store, config_a.inactive_supply.number ()),
+active (*this),
+wallets (init_a.block_store_init, *this),
+network (*this, config.peering_port),
+bootstrap_initiator (*this),
+bootstrap (service_a, config.peering_port, *this),
+channels (*this),
+peers (network.endpoint ()),
+application_path (application_path_a),
+port_mapping (*this),
+warmed_up (0),
+checker (config.signature_checker_threads),
+vote_cache (*this),
+pull_cache (*this),
+vote_generator (*this),
+online_reps (*this),
+vote_processor (*this),
+block_processor (*this)
+{
+	store.environment.sizing_action = [this] ()
+	{
+		auto this_l (shared_from_this ());
+		background ([this_l] ()
+		{
+			this_l->store.environment.handle_environment_sizing ();
+		});
+	};
+	wallets.observer = [this] (rai::account const & account_a, bool active)
+	{
+		observers.wallet (account_a, active);
+	};
+	peers.peer_observer = [this] (rai::endpoint const & endpoint_a)
+	{
+		observers.endpoint (endpoint_a);
+	};
+	peers.disconnect_observer = [this] ()
+	{
+		observers.disconnect ();
+	};
+	observers.blocks.add ([this] (rai::block const & block_a, rai::account const & account_a, rai::amount const & amount_a)
+	{
+		if (!config.callback_address.empty ())
+		{
+			boost::property_tree::ptree event;
+			event.add ("account", account_a.to_account ());
+			event.add ("hash", block_a.hash ().to_string ());
+			std::string block_text;
+			block_a.serialize_json (block_text);
+			event.add ("block", block_text);
+			event.add ("amount", amount_a.to_string_dec ());
+			std::stringstream ostream;
+			boost::property_tree::write_json (ostream, event);
+			ostream.flush ();
+			auto body (std::make_shared <std::string> (ostream.str ()));
+			auto address (config.callback_address);
+			auto port (config.callback_port);
+			auto target (std::make_shared <std::string> (config.callback_target));
+			auto node_l (shared_from_this ());
+			auto resolver (std::make_shared <boost::asio::ip::tcp::resolver> (service));
+			resolver->async_resolve (boost::asio::ip::tcp::resolver::query (address, std::to_string (port)), [node_l, address, port, target, body, resolver] (boost::system::error_code const & ec, boost::asio::ip::tcp::resolver::iterator i_a)
+			{
+				if (!ec)
+				{
+					for (auto i (i_a), n (boost::asio::ip::tcp::resolver::iterator {}); i != n; ++i)
+					{
+						auto sock (std::make_shared <boost::asio::ip::tcp::socket> (node_l->service));
+						sock->async_connect (i->endpoint(), [node_l, target, body, sock, address, port] (boost::system::error_code const & ec)
+						{
+							if (!ec)
+							{
+								auto req (std::make_shared <boost::beast::http::request<boost::beast::http::string_body>> ());
+								req->method (boost::beast::http::verb::post);
+								req->target (*target);
+								req->version = 11;
+								req->insert(boost::beast::http::field::host, address);
+								req->body = *body;
+								//req->prepare (*req);
+								//boost::beast::http::prepare(req);
+								req->prepare_payload();
+								boost::beast::http::async_write (*sock, *req, [node_l, sock, address, port, req] (boost::system::error_code const & ec)
+								{
+									if (!ec)
+									{
+										auto sb (std::make_shared <boost::beast::flat_buffer> ());
+										auto resp (std::make_shared <boost::beast::http::response <boost::beast::http::string_body>> ());
+										boost::beast::http::async_read (*sock, *sb, *resp, [node_l, sb, resp, sock, address, port] (boost::system::error_code const & ec)
+										{
+											if (!ec)
+											{
+												if (resp->result() == boost::beast::http::status::ok)
+												{
+												}
+												else
+												{
+													if (node_l->config.logging.callback_logging ())
+													{
+														BOOST_LOG (node_l->log) << boost::str (boost::format ("Callback to %1%:%2% failed with status: %3%") % address % port % resp->result());
+													}
+												}
+											}
+											else
+											{
+												if (node_l->config.logging.callback_logging ())
+												{
+													BOOST_LOG (node_l->log) << boost::str (boost::format ("Unable complete callback: %1%:%2% %3%") % address % port % ec.message ());
+												}
+											};
+										});
+									}
+									else
+									{
+										if (node_l->config.logging.callback_logging ())
+										{
+											BOOST_LOG (node_l->log) << boost::str (boost::format ("Unable to send callback: %1%:%2% %3%") % address % port % ec.message ());
+										}
+									}
+								});
+							}
+							else
+							{
+								if (node_l->config.logging.callback_logging ())
+								{
+									BOOST_LOG (node_l->log) << boost::str (boost::format ("Unable to connect to callback address: %1%:%2%, %3%") % address % port % ec.message ());
+								}
+							}
+						});
+					}
+				}
+				else
+				{
+					if (node_l->config.logging.callback_logging ())
+					{
+						BOOST_LOG (node_l->log) << boost::str (boost::format ("Error resolving callback: %1%:%2%, %3%") % address % port % ec.message ());
+					}
+				}
+			});
+		}
+	});
+	observers.endpoint.add ([this] (rai::endpoint const & endpoint_a)
+	{
+		this->network.send_keepalive (endpoint_a);
+		rep_query (*this, endpoint_a);
+	});
+    observers.vote.add ([this] (rai::vote const & vote_a, rai::endpoint const & endpoint_a)
+    {
+		this->gap_cache.vote (vote_a, endpoint_a);
+    });
+	observers.vote.add ([this] (rai::vote const & vote_a, rai::endpoint const & endpoint_a)
+	{
+		if (this->rep_crawler.exists (vote_a.block->hash ()))
+		{
+			auto weight_l (weight (vote_a.account));
+			// We see a valid non-replay vote for a block we requested, this node is probably a representative
+			if (peers.rep_response (endpoint_a, weight_l))
+			{
+				BOOST_LOG (log) << boost::str (boost::format ("Found a representative at %1%") % endpoint_a);
+			}
+		}
+	});
+    BOOST_LOG (log) << "Node starting, version: " << RAIBLOCKS_VERSION_MAJOR << "." << RAIBLOCKS_VERSION_MINOR << "." << RAIBLOCKS_VERSION_PATCH;
+	BOOST_LOG (log) << boost::str (boost::format ("Work pool running %1% threads") % work.threads.size ());
+    if (!init_a.error ())
+    {
+        if (config.logging.node_lifetime_tracing ())
+        {
+            std::cerr << "Constructing node\n";
+        }
+		rai::transaction transaction (store.environment, nullptr, true);
+        if (store.latest_begin (transaction) == store.latest_end ())
+        {
+            // Store was empty meaning we just created it, add the genesis block
+            rai::genesis genesis;
+            genesis.initialize (transaction, store);
+        }
+		block_processor.dependencies.load (transaction);
+    }
+}
+
+rai::node::~node ()
+{
+    if (config.logging.node_lifetime_tracing ())
+    {
+        std::cerr << "Destructing node\n";
+    }
+}
+
+void rai::node::send_keepalive (rai::endpoint const & endpoint_a)
+{
+    auto endpoint_l (endpoint_a);
+    if (endpoint_l.address ().is_v4 ())
+    {
+        endpoint_l = rai::endpoint (boost::asio::ip::address_v6::v4_mapped (endpoint_l.address ().to_v4 ()), endpoint_l.port ());
+    }
+    assert (endpoint_l.address ().is_v6 ());
+    network.send_keepalive (endpoint_l);
+}
+
+rai::gap_cache::gap_cache (rai::node & node_a, size_t memory_max_a) :
+memory_max (memory_max_a),
+memory (0),
+filled (0),
+evicted (0),
+pulls (0),
+node (node_a)
+{
+}
+
+size_t rai::gap_cache::entry_size (rai::gap_information const & info_a)
+{
+	// Container node overhead is approximated by two pointers per index
+	auto result (sizeof (rai::gap_information) + 4 * sizeof (void *) + sizeof (rai::votes));
+	result += info_a.votes->rep_votes.size () * (sizeof (std::pair <rai::account, std::shared_ptr <rai::block>>) + 2 * sizeof (void *));
+	result += info_a.voters.capacity () * sizeof (rai::endpoint);
+	// Blocks are shared with other containers and only charged once, for the block that created the entry
+	result += rai::send_block::size;
+	return result;
+}
+
+void rai::gap_cache::add (MDB_txn * transaction_a, std::shared_ptr <rai::block> block_a, rai::block_hash const & missing_a)
+{
+	auto hash (block_a->hash ());
+    std::lock_guard <std::mutex> lock (mutex);
+    auto existing (blocks.get <1>().find (hash));
+    if (existing != blocks.get <1> ().end ())
+    {
+        blocks.get <1> ().modify (existing, [] (rai::gap_information & info)
+		{
+			info.arrival = std::chrono::system_clock::now ();
+		});
+    }
+    else
+    {
+		rai::gap_information info {std::chrono::system_clock::now (), hash, missing_a, std::unique_ptr <rai::votes> (new rai::votes (block_a)), std::vector <rai::endpoint> (), std::chrono::steady_clock::now (), 0, false};
+		info.memory = entry_size (info);
+		memory += info.memory;
+		blocks.insert (std::move (info));
+        while (memory > memory_max && !blocks.empty ())
+        {
+			auto oldest (blocks.get <0> ().begin ());
+			memory -= oldest->memory;
+            blocks.get <0> ().erase (oldest);
+			++evicted;
+        }
+    }
+}
+
+void rai::gap_cache::vote (rai::vote const & vote_a, rai::endpoint const & endpoint_a)
+{
+	rai::transaction transaction (node.store.environment, nullptr, false);
+	std::lock_guard <std::mutex> lock (mutex);
+	auto hash (vote_a.block->hash ());
+	auto existing (blocks.get <1> ().find (hash));
+	if (existing != blocks.get <1> ().end ())
+	{
+		existing->votes->vote (vote_a);
+		blocks.get <1> ().modify (existing, [this, &endpoint_a] (rai::gap_information & info)
+		{
+			if (endpoint_a.port () != 0 && info.voters.size () < voters_max && std::find (info.voters.begin (), info.voters.end (), endpoint_a) == info.voters.end ())
+			{
+				info.voters.push_back (endpoint_a);
+			}
+			auto size (entry_size (info));
+			memory = memory - info.memory + size;
+			info.memory = size;
+		});
+		auto winner (node.ledger.winner (transaction, *existing->votes));
+		if (!existing->requested && winner.first > bootstrap_threshold (transaction))
+		{
+			blocks.get <1> ().modify (existing, [] (rai::gap_information & info)
+			{
+				info.requested = true;
+			});
+			auto node_l (node.shared ());
+			auto now (std::chrono::system_clock::now ());
+			auto missing (existing->missing);
+			auto voters (existing->voters);
+			node.alarm.add (rai::rai_network == rai::rai_networks::rai_test_network ? now + std::chrono::milliseconds (5) : now + std::chrono::seconds (5), [node_l, hash, missing, voters] ()
+			{
+				rai::transaction transaction (node_l->store.environment, nullptr, false);
+				if (!node_l->store.block_exists (transaction, hash))
+				{
+					if (!node_l->bootstrap_initiator.in_progress ())
+					{
+						BOOST_LOG (node_l->log) << boost::str (boost::format ("Missing confirmed block %1%") % hash.to_string ());
+					}
+					if (!missing.is_zero () && !voters.empty ())
+					{
+						// Only the chain ending in the missing block is needed and the peers that voted have it
+						{
+							std::lock_guard <std::mutex> lock (node_l->gap_cache.mutex);
+							++node_l->gap_cache.pulls;
+						}
+						node_l->bootstrap_initiator.bootstrap_lazy (missing, voters);
+					}
+					else
+					{
+						node_l->bootstrap_initiator.bootstrap ();
+					}
+				}
+			});
+		}
+	}
+}
+
+void rai::gap_cache::fill (rai::block_hash const & hash_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (blocks.get <1> ().find (hash_a));
+	if (existing != blocks.get <1> ().end ())
+	{
+		++filled;
+		fill_time.add (std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now () - existing->start).count ());
+		memory -= existing->memory;
+		blocks.get <1> ().erase (existing);
+	}
+}
+
+void rai::gap_cache::requested_clear ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto i (blocks.begin ()), n (blocks.end ()); i != n; ++i)
+	{
+		if (i->requested)
+		{
+			blocks.modify (i, [] (rai::gap_information & info)
+			{
+				info.requested = false;
+			});
+		}
+	}
+}
+
+std::shared_ptr <rai::block> rai::gap_cache::find (rai::block_hash const & hash_a)
+{
+	std::shared_ptr <rai::block> result;
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (blocks.get <1> ().find (hash_a));
+	if (existing != blocks.get <1> ().end ())
+	{
+		// The cached block is kept in votes along with any blocks voted for
+		for (auto i (existing->votes->rep_votes.begin ()), n (existing->votes->rep_votes.end ()); i != n && result == nullptr; ++i)
+		{
+			if (i->second->hash () == hash_a)
+			{
+				result = i->second;
+			}
+		}
+	}
+	return result;
+}
+
+size_t rai::gap_cache::memory_used ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	return memory;
+}
+
+void rai::gap_cache::serialize (boost::property_tree::ptree & tree_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	tree_a.put ("size", std::to_string (blocks.size ()));
+	tree_a.put ("memory", std::to_string (memory));
+	tree_a.put ("memory_max", std::to_string (memory_max));
+	tree_a.put ("filled", std::to_string (filled));
+	tree_a.put ("evicted", std::to_string (evicted));
+	tree_a.put ("pulls", std::to_string (pulls));
+	boost::property_tree::ptree fill_time_l;
+	fill_time.serialize (fill_time_l);
+	tree_a.add_child ("fill_time", fill_time_l);
+}
+
+rai::uint128_t rai::gap_cache::bootstrap_threshold (MDB_txn * transaction_a)
+{
+    auto result ((node.ledger.supply (transaction_a) / 256) * node.config.bootstrap_fraction_numerator);
+	return result;
+}
+
+void rai::gap_cache::purge_old ()
+{
+	auto cutoff (std::chrono::system_clock::now () - std::chrono::seconds (10));
+    std::lock_guard <std::mutex> lock (mutex);
+	auto done (false);
+	while (!done && !blocks.empty ())
+	{
+		auto first (blocks.get <0> ().begin ());
+		if (first->arrival < cutoff)
+		{
+			memory -= first->memory;
+			blocks.get <0> ().erase (first);
+		}
+		else
+		{
+			done = true;
+		}
+	}
+}
+
+rai::dependency_graph::dependency_graph (rai::block_store & store_a, size_t bytes_max_a) :
+bytes_max (bytes_max_a),
+bytes (0),
+sequence (0),
+store (store_a)
+{
+}
+
+void rai::dependency_graph::add (MDB_txn * transaction_a, rai::block_hash const & dependency_a, std::shared_ptr <rai::block> block_a)
+{
+	auto hash (block_a->hash ());
+	std::lock_guard <std::mutex> lock (mutex);
+	if (blocks.get <2> ().find (hash) == blocks.get <2> ().end ())
+	{
+		blocks.insert ({block_a, hash, dependency_a, std::chrono::steady_clock::now (), sequence++});
+		bytes += entry_size (*block_a);
+		while (bytes > bytes_max && !blocks.empty ())
+		{
+			auto oldest (blocks.get <0> ().begin ());
+			store.unchecked_put (transaction_a, oldest->dependency, oldest->block);
+			spilled.insert (oldest->dependency);
+			bytes -= entry_size (*oldest->block);
+			blocks.get <0> ().erase (oldest);
+		}
+	}
+}
+
+std::vector <std::shared_ptr <rai::block>> rai::dependency_graph::release (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+{
+	std::vector <std::shared_ptr <rai::block>> result;
+	std::lock_guard <std::mutex> lock (mutex);
+	auto spilled_l (spilled.find (hash_a));
+	if (spilled_l != spilled.end ())
+	{
+		// Spilled entries are always older than the ones still in memory
+		result = store.unchecked_get (transaction_a, hash_a);
+		for (auto & i: result)
+		{
+			store.unchecked_del (transaction_a, hash_a, *i);
+		}
+		spilled.erase (spilled_l);
+	}
+	std::vector <std::pair <uint64_t, std::shared_ptr <rai::block>>> waiting;
+	auto range (blocks.get <1> ().equal_range (hash_a));
+	for (auto i (range.first); i != range.second; ++i)
+	{
+		waiting.push_back (std::make_pair (i->sequence, i->block));
+		bytes -= entry_size (*i->block);
+	}
+	blocks.get <1> ().erase (range.first, range.second);
+	std::sort (waiting.begin (), waiting.end (), [] (std::pair <uint64_t, std::shared_ptr <rai::block>> const & lhs, std::pair <uint64_t, std::shared_ptr <rai::block>> const & rhs)
+	{
+		return lhs.first < rhs.first;
+	});
+	for (auto & i: waiting)
+	{
+		result.push_back (i.second);
+	}
+	return result;
+}
+
+void rai::dependency_graph::load (MDB_txn * transaction_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto i (store.unchecked_begin (transaction_a)), n (store.unchecked_end ()); i != n; ++i)
+	{
+		spilled.insert (rai::block_hash (i->first));
+	}
+}
+
+void rai::dependency_graph::flush (MDB_txn * transaction_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto & i: blocks.get <0> ())
+	{
+		store.unchecked_put (transaction_a, i.dependency, i.block);
+		spilled.insert (i.dependency);
+	}
+	blocks.clear ();
+	bytes = 0;
+	store.unchecked_cache_flush (transaction_a);
+}
+
+void rai::dependency_graph::clear (MDB_txn * transaction_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	blocks.clear ();
+	bytes = 0;
+	spilled.clear ();
+	store.unchecked_clear (transaction_a);
+}
+
+size_t rai::dependency_graph::size ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	return blocks.size ();
+}
+
+size_t rai::dependency_graph::spilled_count ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	return spilled.size ();
+}
+
+unsigned rai::dependency_graph::depth ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	unsigned result (0);
+	// Chain length ending in each entry, an entry whose dependency isn't waiting in memory starts a chain
+	std::unordered_map <rai::block_hash, unsigned> depths;
+	for (auto & i: blocks.get <0> ())
+	{
+		std::vector <rai::block_hash> chain;
+		unsigned depth (0);
+		auto current (i.hash);
+		auto done (false);
+		while (!done)
+		{
+			auto known (depths.find (current));
+			if (known != depths.end ())
+			{
+				depth = known->second;
+				done = true;
+			}
+			else
+			{
+				auto entry (blocks.get <2> ().find (current));
+				if (entry != blocks.get <2> ().end ())
+				{
+					chain.push_back (current);
+					current = entry->dependency;
+				}
+				else
+				{
+					done = true;
+				}
+			}
+		}
+		for (auto j (chain.rbegin ()), n (chain.rend ()); j != n; ++j)
+		{
+			depths [*j] = ++depth;
+		}
+		result = std::max (result, depth);
+	}
+	return result;
+}
+
+std::chrono::steady_clock::duration rai::dependency_graph::age ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	std::chrono::steady_clock::duration result (0);
+	if (!blocks.empty ())
+	{
+		result = std::chrono::steady_clock::now () - blocks.get <0> ().begin ()->arrival;
+	}
+	return result;
+}
+
+std::vector <std::pair <rai::block_hash, std::shared_ptr <rai::block>>> rai::dependency_graph::list (rai::block_hash const & start_a, size_t count_a)
+{
+	std::vector <std::pair <rai::block_hash, std::shared_ptr <rai::block>>> result;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		for (auto & i: blocks.get <0> ())
+		{
+			if (!(i.dependency < start_a))
+			{
+				result.push_back (std::make_pair (i.dependency, i.block));
+			}
+		}
+	}
+	// Stable so blocks waiting on the same hash stay in arrival order
+	std::stable_sort (result.begin (), result.end (), [] (std::pair <rai::block_hash, std::shared_ptr <rai::block>> const & lhs, std::pair <rai::block_hash, std::shared_ptr <rai::block>> const & rhs)
+	{
+		return lhs.first < rhs.first;
+	});
+	if (result.size () > count_a)
+	{
+		result.erase (result.begin () + count_a, result.end ());
+	}
+	return result;
+}
+
+std::shared_ptr <rai::block> rai::dependency_graph::find (rai::block_hash const & hash_a)
+{
+	std::shared_ptr <rai::block> result;
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (blocks.get <2> ().find (hash_a));
+	if (existing != blocks.get <2> ().end ())
+	{
+		result = existing->block;
+	}
+	return result;
+}
+
+size_t rai::dependency_graph::entry_size (rai::block const & block_a)
+{
+	return rai::message_parser::block_size (block_a.type ()) + entry_overhead;
+}
+
+void rai::network::confirm_send (rai::confirm_ack const & confirm_a, std::shared_ptr <std::vector <uint8_t>> bytes_a, rai::endpoint const & endpoint_a)
+{
+    if (node.config.logging.network_publish_logging ())
+    {
+        BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm_ack for %1% to %2%") % (confirm_a.vote.block != nullptr ? confirm_a.vote.block->hash ().to_string () : std::to_string (confirm_a.vote.hashes.size ()) + " hashes") % endpoint_a);
+    }
+    std::weak_ptr <rai::node> node_w (node.shared ());
+	++outgoing.confirm_ack;
+    node.network.send_buffer (bytes_a->data (), bytes_a->size (), endpoint_a, [bytes_a, node_w, endpoint_a] (boost::system::error_code const & ec, size_t size_a)
+	{
+		if (auto node_l = node_w.lock ())
+		{
+			if (node_l->config.logging.network_logging ())
+			{
+				if (ec)
+				{
+					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error broadcasting confirm_ack to %1%: %2%") % endpoint_a % ec.message ());
+				}
+			}
+		}
+	});
+}
+
+void rai::node::process_receive_republish (std::shared_ptr <rai::block> incoming)
+{
+    assert (incoming != nullptr);
+    auto node_l (shared_from_this ());
+	auto seen (std::chrono::steady_clock::now ());
+    block_processor.add (incoming, [node_l, seen] (MDB_txn * transaction_a, rai::process_return result_a, std::shared_ptr <rai::block> block_a)
+    {
+        switch (result_a.code)
         {
-            if (node.config.logging.ledger_logging ())
+            case rai::process_result::progress:
             {
-                BOOST_LOG (node.log) << boost::str (boost::format ("Bad signature for: %1%") % block_a->hash ().to_string ());
+                node_l->active.start (transaction_a, block_a, [] (std::shared_ptr <rai::block>) {}, seen);
+                node_l->background ([node_l, block_a, result_a] ()
+                {
+                    node_l->observers.blocks (*block_a, result_a.account, result_a.amount);
+                });
+                break;
             }
-            break;
-        }
-        case rai::process_result::overspend:
-        {
-            if (node.config.logging.ledger_logging ())
+            default:
             {
-                BOOST_LOG (node.log) << boost::str (boost::format ("Overspend for: %1%") % block_a->hash ().to_string ());
+                break;
             }
-            break;
         }
-        case rai::process_result::unreceivable:
+    });
+    if (rai::rai_network == rai::rai_networks::rai_test_network)
+    {
+        block_processor.flush ();
+    }
+}
+
+rai::process_return rai::node::process (rai::block const & block_a)
+{
+	rai::transaction transaction (store.environment, nullptr, true);
+	auto result (ledger.process (transaction, block_a));
+	return result;
+}
+
+// Simulating with sqrt_broadcast_simulate shows we only need to broadcast to sqrt(total_peers) random peers in order to successfully publish to everyone with high probability
+std::vector <rai::endpoint> rai::peer_container::list_sqrt ()
+{
+	auto peers (random_set (2 * size_sqrt ()));
+	std::vector <rai::endpoint> result;
+	result.reserve (peers.size ());
+	for (auto i (peers.begin ()), n (peers.end ()); i != n; ++i)
+	{
+		result.push_back (*i);
+	}
+	return result;
+}
+
+void rai::peer_container::partition_version (std::vector <rai::endpoint> const & list_a, unsigned version_a, std::vector <rai::endpoint> & older_a, std::vector <rai::endpoint> & newer_a)
+{
+	auto snapshot_l (snapshot ());
+	for (auto & i: list_a)
+	{
+		auto existing (snapshot_l->find (i));
+		if (existing != nullptr && existing->network_version >= version_a)
+		{
+			newer_a.push_back (i);
+		}
+		else
+		{
+			older_a.push_back (i);
+		}
+	}
+}
+
+std::vector <rai::endpoint> rai::peer_container::list ()
+{
+    std::vector <rai::endpoint> result;
+	auto snapshot_l (snapshot ());
+    result.reserve (snapshot_l->peers.size ());
+    for (auto & i: snapshot_l->peers)
+    {
+        result.push_back (i.endpoint);
+    }
+	std::random_shuffle (result.begin (), result.end ());
+    return result;
+}
+
+rai::endpoint rai::peer_container::bootstrap_peer ()
+{
+    rai::endpoint result (boost::asio::ip::address_v6::any (), 0);
+    std::lock_guard <std::mutex> lock (mutex);
+	auto first (peers.get <4> ().begin ());
+	if (first != peers.get <4> ().end ())
+	{
+		result = first->endpoint;
+		peers.get <4> ().modify (first, [] (rai::peer_information & peer_a)
+		{
+			peer_a.last_bootstrap_attempt = std::chrono::system_clock::now ();
+		});
+    }
+    return result;
+}
+
+bool rai::parse_port (std::string const & string_a, uint16_t & port_a)
+{
+	bool result;
+	size_t converted;
+	port_a = std::stoul (string_a, &converted);
+	result = converted != string_a.size () || converted > std::numeric_limits <uint16_t>::max ();
+	return result;
+}
+
+bool rai::parse_address_port (std::string const & string, boost::asio::ip::address & address_a, uint16_t & port_a)
+{
+    auto result (false);
+    auto port_position (string.rfind (':'));
+    if (port_position != std::string::npos && port_position > 0)
+    {
+        std::string port_string (string.substr (port_position + 1));
+        try
         {
-            if (node.config.logging.ledger_logging ())
+			uint16_t port;
+			result = parse_port (port_string, port);
+            if (!result)
             {
-                BOOST_LOG (node.log) << boost::str (boost::format ("Unreceivable for: %1%") % block_a->hash ().to_string ());
+                boost::system::error_code ec;
+                auto address (boost::asio::ip::address_v6::from_string (string.substr (0, port_position), ec));
+                if (ec == 0)
+                {
+                    address_a = address;
+                    port_a = port;
+                }
+                else
+                {
+                    result = true;
+                }
             }
-            break;
-        }
-        case rai::process_result::not_receive_from_send:
-        {
-            if (node.config.logging.ledger_logging ())
+            else
             {
-                BOOST_LOG (node.log) << boost::str (boost::format ("Not receive from send for: %1%") % block_a->hash ().to_string ());
+                result = true;
             }
-            break;
-        }
-        case rai::process_result::fork:
-        {
-			if (node.config.logging.ledger_logging ())
-			{
-				BOOST_LOG (node.log) << boost::str (boost::format ("Fork for: %1% root: %2%") % block_a->hash ().to_string () % block_a->root ().to_string ());
-			}
-            break;
         }
-        case rai::process_result::account_mismatch:
+        catch (...)
         {
-            if (node.config.logging.ledger_logging ())
-            {
-                BOOST_LOG (node.log) << boost::str (boost::format ("Account mismatch for: %1%") % block_a->hash ().to_string ());
-            }
+            result = true;
         }
     }
+    else
+    {
+        result = true;
+    }
+    return result;
+}
+
+bool rai::parse_endpoint (std::string const & string, rai::endpoint & endpoint_a)
+{
+    boost::asio::ip::address address;
+    uint16_t port;
+    auto result (parse_address_port (string, address, port));
+    if (!result)
+    {
+        endpoint_a = rai::endpoint (address, port);
+    }
     return result;
 }
 
-rai::node::node (rai::node_init & init_a, boost::asio::io_service & service_a, uint16_t peering_port_a, boost::filesystem::path const & application_path_a, rai::alarm & alarm_a, rai::logging const & logging_a, rai::work_pool & work_a) :
-node (init_a, service_a, application_path_a, alarm_a, rai::node_config (peering_port_a, logging_a), work_a)
+bool rai::parse_tcp_endpoint (std::string const & string, rai::tcp_endpoint & endpoint_a)
 {
+    boost::asio::ip::address address;
+    uint16_t port;
+    auto result (parse_address_port (string, address, port));
+    if (!result)
+    {
+        endpoint_a = rai::tcp_endpoint (address, port);
+    }
+    return result;
 }
 
-rai::node::node (rai::node_init & init_a, boost::asio::io_service & service_a, boost::filesystem::path const & application_path_a, rai::alarm & alarm_a, rai::node_config const & config_a, rai::work_pool & work_a) :
-service (service_a),
-config (config_a),
-alarm (alarm_a),
-work (work_a),
-store (init_a.block_store_init, application_path_a / "data.ldb"),
-gap_cache (*this),
-ledger (store, config_a.inactive_supply.number ()),
-active (*this),
-wallets (init_a.block_store_init, *this),
-network (*this, config.peering_port),
-bootstrap_initiator (*this),
-bootstrap (service_a, config.peering_port, *this),
-peers (network.endpoint ()),
-application_path (application_path_a),
-port_mapping (*this),
-vote_processor (*this),
-warmed_up (0),
-block_processor (*this)
+void rai::node::start ()
 {
-	store.environment.sizing_action = [this] ()
+    network.start ();
+    ongoing_keepalive ();
+	ongoing_bootstrap ();
+	ongoing_vote_flush ();
+	ongoing_rep_crawl ();
+    bootstrap.start ();
+	channels.ongoing_connect ();
+	backup_wallet ();
+	ongoing_wallet_reps ();
+	active.announce_votes ();
+	port_mapping.start ();
+	add_initial_peers ();
+	observers.started ();
+}
+
+void rai::node::stop ()
+{
+    BOOST_LOG (log) << "Node stopping";
+	block_processor.stop ();
+	vote_processor.stop ();
+	vote_generator.stop ();
+	active.stop ();
+	channels.stop ();
+    network.stop ();
+	bootstrap_initiator.stop ();
+    bootstrap.stop ();
+	port_mapping.stop ();
+}
+
+void rai::node::keepalive_preconfigured (std::vector <std::string> const & peers_a)
+{
+	for (auto i (peers_a.begin ()), n (peers_a.end ()); i != n; ++i)
 	{
-		auto this_l (shared_from_this ());
-		background ([this_l] ()
+		keepalive (*i, rai::network::node_port);
+	}
+}
+
+rai::block_hash rai::node::latest (rai::account const & account_a)
+{
+	rai::transaction transaction (store.environment, nullptr, false);
+	return ledger.latest (transaction, account_a);
+}
+
+rai::uint128_t rai::node::balance (rai::account const & account_a)
+{
+	rai::transaction transaction (store.environment, nullptr, false);
+	return ledger.account_balance (transaction, account_a);
+}
+
+std::unique_ptr <rai::block> rai::node::block (rai::block_hash const & hash_a)
+{
+	rai::transaction transaction (store.environment, nullptr, false);
+	return store.block_get (transaction, hash_a);
+}
+
+std::pair <rai::uint128_t, rai::uint128_t> rai::node::balance_pending (rai::account const & account_a)
+{
+	std::pair <rai::uint128_t, rai::uint128_t> result;
+	rai::transaction transaction (store.environment, nullptr, false);
+	result.first = ledger.account_balance (transaction, account_a);
+	result.second = ledger.account_pending (transaction, account_a);
+	return result;
+}
+
+rai::uint128_t rai::node::weight (rai::account const & account_a)
+{
+	rai::transaction transaction (store.environment, nullptr, false);
+	return ledger.weight (transaction, account_a);
+}
+
+rai::account rai::node::representative (rai::account const & account_a)
+{
+	rai::transaction transaction (store.environment, nullptr, false);
+	rai::account_info info;
+	rai::account result (0);
+	if (!store.account_get (transaction, account_a, info))
+	{
+		result = info.rep_block;
+	}
+	return result;
+}
+
+void rai::node::ongoing_keepalive ()
+{
+    keepalive_preconfigured (config.preconfigured_peers);
+    auto peers_l (peers.purge_list (std::chrono::system_clock::now () - cutoff));
+	network.peer_traffic.purge (std::chrono::steady_clock::now () - cutoff);
+	network.publish_req_limits.purge (std::chrono::steady_clock::now () - cutoff);
+    for (auto i (peers_l.begin ()), j (peers_l.end ()); i != j && std::chrono::system_clock::now () - i->last_attempt > period; ++i)
+    {
+        network.send_keepalive (i->endpoint);
+    }
+	std::weak_ptr <rai::node> node_w (shared_from_this ());
+    alarm.add (std::chrono::system_clock::now () + period, [node_w] ()
+	{
+		if (auto node_l = node_w.lock ())
 		{
-			this_l->store.environment.handle_environment_sizing ();
+			node_l->ongoing_keepalive ();
+		}
+	});
+}
+
+void rai::node::ongoing_rep_crawl ()
+{
+	auto now (std::chrono::system_clock::now ());
+	auto peers_l (peers.rep_crawl ());
+	rep_query (*this, peers_l);
+	if (network.on)
+	{
+		std::weak_ptr <rai::node> node_w (shared_from_this ());
+		alarm.add (now + period, [node_w] ()
+		{
+			if (auto node_l = node_w.lock ())
+			{
+				node_l->ongoing_rep_crawl ();
+			}
 		});
-	};
-	wallets.observer = [this] (rai::account const & account_a, bool active)
+	}
+}
+
+void rai::node::ongoing_bootstrap ()
+{
+	auto next_wakeup (300);
+	if (warmed_up < 3)
 	{
-		observers.wallet (account_a, active);
-	};
-	peers.peer_observer = [this] (rai::endpoint const & endpoint_a)
+		// Re-attempt bootstrapping more aggressively on startup
+		next_wakeup = 5;
+		if (!bootstrap_initiator.in_progress () && !peers.empty ())
+		{
+			++warmed_up;
+		}
+	}
+	bootstrap_initiator.bootstrap ();
+	std::weak_ptr <rai::node> node_w (shared_from_this ());
+	alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (next_wakeup), [node_w] ()
 	{
-		observers.endpoint (endpoint_a);
-	};
-	peers.disconnect_observer = [this] ()
+		if (auto node_l = node_w.lock ())
+		{
+			node_l->ongoing_bootstrap ();
+		}
+	});
+}
+
+void rai::node::ongoing_vote_flush ()
+{
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		store.sequence_flush (transaction);
+	}
+	std::weak_ptr <rai::node> node_w (shared_from_this ());
+	alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (5), [node_w] ()
+	{
+		if (auto node_l = node_w.lock ())
+		{
+			node_l->ongoing_vote_flush ();
+		}
+	});
+}
+
+void rai::node::backup_wallet ()
+{
+	rai::transaction transaction (store.environment, nullptr, false);
+	for (auto i (wallets.items.begin ()), n (wallets.items.end ()); i != n; ++i)
+	{
+		auto backup_path (application_path / "backup");
+		boost::filesystem::create_directories (backup_path);
+		i->second->store.write_backup (transaction, backup_path / (i->first.to_string () + ".json"));
+	}
+	auto this_l (shared ());
+	alarm.add (std::chrono::system_clock::now () + backup_interval, [this_l] ()
+	{
+		this_l->backup_wallet ();
+	});
+}
+
+void rai::node::ongoing_wallet_reps ()
+{
+	wallets.compute_reps ();
+	std::weak_ptr <rai::node> node_w (shared_from_this ());
+	alarm.add (std::chrono::system_clock::now () + wallet_reps_interval, [node_w] ()
+	{
+		if (auto node_l = node_w.lock ())
+		{
+			node_l->ongoing_wallet_reps ();
+		}
+	});
+}
+
+int rai::node::price (rai::uint128_t const & balance_a, int amount_a)
+{
+	assert (balance_a >= amount_a * rai::Gxrb_ratio);
+	auto balance_l (balance_a);
+	double result (0.0);
+	for (auto i (0); i < amount_a; ++i)
+	{
+		balance_l -= rai::Gxrb_ratio;
+		auto balance_scaled ((balance_l / rai::Mxrb_ratio).convert_to <double> ());
+		auto units (balance_scaled / 1000.0);
+		auto unit_price (((free_cutoff - units) / free_cutoff) * price_max);
+		result += std::min (std::max (0.0, unit_price), price_max);
+	}
+	return static_cast <int> (result * 100.0);
+}
+
+namespace {
+class work_request
+{
+public:
+work_request (boost::asio::io_service & service_a, boost::asio::ip::address address_a, uint16_t port_a) :
+address (address_a),
+port (port_a),
+socket (service_a)
+{
+}
+boost::asio::ip::address address;
+uint16_t port;
+boost::beast::flat_buffer buffer;
+boost::beast::http::response <boost::beast::http::string_body> response;
+boost::asio::ip::tcp::socket socket;
+};
+class distributed_work : public std::enable_shared_from_this <distributed_work>
+{
+public:
+distributed_work (std::shared_ptr <rai::node> const & node_a, rai::block_hash const & root_a, std::function <void (uint64_t)> callback_a) :
+callback (callback_a),
+node (node_a),
+root (root_a)
+{
+	completed.clear ();
+	for (auto & i : node_a->config.work_peers)
 	{
-		observers.disconnect ();
-	};
-	observers.blocks.add ([this] (rai::block const & block_a, rai::account const & account_a, rai::amount const & amount_a)
+		outstanding [i.first] = i.second;
+	}
+}
+void start ()
+{
+	if (!outstanding.empty ())
 	{
-		if (!config.callback_address.empty ())
+		auto this_l (shared_from_this ());
+		std::lock_guard <std::mutex> lock (mutex);
+		for (auto const & i: outstanding)
 		{
-			boost::property_tree::ptree event;
-			event.add ("account", account_a.to_account ());
-			event.add ("hash", block_a.hash ().to_string ());
-			std::string block_text;
-			block_a.serialize_json (block_text);
-			event.add ("block", block_text);
-			event.add ("amount", amount_a.to_string_dec ());
-			std::stringstream ostream;
-			boost::property_tree::write_json (ostream, event);
-			ostream.flush ();
-			auto body (std::make_shared <std::string> (ostream.str ()));
-			auto address (config.callback_address);
-			auto port (config.callback_port);
-			auto target (std::make_shared <std::string> (config.callback_target));
-			auto node_l (shared_from_this ());
-			auto resolver (std::make_shared <boost::asio::ip::tcp::resolver> (service));
-			resolver->async_resolve (boost::asio::ip::tcp::resolver::query (address, std::to_string (port)), [node_l, address, port, target, body, resolver] (boost::system::error_code const & ec, boost::asio::ip::tcp::resolver::iterator i_a)
+			auto host (i.first);
+			auto service (i.second);
+			node->background ([this_l, host, service] ()
 			{
-				if (!ec)
+				auto connection (std::make_shared <work_request> (this_l->node->service, host, service));
+				connection->socket.async_connect (rai::tcp_endpoint (host, service), [this_l, connection] (boost::system::error_code const & ec)
 				{
-					for (auto i (i_a), n (boost::asio::ip::tcp::resolver::iterator {}); i != n; ++i)
+					if (!ec)
 					{
-						auto sock (std::make_shared <boost::asio::ip::tcp::socket> (node_l->service));
-						sock->async_connect (i->endpoint(), [node_l, target, body, sock, address, port] (boost::system::error_code const & ec)
+						std::string request_string;
+						{
+							boost::property_tree::ptree request;
+							request.put ("action", "work_generate");
+							request.put ("hash", this_l->root.to_string ());
+							std::stringstream ostream;
+							boost::property_tree::write_json (ostream, request);
+							request_string = ostream.str ();
+						}
+						auto request (std::make_shared <boost::beast::http::request <boost::beast::http::string_body>> ());
+						request->method (boost::beast::http::verb::post);
+						request->target ("/");
+						request->version = 11;
+						request->body = request_string;
+						request->prepare_payload ();
+						boost::beast::http::async_write (connection->socket, *request, [this_l, connection, request] (boost::system::error_code const & ec)
 						{
 							if (!ec)
 							{
-								auto req (std::make_shared <boost::beast::http::request<boost::beast::http::string_body>> ());
-								req->method (boost::beast::http::verb::post);
-								req->target (*target);
-								req->version = 11;
-								req->insert(boost::beast::http::field::host, address);
-								req->body = *body;
-								//req->prepare (*req);
-								//boost::beast::http::prepare(req);
-								req->prepare_payload();
-								boost::beast::http::async_write (*sock, *req, [node_l, sock, address, port, req] (boost::system::error_code const & ec)
+								boost::beast::http::async_read (connection->socket, connection->buffer, connection->response, [this_l, connection] (boost::system::error_code const & ec)
 								{
 									if (!ec)
 									{
-										auto sb (std::make_shared <boost::beast::flat_buffer> ());
-										auto resp (std::make_shared <boost::beast::http::response <boost::beast::http::string_body>> ());
-										boost::beast::http::async_read (*sock, *sb, *resp, [node_l, sb, resp, sock, address, port] (boost::system::error_code const & ec)
+										if (connection->response.result() == boost::beast::http::status::ok)
 										{
-											if (!ec)
-											{
-												if (resp->result() == boost::beast::http::status::ok)
-												{
-												}
-												else
-												{
-													if (node_l->config.logging.callback_logging ())
-													{
-														BOOST_LOG (node_l->log) << boost::str (boost::format ("Callback to %1%:%2% failed with status: %3%") % address % port % resp->result());
-													}
-												}
-											}
-											else
-											{
-												if (node_l->config.logging.callback_logging ())
-												{
-													BOOST_LOG (node_l->log) << boost::str (boost::format ("Unable complete callback: %1%:%2% %3%") % address % port % ec.message ());
-												}
-											};
-										});
+											this_l->success (connection->response.body, connection->address);
+										}
+										else
+										{
+											BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Work peer %1% responded with an error %2%") % connection->address % connection->port);
+											this_l->failure (connection->address);
+										}
 									}
 									else
 									{
-										if (node_l->config.logging.callback_logging ())
-										{
-											BOOST_LOG (node_l->log) << boost::str (boost::format ("Unable to send callback: %1%:%2% %3%") % address % port % ec.message ());
-										}
+										BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Unable to read from work_peer %1% %2%") % connection->address % connection->port);
+										this_l->failure (connection->address);
 									}
 								});
 							}
 							else
 							{
-								if (node_l->config.logging.callback_logging ())
-								{
-									BOOST_LOG (node_l->log) << boost::str (boost::format ("Unable to connect to callback address: %1%:%2%, %3%") % address % port % ec.message ());
-								}
+								BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Unable to write to work_peer %1% %2%") % connection->address % connection->port);
+								this_l->failure (connection->address);
 							}
 						});
 					}
-				}
-				else
-				{
-					if (node_l->config.logging.callback_logging ())
+					else
 					{
-						BOOST_LOG (node_l->log) << boost::str (boost::format ("Error resolving callback: %1%:%2%, %3%") % address % port % ec.message ());
+						BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Unable to connect to work_peer %1% %2%") % connection->address % connection->port);
+						this_l->failure (connection->address);
 					}
-				}
+				});
 			});
 		}
-	});
-	observers.endpoint.add ([this] (rai::endpoint const & endpoint_a)
+	}
+	else
 	{
-		this->network.send_keepalive (endpoint_a);
-		rep_query (*this, endpoint_a);
-	});
-    observers.vote.add ([this] (rai::vote const & vote_a, rai::endpoint const &)
-    {
-		active.vote (vote_a);
-    });
-    observers.vote.add ([this] (rai::vote const & vote_a, rai::endpoint const &)
-    {
-		this->gap_cache.vote (vote_a);
-    });
-	observers.vote.add ([this] (rai::vote const & vote_a, rai::endpoint const & endpoint_a)
+		handle_failure (true);
+	}
+}
+void stop ()
+{
+	auto this_l (shared_from_this ());
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto const & i: outstanding)
 	{
-		if (this->rep_crawler.exists (vote_a.block->hash ()))
+		auto host (i.first);
+		auto service (i.second);
+		node->background ([this_l, host, service] ()
 		{
-			auto weight_l (weight (vote_a.account));
-			// We see a valid non-replay vote for a block we requested, this node is probably a representative
-			if (peers.rep_response (endpoint_a, weight_l))
+			std::string request_string;
 			{
-				BOOST_LOG (log) << boost::str (boost::format ("Found a representative at %1%") % endpoint_a);
+				boost::property_tree::ptree request;
+				request.put ("action", "work_cancel");
+				request.put ("hash", this_l->root.to_string ());
+				std::stringstream ostream;
+				boost::property_tree::write_json (ostream, request);
+				request_string = ostream.str ();
+			}
+			boost::beast::http::request <boost::beast::http::string_body> request;
+			request.method (boost::beast::http::verb::post);
+			request.target ("/");
+			request.version = 11;
+			request.body = request_string;
+			request.prepare_payload();
+			auto socket (std::make_shared <boost::asio::ip::tcp::socket> (this_l->node->service));
+			boost::beast::http::async_write (*socket, request, [socket] (boost::system::error_code const & ec)
+			{
+			});
+		});
+	}
+	outstanding.clear ();
+}
+void success (std::string const & body_a, boost::asio::ip::address const & address)
+{
+	auto last (remove (address));
+	std::stringstream istream (body_a);
+	try
+	{
+		boost::property_tree::ptree result;
+		boost::property_tree::read_json (istream, result);
+		auto work_text (result.get <std::string> ("work"));
+		uint64_t work;
+		if (!rai::from_string_hex (work_text, work))
+		{
+			if (!node->work.work_validate (root, work))
+			{
+				set_once (work);
+				stop ();
+			}
+			else
+			{
+				BOOST_LOG (node->log) << boost::str (boost::format ("Incorrect work response from %1% for root %2% value %3%") % address % root.to_string () % work_text);
+				handle_failure (last);
 			}
 		}
-	});
-    BOOST_LOG (log) << "Node starting, version: " << RAIBLOCKS_VERSION_MAJOR << "." << RAIBLOCKS_VERSION_MINOR << "." << RAIBLOCKS_VERSION_PATCH;
-	BOOST_LOG (log) << boost::str (boost::format ("Work pool running %1% threads") % work.threads.size ());
-    if (!init_a.error ())
-    {
-        if (config.logging.node_lifetime_tracing ())
-        {
-            std::cerr << "Constructing node\n";
-        }
-		rai::transaction transaction (store.environment, nullptr, true);
-        if (store.latest_begin (transaction) == store.latest_end ())
-        {
-            // Store was empty meaning we just created it, add the genesis block
-            rai::genesis genesis;
-            genesis.initialize (transaction, store);
-        }
-    }
+		else
+		{
+			BOOST_LOG (node->log) << boost::str (boost::format ("Work response from %1% wasn't a number %2%") % address % work_text);
+			handle_failure (last);
+		}
+	}
+	catch (...)
+	{
+		BOOST_LOG (node->log) << boost::str (boost::format ("Work response from %1% wasn't parsable %2%") % address % body_a);
+		handle_failure (last);
+	}
+}
+void set_once (uint64_t work_a)
+{
+	if (!completed.test_and_set ())
+	{
+		callback (work_a);
+	}
+}
+void failure (boost::asio::ip::address const & address)
+{
+	auto last (remove (address));
+	handle_failure (last);
+}
+void handle_failure (bool last)
+{
+	if (last)
+	{
+		if (!completed.test_and_set ())
+		{
+			auto callback_l (callback);
+			node->work.generate (root, [callback_l] (boost::optional <uint64_t> const & work_a)
+			{
+				callback_l (work_a.value ());
+			});
+		}
+	}
+}
+bool remove (boost::asio::ip::address const & address)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	outstanding.erase (address);
+	return outstanding.empty ();
+}
+std::function <void (uint64_t)> callback;
+std::shared_ptr <rai::node> node;
+rai::block_hash root;
+std::mutex mutex;
+std::map <boost::asio::ip::address, uint16_t> outstanding;
+std::atomic_flag completed;
+};
 }
 
-rai::node::~node ()
+void rai::node::generate_work (rai::block & block_a)
 {
-    if (config.logging.node_lifetime_tracing ())
-    {
-        std::cerr << "Destructing node\n";
-    }
+    block_a.block_work_set (generate_work (block_a.root ()));
 }
 
-void rai::node::send_keepalive (rai::endpoint const & endpoint_a)
+void rai::node::generate_work (rai::uint256_union const & hash_a, std::function <void (uint64_t)> callback_a)
 {
-    auto endpoint_l (endpoint_a);
-    if (endpoint_l.address ().is_v4 ())
-    {
-        endpoint_l = rai::endpoint (boost::asio::ip::address_v6::v4_mapped (endpoint_l.address ().to_v4 ()), endpoint_l.port ());
-    }
-    assert (endpoint_l.address ().is_v6 ());
-    network.send_keepalive (endpoint_l);
+	auto work_generation (std::make_shared <distributed_work> (shared (), hash_a, callback_a));
+	work_generation->start ();
 }
 
-rai::gap_cache::gap_cache (rai::node & node_a) :
-node (node_a)
+uint64_t rai::node::generate_work (rai::uint256_union const & hash_a)
+{
+	std::promise <uint64_t> promise;
+	generate_work (hash_a, [&promise] (uint64_t work_a)
+	{
+		promise.set_value (work_a);
+	});
+	return promise.get_future ().get ();
+}
+
+void rai::node::add_initial_peers ()
 {
+	
 }
 
-void rai::gap_cache::add (MDB_txn * transaction_a, std::shared_ptr <rai::block> block_a)
+namespace
 {
-	auto hash (block_a->hash ());
-    std::lock_guard <std::mutex> lock (mutex);
-    auto existing (blocks.get <1>().find (hash));
-    if (existing != blocks.get <1> ().end ())
+class confirmed_visitor : public rai::block_visitor
+{
+public:
+    confirmed_visitor (rai::node & node_a, std::shared_ptr <rai::block> block_a) :
+    node (node_a),
+	block (block_a)
     {
-        blocks.get <1> ().modify (existing, [] (rai::gap_information & info)
-		{
-			info.arrival = std::chrono::system_clock::now ();
-		});
     }
-    else
+    void send_block (rai::send_block const & block_a) override
     {
-		blocks.insert ({std::chrono::system_clock::now (), hash, std::unique_ptr <rai::votes> (new rai::votes (block_a))});
-        if (blocks.size () > max)
+        for (auto i (node.wallets.items.begin ()), n (node.wallets.items.end ()); i != n; ++i)
         {
-            blocks.get <0> ().erase (blocks.get <0> ().begin ());
+			auto wallet (i->second);
+			if (wallet->exists (block_a.hashables.destination))
+			{
+				rai::account representative;
+				rai::pending_info pending;
+				rai::transaction transaction (node.store.environment, nullptr, false);
+				representative = wallet->store.representative (transaction);
+				auto error (node.store.pending_get (transaction, rai::pending_key (block_a.hashables.destination, block_a.hash ()), pending));
+				if (!error)
+				{
+					auto node_l (node.shared ());
+					auto amount (pending.amount.number ());
+					assert (block.get () == &block_a);
+					wallet->receive_async (block, representative, amount, [] (std::shared_ptr <rai::block>) {});
+				}
+				else
+				{
+					if (node.config.logging.ledger_duplicate_logging ())
+					{
+						BOOST_LOG (node.log) << boost::str (boost::format ("Block confirmed before timeout %1%") % block_a.hash ().to_string ());
+					}
+				}
+			}
         }
     }
+    void receive_block (rai::receive_block const &) override
+    {
+    }
+    void open_block (rai::open_block const &) override
+    {
+    }
+    void change_block (rai::change_block const &) override
+    {
+    }
+    rai::node & node;
+	std::shared_ptr <rai::block> block;
+};
 }
 
-void rai::gap_cache::vote (rai::vote const & vote_a)
+void rai::node::confirm_heights (std::vector <rai::block_hash> const & remaining_a)
 {
-	rai::transaction transaction (node.store.environment, nullptr, false);
-	std::lock_guard <std::mutex> lock (mutex);
-	auto hash (vote_a.block->hash ());
-	auto existing (blocks.get <1> ().find (hash));
-	if (existing != blocks.get <1> ().end ())
+	auto remaining (remaining_a);
 	{
-		existing->votes->vote (vote_a);
-		auto winner (node.ledger.winner (transaction, *existing->votes));
-		if (winner.first > bootstrap_threshold (transaction))
+		rai::transaction transaction (store.environment, nullptr, true);
+		ledger.confirm (transaction, remaining, confirm_batch);
+	}
+	if (!remaining.empty ())
+	{
+		// Let other writers in between batches
+		std::weak_ptr <rai::node> node_w (shared_from_this ());
+		background ([node_w, remaining] ()
 		{
-			auto node_l (node.shared ());
-			auto now (std::chrono::system_clock::now ());
-			node.alarm.add (rai::rai_network == rai::rai_networks::rai_test_network ? now + std::chrono::milliseconds (5) : now + std::chrono::seconds (5), [node_l, hash] ()
+			if (auto node_l = node_w.lock ())
 			{
-				rai::transaction transaction (node_l->store.environment, nullptr, false);
-				if (!node_l->store.block_exists (transaction, hash))
-				{
-					if (!node_l->bootstrap_initiator.in_progress ())
-					{
-						BOOST_LOG (node_l->log) << boost::str (boost::format ("Missing confirmed block %1%") % hash.to_string ());
-					}
-					node_l->bootstrap_initiator.bootstrap ();
-				}
-			});
-		}
+				node_l->confirm_heights (remaining);
+			}
+		});
 	}
 }
 
-rai::uint128_t rai::gap_cache::bootstrap_threshold (MDB_txn * transaction_a)
+void rai::node::process_confirmed (std::shared_ptr <rai::block> confirmed_a)
 {
-    auto result ((node.ledger.supply (transaction_a) / 256) * node.config.bootstrap_fraction_numerator);
-	return result;
+    confirmed_visitor visitor (*this, confirmed_a);
+    confirmed_a->visit (visitor);
 }
 
-void rai::gap_cache::purge_old ()
+void rai::node::process_message (rai::message & message_a, rai::endpoint const & sender_a)
 {
-	auto cutoff (std::chrono::system_clock::now () - std::chrono::seconds (10));
-    std::lock_guard <std::mutex> lock (mutex);
-	auto done (false);
-	while (!done && !blocks.empty ())
+	network_message_visitor visitor (*this, sender_a);
+	message_a.visit (visitor);
+}
+
+rai::endpoint rai::network::endpoint ()
+{
+	rai::endpoint result;
+	if (transport != nullptr)
 	{
-		auto first (blocks.get <1> ().begin ());
-		if (first->arrival < cutoff)
-		{
-			blocks.get <1> ().erase (first);
-		}
-		else
+		result = transport->endpoint ();
+	}
+	else
+	{
+		boost::system::error_code ec;
+		auto port (socket.local_endpoint (ec).port ());
+		if (ec)
 		{
-			done = true;
+			BOOST_LOG (node.log) << "Unable to retrieve port: " << ec.message ();
 		}
+		result = rai::endpoint (boost::asio::ip::address_v6::loopback (), port);
 	}
+    return result;
 }
 
-void rai::network::confirm_send (rai::confirm_ack const & confirm_a, std::shared_ptr <std::vector <uint8_t>> bytes_a, rai::endpoint const & endpoint_a)
+std::unordered_set <rai::endpoint> rai::peer_container::random_set (size_t count_a)
 {
-    if (node.config.logging.network_publish_logging ())
-    {
-        BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm_ack for block %1% to %2%") % confirm_a.vote.block->hash ().to_string () % endpoint_a);
-    }
-    std::weak_ptr <rai::node> node_w (node.shared ());
-	++outgoing.confirm_ack;
-    node.network.send_buffer (bytes_a->data (), bytes_a->size (), endpoint_a, [bytes_a, node_w, endpoint_a] (boost::system::error_code const & ec, size_t size_a)
+	std::unordered_set <rai::endpoint> result;
+	result.reserve (count_a);
+	auto snapshot_l (snapshot ());
+	auto & peers_l (snapshot_l->peers);
+	// Stop trying to fill result with random samples after this many attempts
+	auto random_cutoff (count_a * 2);
+	auto peers_size (peers_l.size ());
+	// Usually count_a will be much smaller than peers.size()
+	// Otherwise make sure we have a cutoff on attempting to randomly fill
+	if (!peers_l.empty ())
 	{
-		if (auto node_l = node_w.lock ())
+		for (auto i (0); i < random_cutoff && result.size () < count_a; ++i)
 		{
-			if (node_l->config.logging.network_logging ())
-			{
-				if (ec)
-				{
-					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error broadcasting confirm_ack to %1%: %2%") % endpoint_a % ec.message ());
-				}
-			}
+			auto index (random_pool.GenerateWord32 (0, peers_size - 1));
+			result.insert (peers_l [index].endpoint);
 		}
-	});
+	}
+	// Fill the remainder with most recent contact
+	for (auto i (snapshot_l->by_contact.begin ()), n (snapshot_l->by_contact.end ()); i != n && result.size () < count_a; ++i)
+	{
+		result.insert (peers_l [*i].endpoint);
+	}
+	return result;
 }
 
-void rai::node::process_receive_republish (std::shared_ptr <rai::block> incoming)
+void rai::peer_container::random_fill (std::array <rai::endpoint, 8> & target_a)
 {
-    assert (incoming != nullptr);
-    auto node_l (shared_from_this ());
-    block_processor.add (incoming, [node_l] (MDB_txn * transaction_a, rai::process_return result_a, std::shared_ptr <rai::block> block_a)
-    {
-        switch (result_a.code)
-        {
-            case rai::process_result::progress:
-            {
-                node_l->active.start (transaction_a, block_a);
-                node_l->background ([node_l, block_a, result_a] ()
-                {
-                    node_l->observers.blocks (*block_a, result_a.account, result_a.amount);
-                });
-                break;
-            }
-            default:
-            {
-                break;
-            }
-        }
-    });
-    if (rai::rai_network == rai::rai_networks::rai_test_network)
+    auto peers (random_set (target_a.size ()));
+    assert (peers.size () <= target_a.size ());
+    auto endpoint (rai::endpoint (boost::asio::ip::address_v6 {}, 0));
+    assert (endpoint.address ().is_v6 ());
+    std::fill (target_a.begin (), target_a.end (), endpoint);
+    auto j (target_a.begin ());
+    for (auto i (peers.begin ()), n (peers.end ()); i != n; ++i, ++j)
     {
-        block_processor.flush ();
+        assert (i->address ().is_v6 ());
+        assert (j < target_a.end ());
+        *j = *i;
     }
 }
 
-rai::process_return rai::node::process (rai::block const & block_a)
+// Request a list of the top known representatives
+std::vector <rai::peer_information> rai::peer_container::representatives (size_t count_a)
 {
-	rai::transaction transaction (store.environment, nullptr, true);
-	auto result (ledger.process (transaction, block_a));
+	std::vector <peer_information> result;
+	result.reserve (std::min (count_a, size_t (16)));
+	auto snapshot_l (snapshot ());
+	for (auto i (snapshot_l->by_weight.begin ()), n (snapshot_l->by_weight.end ()); i != n && result.size () < count_a; ++i)
+	{
+		result.push_back (snapshot_l->peers [*i]);
+	}
 	return result;
 }
 
-// Simulating with sqrt_broadcast_simulate shows we only need to broadcast to sqrt(total_peers) random peers in order to successfully publish to everyone with high probability
-std::vector <rai::endpoint> rai::peer_container::list_sqrt ()
+std::vector <rai::peer_information> rai::peer_container::purge_list (std::chrono::system_clock::time_point const & cutoff)
 {
-	auto peers (random_set (2 * size_sqrt ()));
-	std::vector <rai::endpoint> result;
-	result.reserve (peers.size ());
-	for (auto i (peers.begin ()), n (peers.end ()); i != n; ++i)
+	std::vector <rai::peer_information> result;
+	std::unordered_map <rai::endpoint, std::chrono::system_clock::time_point> contacts_l;
 	{
-		result.push_back (*i);
+		std::lock_guard <std::mutex> lock (contacts_mutex);
+		contacts_l.swap (contacts);
+		contacts_flushed = std::chrono::steady_clock::now ();
 	}
-	return result;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		// Peers heard from since the last flush must not be purged
+		apply_contacts (contacts_l);
+		auto pivot (peers.get <1> ().lower_bound (cutoff));
+		result.assign (pivot, peers.get <1> ().end ());
+		peers.get <1> ().erase (peers.get <1> ().begin (), pivot);
+		for (auto i (peers.begin ()), n (peers.end ()); i != n; ++i)
+		{
+			peers.modify (i, [] (rai::peer_information & info) {info.last_attempt = std::chrono::system_clock::now ();});
+		}
+		publish ();
+	}
+	if (result.empty ())
+	{
+		disconnect_observer ();
+	}
+    return result;
 }
 
-std::vector <rai::endpoint> rai::peer_container::list ()
+std::vector <rai::endpoint> rai::peer_container::rep_crawl ()
 {
-    std::vector <rai::endpoint> result;
-    std::lock_guard <std::mutex> lock (mutex);
-    result.reserve (peers.size ());
-    for (auto i (peers.begin ()), j (peers.end ()); i != j; ++i)
-    {
-        result.push_back (i->endpoint);
-    }
-	std::random_shuffle (result.begin (), result.end ());
-    return result;
+	std::vector <rai::endpoint> result;
+	result.reserve (8);
+	std::lock_guard <std::mutex> lock (mutex);
+	auto count (0);
+	for (auto i (peers.get <5> ().begin ()), n (peers.get <5> ().end ()); i != n && count < 8; ++i, ++count)
+	{
+		result.push_back (i->endpoint);
+	};
+	return result;
 }
 
-rai::endpoint rai::peer_container::bootstrap_peer ()
+size_t rai::peer_container::size ()
 {
-    rai::endpoint result (boost::asio::ip::address_v6::any (), 0);
-    std::lock_guard <std::mutex> lock (mutex);
-	auto first (peers.get <4> ().begin ());
-	if (first != peers.get <4> ().end ())
-	{
-		result = first->endpoint;
-		peers.get <4> ().modify (first, [] (rai::peer_information & peer_a)
-		{
-			peer_a.last_bootstrap_attempt = std::chrono::system_clock::now ();
-		});
-    }
-    return result;
+    return snapshot ()->peers.size ();
 }
 
-bool rai::parse_port (std::string const & string_a, uint16_t & port_a)
+size_t rai::peer_container::size_sqrt ()
 {
-	bool result;
-	size_t converted;
-	port_a = std::stoul (string_a, &converted);
-	result = converted != string_a.size () || converted > std::numeric_limits <uint16_t>::max ();
+	auto result (std::ceil (std::sqrt (size ())));
 	return result;
 }
 
-bool rai::parse_address_port (std::string const & string, boost::asio::ip::address & address_a, uint16_t & port_a)
+bool rai::peer_container::empty ()
 {
-    auto result (false);
-    auto port_position (string.rfind (':'));
-    if (port_position != std::string::npos && port_position > 0)
+    return size () == 0;
+}
+
+bool rai::peer_container::not_a_peer (rai::endpoint const & endpoint_a)
+{
+    bool result (false);
+    if (endpoint_a.address ().to_v6 ().is_unspecified ())
     {
-        std::string port_string (string.substr (port_position + 1));
-        try
-        {
-			uint16_t port;
-			result = parse_port (port_string, port);
-            if (!result)
-            {
-                boost::system::error_code ec;
-                auto address (boost::asio::ip::address_v6::from_string (string.substr (0, port_position), ec));
-                if (ec == 0)
-                {
-                    address_a = address;
-                    port_a = port;
-                }
-                else
-                {
-                    result = true;
-                }
-            }
-            else
-            {
-                result = true;
-            }
-        }
-        catch (...)
-        {
-            result = true;
-        }
+        result = true;
     }
-    else
+    else if (rai::reserved_address (endpoint_a))
     {
         result = true;
     }
-    return result;
-}
-
-bool rai::parse_endpoint (std::string const & string, rai::endpoint & endpoint_a)
-{
-    boost::asio::ip::address address;
-    uint16_t port;
-    auto result (parse_address_port (string, address, port));
-    if (!result)
+    else if (endpoint_a == self)
     {
-        endpoint_a = rai::endpoint (address, port);
+        result = true;
     }
     return result;
 }
 
-bool rai::parse_tcp_endpoint (std::string const & string, rai::tcp_endpoint & endpoint_a)
+bool rai::peer_container::rep_response (rai::endpoint const & endpoint_a, rai::amount const & weight_a)
 {
-    boost::asio::ip::address address;
-    uint16_t port;
-    auto result (parse_address_port (string, address, port));
-    if (!result)
+	auto updated (false);
+    std::lock_guard <std::mutex> lock (mutex);
+    auto existing (peers.find (endpoint_a));
+    if (existing != peers.end ())
     {
-        endpoint_a = rai::tcp_endpoint (address, port);
+		peers.modify (existing, [weight_a, &updated] (rai::peer_information & info)
+		{
+			info.last_rep_response = std::chrono::system_clock::now ();
+			if (info.rep_weight < weight_a)
+			{
+				updated = true;
+				info.rep_weight = weight_a;
+			}
+		});
+		if (updated)
+		{
+			publish ();
+		}
     }
-    return result;
-}
-
-void rai::node::start ()
-{
-    network.receive ();
-    ongoing_keepalive ();
-	ongoing_bootstrap ();
-	ongoing_vote_flush ();
-	ongoing_rep_crawl ();
-    bootstrap.start ();
-	backup_wallet ();
-	active.announce_votes ();
-	port_mapping.start ();
-	add_initial_peers ();
-	observers.started ();
+	return updated;
 }
 
-void rai::node::stop ()
+void rai::peer_container::rep_request (rai::endpoint const & endpoint_a)
 {
-    BOOST_LOG (log) << "Node stopping";
-	block_processor.stop ();
-	active.stop ();
-    network.stop ();
-	bootstrap_initiator.stop ();
-    bootstrap.stop ();
-	port_mapping.stop ();
+    std::lock_guard <std::mutex> lock (mutex);
+    auto existing (peers.find (endpoint_a));
+    if (existing != peers.end ())
+    {
+		peers.modify (existing, [] (rai::peer_information & info)
+		{
+			info.last_rep_request = std::chrono::system_clock::now ();
+		});
+    }
 }
 
-void rai::node::keepalive_preconfigured (std::vector <std::string> const & peers_a)
+bool rai::peer_container::insert (rai::endpoint const & endpoint_a, unsigned version_a)
 {
-	for (auto i (peers_a.begin ()), n (peers_a.end ()); i != n; ++i)
+	auto unknown (false);
+    auto result (not_a_peer (endpoint_a));
+    if (!result)
+    {
+        std::lock_guard <std::mutex> lock (mutex);
+        auto existing (peers.find (endpoint_a));
+        if (existing != peers.end ())
+        {
+			auto version_changed (existing->network_version != version_a);
+            peers.modify (existing, [version_a] (rai::peer_information & info)
+            {
+                info.last_contact = std::chrono::system_clock::now ();
+                info.network_version = version_a;
+            });
+            result = true;
+			if (version_changed)
+			{
+				publish ();
+			}
+			else
+			{
+				publish_batched ();
+			}
+        }
+        else
+        {
+            peers.insert (rai::peer_information (endpoint_a, version_a));
+			unknown = true;
+			publish ();
+        }
+    }
+	if (unknown && !result)
 	{
-		keepalive (*i, rai::network::node_port);
+		peer_observer (endpoint_a);
 	}
+    return result;
 }
 
-rai::block_hash rai::node::latest (rai::account const & account_a)
+namespace {
+boost::asio::ip::address_v6 mapped_from_v4_bytes (unsigned long address_a)
 {
-	rai::transaction transaction (store.environment, nullptr, false);
-	return ledger.latest (transaction, account_a);
+    return boost::asio::ip::address_v6::v4_mapped (boost::asio::ip::address_v4 (address_a));
 }
-
-rai::uint128_t rai::node::balance (rai::account const & account_a)
-{
-	rai::transaction transaction (store.environment, nullptr, false);
-	return ledger.account_balance (transaction, account_a);
 }
 
-std::unique_ptr <rai::block> rai::node::block (rai::block_hash const & hash_a)
+bool rai::reserved_address (rai::endpoint const & endpoint_a)
 {
-	rai::transaction transaction (store.environment, nullptr, false);
-	return store.block_get (transaction, hash_a);
+    assert (endpoint_a.address ().is_v6 ());
+	auto bytes (endpoint_a.address ().to_v6 ());
+	auto result (false);
+	static auto const rfc1700_min (mapped_from_v4_bytes (0x00000000ul));
+	static auto const rfc1700_max (mapped_from_v4_bytes (0x00fffffful));
+	static auto const rfc5737_1_min (mapped_from_v4_bytes (0xc0000200ul));
+	static auto const rfc5737_1_max (mapped_from_v4_bytes (0xc00002fful));
+	static auto const rfc5737_2_min (mapped_from_v4_bytes (0xc6336400ul));
+	static auto const rfc5737_2_max (mapped_from_v4_bytes (0xc63364fful));
+	static auto const rfc5737_3_min (mapped_from_v4_bytes (0xcb007100ul));
+	static auto const rfc5737_3_max (mapped_from_v4_bytes (0xcb0071fful));
+	static auto const ipv4_multicast_min (mapped_from_v4_bytes (0xe0000000ul));
+	static auto const ipv4_multicast_max (mapped_from_v4_bytes (0xeffffffful));
+	static auto const rfc6890_min (mapped_from_v4_bytes (0xf0000000ul));
+	static auto const rfc6890_max (mapped_from_v4_bytes (0xfffffffful));
+	static auto const rfc6666_min (boost::asio::ip::address_v6::from_string ("100::"));
+	static auto const rfc6666_max (boost::asio::ip::address_v6::from_string ("100::ffff:ffff:ffff:ffff"));
+	static auto const rfc3849_min (boost::asio::ip::address_v6::from_string ("2001:db8::"));
+	static auto const rfc3849_max (boost::asio::ip::address_v6::from_string ("2001:db8:ffff:ffff:ffff:ffff:ffff:ffff"));
+	static auto const ipv6_multicast_min (boost::asio::ip::address_v6::from_string ("ff00::"));
+	static auto const ipv6_multicast_max (boost::asio::ip::address_v6::from_string ("ff00:ffff:ffff:ffff:ffff:ffff:ffff:ffff"));
+    if (bytes >= rfc1700_min && bytes <= rfc1700_max)
+	{
+		result = true;
+	}
+	else if (bytes >= rfc5737_1_min && bytes <= rfc5737_1_max)
+	{
+		result = true;
+	}
+	else if (bytes >= rfc5737_2_min && bytes <= rfc5737_2_max)
+	{
+		result = true;
+	}
+	else if (bytes >= rfc5737_3_min && bytes <= rfc5737_3_max)
+	{
+		result = true;
+	}
+	else if (bytes >= ipv4_multicast_min && bytes <= ipv4_multicast_max)
+	{
+		result = true;
+	}
+	else if (bytes >= rfc6890_min && bytes <= rfc6890_max)
+	{
+		result = true;
+	}
+	else if (bytes >= rfc6666_min && bytes <= rfc6666_max)
+	{
+		result = true;
+	}
+	else if (bytes >= rfc3849_min && bytes <= rfc3849_max)
+	{
+		result = true;
+	}
+	else if (bytes >= ipv6_multicast_min && bytes <= ipv6_multicast_max)
+	{
+		result = true;
+	}
+	return result;
 }
 
-std::pair <rai::uint128_t, rai::uint128_t> rai::node::balance_pending (rai::account const & account_a)
+rai::peer_information::peer_information (rai::endpoint const & endpoint_a, unsigned network_version_a) :
+endpoint (endpoint_a),
+last_contact (std::chrono::system_clock::now ()),
+last_attempt (last_contact),
+last_bootstrap_attempt (std::chrono::system_clock::time_point ()),
+last_rep_request (std::chrono::system_clock::time_point ()),
+last_rep_response (std::chrono::system_clock::time_point ()),
+rep_weight (0),
+network_version (network_version_a)
 {
-	std::pair <rai::uint128_t, rai::uint128_t> result;
-	rai::transaction transaction (store.environment, nullptr, false);
-	result.first = ledger.account_balance (transaction, account_a);
-	result.second = ledger.account_pending (transaction, account_a);
-	return result;
 }
 
-rai::uint128_t rai::node::weight (rai::account const & account_a)
+rai::peer_information::peer_information (rai::endpoint const & endpoint_a, std::chrono::system_clock::time_point const & last_contact_a, std::chrono::system_clock::time_point const & last_attempt_a) :
+endpoint (endpoint_a),
+last_contact (last_contact_a),
+last_attempt (last_attempt_a),
+last_bootstrap_attempt (std::chrono::system_clock::time_point ()),
+last_rep_request (std::chrono::system_clock::time_point ()),
+last_rep_response (std::chrono::system_clock::time_point ()),
+rep_weight (0)
 {
-	rai::transaction transaction (store.environment, nullptr, false);
-	return ledger.weight (transaction, account_a);
 }
 
-rai::account rai::node::representative (rai::account const & account_a)
+rai::peer_information const * rai::peer_snapshot::find (rai::endpoint const & endpoint_a) const
 {
-	rai::transaction transaction (store.environment, nullptr, false);
-	rai::account_info info;
-	rai::account result (0);
-	if (!store.account_get (transaction, account_a, info))
+	rai::peer_information const * result (nullptr);
+	auto existing (index.find (endpoint_a));
+	if (existing != index.end ())
 	{
-		result = info.rep_block;
+		result = &peers [existing->second];
 	}
 	return result;
 }
 
-void rai::node::ongoing_keepalive ()
+rai::peer_container::peer_container (rai::endpoint const & self_a) :
+self (self_a),
+peer_observer ([] (rai::endpoint const &) {}),
+disconnect_observer ([] () {}),
+contacts_flushed (std::chrono::steady_clock::now ()),
+stale (false),
+published (std::chrono::steady_clock::now ()),
+current (std::make_shared <rai::peer_snapshot> ())
 {
-    keepalive_preconfigured (config.preconfigured_peers);
-    auto peers_l (peers.purge_list (std::chrono::system_clock::now () - cutoff));
-    for (auto i (peers_l.begin ()), j (peers_l.end ()); i != j && std::chrono::system_clock::now () - i->last_attempt > period; ++i)
-    {
-        network.send_keepalive (i->endpoint);
-    }
-	std::weak_ptr <rai::node> node_w (shared_from_this ());
-    alarm.add (std::chrono::system_clock::now () + period, [node_w] ()
-	{
-		if (auto node_l = node_w.lock ())
-		{
-			node_l->ongoing_keepalive ();
-		}
-	});
 }
 
-void rai::node::ongoing_rep_crawl ()
+std::shared_ptr <rai::peer_snapshot const> rai::peer_container::snapshot () const
 {
-	auto now (std::chrono::system_clock::now ());
-	auto peers_l (peers.rep_crawl ());
-	rep_query (*this, peers_l);
-	if (network.on)
-	{
-		std::weak_ptr <rai::node> node_w (shared_from_this ());
-		alarm.add (now + period, [node_w] ()
-		{
-			if (auto node_l = node_w.lock ())
-			{
-				node_l->ongoing_rep_crawl ();
-			}
-		});
-	}
+	return std::atomic_load (&current);
 }
 
-void rai::node::ongoing_bootstrap ()
+void rai::peer_container::publish ()
 {
-	auto next_wakeup (300);
-	if (warmed_up < 3)
+	auto snapshot_l (std::make_shared <rai::peer_snapshot> ());
+	snapshot_l->peers.reserve (peers.size ());
+	snapshot_l->index.reserve (peers.size ());
+	for (auto & i: peers.get <3> ())
 	{
-		// Re-attempt bootstrapping more aggressively on startup
-		next_wakeup = 5;
-		if (!bootstrap_initiator.in_progress () && !peers.empty ())
-		{
-			++warmed_up;
-		}
+		snapshot_l->index [i.endpoint] = snapshot_l->peers.size ();
+		snapshot_l->peers.push_back (i);
 	}
-	bootstrap_initiator.bootstrap ();
-	std::weak_ptr <rai::node> node_w (shared_from_this ());
-	alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (next_wakeup), [node_w] ()
+	snapshot_l->by_contact.reserve (peers.size ());
+	for (auto & i: peers.get <1> ())
 	{
-		if (auto node_l = node_w.lock ())
-		{
-			node_l->ongoing_bootstrap ();
-		}
-	});
+		snapshot_l->by_contact.push_back (snapshot_l->index [i.endpoint]);
+	}
+	for (auto i (peers.get <6> ().begin ()), n (peers.get <6> ().end ()); i != n && !i->rep_weight.is_zero (); ++i)
+	{
+		snapshot_l->by_weight.push_back (snapshot_l->index [i->endpoint]);
+	}
+	std::atomic_store (&current, std::shared_ptr <rai::peer_snapshot const> (snapshot_l));
+	stale = false;
+	published = std::chrono::steady_clock::now ();
 }
 
-void rai::node::ongoing_vote_flush ()
+void rai::peer_container::publish_batched ()
 {
+	stale = true;
+	if (std::chrono::steady_clock::now () - published >= contacts_interval)
 	{
-		rai::transaction transaction (store.environment, nullptr, true);
-		store.sequence_flush (transaction);
+		publish ();
 	}
-	std::weak_ptr <rai::node> node_w (shared_from_this ());
-	alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (5), [node_w] ()
+}
+
+void rai::peer_container::apply_contacts (std::unordered_map <rai::endpoint, std::chrono::system_clock::time_point> const & contacts_a)
+{
+	for (auto & i: contacts_a)
 	{
-		if (auto node_l = node_w.lock ())
+		auto existing (peers.find (i.first));
+		if (existing != peers.end () && existing->last_contact < i.second)
 		{
-			node_l->ongoing_vote_flush ();
+			peers.modify (existing, [&i] (rai::peer_information & info)
+			{
+				info.last_contact = i.second;
+			});
 		}
-	});
+	}
 }
 
-void rai::node::backup_wallet ()
+void rai::peer_container::flush_contacts ()
 {
-	rai::transaction transaction (store.environment, nullptr, false);
-	for (auto i (wallets.items.begin ()), n (wallets.items.end ()); i != n; ++i)
+	std::unordered_map <rai::endpoint, std::chrono::system_clock::time_point> contacts_l;
 	{
-		auto backup_path (application_path / "backup");
-		boost::filesystem::create_directories (backup_path);
-		i->second->store.write_backup (transaction, backup_path / (i->first.to_string () + ".json"));
+		std::lock_guard <std::mutex> lock (contacts_mutex);
+		contacts_l.swap (contacts);
+		contacts_flushed = std::chrono::steady_clock::now ();
 	}
-	auto this_l (shared ());
-	alarm.add (std::chrono::system_clock::now () + backup_interval, [this_l] ()
+	std::lock_guard <std::mutex> lock (mutex);
+	if (!contacts_l.empty () || stale)
 	{
-		this_l->backup_wallet ();
-	});
+		apply_contacts (contacts_l);
+		publish ();
+	}
 }
 
-int rai::node::price (rai::uint128_t const & balance_a, int amount_a)
+void rai::peer_container::contacted (rai::endpoint const & endpoint_a, unsigned version_a)
 {
-	assert (balance_a >= amount_a * rai::Gxrb_ratio);
-	auto balance_l (balance_a);
-	double result (0.0);
-	for (auto i (0); i < amount_a; ++i)
+    auto endpoint_l (endpoint_a);
+    if (endpoint_l.address ().is_v4 ())
+    {
+        endpoint_l = rai::endpoint (boost::asio::ip::address_v6::v4_mapped (endpoint_l.address ().to_v4 ()), endpoint_l.port ());
+    }
+    assert (endpoint_l.address ().is_v6 ());
+	auto snapshot_l (snapshot ());
+	auto existing (snapshot_l->find (endpoint_l));
+	if (existing != nullptr && existing->network_version == version_a)
 	{
-		balance_l -= rai::Gxrb_ratio;
-		auto balance_scaled ((balance_l / rai::Mxrb_ratio).convert_to <double> ());
-		auto units (balance_scaled / 1000.0);
-		auto unit_price (((free_cutoff - units) / free_cutoff) * price_max);
-		result += std::min (std::max (0.0, unit_price), price_max);
+		// Known peer, only last_contact changes so record it without taking mutex
+		auto flush (false);
+		{
+			std::lock_guard <std::mutex> lock (contacts_mutex);
+			contacts [endpoint_l] = std::chrono::system_clock::now ();
+			flush = contacts.size () >= contacts_max || std::chrono::steady_clock::now () - contacts_flushed >= contacts_interval;
+		}
+		if (flush)
+		{
+			flush_contacts ();
+		}
+	}
+	else
+	{
+		insert (endpoint_l, version_a);
 	}
-	return static_cast <int> (result * 100.0);
 }
 
-namespace {
-class work_request
-{
-public:
-work_request (boost::asio::io_service & service_a, boost::asio::ip::address address_a, uint16_t port_a) :
-address (address_a),
-port (port_a),
-socket (service_a)
+std::ostream & operator << (std::ostream & stream_a, std::chrono::system_clock::time_point const & time_a)
 {
+    time_t last_contact (std::chrono::system_clock::to_time_t (time_a));
+    std::string string (ctime (&last_contact));
+    string.pop_back ();
+    stream_a << string;
+    return stream_a;
 }
-boost::asio::ip::address address;
-uint16_t port;
-boost::beast::flat_buffer buffer;
-boost::beast::http::response <boost::beast::http::string_body> response;
-boost::asio::ip::tcp::socket socket;
-};
-class distributed_work : public std::enable_shared_from_this <distributed_work>
-{
-public:
-distributed_work (std::shared_ptr <rai::node> const & node_a, rai::block_hash const & root_a, std::function <void (uint64_t)> callback_a) :
-callback (callback_a),
-node (node_a),
-root (root_a)
+
+void rai::network::send_buffer (uint8_t const * data_a, size_t size_a, rai::endpoint const & endpoint_a, std::function <void (boost::system::error_code const &, size_t)> callback_a)
 {
-	completed.clear ();
-	for (auto & i : node_a->config.work_peers)
+	if (node.config.logging.network_packet_logging ())
 	{
-		outstanding [i.first] = i.second;
+		BOOST_LOG (node.log) << "Sending packet";
 	}
+	send_queue.add (rai::send_info ({data_a, size_a, endpoint_a, callback_a}));
 }
-void start ()
+
+void rai::network::transmit (std::vector <rai::send_info> & sends_a)
 {
-	if (!outstanding.empty ())
+	for (auto & i: sends_a)
 	{
-		auto this_l (shared_from_this ());
-		std::lock_guard <std::mutex> lock (mutex);
-		for (auto const & i: outstanding)
+		peer_traffic.sent (i.endpoint, i.data, i.size);
+	}
+	if (node.channels.size () != 0)
+	{
+		// Datagrams to peers with an open channel go over it, the rest and any a backed up channel refuses go out as usual
+		auto channelled (std::remove_if (sends_a.begin (), sends_a.end (), [this] (rai::send_info const & send_a)
 		{
-			auto host (i.first);
-			auto service (i.second);
-			node->background ([this_l, host, service] ()
+			auto result (false);
+			auto channel (node.channels.find (send_a.endpoint));
+			if (channel != nullptr)
 			{
-				auto connection (std::make_shared <work_request> (this_l->node->service, host, service));
-				connection->socket.async_connect (rai::tcp_endpoint (host, service), [this_l, connection] (boost::system::error_code const & ec)
+				result = !channel->send (send_a);
+				if (!result)
 				{
-					if (!ec)
-					{
-						std::string request_string;
-						{
-							boost::property_tree::ptree request;
-							request.put ("action", "work_generate");
-							request.put ("hash", this_l->root.to_string ());
-							std::stringstream ostream;
-							boost::property_tree::write_json (ostream, request);
-							request_string = ostream.str ();
-						}
-						auto request (std::make_shared <boost::beast::http::request <boost::beast::http::string_body>> ());
-						request->method (boost::beast::http::verb::post);
-						request->target ("/");
-						request->version = 11;
-						request->body = request_string;
-						request->prepare_payload ();
-						boost::beast::http::async_write (connection->socket, *request, [this_l, connection, request] (boost::system::error_code const & ec)
-						{
-							if (!ec)
-							{
-								boost::beast::http::async_read (connection->socket, connection->buffer, connection->response, [this_l, connection] (boost::system::error_code const & ec)
-								{
-									if (!ec)
-									{
-										if (connection->response.result() == boost::beast::http::status::ok)
-										{
-											this_l->success (connection->response.body, connection->address);
-										}
-										else
-										{
-											BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Work peer %1% responded with an error %2%") % connection->address % connection->port);
-											this_l->failure (connection->address);
-										}
-									}
-									else
-									{
-										BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Unable to read from work_peer %1% %2%") % connection->address % connection->port);
-										this_l->failure (connection->address);
-									}
-								});
-							}
-							else
-							{
-								BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Unable to write to work_peer %1% %2%") % connection->address % connection->port);
-								this_l->failure (connection->address);
-							}
-						});
-					}
-					else
+					++node.channels.overflowed;
+				}
+			}
+			return result;
+		}));
+		sends_a.erase (channelled, sends_a.end ());
+	}
+	if (transport != nullptr)
+	{
+		datagrams_sent += sends_a.size ();
+		transport->send (sends_a);
+	}
+	else if (batching)
+	{
+		std::array <rai::datagram, rai::datagram_batch::max> datagrams;
+		size_t sent (0);
+		while (sent < sends_a.size ())
+		{
+			auto count (std::min (datagrams.size (), sends_a.size () - sent));
+			for (size_t i (0); i < count; ++i)
+			{
+				auto & send (sends_a [sent + i]);
+				datagrams [i] = rai::datagram ({const_cast <uint8_t *> (send.data), send.size, send.endpoint});
+			}
+			boost::system::error_code ec;
+			auto transferred (rai::send_batch (socket, datagrams.data (), count, ec));
+			++send_syscalls;
+			datagrams_sent += transferred;
+			for (size_t i (0); i < transferred; ++i)
+			{
+				sends_a [sent + i].callback (boost::system::error_code (), sends_a [sent + i].size);
+			}
+			sent += transferred;
+			if (ec)
+			{
+				if (ec == boost::asio::error::would_block)
+				{
+					// The socket buffer is full, let asio wait until it has room for the rest
+					std::lock_guard <std::mutex> lock (socket_mutex);
+					for (; sent < sends_a.size (); ++sent)
 					{
-						BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Unable to connect to work_peer %1% %2%") % connection->address % connection->port);
-						this_l->failure (connection->address);
+						auto & send (sends_a [sent]);
+						++send_syscalls;
+						++datagrams_sent;
+						socket.async_send_to (boost::asio::buffer (send.data, send.size), send.endpoint, send.callback);
 					}
-				});
-			});
+				}
+				else
+				{
+					// Only the first unsent datagram failed, report it and carry on with the rest
+					peer_traffic.dropped (sends_a [sent].endpoint, rai::peer_drop::send_error);
+					sends_a [sent].callback (ec, 0);
+					++sent;
+				}
+			}
 		}
 	}
 	else
 	{
-		handle_failure (true);
+		std::lock_guard <std::mutex> lock (socket_mutex);
+		for (auto & i: sends_a)
+		{
+			++send_syscalls;
+			++datagrams_sent;
+			auto callback (std::move (i.callback));
+			auto endpoint_l (i.endpoint);
+			socket.async_send_to (boost::asio::buffer (i.data, i.size), i.endpoint, [this, callback, endpoint_l] (boost::system::error_code const & ec, size_t size_a)
+			{
+				if (ec)
+				{
+					this->peer_traffic.dropped (endpoint_l, rai::peer_drop::send_error);
+				}
+				callback (ec, size_a);
+				if (this->node.config.logging.network_packet_logging ())
+				{
+					BOOST_LOG (this->node.log) << "Packet send complete";
+				}
+			});
+		}
 	}
 }
-void stop ()
+
+rai::realtime_channel::realtime_channel (rai::node & node_a, std::shared_ptr <rai::socket> socket_a, rai::endpoint const & endpoint_a, bool inbound_a) :
+node (node_a),
+socket (socket_a),
+endpoint (endpoint_a),
+inbound (inbound_a),
+writing (false),
+closed (false),
+write_timeout (node_a.service),
+idle_timeout (node_a.service)
+{
+}
+
+void rai::realtime_channel::start ()
+{
+	receive ();
+}
+
+void rai::realtime_channel::receive ()
 {
-	auto this_l (shared_from_this ());
-	std::lock_guard <std::mutex> lock (mutex);
-	for (auto const & i: outstanding)
 	{
-		auto host (i.first);
-		auto service (i.second);
-		node->background ([this_l, host, service] ()
+		std::lock_guard <std::mutex> lock (mutex);
+		if (!closed)
 		{
-			std::string request_string;
-			{
-				boost::property_tree::ptree request;
-				request.put ("action", "work_cancel");
-				request.put ("hash", this_l->root.to_string ());
-				std::stringstream ostream;
-				boost::property_tree::write_json (ostream, request);
-				request_string = ostream.str ();
-			}
-			boost::beast::http::request <boost::beast::http::string_body> request;
-			request.method (boost::beast::http::verb::post);
-			request.target ("/");
-			request.version = 11;
-			request.body = request_string;
-			request.prepare_payload();
-			auto socket (std::make_shared <boost::asio::ip::tcp::socket> (this_l->node->service));
-			boost::beast::http::async_write (*socket, request, [socket] (boost::system::error_code const & ec)
-			{
-			});
-		});
+			start_timeout (idle_timeout, idle_cutoff);
+		}
 	}
-	outstanding.clear ();
+	auto this_l (shared_from_this ());
+	socket->async_read (size_buffer.data (), size_buffer.size (), [this_l] (boost::system::error_code const & ec, size_t size_a)
+	{
+		this_l->receive_size_action (ec, size_a);
+	});
 }
-void success (std::string const & body_a, boost::asio::ip::address const & address)
+
+void rai::realtime_channel::receive_size_action (boost::system::error_code const & ec, size_t size_a)
 {
-	auto last (remove (address));
-	std::stringstream istream (body_a);
-	try
+	if (!ec)
 	{
-		boost::property_tree::ptree result;
-		boost::property_tree::read_json (istream, result);
-		auto work_text (result.get <std::string> ("work"));
-		uint64_t work;
-		if (!rai::from_string_hex (work_text, work))
+		size_t size_l (size_buffer [0] | (size_buffer [1] << 8));
+		if (size_l > 0 && size_l <= receive_buffer.size ())
 		{
-			if (!node->work.work_validate (root, work))
-			{
-				set_once (work);
-				stop ();
-			}
-			else
+			auto this_l (shared_from_this ());
+			socket->async_read (receive_buffer.data (), size_l, [this_l] (boost::system::error_code const & ec, size_t size_a)
 			{
-				BOOST_LOG (node->log) << boost::str (boost::format ("Incorrect work response from %1% for root %2% value %3%") % address % root.to_string () % work_text);
-				handle_failure (last);
-			}
+				this_l->receive_frame_action (ec, size_a);
+			});
 		}
 		else
 		{
-			BOOST_LOG (node->log) << boost::str (boost::format ("Work response from %1% wasn't a number %2%") % address % work_text);
-			handle_failure (last);
+			if (node.config.logging.network_logging ())
+			{
+				BOOST_LOG (node.log) << boost::str (boost::format ("Invalid frame size %1% on realtime channel to %2%") % size_l % endpoint);
+			}
+			close ();
 		}
 	}
-	catch (...)
+	else
 	{
-		BOOST_LOG (node->log) << boost::str (boost::format ("Work response from %1% wasn't parsable %2%") % address % body_a);
-		handle_failure (last);
+		close ();
 	}
 }
-void set_once (uint64_t work_a)
+
+void rai::realtime_channel::receive_frame_action (boost::system::error_code const & ec, size_t size_a)
 {
-	if (!completed.test_and_set ())
+	if (!ec)
 	{
-		callback (work_a);
+		++node.channels.frames_received;
+		node.network.receive_packet (receive_buffer.data (), size_a, endpoint);
+		receive ();
+	}
+	else
+	{
+		close ();
 	}
 }
-void failure (boost::asio::ip::address const & address)
-{
-	auto last (remove (address));
-	handle_failure (last);
-}
-void handle_failure (bool last)
+
+bool rai::realtime_channel::send (rai::send_info const & send_a)
 {
-	if (last)
+	assert (send_a.size <= std::numeric_limits <uint16_t>::max ());
+	std::lock_guard <std::mutex> lock (mutex);
+	auto result (closed || queue.size () >= queue_max);
+	if (!result)
 	{
-		if (!completed.test_and_set ())
+		queue.emplace_back ();
+		auto & frame (queue.back ());
+		frame.bytes.reserve (2 + send_a.size);
+		frame.bytes.push_back (static_cast <uint8_t> (send_a.size));
+		frame.bytes.push_back (static_cast <uint8_t> (send_a.size >> 8));
+		frame.bytes.insert (frame.bytes.end (), send_a.data, send_a.data + send_a.size);
+		frame.callback = send_a.callback;
+		if (!writing)
 		{
-			auto callback_l (callback);
-			node->work.generate (root, [callback_l] (boost::optional <uint64_t> const & work_a)
-			{
-				callback_l (work_a.value ());
-			});
+			write_next ();
 		}
 	}
+	return result;
 }
-bool remove (boost::asio::ip::address const & address)
+
+void rai::realtime_channel::write_next ()
 {
-	std::lock_guard <std::mutex> lock (mutex);
-	outstanding.erase (address);
-	return outstanding.empty ();
-}
-std::function <void (uint64_t)> callback;
-std::shared_ptr <rai::node> node;
-rai::block_hash root;
-std::mutex mutex;
-std::map <boost::asio::ip::address, uint16_t> outstanding;
-std::atomic_flag completed;
-};
+	writing = !closed && !queue.empty ();
+	if (writing)
+	{
+		start_timeout (write_timeout, write_cutoff);
+		auto this_l (shared_from_this ());
+		auto & front (queue.front ());
+		socket->async_write (front.bytes.data (), front.bytes.size (), [this_l] (boost::system::error_code const & ec, size_t size_a)
+		{
+			this_l->write_action (ec);
+		});
+	}
 }
 
-void rai::node::generate_work (rai::block & block_a)
+void rai::realtime_channel::write_action (boost::system::error_code const & ec)
 {
-    block_a.block_work_set (generate_work (block_a.root ()));
+	rai::channel_frame frame;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		assert (!queue.empty ());
+		frame = std::move (queue.front ());
+		queue.pop_front ();
+		writing = false;
+		write_timeout.cancel ();
+		if (!ec)
+		{
+			++node.channels.frames_sent;
+			write_next ();
+		}
+	}
+	frame.callback (ec, ec ? 0 : frame.bytes.size () - 2);
+	if (ec)
+	{
+		close ();
+	}
 }
 
-void rai::node::generate_work (rai::uint256_union const & hash_a, std::function <void (uint64_t)> callback_a)
+void rai::realtime_channel::close ()
 {
-	auto work_generation (std::make_shared <distributed_work> (shared (), hash_a, callback_a));
-	work_generation->start ();
+	std::vector <rai::channel_frame> dropped;
+	auto closing (false);
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		if (!closed)
+		{
+			closing = true;
+			closed = true;
+			// The frame being written has to outlive the write, write_action releases it
+			auto first (queue.begin () + (writing ? 1 : 0));
+			dropped.insert (dropped.end (), std::make_move_iterator (first), std::make_move_iterator (queue.end ()));
+			queue.erase (first, queue.end ());
+			write_timeout.cancel ();
+			idle_timeout.cancel ();
+			socket->close ();
+		}
+	}
+	if (closing)
+	{
+		for (auto & i: dropped)
+		{
+			i.callback (boost::asio::error::operation_aborted, 0);
+		}
+		node.channels.remove (*this);
+	}
 }
 
-uint64_t rai::node::generate_work (rai::uint256_union const & hash_a)
+void rai::realtime_channel::start_timeout (boost::asio::deadline_timer & timer_a, std::chrono::seconds const & duration_a)
 {
-	std::promise <uint64_t> promise;
-	generate_work (hash_a, [&promise] (uint64_t work_a)
+	timer_a.expires_from_now (boost::posix_time::seconds (duration_a.count ()));
+	std::weak_ptr <rai::realtime_channel> this_w (shared_from_this ());
+	timer_a.async_wait ([this_w] (boost::system::error_code const & ec)
 	{
-		promise.set_value (work_a);
+		if (ec != boost::asio::error::operation_aborted)
+		{
+			if (auto this_l = this_w.lock ())
+			{
+				if (this_l->node.config.logging.network_logging ())
+				{
+					BOOST_LOG (this_l->node.log) << boost::str (boost::format ("Closing realtime channel to %1% due to timeout") % this_l->endpoint);
+				}
+				this_l->close ();
+			}
+		}
 	});
-	return promise.get_future ().get ();
 }
 
-void rai::node::add_initial_peers ()
+rai::realtime_channels::realtime_channels (rai::node & node_a) :
+node (node_a),
+stopped (false),
+count (0),
+opened (0),
+failed (0),
+closed (0),
+frames_sent (0),
+frames_received (0),
+overflowed (0)
 {
-	
 }
 
-namespace
+std::shared_ptr <rai::realtime_channel> rai::realtime_channels::find (rai::endpoint const & endpoint_a)
 {
-class confirmed_visitor : public rai::block_visitor
+	std::shared_ptr <rai::realtime_channel> result;
+	std::lock_guard <std::mutex> lock (mutex);
+	auto range (channels.equal_range (endpoint_a));
+	for (auto i (range.first); i != range.second && result == nullptr; ++i)
+	{
+		if (!i->second->closed)
+		{
+			result = i->second;
+		}
+	}
+	return result;
+}
+
+bool rai::realtime_channels::add (std::shared_ptr <rai::realtime_channel> channel_a)
 {
-public:
-    confirmed_visitor (rai::node & node_a, std::shared_ptr <rai::block> block_a) :
-    node (node_a),
-	block (block_a)
-    {
-    }
-    void send_block (rai::send_block const & block_a) override
-    {
-        for (auto i (node.wallets.items.begin ()), n (node.wallets.items.end ()); i != n; ++i)
-        {
-			auto wallet (i->second);
-			if (wallet->exists (block_a.hashables.destination))
+	auto result (false);
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		connecting.erase (channel_a->endpoint);
+		result = stopped;
+		if (!result)
+		{
+			size_t outbound_l (0);
+			size_t inbound_l (0);
+			auto same_address (false);
+			for (auto & i: channels)
 			{
-				rai::account representative;
-				rai::pending_info pending;
-				rai::transaction transaction (node.store.environment, nullptr, false);
-				representative = wallet->store.representative (transaction);
-				auto error (node.store.pending_get (transaction, rai::pending_key (block_a.hashables.destination, block_a.hash ()), pending));
-				if (!error)
+				if (i.second->inbound)
 				{
-					auto node_l (node.shared ());
-					auto amount (pending.amount.number ());
-					assert (block.get () == &block_a);
-					wallet->receive_async (block, representative, amount, [] (std::shared_ptr <rai::block>) {});
+					++inbound_l;
+					same_address = same_address || i.second->endpoint.address () == channel_a->endpoint.address ();
 				}
 				else
 				{
-					if (node.config.logging.ledger_duplicate_logging ())
-					{
-						BOOST_LOG (node.log) << boost::str (boost::format ("Block confirmed before timeout %1%") % block_a.hash ().to_string ());
-					}
+					++outbound_l;
 				}
 			}
-        }
-    }
-    void receive_block (rai::receive_block const &) override
-    {
-    }
-    void open_block (rai::open_block const &) override
-    {
-    }
-    void change_block (rai::change_block const &) override
-    {
-    }
-    rai::node & node;
-	std::shared_ptr <rai::block> block;
-};
-}
-
-void rai::node::process_confirmed (std::shared_ptr <rai::block> confirmed_a)
-{
-    confirmed_visitor visitor (*this, confirmed_a);
-    confirmed_a->visit (visitor);
+			if (channel_a->inbound)
+			{
+				// Peers can't use up our sockets, inbound channels are only for nodes that keep channels themselves
+				result = node.config.realtime_channels == 0 || inbound_l >= inbound_max || same_address;
+			}
+			else
+			{
+				result = outbound_l >= max;
+			}
+		}
+		if (!result)
+		{
+			channels.insert (std::make_pair (channel_a->endpoint, channel_a));
+			count = channels.size ();
+			++opened;
+		}
+	}
+	if (!result)
+	{
+		if (node.config.logging.network_logging ())
+		{
+			BOOST_LOG (node.log) << boost::str (boost::format ("Realtime channel to %1% opened") % channel_a->endpoint);
+		}
+		channel_a->start ();
+	}
+	else
+	{
+		channel_a->socket->close ();
+	}
+	return result;
 }
 
-void rai::node::process_message (rai::message & message_a, rai::endpoint const & sender_a)
+void rai::realtime_channels::remove (rai::realtime_channel const & channel_a)
 {
-	network_message_visitor visitor (*this, sender_a);
-	message_a.visit (visitor);
+	std::lock_guard <std::mutex> lock (mutex);
+	auto range (channels.equal_range (channel_a.endpoint));
+	for (auto i (range.first); i != range.second; ++i)
+	{
+		if (i->second.get () == &channel_a)
+		{
+			channels.erase (i);
+			count = channels.size ();
+			++closed;
+			break;
+		}
+	}
 }
 
-rai::endpoint rai::network::endpoint ()
+void rai::realtime_channels::connect (rai::endpoint const & endpoint_a)
 {
-	boost::system::error_code ec;
-	auto port (socket.local_endpoint (ec).port ());
-	if (ec)
+	auto connect_l (false);
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		connect_l = !stopped && channels.size () < max && channels.count (endpoint_a) == 0 && connecting.count (endpoint_a) == 0;
+		if (connect_l)
+		{
+			connecting.insert (endpoint_a);
+		}
+	}
+	if (connect_l)
 	{
-		BOOST_LOG (node.log) << "Unable to retrieve port: " << ec.message ();
+		std::shared_ptr <rai::socket> socket (node.network.transport != nullptr ? node.network.transport->connection () : std::make_shared <rai::tcp_socket> (node.service));
+		auto node_l (node.shared ());
+		socket->async_connect (rai::tcp_endpoint (endpoint_a.address (), endpoint_a.port ()), [node_l, socket, endpoint_a] (boost::system::error_code const & ec)
+		{
+			if (!ec)
+			{
+				node_l->channels.connected (endpoint_a, socket);
+			}
+			else
+			{
+				node_l->channels.connect_failed (endpoint_a);
+			}
+		});
 	}
-    return rai::endpoint (boost::asio::ip::address_v6::loopback (), port);
 }
 
-std::unordered_set <rai::endpoint> rai::peer_container::random_set (size_t count_a)
+void rai::realtime_channels::connected (rai::endpoint const & endpoint_a, std::shared_ptr <rai::socket> socket_a)
 {
-	std::unordered_set <rai::endpoint> result;
-	result.reserve (count_a);
-	std::lock_guard <std::mutex> lock (mutex);
-	// Stop trying to fill result with random samples after this many attempts
-	auto random_cutoff (count_a * 2);
-	auto peers_size (peers.size ());
-	// Usually count_a will be much smaller than peers.size()
-	// Otherwise make sure we have a cutoff on attempting to randomly fill
-	if (!peers.empty ())
+	rai::realtime_req message (node.network.endpoint ().port ());
+	auto bytes (std::make_shared <std::vector <uint8_t>> ());
+	{
+		rai::vectorstream stream (*bytes);
+		message.serialize (stream);
+	}
+	auto node_l (node.shared ());
+	socket_a->async_write (bytes->data (), bytes->size (), [node_l, socket_a, endpoint_a, bytes] (boost::system::error_code const & ec, size_t size_a)
 	{
-		for (auto i (0); i < random_cutoff && result.size () < count_a; ++i)
+		if (!ec)
 		{
-			auto index (random_pool.GenerateWord32 (0, peers_size - 1));
-			result.insert (peers.get <3> () [index].endpoint);
+			node_l->channels.add (std::make_shared <rai::realtime_channel> (*node_l, socket_a, endpoint_a, false));
 		}
-	}
-	// Fill the remainder with most recent contact
-	for (auto i (peers.get <1> ().begin ()), n (peers.get <1> ().end ()); i != n && result.size () < count_a; ++i)
-	{
-		result.insert (i->endpoint);
-	}
-	return result;
+		else
+		{
+			socket_a->close ();
+			node_l->channels.connect_failed (endpoint_a);
+		}
+	});
 }
 
-void rai::peer_container::random_fill (std::array <rai::endpoint, 8> & target_a)
+void rai::realtime_channels::connect_failed (rai::endpoint const & endpoint_a)
 {
-    auto peers (random_set (target_a.size ()));
-    assert (peers.size () <= target_a.size ());
-    auto endpoint (rai::endpoint (boost::asio::ip::address_v6 {}, 0));
-    assert (endpoint.address ().is_v6 ());
-    std::fill (target_a.begin (), target_a.end (), endpoint);
-    auto j (target_a.begin ());
-    for (auto i (peers.begin ()), n (peers.end ()); i != n; ++i, ++j)
-    {
-        assert (i->address ().is_v6 ());
-        assert (j < target_a.end ());
-        *j = *i;
-    }
+	if (node.config.logging.network_logging ())
+	{
+		BOOST_LOG (node.log) << boost::str (boost::format ("Unable to open realtime channel to %1%") % endpoint_a);
+	}
+	++failed;
+	std::lock_guard <std::mutex> lock (mutex);
+	connecting.erase (endpoint_a);
 }
 
-// Request a list of the top known representatives
-std::vector <rai::peer_information> rai::peer_container::representatives (size_t count_a)
+void rai::realtime_channels::ongoing_connect ()
 {
-	std::vector <peer_information> result;
-	result.reserve (std::min (count_a, size_t (16)));
-	std::lock_guard <std::mutex> lock (mutex);
-	for (auto i (peers.get <6> ().begin ()), n (peers.get <6> ().end ()); i != n && result.size () < count_a; ++i)
+	if (node.config.realtime_channels != 0)
 	{
-		if (!i->rep_weight.is_zero ())
+		auto representatives (node.peers.representatives (node.config.realtime_channels));
+		for (auto & i: representatives)
 		{
-			result.push_back (*i);
+			if (i.network_version >= rai::message::realtime_version)
+			{
+				connect (i.endpoint);
+			}
 		}
 	}
-	return result;
+	std::weak_ptr <rai::node> node_w (node.shared ());
+	node.alarm.add (std::chrono::system_clock::now () + connect_interval, [node_w] ()
+	{
+		if (auto node_l = node_w.lock ())
+		{
+			node_l->channels.ongoing_connect ();
+		}
+	});
 }
 
-std::vector <rai::peer_information> rai::peer_container::purge_list (std::chrono::system_clock::time_point const & cutoff)
+void rai::realtime_channels::stop ()
 {
-	std::vector <rai::peer_information> result;
+	std::vector <std::shared_ptr <rai::realtime_channel>> channels_l;
 	{
 		std::lock_guard <std::mutex> lock (mutex);
-		auto pivot (peers.get <1> ().lower_bound (cutoff));
-		result.assign (pivot, peers.get <1> ().end ());
-		peers.get <1> ().erase (peers.get <1> ().begin (), pivot);
-		for (auto i (peers.begin ()), n (peers.end ()); i != n; ++i)
+		stopped = true;
+		for (auto & i: channels)
 		{
-			peers.modify (i, [] (rai::peer_information & info) {info.last_attempt = std::chrono::system_clock::now ();});
+			channels_l.push_back (i.second);
 		}
 	}
-	if (result.empty ())
+	for (auto & i: channels_l)
 	{
-		disconnect_observer ();
+		i->close ();
 	}
-    return result;
-}
-
-std::vector <rai::endpoint> rai::peer_container::rep_crawl ()
-{
-	std::vector <rai::endpoint> result;
-	result.reserve (8);
-	std::lock_guard <std::mutex> lock (mutex);
-	auto count (0);
-	for (auto i (peers.get <5> ().begin ()), n (peers.get <5> ().end ()); i != n && count < 8; ++i, ++count)
-	{
-		result.push_back (i->endpoint);
-	};
-	return result;
 }
 
-size_t rai::peer_container::size ()
+size_t rai::realtime_channels::size ()
 {
-    std::lock_guard <std::mutex> lock (mutex);
-    return peers.size ();
+	return count;
 }
 
-size_t rai::peer_container::size_sqrt ()
+void rai::realtime_channels::serialize (boost::property_tree::ptree & tree_a)
 {
-	auto result (std::ceil (std::sqrt (size ())));
-	return result;
+	tree_a.put ("open", std::to_string (size ()));
+	tree_a.put ("opened", std::to_string (opened));
+	tree_a.put ("failed", std::to_string (failed));
+	tree_a.put ("closed", std::to_string (closed));
+	tree_a.put ("frames_sent", std::to_string (frames_sent));
+	tree_a.put ("frames_received", std::to_string (frames_received));
+	tree_a.put ("overflowed", std::to_string (overflowed));
 }
 
-bool rai::peer_container::empty ()
+rai::peer_queue::peer_queue () :
+bytes (0),
+tokens (0),
+sent (0),
+dropped (0)
 {
-    return size () == 0;
 }
 
-bool rai::peer_container::not_a_peer (rai::endpoint const & endpoint_a)
+rai::send_queue::send_queue (rai::network & network_a, uint64_t bandwidth_limit_a, uint64_t peer_bandwidth_limit_a, size_t bytes_max_a, std::array <unsigned, rai::traffic_classes> const & weights_a) :
+network (network_a),
+bandwidth_limit (bandwidth_limit_a),
+peer_bandwidth_limit (peer_bandwidth_limit_a),
+bytes_max (bytes_max_a),
+scheduler (weights_a),
+sequence (0),
+bytes (0),
+tokens (std::max <uint64_t> (bandwidth_limit_a, burst_min)),
+refilled (std::chrono::steady_clock::now ()),
+purged (std::chrono::steady_clock::now ()),
+dropped (0),
+stopped (false),
+thread ([this] () { run (); })
 {
-    bool result (false);
-    if (endpoint_a.address ().to_v6 ().is_unspecified ())
-    {
-        result = true;
-    }
-    else if (rai::reserved_address (endpoint_a))
-    {
-        result = true;
-    }
-    else if (endpoint_a == self)
-    {
-        result = true;
-    }
-    return result;
 }
 
-bool rai::peer_container::rep_response (rai::endpoint const & endpoint_a, rai::amount const & weight_a)
+rai::send_queue::~send_queue ()
 {
-	auto updated (false);
-    std::lock_guard <std::mutex> lock (mutex);
-    auto existing (peers.find (endpoint_a));
-    if (existing != peers.end ())
-    {
-		peers.modify (existing, [weight_a, &updated] (rai::peer_information & info)
-		{
-			info.last_rep_response = std::chrono::system_clock::now ();
-			if (info.rep_weight < weight_a)
-			{
-				updated = true;
-				info.rep_weight = weight_a;
-			}
-		});
-    }
-	return updated;
+	stop ();
+	thread.join ();
 }
 
-void rai::peer_container::rep_request (rai::endpoint const & endpoint_a)
+rai::message_type rai::send_queue::type (rai::send_info const & send_a)
 {
-    std::lock_guard <std::mutex> lock (mutex);
-    auto existing (peers.find (endpoint_a));
-    if (existing != peers.end ())
-    {
-		peers.modify (existing, [] (rai::peer_information & info)
-		{
-			info.last_rep_request = std::chrono::system_clock::now ();
-		});
-    }
+	return rai::datagram_type (send_a.data, send_a.size);
 }
 
-bool rai::peer_container::insert (rai::endpoint const & endpoint_a, unsigned version_a)
+unsigned rai::send_queue::drop_priority (rai::message_type type_a)
 {
-	auto unknown (false);
-    auto result (not_a_peer (endpoint_a));
-    if (!result)
-    {
-        std::lock_guard <std::mutex> lock (mutex);
-        auto existing (peers.find (endpoint_a));
-        if (existing != peers.end ())
-        {
-            peers.modify (existing, [] (rai::peer_information & info)
-            {
-                info.last_contact = std::chrono::system_clock::now ();
-            });
-            result = true;
-        }
-        else
-        {
-            peers.insert (rai::peer_information (endpoint_a, version_a));
-			unknown = true;
-        }
-    }
-	if (unknown && !result)
+	unsigned result;
+	switch (type_a)
 	{
-		peer_observer (endpoint_a);
+		case rai::message_type::keepalive:
+			result = 0;
+			break;
+		case rai::message_type::confirm_req:
+			result = 2;
+			break;
+		case rai::message_type::confirm_ack:
+			result = 3;
+			break;
+		default:
+			result = 1;
+			break;
 	}
-    return result;
+	return result;
 }
 
-namespace {
-boost::asio::ip::address_v6 mapped_from_v4_bytes (unsigned long address_a)
+void rai::send_queue::refill (double & tokens_a, std::chrono::steady_clock::time_point & refilled_a, uint64_t limit_a, std::chrono::steady_clock::time_point const & now_a)
 {
-    return boost::asio::ip::address_v6::v4_mapped (boost::asio::ip::address_v4 (address_a));
+	// Buckets hold one second of traffic but always enough for the largest datagram
+	tokens_a = std::min <double> (std::max <uint64_t> (limit_a, burst_min), tokens_a + limit_a * std::chrono::duration <double> (now_a - refilled_a).count ());
+	refilled_a = now_a;
 }
+
+void rai::send_queue::drop (rai::endpoint const & endpoint_a, rai::peer_queue & peer_a, size_t index_a, std::deque <rai::queued_send>::iterator existing_a, std::vector <rai::send_info> & dropped_a)
+{
+	auto & sends (peer_a.sends [index_a]);
+	evictable.erase (std::make_pair (existing_a->priority, existing_a->sequence));
+	bytes -= existing_a->send.size;
+	peer_a.bytes -= existing_a->send.size;
+	++peer_a.dropped;
+	++dropped;
+	++network.outgoing.classes [index_a].dropped;
+	dropped_a.push_back (std::move (existing_a->send));
+	sends.erase (existing_a);
+	if (sends.empty ())
+	{
+		// The sender loop expects every active peer to have a send in that class
+		auto & active_l (active [index_a]);
+		active_l.erase (std::find (active_l.begin (), active_l.end (), endpoint_a));
+	}
 }
 
-bool rai::reserved_address (rai::endpoint const & endpoint_a)
+bool rai::send_queue::evict (rai::peer_queue & peer_a, unsigned priority_a, std::vector <rai::send_info> & dropped_a)
 {
-    assert (endpoint_a.address ().is_v6 ());
-	auto bytes (endpoint_a.address ().to_v6 ());
 	auto result (false);
-	static auto const rfc1700_min (mapped_from_v4_bytes (0x00000000ul));
-	static auto const rfc1700_max (mapped_from_v4_bytes (0x00fffffful));
-	static auto const rfc5737_1_min (mapped_from_v4_bytes (0xc0000200ul));
-	static auto const rfc5737_1_max (mapped_from_v4_bytes (0xc00002fful));
-	static auto const rfc5737_2_min (mapped_from_v4_bytes (0xc6336400ul));
-	static auto const rfc5737_2_max (mapped_from_v4_bytes (0xc63364fful));
-	static auto const rfc5737_3_min (mapped_from_v4_bytes (0xcb007100ul));
-	static auto const rfc5737_3_max (mapped_from_v4_bytes (0xcb0071fful));
-	static auto const ipv4_multicast_min (mapped_from_v4_bytes (0xe0000000ul));
-	static auto const ipv4_multicast_max (mapped_from_v4_bytes (0xeffffffful));
-	static auto const rfc6890_min (mapped_from_v4_bytes (0xf0000000ul));
-	static auto const rfc6890_max (mapped_from_v4_bytes (0xfffffffful));
-	static auto const rfc6666_min (boost::asio::ip::address_v6::from_string ("100::"));
-	static auto const rfc6666_max (boost::asio::ip::address_v6::from_string ("100::ffff:ffff:ffff:ffff"));
-	static auto const rfc3849_min (boost::asio::ip::address_v6::from_string ("2001:db8::"));
-	static auto const rfc3849_max (boost::asio::ip::address_v6::from_string ("2001:db8:ffff:ffff:ffff:ffff:ffff:ffff"));
-	static auto const ipv6_multicast_min (boost::asio::ip::address_v6::from_string ("ff00::"));
-	static auto const ipv6_multicast_max (boost::asio::ip::address_v6::from_string ("ff00:ffff:ffff:ffff:ffff:ffff:ffff:ffff"));
-    if (bytes >= rfc1700_min && bytes <= rfc1700_max)
+	// Look through the least important classes first
+	for (auto i (rai::traffic_classes); i > 0 && !result; --i)
 	{
-		result = true;
+		auto & sends (peer_a.sends [i - 1]);
+		auto existing (std::find_if (sends.begin (), sends.end (), [priority_a] (rai::queued_send const & queued_a)
+		{
+			return queued_a.priority < priority_a;
+		}));
+		if (existing != sends.end ())
+		{
+			drop (existing->send.endpoint, peer_a, i - 1, existing, dropped_a);
+			result = true;
+		}
 	}
-	else if (bytes >= rfc5737_1_min && bytes <= rfc5737_1_max)
+	return result;
+}
+
+bool rai::send_queue::evict (unsigned priority_a, std::vector <rai::send_info> & dropped_a)
+{
+	// The least important queued send of any peer, the oldest one among equals
+	auto result (false);
+	auto lowest (evictable.begin ());
+	if (lowest != evictable.end () && lowest->first.first < priority_a)
 	{
+		auto sequence_l (lowest->first.second);
+		auto index_l (lowest->second.second);
+		auto peer_l (peers.find (lowest->second.first));
+		assert (peer_l != peers.end ());
+		auto & sends (peer_l->second.sends [index_l]);
+		auto existing_l (std::lower_bound (sends.begin (), sends.end (), sequence_l, [] (rai::queued_send const & queued_a, uint64_t sequence_a)
+		{
+			return queued_a.sequence < sequence_a;
+		}));
+		assert (existing_l != sends.end () && existing_l->sequence == sequence_l);
+		drop (peer_l->first, peer_l->second, index_l, existing_l, dropped_a);
 		result = true;
 	}
-	else if (bytes >= rfc5737_2_min && bytes <= rfc5737_2_max)
+	return result;
+}
+
+bool rai::send_queue::add (rai::send_info const & send_a)
+{
+	std::vector <rai::send_info> dropped_l;
+	auto type_l (type (send_a));
+	auto & statistics (network.outgoing.classes [static_cast <size_t> (rai::traffic_class_of (type_l))]);
+	auto result (false);
 	{
-		result = true;
+		std::lock_guard <std::mutex> lock (mutex);
+		auto & peer (peers [send_a.endpoint]);
+		auto priority (drop_priority (type_l));
+		auto over_peer ([&peer, &send_a, this] ()
+		{
+			return peer.bytes + send_a.size > bytes_max / peer_share;
+		});
+		auto over ([this, &send_a] ()
+		{
+			return bytes + send_a.size > bytes_max;
+		});
+		// Make room by dropping this peer's oldest sends that matter less than this one
+		while (!stopped && over_peer () && evict (peer, priority, dropped_l))
+		{
+		}
+		// The global cap is shared, make room there from whichever peer queued the least important send
+		while (!stopped && !over_peer () && over () && evict (priority, dropped_l))
+		{
+		}
+		result = stopped || over_peer () || over ();
+		if (!result)
+		{
+			auto index (static_cast <size_t> (rai::traffic_class_of (type_l)));
+			if (peer.sends [index].empty ())
+			{
+				active [index].push_back (send_a.endpoint);
+				condition.notify_all ();
+			}
+			peer.sends [index].push_back (rai::queued_send ({send_a, std::chrono::steady_clock::now (), priority, sequence}));
+			evictable [std::make_pair (priority, sequence)] = std::make_pair (send_a.endpoint, index);
+			++sequence;
+			peer.bytes += send_a.size;
+			bytes += send_a.size;
+			++statistics.queued;
+		}
+		else
+		{
+			++peer.dropped;
+			++dropped;
+			++statistics.dropped;
+			dropped_l.push_back (send_a);
+		}
 	}
-	else if (bytes >= rfc5737_3_min && bytes <= rfc5737_3_max)
+	// Release the dropped buffers outside the lock
+	for (auto & i: dropped_l)
 	{
-		result = true;
+		network.peer_traffic.dropped (i.endpoint, rai::peer_drop::send_queue_full);
+		i.callback (boost::asio::error::no_buffer_space, 0);
 	}
-	else if (bytes >= ipv4_multicast_min && bytes <= ipv4_multicast_max)
+	return result;
+}
+
+void rai::send_queue::run ()
+{
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!stopped)
 	{
-		result = true;
+		auto now (std::chrono::steady_clock::now ());
+		if (now - purged > idle_cutoff)
+		{
+			for (auto i (peers.begin ()), n (peers.end ()); i != n;)
+			{
+				if (i->second.bytes == 0 && now - i->second.last_send > idle_cutoff)
+				{
+					i = peers.erase (i);
+				}
+				else
+				{
+					++i;
+				}
+			}
+			purged = now;
+		}
+		std::array <bool, rai::traffic_classes> pending;
+		// Peers in a row that were waiting for tokens, a class is done for this pass when all of its peers are
+		std::array <size_t, rai::traffic_classes> blocked;
+		auto any (false);
+		for (size_t i (0); i < rai::traffic_classes; ++i)
+		{
+			pending [i] = !active [i].empty ();
+			blocked [i] = 0;
+			any = any || pending [i];
+		}
+		if (any)
+		{
+			if (bandwidth_limit != 0)
+			{
+				refill (tokens, refilled, bandwidth_limit, now);
+			}
+			std::vector <rai::send_info> batch;
+			auto wakeup (now + std::chrono::seconds (1));
+			rai::traffic_class class_l;
+			while (batch.size () < batch_max && !scheduler.next (pending, class_l))
+			{
+				auto index (static_cast <size_t> (class_l));
+				auto & active_l (active [index]);
+				auto endpoint (active_l.front ());
+				active_l.pop_front ();
+				auto & peer (peers [endpoint]);
+				auto & sends (peer.sends [index]);
+				auto & front (sends.front ());
+				if (peer_bandwidth_limit != 0)
+				{
+					refill (peer.tokens, peer.refilled, peer_bandwidth_limit, now);
+				}
+				auto size (front.send.size);
+				auto peer_ready (peer_bandwidth_limit == 0 || peer.tokens >= size);
+				auto global_ready (bandwidth_limit == 0 || tokens >= size);
+				if (peer_ready && global_ready)
+				{
+					peer.tokens -= peer_bandwidth_limit != 0 ? size : 0;
+					tokens -= bandwidth_limit != 0 ? size : 0;
+					peer.bytes -= size;
+					bytes -= size;
+					++peer.sent;
+					peer.last_send = now;
+					network.outgoing.classes [index].add_latency (now - front.queued);
+					evictable.erase (std::make_pair (front.priority, front.sequence));
+					batch.push_back (std::move (front.send));
+					sends.pop_front ();
+					blocked [index] = 0;
+				}
+				else
+				{
+					// Sleep until the emptier of the two buckets has enough for this send
+					auto needed (std::max (peer_ready ? 0.0 : (size - peer.tokens) / peer_bandwidth_limit, global_ready ? 0.0 : (size - tokens) / bandwidth_limit));
+					wakeup = std::min (wakeup, now + std::chrono::duration_cast <std::chrono::steady_clock::duration> (std::chrono::duration <double> (needed)));
+					++blocked [index];
+				}
+				if (!sends.empty ())
+				{
+					active_l.push_back (endpoint);
+				}
+				pending [index] = !active_l.empty () && blocked [index] < active_l.size ();
+			}
+			if (!batch.empty ())
+			{
+				lock.unlock ();
+				network.transmit (batch);
+				lock.lock ();
+			}
+			else
+			{
+				condition.wait_until (lock, wakeup);
+			}
+		}
+		else
+		{
+			condition.wait_for (lock, idle_cutoff);
+		}
 	}
-	else if (bytes >= rfc6890_min && bytes <= rfc6890_max)
+	// Let every remaining sender release its buffer
+	std::vector <rai::send_info> remaining;
+	for (auto & i: peers)
 	{
-		result = true;
+		for (auto & j: i.second.sends)
+		{
+			for (auto & k: j)
+			{
+				remaining.push_back (std::move (k.send));
+			}
+			j.clear ();
+		}
+		i.second.bytes = 0;
 	}
-	else if (bytes >= rfc6666_min && bytes <= rfc6666_max)
+	for (auto & i: active)
 	{
-		result = true;
+		i.clear ();
 	}
-	else if (bytes >= rfc3849_min && bytes <= rfc3849_max)
+	evictable.clear ();
+	bytes = 0;
+	lock.unlock ();
+	for (auto & i: remaining)
 	{
-		result = true;
+		i.callback (boost::asio::error::operation_aborted, 0);
 	}
-	else if (bytes >= ipv6_multicast_min && bytes <= ipv6_multicast_max)
+}
+
+void rai::send_queue::stop ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	stopped = true;
+	condition.notify_all ();
+}
+
+size_t rai::send_queue::size ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	size_t result (0);
+	for (auto & i: peers)
 	{
-		result = true;
+		for (auto & j: i.second.sends)
+		{
+			result += j.size ();
+		}
 	}
 	return result;
 }
 
-rai::peer_information::peer_information (rai::endpoint const & endpoint_a, unsigned network_version_a) :
-endpoint (endpoint_a),
-last_contact (std::chrono::system_clock::now ()),
-last_attempt (last_contact),
-last_bootstrap_attempt (std::chrono::system_clock::time_point ()),
-last_rep_request (std::chrono::system_clock::time_point ()),
-last_rep_response (std::chrono::system_clock::time_point ()),
-rep_weight (0),
-network_version (network_version_a)
+void rai::send_queue::serialize (boost::property_tree::ptree & tree_a)
 {
+	std::lock_guard <std::mutex> lock (mutex);
+	tree_a.put ("bytes", std::to_string (bytes));
+	tree_a.put ("bytes_max", std::to_string (bytes_max));
+	tree_a.put ("dropped", std::to_string (dropped));
+	boost::property_tree::ptree peers_l;
+	for (auto & i: peers)
+	{
+		boost::property_tree::ptree entry;
+		size_t queued (0);
+		for (auto & j: i.second.sends)
+		{
+			queued += j.size ();
+		}
+		entry.put ("queued", std::to_string (queued));
+		entry.put ("bytes", std::to_string (i.second.bytes));
+		entry.put ("sent", std::to_string (i.second.sent));
+		entry.put ("dropped", std::to_string (i.second.dropped));
+		std::stringstream text;
+		text << i.first;
+		peers_l.add_child (boost::property_tree::ptree::path_type (text.str (), '\0'), entry);
+	}
+	tree_a.add_child ("peers", peers_l);
 }
 
-rai::peer_information::peer_information (rai::endpoint const & endpoint_a, std::chrono::system_clock::time_point const & last_contact_a, std::chrono::system_clock::time_point const & last_attempt_a) :
-endpoint (endpoint_a),
-last_contact (last_contact_a),
-last_attempt (last_attempt_a),
-last_bootstrap_attempt (std::chrono::system_clock::time_point ()),
-last_rep_request (std::chrono::system_clock::time_point ()),
-last_rep_response (std::chrono::system_clock::time_point ()),
-rep_weight (0)
+rai::receive_queue::receive_queue (rai::network & network_a, std::array <unsigned, rai::traffic_classes> const & weights_a, unsigned threads_a) :
+network (network_a),
+scheduler (weights_a),
+stopped (false)
 {
+	for (unsigned i (0); i < std::max (1u, threads_a); ++i)
+	{
+		threads.push_back (std::thread ([this] () { run (); }));
+	}
 }
 
-rai::peer_container::peer_container (rai::endpoint const & self_a) :
-self (self_a),
-peer_observer ([] (rai::endpoint const &) {}),
-disconnect_observer ([] () {})
+rai::receive_queue::~receive_queue ()
 {
+	stop ();
 }
 
-void rai::peer_container::contacted (rai::endpoint const & endpoint_a, unsigned version_a)
+bool rai::receive_queue::add (uint8_t const * data_a, size_t size_a, rai::endpoint const & endpoint_a)
 {
-    auto endpoint_l (endpoint_a);
-    if (endpoint_l.address ().is_v4 ())
-    {
-        endpoint_l = rai::endpoint (boost::asio::ip::address_v6::v4_mapped (endpoint_l.address ().to_v4 ()), endpoint_l.port ());
-    }
-    assert (endpoint_l.address ().is_v6 ());
-	insert (endpoint_l, version_a);
+	auto index (static_cast <size_t> (rai::traffic_class_of (rai::datagram_type (data_a, size_a))));
+	auto & statistics (network.incoming.classes [index]);
+	std::lock_guard <std::mutex> lock (mutex);
+	auto & queue (classes [index]);
+	auto result (stopped || queue.size () >= max);
+	if (!result)
+	{
+		queue.emplace_back ();
+		auto & datagram (queue.back ());
+		if (!buffers.empty ())
+		{
+			datagram.buffer = std::move (buffers.back ());
+			buffers.pop_back ();
+		}
+		else
+		{
+			datagram.buffer.reset (new std::array <uint8_t, 512>);
+		}
+		datagram.size = std::min (size_a, datagram.buffer->size ());
+		std::copy (data_a, data_a + datagram.size, datagram.buffer->begin ());
+		datagram.endpoint = endpoint_a;
+		datagram.queued = std::chrono::steady_clock::now ();
+		++statistics.queued;
+		condition.notify_one ();
+	}
+	else
+	{
+		++statistics.dropped;
+	}
+	return result;
 }
 
-std::ostream & operator << (std::ostream & stream_a, std::chrono::system_clock::time_point const & time_a)
+void rai::receive_queue::run ()
 {
-    time_t last_contact (std::chrono::system_clock::to_time_t (time_a));
-    std::string string (ctime (&last_contact));
-    string.pop_back ();
-    stream_a << string;
-    return stream_a;
+	rai::received_datagram datagram;
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!stopped)
+	{
+		std::array <bool, rai::traffic_classes> pending;
+		for (size_t i (0); i < rai::traffic_classes; ++i)
+		{
+			pending [i] = !classes [i].empty ();
+		}
+		rai::traffic_class class_l;
+		if (!scheduler.next (pending, class_l))
+		{
+			auto index (static_cast <size_t> (class_l));
+			auto & queue (classes [index]);
+			datagram = std::move (queue.front ());
+			queue.pop_front ();
+			lock.unlock ();
+			network.incoming.classes [index].add_latency (std::chrono::steady_clock::now () - datagram.queued);
+			network.process_packet (datagram.buffer->data (), datagram.size, datagram.endpoint);
+			lock.lock ();
+			if (buffers.size () < max)
+			{
+				buffers.push_back (std::move (datagram.buffer));
+			}
+		}
+		else
+		{
+			condition.wait (lock);
+		}
+	}
 }
 
-void rai::network::send_buffer (uint8_t const * data_a, size_t size_a, rai::endpoint const & endpoint_a, std::function <void (boost::system::error_code const &, size_t)> callback_a)
+void rai::receive_queue::stop ()
 {
-	std::unique_lock <std::mutex> lock (socket_mutex);
-	if (node.config.logging.network_packet_logging ())
 	{
-		BOOST_LOG (node.log) << "Sending packet";
+		std::lock_guard <std::mutex> lock (mutex);
+		stopped = true;
+		for (auto & i: classes)
+		{
+			i.clear ();
+		}
+		condition.notify_all ();
 	}
-	socket.async_send_to (boost::asio::buffer (data_a, size_a), endpoint_a, [this, callback_a] (boost::system::error_code const & ec, size_t size_a)
+	// Wait for messages being processed so nothing touches the node after it stops
+	for (auto & i: threads)
 	{
-		callback_a (ec, size_a);
-		if (this->node.config.logging.network_packet_logging ())
+		if (i.joinable ())
 		{
-			BOOST_LOG (this->node.log) << "Packet send complete";
+			i.join ();
 		}
-	});
+	}
+}
+
+size_t rai::receive_queue::size ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	size_t result (0);
+	for (auto & i: classes)
+	{
+		result += i.size ();
+	}
+	return result;
 }
 
 uint64_t rai::block_store::now ()
@@ -2563,9 +5941,9 @@ uint64_t rai::block_store::now ()
 
 bool rai::peer_container::known_peer (rai::endpoint const & endpoint_a)
 {
-    std::lock_guard <std::mutex> lock (mutex);
-    auto existing (peers.find (endpoint_a));
-    return existing != peers.end () && existing->last_contact > std::chrono::system_clock::now () - rai::node::cutoff;
+	auto snapshot_l (snapshot ());
+    auto existing (snapshot_l->find (endpoint_a));
+    return existing != nullptr && existing->last_contact > std::chrono::system_clock::now () - rai::node::cutoff;
 }
 
 std::shared_ptr <rai::node> rai::node::shared ()
@@ -2573,24 +5951,123 @@ std::shared_ptr <rai::node> rai::node::shared ()
     return shared_from_this ();
 }
 
-rai::election::election (MDB_txn * transaction_a, rai::node & node_a, std::shared_ptr <rai::block> block_a, std::function <void (std::shared_ptr <rai::block>)> const & confirmation_action_a) :
+rai::histogram::histogram () :
+count (0),
+sum (0),
+max (0)
+{
+	buckets.fill (0);
+}
+
+void rai::histogram::add (uint64_t value_a)
+{
+	size_t bucket (0);
+	while (bucket < buckets.size () - 1 && value_a >= (uint64_t (1) << bucket))
+	{
+		++bucket;
+	}
+	++buckets [bucket];
+	++count;
+	sum += value_a;
+	max = std::max (max, value_a);
+}
+
+void rai::histogram::serialize (boost::property_tree::ptree & tree_a) const
+{
+	tree_a.put ("count", std::to_string (count));
+	tree_a.put ("average", std::to_string (count > 0 ? sum / count : 0));
+	tree_a.put ("max", std::to_string (max));
+	// Keyed by the exclusive upper bound of each bucket, trailing empty buckets are left out
+	boost::property_tree::ptree buckets_l;
+	auto last (buckets.size ());
+	while (last > 0 && buckets [last - 1] == 0)
+	{
+		--last;
+	}
+	for (size_t i (0); i < last; ++i)
+	{
+		buckets_l.put (i < buckets.size () - 1 ? std::to_string (uint64_t (1) << i) : std::string ("inf"), std::to_string (buckets [i]));
+	}
+	tree_a.add_child ("buckets", buckets_l);
+}
+
+rai::confirmation_stats::confirmation_stats () :
+confirmed (0),
+quorum (0),
+cutoff (0)
+{
+}
+
+void rai::confirmation_stats::add (rai::election const & election_a)
+{
+	auto now (std::chrono::steady_clock::now ());
+	auto milliseconds ([] (std::chrono::steady_clock::duration const & duration_a)
+	{
+		return static_cast <uint64_t> (std::chrono::duration_cast <std::chrono::milliseconds> (duration_a).count ());
+	});
+	std::lock_guard <std::mutex> lock (mutex);
+	++confirmed;
+	queued.add (milliseconds (election_a.started - election_a.seen));
+	if (election_a.quorum_reached != std::chrono::steady_clock::time_point ())
+	{
+		++quorum;
+		to_quorum.add (milliseconds (election_a.quorum_reached - election_a.started));
+	}
+	else
+	{
+		++cutoff;
+	}
+	to_confirm.add (milliseconds (now - election_a.seen));
+	// Our own starting block is held under not_an_account
+	votes.add (election_a.votes.rep_votes.size () - 1);
+	announcements.add (election_a.announcements);
+}
+
+void rai::confirmation_stats::serialize (boost::property_tree::ptree & tree_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	tree_a.put ("confirmed", std::to_string (confirmed));
+	tree_a.put ("quorum", std::to_string (quorum));
+	tree_a.put ("cutoff", std::to_string (cutoff));
+	std::array <std::pair <char const *, rai::histogram const *>, 5> histograms ({{ {"queued", &queued}, {"to_quorum", &to_quorum}, {"to_confirm", &to_confirm}, {"votes", &votes}, {"announcements", &announcements} }});
+	for (auto & i: histograms)
+	{
+		boost::property_tree::ptree histogram_l;
+		i.second->serialize (histogram_l);
+		tree_a.add_child (i.first, histogram_l);
+	}
+}
+
+rai::election::election (MDB_txn * transaction_a, rai::node & node_a, std::shared_ptr <rai::block> block_a, std::function <void (std::shared_ptr <rai::block>)> const & confirmation_action_a, std::chrono::steady_clock::time_point seen_a) :
 confirmation_action (confirmation_action_a),
 votes (block_a),
 node (node_a),
 last_vote (std::chrono::system_clock::now ()),
-last_winner (block_a)
+last_winner (block_a),
+confirmed (false),
+seen (seen_a),
+started (std::chrono::steady_clock::now ()),
+announcements (0),
+voters (votes.rep_votes.size ())
 {
 	assert (node_a.store.block_exists (transaction_a, block_a->hash ()));
-	confirmed.clear ();
+	weights [rai::not_an_account] = 0;
+	totals [block_a->hash ()] = 0;
 	compute_rep_votes (transaction_a);
 }
 
 void rai::election::compute_rep_votes (MDB_txn * transaction_a)
 {
+	std::lock_guard <std::mutex> lock (mutex);
 	node.wallets.foreach_representative (transaction_a, [this, transaction_a] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
 	{
 		rai::vote vote (pub_a, prv_a, this->node.store.sequence_atomic_inc (transaction_a, pub_a), last_winner);
-		this->votes.vote (vote);
+		this->node.online_reps.vote (transaction_a, pub_a);
+		if (weights.find (pub_a) == weights.end ())
+		{
+			weights.insert (std::make_pair (pub_a, this->node.ledger.weight (transaction_a, pub_a)));
+		}
+		tally_vote (vote);
 	});
 }
 
@@ -2600,28 +6077,36 @@ void rai::election::broadcast_winner ()
 		rai::transaction transaction (node.store.environment, nullptr, true);
 		compute_rep_votes (transaction);
 	}
-	node.network.republish_block (last_winner);
+	std::shared_ptr <rai::block> winner_l;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		winner_l = last_winner;
+	}
+	node.network.republish_block (winner_l);
 }
 
-rai::uint128_t rai::election::quorum_threshold (MDB_txn * transaction_a, rai::ledger & ledger_a)
+rai::uint128_t rai::election::quorum_threshold ()
 {
 	// Threshold over which unanimous voting implies confirmation
-    return ledger_a.supply (transaction_a) / 2;
+    return node.online_reps.online_stake () / 2;
 }
 
-rai::uint128_t rai::election::minimum_treshold (MDB_txn * transaction_a, rai::ledger & ledger_a)
+rai::uint128_t rai::election::minimum_treshold ()
 {
 	// Minimum number of votes needed to change our ledger, underwhich we're probably disconnected
-	return ledger_a.supply (transaction_a) / 16;
+	return node.online_reps.online_stake () / 16;
 }
 
 void rai::election::confirm_once (MDB_txn * transaction_a)
 {
-	if (!confirmed.test_and_set ())
+	if (!confirmed.exchange (true))
 	{
 		auto tally_l (node.ledger.tally (transaction_a, votes));
 		assert (tally_l.size () > 0);
 		auto winner (tally_l.begin ());
+		// Settling time or a minority tally can still decide what we keep but only a quorum makes it final
+		auto quorum_l (winner->first > quorum_threshold ());
+		auto winner_hash (winner->second->hash ());
 		if (tally_l.size () > 1)
 		{
 			BOOST_LOG (node.log) << boost::str (boost::format ("Vote tally weight %2% for root %1%") % votes.id.to_string () % winner->first.convert_to <std::string> ());
@@ -2632,7 +6117,11 @@ void rai::election::confirm_once (MDB_txn * transaction_a)
 		}
 		if (!(*winner->second == *last_winner))
 		{
-			if (winner->first > minimum_treshold (transaction_a, node.ledger))
+			if (node.ledger.confirmed (transaction_a, last_winner->hash ()))
+			{
+				BOOST_LOG (node.log) << boost::str (boost::format ("Retaining confirmed block %1% over %2%") % last_winner->hash ().to_string () % winner->second->hash ().to_string ());
+			}
+			else if (winner->first > minimum_treshold ())
 			{
 				BOOST_LOG (node.log) << boost::str (boost::format ("Rolling back %1% and replacing with %2%") % last_winner->hash ().to_string () % winner->second->hash ().to_string ());
 				// Replace our block with the winner and roll back any dependent blocks
@@ -2640,17 +6129,25 @@ void rai::election::confirm_once (MDB_txn * transaction_a)
 				node.ledger.process (transaction_a, *winner->second);
 				node.block_processor.add (winner->second);
 				last_winner = std::move (winner->second);
+				node.active.winner_changed (*this, last_winner->hash ());
 			}
 			else
 			{
 				BOOST_LOG (node.log) << boost::str (boost::format ("Retaining block %1%") % last_winner->hash ().to_string ());
 			}
 		}
+		auto confirm_height (quorum_l && last_winner->hash () == winner_hash);
+		node.confirmation_stats.add (*this);
 		auto winner_l (last_winner);
 		auto node_l (node.shared ());
 		auto confirmation_action_l (confirmation_action);
-		node.background ([winner_l, confirmation_action_l, node_l] ()
+		node.background ([winner_l, confirmation_action_l, node_l, confirm_height] ()
 		{
+			if (confirm_height)
+			{
+				// Walked outside the election and its write transaction, the dependencies can be long chains
+				node_l->confirm_heights (std::vector <rai::block_hash> (1, winner_l->hash ()));
+			}
 			node_l->process_confirmed (winner_l);
 			confirmation_action_l (winner_l);
 		});
@@ -2661,85 +6158,157 @@ bool rai::election::have_quorum (MDB_txn * transaction_a)
 {
 	auto tally_l (node.ledger.tally (transaction_a, votes));
 	assert (tally_l.size () > 0);
-	auto result (tally_l.begin ()->first > quorum_threshold (transaction_a, node.ledger));
+	auto result (tally_l.begin ()->first > quorum_threshold ());
 	return result;
 }
 
 void rai::election::confirm_if_quarum (MDB_txn * transaction_a)
 {
+	std::lock_guard <std::mutex> lock (mutex);
 	auto quarum (have_quorum (transaction_a));
 	if (quarum)
 	{
+		if (quorum_reached == std::chrono::steady_clock::time_point ())
+		{
+			quorum_reached = std::chrono::steady_clock::now ();
+		}
 		confirm_once (transaction_a);
 	}
 }
 
 void rai::election::confirm_cutoff (MDB_txn * transaction_a)
 {
+	std::lock_guard <std::mutex> lock (mutex);
 	confirm_once (transaction_a);
 }
 
-void rai::election::vote (rai::vote const & vote_a)
+bool rai::election::vote (rai::vote const & vote_a)
+{
+	auto quorum (false);
+	auto result (false);
+	{
+		std::unique_lock <std::mutex> lock (mutex);
+		auto now (std::chrono::system_clock::now ());
+		result = last_vote < now - std::chrono::seconds (1);
+		last_vote = now;
+		if (weights.find (vote_a.account) == weights.end ())
+		{
+			lock.unlock ();
+			rai::uint128_t weight;
+			{
+				rai::transaction transaction (node.store.environment, nullptr, false);
+				weight = node.ledger.weight (transaction, vote_a.account);
+			}
+			lock.lock ();
+			weights.insert (std::make_pair (vote_a.account, weight));
+		}
+		tally_vote (vote_a);
+		quorum = !confirmed && have_quorum_cached ();
+		if (quorum && quorum_reached == std::chrono::steady_clock::time_point ())
+		{
+			quorum_reached = std::chrono::steady_clock::now ();
+		}
+	}
+	if (quorum)
+	{
+		// Only take the write lock once the cached tally says we're done, the ledger tally has the final say
+		rai::transaction transaction (node.store.environment, nullptr, true);
+		confirm_if_quarum (transaction);
+	}
+	return result;
+}
+
+void rai::election::tally_vote (rai::vote const & vote_a)
 {
-	node.network.republish_vote (last_vote, vote_a);
-	last_vote = std::chrono::system_clock::now ();
-	rai::transaction transaction (node.store.environment, nullptr, true);
-	assert (vote_a.validate (transaction, node.store) != rai::vote_result::invalid);
+	auto weight (weights [vote_a.account]);
+	auto existing (votes.rep_votes.find (vote_a.account));
+	if (existing != votes.rep_votes.end ())
+	{
+		totals [existing->second->hash ()] -= weight;
+	}
 	votes.vote (vote_a);
-	confirm_if_quarum (transaction);
+	voters = votes.rep_votes.size ();
+	totals [vote_a.block->hash ()] += weight;
+}
+
+bool rai::election::have_quorum_cached ()
+{
+	rai::uint128_t max (0);
+	for (auto & i: totals)
+	{
+		max = std::max (max, i.second);
+	}
+	return max > quorum_threshold ();
 }
 
 void rai::active_transactions::announce_votes ()
 {
-	std::vector <rai::block_hash> inactive;
-	rai::transaction transaction (node.store.environment, nullptr, true);
-	std::lock_guard <std::mutex> lock (mutex);
-	size_t announcements (0);
+	std::vector <std::shared_ptr <rai::election>> announce;
+	std::vector <std::shared_ptr <rai::election>> inactive;
+	auto bootstrap (false);
 	{
-		auto i (roots.begin ());
-		auto n (roots.end ());
-		// Announce our decision for up to `announcements_per_interval' conflicts
-		for (; i != n && announcements < announcements_per_interval; ++i)
+		std::lock_guard <std::mutex> lock (mutex);
+		++round;
+		// Announce our decision for up to `announcements_per_interval' conflicts, highest work first
+		// Conflicts further down aren't visited, their announcements stop being contiguous because their announced_round falls behind
+		// This is a DoS protection mechanism to rate-limit the amount of traffic for solving forks.
+		auto & priority (roots.get <2> ());
+		auto i (priority.begin ());
+		auto n (priority.end ());
+		for (size_t announcements (0); i != n && announcements < announcements_per_interval; ++i, ++announcements)
 		{
-			auto election_l (i->election);
-			node.background ([election_l] () { election_l->broadcast_winner (); } );
-			if (i->announcements >= contigious_announcements - 1)
+			announce.push_back (i->election);
+			++i->election->announcements;
+			auto contiguous (i->announced_round + 1 == round ? i->announcements : 0);
+			if (contiguous >= contigious_announcements - 1)
 			{
 				// These blocks have reached the confirmation interval for forks
-				i->election->confirm_cutoff (transaction);
-				auto root_l (i->election->votes.id);
-				inactive.push_back (root_l);
+				inactive.push_back (i->election);
 			}
 			else
 			{
-				unsigned announcements;
-				roots.modify (i, [&announcements] (rai::conflict_info & info_a)
+				auto round_l (round);
+				priority.modify (i, [contiguous, round_l] (rai::conflict_info & info_a)
 				{
-					announcements = ++info_a.announcements;
+					info_a.announcements = contiguous + 1;
+					info_a.announced_round = round_l;
 				});
 				// If more than one full announcement interval has passed and no one has voted on this block, we need to synchronize
-				if (announcements > 1 && i->election->votes.rep_votes.size () <= 1)
+				if (contiguous + 1 > 1 && i->election->voters <= 1)
 				{
-					node.bootstrap_initiator.bootstrap ();
+					bootstrap = true;
 				}
 			}
 		}
-		// Mark remainder as 0 announcements sent
-		// This could happen if there's a flood of forks, the network will resolve them in increasing root hash order
-		// This is a DoS protection mechanism to rate-limit the amount of traffic for solving forks.
-		for (; i != n; ++i)
+	}
+	for (auto & i: announce)
+	{
+		auto election_l (i);
+		node.background ([election_l] () { election_l->broadcast_winner (); } );
+	}
+	if (bootstrap)
+	{
+		node.bootstrap_initiator.bootstrap ();
+	}
+	if (!inactive.empty ())
+	{
 		{
-			// Reset announcement count for conflicts above announcement cutoff
-			roots.modify (i, [] (rai::conflict_info & info_a)
+			rai::transaction transaction (node.store.environment, nullptr, true);
+			for (auto & i: inactive)
 			{
-				info_a.announcements = 0;
-			});
+				i->confirm_cutoff (transaction);
+			}
+		}
+		std::lock_guard <std::mutex> lock (mutex);
+		for (auto & i: inactive)
+		{
+			auto existing (roots.find (i->votes.id));
+			if (existing != roots.end () && existing->election == i)
+			{
+				erase_blocks (existing->root);
+				roots.erase (existing);
+			}
 		}
-	}
-	for (auto i (inactive.begin ()), n (inactive.end ()); i != n; ++i)
-	{
-		assert (roots.find (*i) != roots.end ());
-		roots.erase (*i);
 	}
 	auto now (std::chrono::system_clock::now ());
 	auto node_l (node.shared ());
@@ -2750,23 +6319,52 @@ void rai::active_transactions::stop ()
 {
 	std::lock_guard <std::mutex> lock (mutex);
 	roots.clear ();
+	blocks.clear ();
 }
 
-void rai::active_transactions::start (MDB_txn * transaction_a, std::shared_ptr <rai::block> block_a, std::function <void (std::shared_ptr <rai::block>)> const & confirmation_action_a)
+void rai::active_transactions::start (MDB_txn * transaction_a, std::shared_ptr <rai::block> block_a, std::function <void (std::shared_ptr <rai::block>)> const & confirmation_action_a, std::chrono::steady_clock::time_point seen_a)
 {
     std::lock_guard <std::mutex> lock (mutex);
     auto root (block_a->root ());
     auto existing (roots.find (root));
-    if (existing == roots.end ())
+    if (existing == roots.end () && node.ledger.confirmed (transaction_a, block_a->hash ()))
     {
-        auto election (std::make_shared <rai::election> (transaction_a, node, block_a, confirmation_action_a));
-        roots.insert (rai::conflict_info {root, election, 0});
+		// Nothing left to decide, don't vote or check for rollback again
+		++already_confirmed;
+    }
+    else if (existing == roots.end ())
+    {
+		auto priority (node.work.work_value (root, block_a->block_work ()));
+		auto start (true);
+		if (roots.size () >= max)
+		{
+			// Make room by dropping the election with the least work behind it, or refuse this one if it has even less
+			auto & priority_l (roots.get <2> ());
+			auto lowest (std::prev (priority_l.end ()));
+			if (lowest->priority < priority)
+			{
+				erase_blocks (lowest->root);
+				priority_l.erase (lowest);
+			}
+			else
+			{
+				start = false;
+			}
+			++dropped;
+		}
+		if (start)
+		{
+			auto election (std::make_shared <rai::election> (transaction_a, node, block_a, confirmation_action_a, seen_a));
+			roots.insert (rai::conflict_info {root, block_a->hash (), priority, election, 0, 0});
+			add_block (block_a);
+		}
     }
 }
 
 // Validate a vote and apply it to the current election if one exists
-void rai::active_transactions::vote (rai::vote const & vote_a)
+bool rai::active_transactions::vote (rai::vote const & vote_a)
 {
+	auto result (false);
 	std::shared_ptr <rai::election> election;
 	{
 		std::lock_guard <std::mutex> lock (mutex);
@@ -2775,12 +6373,14 @@ void rai::active_transactions::vote (rai::vote const & vote_a)
 		if (existing != roots.end ())
 		{
 			election = existing->election;
+			add_block (vote_a.block);
 		}
 	}
 	if (election)
 	{
-        election->vote (vote_a);
+        result = election->vote (vote_a);
 	}
+	return result;
 }
 
 bool rai::active_transactions::active (rai::block const & block_a)
@@ -2789,8 +6389,66 @@ bool rai::active_transactions::active (rai::block const & block_a)
 	return roots.find (block_a.root ()) != roots.end ();
 }
 
+bool rai::active_transactions::active (rai::block_hash const & hash_a)
+{
+    std::lock_guard <std::mutex> lock (mutex);
+	return roots.get <1> ().find (hash_a) != roots.get <1> ().end ();
+}
+
+void rai::active_transactions::fork (std::shared_ptr <rai::block> block_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	if (roots.find (block_a->root ()) != roots.end ())
+	{
+		add_block (block_a);
+	}
+}
+
+std::shared_ptr <rai::block> rai::active_transactions::find (rai::block_hash const & hash_a)
+{
+	std::shared_ptr <rai::block> result;
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (blocks.find (hash_a));
+	if (existing != blocks.end ())
+	{
+		result = existing->block;
+	}
+	return result;
+}
+
+void rai::active_transactions::add_block (std::shared_ptr <rai::block> block_a)
+{
+	auto root (block_a->root ());
+	if (blocks.get <1> ().count (root) < blocks_max)
+	{
+		blocks.insert (rai::active_block {block_a->hash (), root, block_a});
+	}
+}
+
+void rai::active_transactions::erase_blocks (rai::block_hash const & root_a)
+{
+	blocks.get <1> ().erase (root_a);
+}
+
+void rai::active_transactions::winner_changed (rai::election const & election_a, rai::block_hash const & hash_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (roots.find (election_a.votes.id));
+	if (existing != roots.end () && existing->election.get () == &election_a)
+	{
+		roots.modify (existing, [&hash_a] (rai::conflict_info & info_a)
+		{
+			info_a.winner = hash_a;
+		});
+	}
+}
+
 rai::active_transactions::active_transactions (rai::node & node_a) :
-node (node_a)
+node (node_a),
+max (rai::rai_network == rai::rai_networks::rai_test_network ? 1024 : 16384),
+round (0),
+dropped (0),
+already_confirmed (0)
 {
 }
 
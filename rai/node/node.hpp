@@ -4,6 +4,8 @@
 #include <rai/node/wallet.hpp>
 
 #include <unordered_set>
+#include <list>
+#include <deque>
 #include <memory>
 #include <queue>
 #include <mutex>
@@ -18,6 +20,7 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/random_access_index.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
 #include <boost/circular_buffer.hpp>
 
 #include <miniupnpc.h>
@@ -36,13 +39,54 @@ class variables_map;
 namespace rai
 {
 class node;
+// Counts of values in power of two buckets, bucket i holds values below 2^i and the last bucket holds everything larger
+class histogram
+{
+public:
+	histogram ();
+	void add (uint64_t);
+	void serialize (boost::property_tree::ptree &) const;
+	std::array <uint64_t, 24> buckets;
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+};
+class election;
+// Where the time goes between first seeing a block and confirming it, times are in milliseconds
+class confirmation_stats
+{
+public:
+	confirmation_stats ();
+	// Record an election as it's confirmed
+	void add (rai::election const &);
+	void serialize (boost::property_tree::ptree &);
+	uint64_t confirmed;
+	uint64_t quorum;
+	uint64_t cutoff;
+	// First seen until the election started, time spent in the block processor queue
+	rai::histogram queued;
+	// Election start until the vote tally reached quorum
+	rai::histogram to_quorum;
+	// First seen until confirmed
+	rai::histogram to_confirm;
+	// Representatives that voted in the election
+	rai::histogram votes;
+	// Announcement rounds the election went through
+	rai::histogram announcements;
+	std::mutex mutex;
+};
 class election : public std::enable_shared_from_this <rai::election>
 {
 	std::function <void (std::shared_ptr <rai::block>)> confirmation_action;
 	void confirm_once (MDB_txn *);
+	// Add a vote to the running tally, the representative's weight must already be cached
+	void tally_vote (rai::vote const &);
+	// Quorum according to the running tally, no store access
+	bool have_quorum_cached ();
 public:
-    election (MDB_txn *, rai::node &, std::shared_ptr <rai::block>, std::function <void (std::shared_ptr <rai::block>)> const &);
-    void vote (rai::vote const &);
+    election (MDB_txn *, rai::node &, std::shared_ptr <rai::block>, std::function <void (std::shared_ptr <rai::block>)> const &, std::chrono::steady_clock::time_point = std::chrono::steady_clock::now ());
+	// Returns true if no vote was seen for this election in the last second and the vote is worth republishing
+    bool vote (rai::vote const &);
 	// Check if we have vote quorum
 	bool have_quorum (MDB_txn *);
 	// Tell the network our view of the winner
@@ -53,21 +97,48 @@ public:
 	void confirm_if_quarum (MDB_txn *);
 	// Confirmation method 2, settling time
 	void confirm_cutoff (MDB_txn *);
-    rai::uint128_t quorum_threshold (MDB_txn *, rai::ledger &);
-	rai::uint128_t minimum_treshold (MDB_txn *, rai::ledger &);
+    rai::uint128_t quorum_threshold ();
+	rai::uint128_t minimum_treshold ();
     rai::votes votes;
     rai::node & node;
     std::chrono::system_clock::time_point last_vote;
 	std::shared_ptr <rai::block> last_winner;
-    std::atomic_flag confirmed;
+    std::atomic <bool> confirmed;
+	// Weight of each representative that has voted, read once per election
+	std::unordered_map <rai::account, rai::uint128_t> weights;
+	// Running weight behind each block in votes
+	std::unordered_map <rai::block_hash, rai::uint128_t> totals;
+	// When the block was first seen, started and when the tally first reached quorum, which stays default constructed until it does
+	std::chrono::steady_clock::time_point seen;
+	std::chrono::steady_clock::time_point started;
+	std::chrono::steady_clock::time_point quorum_reached;
+	// Number of times this election was announced
+	std::atomic <unsigned> announcements;
+	// Size of votes.rep_votes, kept by tally_vote so it can be read without the mutex
+	std::atomic <size_t> voters;
+	std::mutex mutex;
 };
 class conflict_info
 {
 public:
 	rai::block_hash root;
+	// Hash of the election's current winner, the block it was started with until confirm_once replaces it
+	rai::block_hash winner;
+	// Work difficulty of the starting block, elections with more work are announced and kept first
+	uint64_t priority;
 	std::shared_ptr <rai::election> election;
 	// Number of announcements in a row for this fork
 	unsigned announcements;
+	// Announcement round this fork was last announced in
+	uint64_t announced_round;
+};
+// A block an active election could settle on, kept so votes-by-hash for forks that aren't in the ledger can be matched
+class active_block
+{
+public:
+	rai::block_hash hash;
+	rai::block_hash root;
+	std::shared_ptr <rai::block> block;
 };
 // Core class for determining concensus
 // Holds all active blocks i.e. recently added blocks that need confirmation
@@ -77,10 +148,20 @@ public:
     active_transactions (rai::node &);
 	// Start an election for a block
 	// Call action with confirmed block, may be different than what we started with
-    void start (MDB_txn *, std::shared_ptr <rai::block>, std::function <void (std::shared_ptr <rai::block>)> const & = [] (std::shared_ptr <rai::block>) {});
-    void vote (rai::vote const &);
+	// The time the block was first seen is kept for confirmation_stats
+    void start (MDB_txn *, std::shared_ptr <rai::block>, std::function <void (std::shared_ptr <rai::block>)> const & = [] (std::shared_ptr <rai::block>) {}, std::chrono::steady_clock::time_point = std::chrono::steady_clock::now ());
+	// Returns true if the vote went to an active election that wants it republished
+    bool vote (rai::vote const &);
 	// Is the root of this block in the roots container
 	bool active (rai::block const &);
+	// Is this block the current winner of an election
+	bool active (rai::block_hash const &);
+	// Point the winner index at the block an election switched to
+	void winner_changed (rai::election const &, rai::block_hash const &);
+	// Remember a block that forks an active election
+	void fork (std::shared_ptr <rai::block>);
+	// Candidate block of an active election with this hash, nullptr if there isn't one
+	std::shared_ptr <rai::block> find (rai::block_hash const &);
 	void announce_votes ();
 	void stop ();
     boost::multi_index_container
@@ -88,52 +169,125 @@ public:
 		rai::conflict_info,
 		boost::multi_index::indexed_by
 		<
-			boost::multi_index::ordered_unique <boost::multi_index::member <rai::conflict_info, rai::block_hash, &rai::conflict_info::root>>
+			boost::multi_index::ordered_unique <boost::multi_index::member <rai::conflict_info, rai::block_hash, &rai::conflict_info::root>>,
+			boost::multi_index::hashed_non_unique <boost::multi_index::member <rai::conflict_info, rai::block_hash, &rai::conflict_info::winner>>,
+			boost::multi_index::ordered_non_unique <boost::multi_index::member <rai::conflict_info, uint64_t, &rai::conflict_info::priority>, std::greater <uint64_t>>
 		>
 	> roots;
+	// Blocks each election has started with, seen as forks or seen in votes
+	boost::multi_index_container
+	<
+		rai::active_block,
+		boost::multi_index::indexed_by
+		<
+			boost::multi_index::hashed_unique <boost::multi_index::member <rai::active_block, rai::block_hash, &rai::active_block::hash>>,
+			boost::multi_index::hashed_non_unique <boost::multi_index::member <rai::active_block, rai::block_hash, &rai::active_block::root>>
+		>
+	> blocks;
     rai::node & node;
     std::mutex mutex;
-	// Maximum number of conflicts to vote on per interval, lowest root hash first
+	// Maximum number of elections held at once, the lowest priority election is dropped to make room
+	size_t max;
+	// Number of times announce_votes has run
+	uint64_t round;
+	// Elections dropped or refused because the container was full
+	std::atomic <uint64_t> dropped;
+	// Elections not started because the block was already below its account's confirmation height
+	std::atomic <uint64_t> already_confirmed;
+	// Maximum number of conflicts to vote on per interval, highest priority first
 	static unsigned constexpr announcements_per_interval = 32;
 	// After this many successive vote announcements, block is confirmed
 	static unsigned constexpr contigious_announcements = 4;
 	static unsigned constexpr announce_interval_ms = (rai::rai_network == rai::rai_networks::rai_test_network) ? 10 : 16000;
+	// Candidate blocks remembered per election
+	static size_t constexpr blocks_max = 8;
+private:
+	// Both require mutex to be held
+	void add_block (std::shared_ptr <rai::block>);
+	void erase_blocks (rai::block_hash const &);
 };
 class operation
 {
 public:
-    bool operator > (rai::operation const &) const;
-    std::chrono::system_clock::time_point wakeup;
+	uint64_t id;
+	// Absolute tick the operation becomes due
+	uint64_t tick;
     std::function <void ()> function;
 };
+// Hierarchical timing wheel, each level has slots ticks of the level below and entries cascade down as their slot comes up
+// Adding and cancelling an operation are constant time
 class alarm
 {
 public:
     alarm (boost::asio::io_service &);
 	~alarm ();
-    void add (std::chrono::system_clock::time_point const &, std::function <void ()> const &);
+	// Returns a handle that can be passed to cancel
+    uint64_t add (std::chrono::system_clock::time_point const &, std::function <void ()> const &);
+	// Returns true if the operation already ran or was cancelled
+	bool cancel (uint64_t);
+	size_t size ();
 	void run ();
+	static size_t constexpr slot_bits = 8;
+	static size_t constexpr slots = 1 << slot_bits;
+	static size_t constexpr levels = 4;
+	static std::chrono::milliseconds constexpr tick_length = std::chrono::milliseconds (1);
 	boost::asio::io_service & service;
     std::mutex mutex;
     std::condition_variable condition;
-    std::priority_queue <operation, std::vector <operation>, std::greater <operation>> operations;
+	std::chrono::system_clock::time_point const base;
+	// Every tick before current has been processed
+	uint64_t current;
+	// Tick the run thread is sleeping until, adds before it need to wake the thread
+	uint64_t waiting;
+	uint64_t id;
+	bool stopped;
+	std::array <std::array <std::list <rai::operation>, slots>, levels> wheel;
+	// Operations due past the last level, re-inserted each time the top level wraps
+	std::list <rai::operation> overflow;
+	std::unordered_map <uint64_t, std::pair <std::list <rai::operation> *, std::list <rai::operation>::iterator>> handles;
 	std::thread thread;
+private:
+	uint64_t tick (std::chrono::system_clock::time_point const &);
+	// Move an operation from the list it's in to the slot it belongs in now
+	void insert (std::list <rai::operation> &, std::list <rai::operation>::iterator);
+	void advance (uint64_t);
+	uint64_t next_tick ();
 };
 class gap_information
 {
 public:
     std::chrono::system_clock::time_point arrival;
     rai::block_hash hash;
+	// Block this one is waiting on, zero if not known
+	rai::block_hash missing;
 	std::unique_ptr <rai::votes> votes;
+	// Peers that voted for this block and so should be able to supply the missing chain
+	std::vector <rai::endpoint> voters;
+	// When the gap was first seen, used to time how long it takes to fill
+	std::chrono::steady_clock::time_point start;
+	// Estimated bytes held by this entry
+	size_t memory;
+	// A bootstrap has been scheduled for this gap, later votes don't schedule another
+	bool requested;
 };
+// Blocks we can't process because a previous or source is missing
+// Entries are evicted oldest first once their estimated size exceeds the memory budget
 class gap_cache
 {
 public:
-    gap_cache (rai::node &);
-    void add (MDB_txn *, std::shared_ptr <rai::block>);
-    void vote (rai::vote const &);
+    gap_cache (rai::node &, size_t = 4 * 1024 * 1024);
+    void add (MDB_txn *, std::shared_ptr <rai::block>, rai::block_hash const & = rai::block_hash (0));
+    void vote (rai::vote const &, rai::endpoint const & = rai::endpoint ());
+	// Called when a block in the cache has been processed
+	void fill (rai::block_hash const &);
+	// Called when a bootstrap attempt ends, entries left weren't filled by it
+	void requested_clear ();
+	// Block waiting in the cache with this hash, nullptr if there isn't one
+	std::shared_ptr <rai::block> find (rai::block_hash const &);
     rai::uint128_t bootstrap_threshold (MDB_txn *);
 	void purge_old ();
+	size_t memory_used ();
+	void serialize (boost::property_tree::ptree &);
     boost::multi_index_container
     <
         rai::gap_information,
@@ -143,9 +297,76 @@ public:
             boost::multi_index::hashed_unique <boost::multi_index::member <gap_information, rai::block_hash, &gap_information::hash>>
         >
     > blocks;
-    size_t const max = 256;
+	size_t const memory_max;
+	static size_t constexpr voters_max = 8;
+	size_t memory;
+	// Gaps filled, gaps dropped to stay in budget and targeted pulls started
+	uint64_t filled;
+	uint64_t evicted;
+	uint64_t pulls;
+	// Milliseconds from first seeing a gap until the waiting block was processed
+	rai::histogram fill_time;
     std::mutex mutex;
     rai::node & node;
+private:
+	size_t entry_size (rai::gap_information const &);
+};
+class dependency_information
+{
+public:
+	std::shared_ptr <rai::block> block;
+	rai::block_hash hash;
+	// Missing block this one is waiting on
+	rai::block_hash dependency;
+	std::chrono::steady_clock::time_point arrival;
+	uint64_t sequence;
+};
+// Blocks waiting on a missing previous or source, keyed by the missing hash
+// Once the entries take more than bytes_max they're spilled to the unchecked table oldest first
+class dependency_graph
+{
+public:
+	dependency_graph (rai::block_store &, size_t = bytes_max_default);
+	void add (MDB_txn *, rai::block_hash const &, std::shared_ptr <rai::block>);
+	// Remove and return the blocks waiting on hash in the order they arrived
+	std::vector <std::shared_ptr <rai::block>> release (MDB_txn *, rai::block_hash const &);
+	// Note dependencies already spilled by a previous run
+	void load (MDB_txn *);
+	// Move every in memory entry to the unchecked table
+	void flush (MDB_txn *);
+	void clear (MDB_txn *);
+	size_t size ();
+	size_t spilled_count ();
+	// Length of the longest chain of waiting blocks in memory, computed on demand since chains change as their dependencies arrive
+	unsigned depth ();
+	std::chrono::steady_clock::duration age ();
+	// Waiting blocks with the hash they wait on, ordered by that hash starting from start
+	std::vector <std::pair <rai::block_hash, std::shared_ptr <rai::block>>> list (rai::block_hash const &, size_t);
+	// Waiting block with this hash, nullptr if it isn't in memory
+	std::shared_ptr <rai::block> find (rai::block_hash const &);
+	// Memory counted against bytes_max for one entry, the serialized block plus entry_overhead
+	static size_t entry_size (rai::block const &);
+	boost::multi_index_container
+	<
+		rai::dependency_information,
+		boost::multi_index::indexed_by
+		<
+			boost::multi_index::ordered_unique <boost::multi_index::member <dependency_information, uint64_t, &dependency_information::sequence>>,
+			boost::multi_index::hashed_non_unique <boost::multi_index::member <dependency_information, rai::block_hash, &dependency_information::dependency>>,
+			boost::multi_index::hashed_unique <boost::multi_index::member <dependency_information, rai::block_hash, &dependency_information::hash>>
+		>
+	> blocks;
+	std::unordered_set <rai::block_hash> spilled;
+	size_t const bytes_max;
+	// Sum of entry_size over blocks
+	size_t bytes;
+	uint64_t sequence;
+	std::mutex mutex;
+	rai::block_store & store;
+	// Block object and shared_ptr control block beyond the serialized size, the entry and its three index nodes, rounded up
+	static size_t constexpr entry_overhead = 256;
+	// Roughly 65536 send blocks
+	static size_t constexpr bytes_max_default = 32 * 1024 * 1024;
 };
 class work_pool;
 class peer_information
@@ -162,6 +383,23 @@ public:
 	rai::amount rep_weight;
 	unsigned network_version;
 };
+// Immutable copy of the peer list, read without taking peer_container::mutex
+class peer_snapshot
+{
+public:
+	rai::peer_information const * find (rai::endpoint const &) const;
+	std::vector <rai::peer_information> peers;
+	// Position of each endpoint in peers
+	std::unordered_map <rai::endpoint, size_t> index;
+	// Positions in peers ordered by last contact, oldest first
+	std::vector <size_t> by_contact;
+	// Positions in peers of representatives, heaviest first
+	std::vector <size_t> by_weight;
+};
+// Changes to peers are made under mutex and published as a new snapshot that readers load atomically
+// Contacts from known peers are batched and applied to last_contact every contacts_max contacts or contacts_interval
+// New peers, version and weight changes are published at once, contact times at most every contacts_interval
+// last_bootstrap_attempt, last_rep_request and last_rep_response are only read under mutex and may be stale in a snapshot
 class peer_container
 {
 public:
@@ -182,6 +420,8 @@ public:
 	std::vector <rai::endpoint> list ();
 	// A list of random peers with size the square root of total peer count
 	std::vector <rai::endpoint> list_sqrt ();
+	// Split endpoints by whether the peer last spoke at least this protocol version, unknown peers count as older
+	void partition_version (std::vector <rai::endpoint> const &, unsigned, std::vector <rai::endpoint> &, std::vector <rai::endpoint> &);
 	// Get the next peer for attempting bootstrap
 	rai::endpoint bootstrap_peer ();
 	// Purge any peer where last_contact < time_point and return what was left
@@ -192,6 +432,9 @@ public:
 	size_t size ();
 	size_t size_sqrt ();
 	bool empty ();
+	std::shared_ptr <rai::peer_snapshot const> snapshot () const;
+	// Apply the batched contacts to peers now
+	void flush_contacts ();
 	std::mutex mutex;
 	rai::endpoint self;
 	boost::multi_index_container
@@ -213,6 +456,23 @@ public:
 	std::function <void ()> disconnect_observer;
 	// Number of peers to crawl for being a rep every period
 	static size_t constexpr peers_per_crawl = 8;
+	std::mutex contacts_mutex;
+	// Latest contact time of known peers not yet applied to peers
+	std::unordered_map <rai::endpoint, std::chrono::system_clock::time_point> contacts;
+	std::chrono::steady_clock::time_point contacts_flushed;
+	// Changes are waiting to be published and when the current snapshot was made
+	bool stale;
+	std::chrono::steady_clock::time_point published;
+	static size_t constexpr contacts_max = 256;
+	static std::chrono::seconds constexpr contacts_interval = std::chrono::seconds (1);
+private:
+	// Copy peers into a new snapshot, called with mutex held
+	void publish ();
+	// Publish if the current snapshot is older than contacts_interval, otherwise leave it to the next flush, called with mutex held
+	void publish_batched ();
+	// Update last_contact from batched contacts, called with mutex held
+	void apply_contacts (std::unordered_map <rai::endpoint, std::chrono::system_clock::time_point> const &);
+	std::shared_ptr <rai::peer_snapshot const> current;
 };
 class send_info
 {
@@ -222,6 +482,24 @@ public:
 	rai::endpoint endpoint;
 	std::function <void (boost::system::error_code const &, size_t)> callback;
 };
+class network;
+// Carries a node's datagrams and bootstrap streams in place of its UDP and TCP sockets, e.g. rai::simulated_network
+class transport
+{
+public:
+	virtual ~transport () = default;
+	// Begin handing datagrams addressed to endpoint () to network::receive_packet
+	virtual void start (rai::network &) = 0;
+	// Nothing is handed to the network or the listener once this returns
+	virtual void stop () = 0;
+	// Send each datagram and call its callback once it has left
+	virtual void send (std::vector <rai::send_info> &) = 0;
+	virtual rai::endpoint endpoint () = 0;
+	// An unconnected stream for a bootstrap client
+	virtual std::shared_ptr <rai::socket> connection () = 0;
+	// Pass each stream connecting to endpoint () to the listener until stopped
+	virtual void listen (std::function <void (std::shared_ptr <rai::socket>)>) = 0;
+};
 class mapping_protocol
 {
 public:
@@ -257,27 +535,289 @@ public:
 	uint64_t check_count;
 	bool on;
 };
+// Realtime messages are queued and scheduled by class, votes ahead of publishes ahead of keepalives
+// Message types that don't belong to a class are treated as keepalives
+enum class traffic_class : uint8_t
+{
+	vote,
+	publish,
+	keepalive
+};
+size_t constexpr traffic_classes = 3;
+rai::traffic_class traffic_class_of (rai::message_type);
+char const * traffic_class_name (rai::traffic_class);
+// Type of the message in a serialized datagram, invalid if it's too short to have a header
+rai::message_type datagram_type (uint8_t const *, size_t);
+// Weighted round robin between traffic classes, a pending class gets as many turns per round as its weight
+class traffic_scheduler
+{
+public:
+	traffic_scheduler (std::array <unsigned, rai::traffic_classes> const &);
+	// Pick the next class among the pending ones, returns true if none are pending
+	bool next (std::array <bool, rai::traffic_classes> const &, rai::traffic_class &);
+	std::array <unsigned, rai::traffic_classes> const weights;
+	std::array <unsigned, rai::traffic_classes> credits;
+};
+class traffic_statistics
+{
+public:
+	traffic_statistics ();
+	void add_latency (std::chrono::steady_clock::duration const &);
+	void serialize (boost::property_tree::ptree &);
+	// Messages that entered and that were dropped from the queue of this class
+	std::atomic <uint64_t> queued;
+	std::atomic <uint64_t> dropped;
+	std::mutex mutex;
+	// Microseconds messages waited in the queue
+	rai::histogram latency;
+};
 class message_statistics
 {
 public:
 	message_statistics ();
+	void serialize (boost::property_tree::ptree &);
     std::atomic <uint64_t> keepalive;
     std::atomic <uint64_t> publish;
     std::atomic <uint64_t> confirm_req;
     std::atomic <uint64_t> confirm_ack;
+	std::atomic <uint64_t> announce;
+	std::atomic <uint64_t> publish_req;
+	std::array <rai::traffic_statistics, rai::traffic_classes> classes;
+};
+size_t constexpr message_types = static_cast <size_t> (rai::message_type::realtime_req) + 1;
+char const * message_type_name (rai::message_type);
+// Why a datagram to or from a peer was thrown away
+enum class peer_drop : uint8_t
+{
+	receive_queue_full,
+	send_queue_full,
+	parse_error,
+	insufficient_work,
+	send_error
+};
+size_t constexpr peer_drop_reasons = 5;
+char const * peer_drop_name (rai::peer_drop);
+// Messages and bytes exchanged with one peer, indexed by rai::message_type
+class peer_traffic
+{
+public:
+	peer_traffic ();
+	void serialize (boost::property_tree::ptree &) const;
+	static uint64_t total (std::array <uint64_t, rai::message_types> const &);
+	uint64_t dropped_total () const;
+	std::array <uint64_t, rai::message_types> messages_in;
+	std::array <uint64_t, rai::message_types> bytes_in;
+	std::array <uint64_t, rai::message_types> messages_out;
+	std::array <uint64_t, rai::message_types> bytes_out;
+	// Indexed by rai::peer_drop
+	std::array <uint64_t, rai::peer_drop_reasons> dropped;
+	std::chrono::steady_clock::time_point last_seen;
+};
+class peer_traffic_shard
+{
+public:
+	std::mutex mutex;
+	std::unordered_map <rai::endpoint, rai::peer_traffic> peers;
+};
+// Traffic counters for every peer we exchange datagrams with, split into shards by endpoint so receive and send threads rarely wait on each other
+// Once entries_max peers are tracked, traffic from new endpoints is added to a single overflow entry so spoofed senders can't grow the table
+class peer_traffic_table
+{
+public:
+	peer_traffic_table (size_t = 16384);
+	void received (rai::endpoint const &, uint8_t const *, size_t);
+	void sent (rai::endpoint const &, uint8_t const *, size_t);
+	void dropped (rai::endpoint const &, rai::peer_drop);
+	// Forget peers we haven't exchanged anything with since the cutoff
+	void purge (std::chrono::steady_clock::time_point const &);
+	// Copy of every entry, the overflow entry is listed under the unspecified endpoint if it has been used
+	std::vector <std::pair <rai::endpoint, rai::peer_traffic>> list ();
+	size_t size ();
+	static size_t constexpr shard_count = 16;
+	std::array <rai::peer_traffic_shard, shard_count> shards;
+	size_t const entries_max;
+	std::atomic <size_t> entries;
+	std::mutex overflow_mutex;
+	rai::peer_traffic overflow;
+private:
+	// Entry for the endpoint with the mutex guarding it held by the lock
+	rai::peer_traffic & find (rai::endpoint const &, std::unique_lock <std::mutex> &);
+	static size_t type_index (uint8_t const *, size_t);
+};
+// Buffers for draining many datagrams from a socket in one system call
+class datagram_batch
+{
+public:
+	datagram_batch ();
+	static size_t constexpr max = 32;
+	std::array <std::array <uint8_t, 512>, max> buffers;
+	std::array <rai::datagram, max> datagrams;
+};
+class network;
+class queued_send
+{
+public:
+	rai::send_info send;
+	std::chrono::steady_clock::time_point queued;
+	unsigned priority;
+	// Increases with every queued send so a class queue is ordered by it
+	uint64_t sequence;
+};
+class peer_queue
+{
+public:
+	peer_queue ();
+	// Queued sends by traffic class
+	std::array <std::deque <rai::queued_send>, rai::traffic_classes> sends;
+	// Bytes of the queued sends
+	size_t bytes;
+	// Token bucket, in bytes
+	double tokens;
+	std::chrono::steady_clock::time_point refilled;
+	std::chrono::steady_clock::time_point last_send;
+	uint64_t sent;
+	uint64_t dropped;
+};
+// Outbound datagrams wait here per peer and traffic class, one sender loop drains them by class weight through per peer and global token buckets
+// When a peer's share is used up a send evicts that peer's queued sends of less important message types, when the global cap is reached it evicts the least important queued send of any peer, otherwise it is dropped
+class send_queue
+{
+public:
+	send_queue (rai::network &, uint64_t, uint64_t, size_t, std::array <unsigned, rai::traffic_classes> const &);
+	~send_queue ();
+	// Returns true if the send was dropped, its callback has then been called with no_buffer_space
+	bool add (rai::send_info const &);
+	void run ();
+	void stop ();
+	size_t size ();
+	void serialize (boost::property_tree::ptree &);
+	// Higher values are dropped last
+	static unsigned drop_priority (rai::message_type);
+	static rai::message_type type (rai::send_info const &);
+	rai::network & network;
+	// Bytes per second, 0 is unlimited
+	uint64_t const bandwidth_limit;
+	uint64_t const peer_bandwidth_limit;
+	size_t const bytes_max;
+	// One peer may hold at most this share of bytes_max
+	static size_t constexpr peer_share = 16;
+	static size_t constexpr batch_max = 64;
+	// Token buckets always hold at least one full receive buffer so every datagram can eventually leave
+	static size_t constexpr burst_min = 512;
+	static std::chrono::minutes constexpr idle_cutoff = std::chrono::minutes (5);
+	std::unordered_map <rai::endpoint, rai::peer_queue> peers;
+	// Peers with queued sends in each class in round robin order
+	std::array <std::deque <rai::endpoint>, rai::traffic_classes> active;
+	rai::traffic_scheduler scheduler;
+	// Every queued send by drop priority then age, pointing at its peer and class, so the global cap finds what to evict without a scan
+	std::map <std::pair <unsigned, uint64_t>, std::pair <rai::endpoint, size_t>> evictable;
+	uint64_t sequence;
+	size_t bytes;
+	double tokens;
+	std::chrono::steady_clock::time_point refilled;
+	std::chrono::steady_clock::time_point purged;
+	uint64_t dropped;
+	bool stopped;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::thread thread;
+private:
+	bool evict (rai::peer_queue &, unsigned, std::vector <rai::send_info> &);
+	bool evict (unsigned, std::vector <rai::send_info> &);
+	void drop (rai::endpoint const &, rai::peer_queue &, size_t, std::deque <rai::queued_send>::iterator, std::vector <rai::send_info> &);
+	void refill (double &, std::chrono::steady_clock::time_point &, uint64_t, std::chrono::steady_clock::time_point const &);
+};
+class received_datagram
+{
+public:
+	// Owned by the datagram so handing it from the queue to a worker doesn't copy the payload
+	std::unique_ptr <std::array <uint8_t, 512>> buffer;
+	size_t size;
+	rai::endpoint endpoint;
+	std::chrono::steady_clock::time_point queued;
+};
+// Received datagrams wait here by traffic class so workers parse votes ahead of a flood of publishes
+class receive_queue
+{
+public:
+	receive_queue (rai::network &, std::array <unsigned, rai::traffic_classes> const &, unsigned);
+	~receive_queue ();
+	// Returns true if the datagram was dropped because the queue for its class is full
+	bool add (uint8_t const *, size_t, rai::endpoint const &);
+	void run ();
+	void stop ();
+	size_t size ();
+	rai::network & network;
+	// Datagrams each class may hold
+	static size_t constexpr max = 4096;
+	std::array <std::deque <rai::received_datagram>, rai::traffic_classes> classes;
+	// Buffers of processed datagrams kept for reuse, at most max of them
+	std::vector <std::unique_ptr <std::array <uint8_t, 512>>> buffers;
+	rai::traffic_scheduler scheduler;
+	bool stopped;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::vector <std::thread> threads;
+};
+// An additional socket bound to the peering port, with its own buffer so packets are received and parsed in parallel
+class udp_receiver
+{
+public:
+	udp_receiver (rai::network &, uint16_t);
+	void receive ();
+	void receive_action (boost::system::error_code const &, size_t);
+	void receive_ready (boost::system::error_code const &);
+	rai::network & network;
+	boost::asio::ip::udp::socket socket;
+	rai::endpoint remote;
+	std::array <uint8_t, 512> buffer;
+	rai::datagram_batch batch;
+};
+// Blocks sent in answer to publish_req are limited per peer with a token bucket counted in blocks
+// A publish_req is far smaller than the blocks it asks for, so without this a spoofed request would have us flood its victim
+class publish_req_limiter
+{
+public:
+	publish_req_limiter (size_t = rai::hash_list_message::hashes_max);
+	// Returns how many of the requested blocks may be sent to the endpoint now
+	size_t take (rai::endpoint const &, size_t, std::chrono::steady_clock::time_point const & = std::chrono::steady_clock::now ());
+	// Forget peers that haven't asked since the cutoff
+	void purge (std::chrono::steady_clock::time_point const &);
+	size_t size ();
+	std::unordered_map <rai::endpoint, std::pair <double, std::chrono::steady_clock::time_point>> buckets;
+	// Requested blocks that weren't sent because of the limit or because the requester isn't a peer
+	std::atomic <uint64_t> refused;
+	std::mutex mutex;
+	size_t const blocks_per_second;
+	// At least one full publish_req can always be answered at once
+	size_t const burst;
+	static size_t constexpr max = 16384;
 };
 class network
 {
 public:
     network (rai::node &, uint16_t);
+	void start ();
     void receive ();
     void stop ();
     void receive_action (boost::system::error_code const &, size_t);
+	// Check the sender of a datagram and queue it by traffic class, called from every receiving socket
+	void receive_packet (uint8_t const *, size_t, rai::endpoint const &);
+	// Parse a datagram and dispatch its message, called from the receive queue
+	void process_packet (uint8_t const *, size_t, rai::endpoint const &);
+	// Called when the socket is readable in batched mode
+	void receive_ready (boost::system::error_code const &);
+	// Read and process everything queued on a readable socket with as few system calls as possible
+	void drain (boost::asio::ip::udp::socket &, rai::datagram_batch &);
+	// Emit datagrams taken from the send queue, in batches when batching is on
+	void transmit (std::vector <rai::send_info> &);
     void rpc_action (boost::system::error_code const &, size_t);
 	void rebroadcast_reps (std::shared_ptr <rai::block>);
-	void republish_vote (std::chrono::system_clock::time_point const &, rai::vote const &);
+	void republish_vote (rai::vote const &);
     void republish_block (std::shared_ptr <rai::block>);
 	void republish (rai::block_hash const &, std::shared_ptr <std::vector <uint8_t>>, rai::endpoint);
+	void send_announce (std::vector <rai::endpoint> const &, std::vector <rai::block_hash> const &);
+	void send_publish_req (rai::endpoint const &, std::vector <rai::block_hash> const &);
     void publish_broadcast (std::vector <rai::peer_information> &, std::unique_ptr <rai::block>);
 	void confirm_send (rai::confirm_ack const &, std::shared_ptr <std::vector <uint8_t>>, rai::endpoint const &);
     void merge_peers (std::array <rai::endpoint, 8> const &);
@@ -292,14 +832,115 @@ public:
     std::mutex socket_mutex;
     boost::asio::ip::udp::resolver resolver;
     rai::node & node;
-    uint64_t bad_sender_count;
-    bool on;
-    uint64_t insufficient_work_count;
-    uint64_t error_count;
+	// Replaces socket and receivers when set
+	std::shared_ptr <rai::transport> transport;
+	std::vector <std::unique_ptr <rai::udp_receiver>> receivers;
+	// Receives and sends move many datagrams per system call with receive_batch and send_batch
+	bool batching;
+	rai::datagram_batch batch;
+	std::atomic <uint64_t> receive_syscalls;
+	std::atomic <uint64_t> send_syscalls;
+	std::atomic <uint64_t> datagrams_received;
+	std::atomic <uint64_t> datagrams_sent;
+    std::atomic <uint64_t> bad_sender_count;
+    std::atomic <bool> on;
+    std::atomic <uint64_t> insufficient_work_count;
+    std::atomic <uint64_t> error_count;
 	rai::message_statistics incoming;
 	rai::message_statistics outgoing;
+	rai::peer_traffic_table peer_traffic;
+	rai::publish_req_limiter publish_req_limits;
+	rai::send_queue send_queue;
+	rai::receive_queue receive_queue;
     static uint16_t const node_port = rai::rai_network == rai::rai_networks::rai_live_network ? 7075 : 54000;
 };
+class channel_frame
+{
+public:
+	// Length prefix followed by the datagram
+	std::vector <uint8_t> bytes;
+	std::function <void (boost::system::error_code const &, size_t)> callback;
+};
+// A TCP connection to one peer carrying realtime messages both ways, opened with realtime_req on the bootstrap port
+// Each datagram is prefixed with its length, received ones are handed to network::receive_packet as if they came over UDP
+class realtime_channel : public std::enable_shared_from_this <rai::realtime_channel>
+{
+public:
+	realtime_channel (rai::node &, std::shared_ptr <rai::socket>, rai::endpoint const &, bool);
+	void start ();
+	// Queue a datagram for the peer, returns true if the channel is closed or backed up and the caller should send it some other way
+	bool send (rai::send_info const &);
+	void close ();
+	void receive ();
+	void receive_size_action (boost::system::error_code const &, size_t);
+	void receive_frame_action (boost::system::error_code const &, size_t);
+	// Write the front of the queue, called with mutex held
+	void write_next ();
+	void write_action (boost::system::error_code const &);
+	// Close the channel if the timer isn't cancelled or restarted within the duration, called with mutex held
+	void start_timeout (boost::asio::deadline_timer &, std::chrono::seconds const &);
+	// The node owns the channel map and closes every channel when it stops
+	rai::node & node;
+	std::shared_ptr <rai::socket> socket;
+	// Peering endpoint of the peer
+	rai::endpoint endpoint;
+	// The peer opened this channel to us
+	bool inbound;
+	std::array <uint8_t, 2> size_buffer;
+	std::array <uint8_t, 512> receive_buffer;
+	std::deque <rai::channel_frame> queue;
+	bool writing;
+	// Read without the mutex so find can skip channels that are closing
+	std::atomic <bool> closed;
+	// A write that doesn't complete or a peer that sends nothing, not even a keepalive, closes the channel and sends go back to UDP
+	boost::asio::deadline_timer write_timeout;
+	boost::asio::deadline_timer idle_timeout;
+	std::mutex mutex;
+	static size_t constexpr queue_max = 1024;
+	static std::chrono::seconds constexpr write_cutoff = std::chrono::seconds (15);
+	// Peers send a keepalive every minute
+	static std::chrono::seconds constexpr idle_cutoff = std::chrono::seconds (5 * 60);
+};
+// Open realtime channels by peering endpoint, network::transmit sends over these instead of UDP when one is open
+class realtime_channels
+{
+public:
+	realtime_channels (rai::node &);
+	// An open channel to the endpoint, nullptr if there's none and the datagram should go over UDP
+	std::shared_ptr <rai::realtime_channel> find (rai::endpoint const &);
+	// Register and start a channel, returns true if it was refused because we're stopped or at max
+	// Inbound channels are only accepted when realtime channels are enabled, one per address and at most inbound_max
+	bool add (std::shared_ptr <rai::realtime_channel>);
+	void remove (rai::realtime_channel const &);
+	void connect (rai::endpoint const &);
+	// Send realtime_req on a connected socket and start a channel over it
+	void connected (rai::endpoint const &, std::shared_ptr <rai::socket>);
+	void connect_failed (rai::endpoint const &);
+	// Keep channels open to the heaviest representatives that understand realtime_req
+	void ongoing_connect ();
+	void stop ();
+	size_t size ();
+	void serialize (boost::property_tree::ptree &);
+	rai::node & node;
+	// A peer that connects to us while we connect to it ends up with two channels, both receive and we send over whichever is found first
+	std::unordered_multimap <rai::endpoint, std::shared_ptr <rai::realtime_channel>> channels;
+	// Endpoints we're connecting to
+	std::unordered_set <rai::endpoint> connecting;
+	bool stopped;
+	std::mutex mutex;
+	// Size of channels, read without the mutex on the send path
+	std::atomic <size_t> count;
+	std::atomic <uint64_t> opened;
+	std::atomic <uint64_t> failed;
+	std::atomic <uint64_t> closed;
+	std::atomic <uint64_t> frames_sent;
+	std::atomic <uint64_t> frames_received;
+	// Datagrams that went over UDP because their channel was backed up
+	std::atomic <uint64_t> overflowed;
+	static size_t constexpr max = 128;
+	static size_t constexpr inbound_max = 16;
+	static std::chrono::seconds constexpr connect_interval = std::chrono::seconds (rai::rai_network == rai::rai_networks::rai_test_network ? 1 : 30);
+};
 class logging
 {
 public:
@@ -374,6 +1015,31 @@ public:
 	std::string callback_address;
 	uint16_t callback_port;
 	std::string callback_target;
+	// Threads checking block signatures ahead of the ledger, 0 processes serially
+	unsigned signature_checker_threads;
+	// Lower bound for the online weight quorum is computed from, so a node that sees few representatives can't be confirmed by them alone
+	rai::amount online_weight_minimum;
+	// UDP sockets opened on the peering port with SO_REUSEPORT, each receiving on its own
+	unsigned peering_sockets;
+	// Threads parsing received datagrams out of the receive queue
+	unsigned receive_threads;
+	// Use recvmmsg and sendmmsg where the platform has them
+	bool batched_io;
+	// Outbound bytes per second in total and to each peer, 0 is unlimited
+	uint64_t bandwidth_limit;
+	uint64_t peer_bandwidth_limit;
+	// Memory outbound datagrams may hold while waiting to be sent
+	uint64_t send_queue_memory;
+	// Turns each traffic class gets in the send and receive queues per round, indexed by rai::traffic_class
+	std::array <unsigned, rai::traffic_classes> traffic_weights;
+	// Send peers that understand it an announce with the block hash instead of the whole block, they pull it with publish_req if missing
+	bool announce_blocks;
+	// Blocks sent per second to each peer in answer to publish_req
+	unsigned publish_req_rate;
+	// Representatives to keep a TCP realtime channel open to, 0 sends everything over UDP
+	unsigned realtime_channels;
+	// Not serialized, sockets are opened on peering_port when this is null
+	std::shared_ptr <rai::transport> transport;
     static std::chrono::seconds constexpr keepalive_period = std::chrono::seconds (60);
     static std::chrono::seconds constexpr keepalive_cutoff = keepalive_period * 5;
 	static std::chrono::minutes constexpr wallet_backup_interval = std::chrono::minutes (5);
@@ -388,12 +1054,130 @@ public:
 	rai::observer_set <> disconnect;
 	rai::observer_set <> started;
 };
+class online_rep
+{
+public:
+	rai::account account;
+	// Weight when the representative came online, refreshed when it returns after dropping out of the window
+	rai::uint128_t weight;
+	std::chrono::steady_clock::time_point last_vote;
+};
+// Representatives seen voting within the window and their total weight, the base for vote quorum
+class online_reps
+{
+public:
+	online_reps (rai::node &);
+	// Mark this representative as online
+	void vote (MDB_txn *, rai::account const &);
+	// Total online weight, raised to online_weight_minimum
+	rai::uint128_t online_stake ();
+	rai::node & node;
+	static std::chrono::seconds constexpr window = std::chrono::seconds (300);
+private:
+	void trim (std::chrono::steady_clock::time_point const &);
+	boost::multi_index_container
+	<
+		rai::online_rep,
+		boost::multi_index::indexed_by
+		<
+			boost::multi_index::ordered_non_unique <boost::multi_index::member <rai::online_rep, std::chrono::steady_clock::time_point, &rai::online_rep::last_vote>>,
+			boost::multi_index::hashed_unique <boost::multi_index::member <rai::online_rep, rai::account, &rai::online_rep::account>>
+		>
+	> reps;
+	rai::uint128_t online;
+	std::mutex mutex;
+};
+class signature_check
+{
+public:
+	rai::public_key account;
+	rai::uint256_union message;
+	rai::signature signature;
+	bool valid;
+};
+// Verifies batches of signatures on a set of helper threads with the calling thread taking part
+class signature_checker
+{
+public:
+	signature_checker (unsigned);
+	~signature_checker ();
+	void verify (std::vector <rai::signature_check> &);
+	void stop ();
+	std::vector <rai::signature_check> * checks;
+	size_t next;
+	size_t remaining;
+	bool stopped;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::vector <std::thread> threads;
+	static size_t constexpr chunk_size = 32;
+private:
+	void run ();
+	// Verifies one chunk if any are unclaimed, returns false when there was nothing to claim
+	bool verify_chunk (std::unique_lock <std::mutex> &);
+};
 class vote_processor
 {
 public:
 	vote_processor (rai::node &);
+	~vote_processor ();
+	// Queue a vote to be checked and tallied on the vote processing thread
+	void add (rai::vote const &, rai::endpoint const &);
 	rai::vote_result vote (rai::vote const &, rai::endpoint);
+	void flush ();
+	void stop ();
 	rai::node & node;
+	// Votes dropped before their signature was checked because a higher sequence was already seen
+	std::atomic <uint64_t> stale;
+	// Votes dropped because the queue was full
+	std::atomic <uint64_t> overflow;
+	// Hashes in votes-by-hash for blocks that aren't in the ledger, an active election or the gap cache
+	std::atomic <uint64_t> unknown_hashes;
+	static size_t constexpr max_votes = 65536;
+	static size_t constexpr batch_max = 256;
+private:
+	void process_loop ();
+	void process_batch (std::deque <std::pair <rai::vote, rai::endpoint>> &);
+	void vote_completed (rai::vote const &, rai::vote_result);
+	// Tally each expanded vote and republish the original once if any election asked for it
+	void tally (rai::vote const &, std::vector <std::pair <rai::vote, rai::endpoint>>::const_iterator, std::vector <std::pair <rai::vote, rai::endpoint>>::const_iterator);
+	// Turn a checked vote into one vote per block, a vote-by-hash is matched against blocks in the ledger, active elections and the gap cache
+	// Hashes that can't be matched are requested from the voter with publish_req
+	void expand (MDB_txn *, rai::vote const &, rai::endpoint const &, std::vector <std::pair <rai::vote, rai::endpoint>> &);
+	std::deque <std::pair <rai::vote, rai::endpoint>> votes;
+	bool stopped;
+	bool idle;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::thread thread;
+};
+// Batches hashes we're voting for into votes-by-hash so each representative signs once per batch instead of once per block
+class vote_generator
+{
+public:
+	vote_generator (rai::node &);
+	~vote_generator ();
+	// Queue a hash to be voted for by every representative in our wallets, nothing is queued if there aren't any
+	void add (rai::block_hash const &);
+	void stop ();
+	rai::node & node;
+	// Votes-by-hash signed
+	std::atomic <uint64_t> votes;
+	// Hashes covered by those votes
+	std::atomic <uint64_t> hashes_voted;
+	// Hashes dropped because the queue was full
+	std::atomic <uint64_t> overflow;
+	static size_t constexpr max_hashes = 4096;
+	// How long to wait for more hashes before signing a partial batch
+	static unsigned constexpr wait_ms = rai::rai_network == rai::rai_networks::rai_test_network ? 5 : 50;
+private:
+	void run ();
+	void send (std::vector <rai::block_hash> const &);
+	std::deque <rai::block_hash> hashes;
+	bool stopped;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::thread thread;
 };
 // The network is crawled for representatives by ocassionally sending a unicast confirm_req for a specific block and watching to see if it's acknowledged with a vote.
 class rep_crawler
@@ -405,6 +1189,102 @@ public:
 	std::mutex mutex;
 	std::unordered_set <rai::block_hash> active;
 };
+class pull_information
+{
+public:
+	rai::block_hash hash;
+	std::chrono::steady_clock::time_point requested;
+	// Peers that announced the hash, the front one is the one it was last requested from
+	std::vector <rai::endpoint> sources;
+	// Requests sent to the front source
+	unsigned attempts;
+	// Handle of the pending retry alarm
+	uint64_t alarm;
+};
+// Announced blocks we've asked for with publish_req
+// A hash is requested from one peer at a time, if the block hasn't arrived after retry_interval it's requested again and after attempts_max requests from the next peer that announced it
+class pull_cache
+{
+public:
+	pull_cache (rai::node &);
+	// Returns true if the hash wasn't being pulled and should be requested from the endpoint now
+	bool add (rai::block_hash const &, rai::endpoint const &);
+	// Requests the hash again if it isn't in the ledger or waiting in the block processor
+	void retry (rai::block_hash const &);
+	void schedule (rai::block_hash const &);
+	// Called when a block has been processed, stops pulling it and cancels its retry
+	void fill (rai::block_hash const &);
+	size_t size ();
+	void serialize (boost::property_tree::ptree &);
+	rai::node & node;
+	boost::multi_index_container
+	<
+		rai::pull_information,
+		boost::multi_index::indexed_by
+		<
+			boost::multi_index::sequenced <>,
+			boost::multi_index::hashed_unique <boost::multi_index::member <pull_information, rai::block_hash, &pull_information::hash>>
+		>
+	> pulls;
+	// Hashes requested, requests repeated to another source and hashes given up on
+	std::atomic <uint64_t> requested;
+	std::atomic <uint64_t> retried;
+	std::atomic <uint64_t> abandoned;
+	std::mutex mutex;
+	static size_t constexpr max = 16384;
+	static size_t constexpr sources_max = 4;
+	// A lost request or reply shouldn't drop a source, each is asked this many times
+	static unsigned constexpr attempts_max = 2;
+	static std::chrono::milliseconds constexpr retry_interval = std::chrono::milliseconds (rai::rai_network == rai::rai_networks::rai_test_network ? 500 : 2000);
+};
+class generated_vote
+{
+public:
+	std::shared_ptr <rai::confirm_ack> confirm;
+	std::shared_ptr <std::vector <uint8_t>> bytes;
+};
+class generated_votes
+{
+public:
+	rai::block_hash root;
+	rai::block_hash hash;
+	std::chrono::steady_clock::time_point created;
+	std::vector <rai::generated_vote> votes;
+};
+// Votes our representatives signed in answer to confirm_req, keyed by the root they vote on
+// A request for a different block on the same root is signed again and replaces the entry
+// Votes are only reused while they carry their representative's latest sequence, peers drop anything older as a replay
+class vote_cache
+{
+public:
+	vote_cache (rai::node &);
+	// Cached votes for hash, empty if we haven't voted for it or any of them has been superseded by a later vote from the same representative
+	std::vector <rai::generated_vote> find (MDB_txn *, rai::block_hash const &, rai::block_hash const &);
+	void add (rai::block_hash const &, rai::block_hash const &, std::vector <rai::generated_vote> const &);
+	boost::multi_index_container
+	<
+		rai::generated_votes,
+		boost::multi_index::indexed_by
+		<
+			boost::multi_index::sequenced <>,
+			boost::multi_index::hashed_unique <boost::multi_index::member <generated_votes, rai::block_hash, &generated_votes::root>>
+		>
+	> votes;
+	rai::node & node;
+	// Votes signed for confirm_req
+	std::atomic <uint64_t> signatures;
+	// Votes served from the cache instead of being signed
+	std::atomic <uint64_t> hits;
+	std::mutex mutex;
+	static size_t constexpr max = 4096;
+	static std::chrono::seconds constexpr max_age = std::chrono::seconds (rai::rai_network == rai::rai_networks::rai_test_network ? 1 : 15);
+};
+class work_value_information
+{
+public:
+	rai::block_hash hash;
+	uint64_t value;
+};
 // Processing blocks is a potentially long IO operation
 // This class isolates block insertion from other operations like servicing network operations
 class block_processor
@@ -415,13 +1295,43 @@ public:
     void stop ();
     void flush ();
     void add (std::shared_ptr <rai::block>, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)> = [] (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>) {});
-    void process_receive_many (std::shared_ptr <rai::block>, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)> = [] (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>) {});
-    rai::process_return process_receive_one (MDB_txn *, std::shared_ptr <rai::block>);
+    // Process a batch in order, checking the signatures of independent accounts in parallel first
+    void process_batch (std::deque <std::pair <std::shared_ptr <rai::block>, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)>>> const &);
+    void process_receive_many (std::shared_ptr <rai::block>, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)> = [] (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>) {}, rai::account const & = rai::account (0));
+    rai::process_return process_receive_one (MDB_txn *, std::shared_ptr <rai::block>, rai::account const & = rai::account (0));
+	rai::dependency_graph dependencies;
+	// Duplicates already stored with equal or better work
+	std::atomic <uint64_t> duplicates_fast;
+	// Duplicates whose stored work was unknown or lower, checked for replacement in the background
+	std::atomic <uint64_t> duplicates_slow;
+	std::atomic <uint64_t> duplicates_replaced;
+	static size_t constexpr work_values_max = rai::rai_network == rai::rai_networks::rai_test_network ? 256 : 65536;
+	static size_t constexpr batch_max = 256;
+	// Is the block queued, being processed or waiting on a dependency in memory
+	bool have (rai::block_hash const &);
 private:
 	void process_blocks ();
+	// Account whose signature each block carries, zero where the signature couldn't be checked ahead of the ledger
+	std::vector <rai::account> verify_batch (std::deque <std::pair <std::shared_ptr <rai::block>, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)>>> const &);
+	void replace (std::shared_ptr <rai::block>);
+	bool stored_work_covers (rai::block_hash const &, uint64_t);
+	void stored_work_update (rai::block_hash const &, uint64_t);
+	// Work value of blocks known to be in the ledger, most recently seen last
+	boost::multi_index_container
+	<
+		rai::work_value_information,
+		boost::multi_index::indexed_by
+		<
+			boost::multi_index::sequenced <>,
+			boost::multi_index::hashed_unique <boost::multi_index::member <work_value_information, rai::block_hash, &work_value_information::hash>>
+		>
+	> work_values;
+	std::mutex work_values_mutex;
 	bool stopped;
     bool idle;
 	std::deque <std::pair <std::shared_ptr <rai::block>, std::function <void (MDB_txn *, rai::process_return, std::shared_ptr <rai::block>)>>> blocks;
+	// Hashes of blocks from add that haven't finished processing
+	std::unordered_multiset <rai::block_hash> queued;
 	std::mutex mutex;
 	std::condition_variable condition;
 	rai::node & node;
@@ -445,6 +1355,8 @@ public:
     std::shared_ptr <rai::node> shared ();
 	int store_version ();
     void process_confirmed (std::shared_ptr <rai::block>);
+	// Raise confirmation heights for these blocks and their dependencies, confirm_batch blocks per write transaction
+	void confirm_heights (std::vector <rai::block_hash> const &);
 	void process_message (rai::message &, rai::endpoint const &);
     void process_receive_republish (std::shared_ptr <rai::block>);
 	rai::process_return process (rai::block const &);
@@ -460,6 +1372,7 @@ public:
 	void ongoing_bootstrap ();
 	void ongoing_vote_flush ();
 	void backup_wallet ();
+	void ongoing_wallet_reps ();
 	int price (rai::uint128_t const &, int);
 	void generate_work (rai::block &);
 	uint64_t generate_work (rai::uint256_union const &);
@@ -478,19 +1391,30 @@ public:
     rai::network network;
 	rai::bootstrap_initiator bootstrap_initiator;
     rai::bootstrap_listener bootstrap;
+	rai::realtime_channels channels;
     rai::peer_container peers;
 	boost::filesystem::path application_path;
 	rai::node_observers observers;
 	rai::port_mapping port_mapping;
-	rai::vote_processor vote_processor;
 	rai::rep_crawler rep_crawler;
 	unsigned warmed_up;
+	rai::signature_checker checker;
+	rai::vote_cache vote_cache;
+	rai::pull_cache pull_cache;
+	rai::vote_generator vote_generator;
+	rai::online_reps online_reps;
+	rai::confirmation_stats confirmation_stats;
+	// Declared after everything its thread uses so the thread is joined before they're destroyed
+	rai::vote_processor vote_processor;
     rai::block_processor block_processor;
 	static double constexpr price_max = 16.0;
 	static double constexpr free_cutoff = 1024.0;
     static std::chrono::seconds constexpr period = std::chrono::seconds (60);
     static std::chrono::seconds constexpr cutoff = period * 5;
 	static std::chrono::minutes constexpr backup_interval = std::chrono::minutes (5);
+	// Catches representatives that gained weight through receives rather than open or change blocks
+	static std::chrono::minutes constexpr wallet_reps_interval = std::chrono::minutes (5);
+	static size_t constexpr confirm_batch = 4096;
 };
 class thread_runner
 {
@@ -283,6 +283,7 @@ void rai::rpc_handler::account_info ()
 			response_l.put ("balance", balance);
 			response_l.put ("modified_timestamp", std::to_string (info.modified));
 			response_l.put ("block_count", std::to_string (info.block_count));
+			response_l.put ("confirmation_height", std::to_string (node.store.confirmation_height_get (transaction, account)));
 			response (response_l);
 		}
 		else
@@ -832,7 +833,7 @@ void rai::rpc_handler::block_count ()
 	rai::transaction transaction (node.store.environment, nullptr, false);
 	boost::property_tree::ptree response_l;
 	response_l.put ("count", std::to_string (node.store.block_count (transaction).sum ()));
-	response_l.put ("unchecked", std::to_string (node.store.unchecked_count (transaction)));
+	response_l.put ("unchecked", std::to_string (node.store.unchecked_count (transaction) + node.block_processor.dependencies.size ()));
 	response (response_l);
 }
 
@@ -967,6 +968,17 @@ void rai::rpc_handler::chain ()
 	}
 }
 
+void rai::rpc_handler::confirmation_stats ()
+{
+	boost::property_tree::ptree response_l;
+	node.confirmation_stats.serialize (response_l);
+	response_l.put ("already_confirmed", std::to_string (node.active.already_confirmed));
+	boost::property_tree::ptree gaps_l;
+	node.gap_cache.serialize (gaps_l);
+	response_l.add_child ("gaps", gaps_l);
+	response (response_l);
+}
+
 void rai::rpc_handler::delegators ()
 {
 	std::string account_text (request.get <std::string> ("account"));
@@ -1394,7 +1406,7 @@ void rai::rpc_handler::password_change ()
 				rai::transaction transaction (node.store.environment, nullptr, true);
 				boost::property_tree::ptree response_l;
 				std::string password_text (request.get <std::string> ("password"));
-				auto error (existing->second->store.rekey (transaction, password_text));
+				auto error (existing->second->rekey (transaction, password_text));
 				response_l.put ("changed", error ? "0" : "1");
 				response (response_l);
 			}
@@ -2222,6 +2234,103 @@ void rai::rpc_handler::send ()
 	}
 }
 
+void rai::rpc_handler::send_queue ()
+{
+	boost::property_tree::ptree response_l;
+	node.network.send_queue.serialize (response_l);
+	response (response_l);
+}
+
+void rai::rpc_handler::stats_peers ()
+{
+	uint64_t count (16);
+	auto error (false);
+	boost::optional <std::string> count_text (request.get_optional <std::string> ("count"));
+	if (count_text.is_initialized ())
+	{
+		error = decode_unsigned (count_text.get (), count);
+	}
+	if (!error)
+	{
+		std::string sort_l (request.get <std::string> ("sort", "bytes_in"));
+		std::function <uint64_t (rai::peer_traffic const &)> key;
+		// Sort by one message type when asked, otherwise by the sum over all types
+		boost::optional <std::string> type_text (request.get_optional <std::string> ("type"));
+		auto type_index (rai::message_types);
+		if (type_text.is_initialized ())
+		{
+			for (size_t i (0); i < rai::message_types; ++i)
+			{
+				if (type_text.get () == rai::message_type_name (static_cast <rai::message_type> (i)))
+				{
+					type_index = i;
+				}
+			}
+		}
+		auto counter ([type_index] (std::array <uint64_t, rai::message_types> const & counts_a)
+		{
+			return type_index < rai::message_types ? counts_a [type_index] : rai::peer_traffic::total (counts_a);
+		});
+		if (sort_l == "bytes_in")
+		{
+			key = [counter] (rai::peer_traffic const & traffic_a) { return counter (traffic_a.bytes_in); };
+		}
+		else if (sort_l == "bytes_out")
+		{
+			key = [counter] (rai::peer_traffic const & traffic_a) { return counter (traffic_a.bytes_out); };
+		}
+		else if (sort_l == "messages_in")
+		{
+			key = [counter] (rai::peer_traffic const & traffic_a) { return counter (traffic_a.messages_in); };
+		}
+		else if (sort_l == "messages_out")
+		{
+			key = [counter] (rai::peer_traffic const & traffic_a) { return counter (traffic_a.messages_out); };
+		}
+		else if (sort_l == "dropped")
+		{
+			key = [] (rai::peer_traffic const & traffic_a) { return traffic_a.dropped_total (); };
+		}
+		if (key != nullptr && (!type_text.is_initialized () || type_index < rai::message_types))
+		{
+			auto list (node.network.peer_traffic.list ());
+			auto end (list.begin () + std::min <uint64_t> (count, list.size ()));
+			std::partial_sort (list.begin (), end, list.end (), [&key] (std::pair <rai::endpoint, rai::peer_traffic> const & lhs, std::pair <rai::endpoint, rai::peer_traffic> const & rhs)
+			{
+				return key (lhs.second) > key (rhs.second);
+			});
+			boost::property_tree::ptree response_l;
+			// The overflow entry pools peers past the table limit, it isn't a tracked peer
+			auto overflow_l (std::any_of (list.begin (), list.end (), [] (std::pair <rai::endpoint, rai::peer_traffic> const & entry_a)
+			{
+				return entry_a.first == rai::endpoint ();
+			}));
+			response_l.put ("tracked", std::to_string (list.size () - (overflow_l ? 1 : 0)));
+			response_l.put ("overflow", overflow_l ? "true" : "false");
+			boost::property_tree::ptree peers_l;
+			for (auto i (list.begin ()); i != end; ++i)
+			{
+				boost::property_tree::ptree entry;
+				std::stringstream text;
+				text << i->first;
+				entry.put ("endpoint", text.str ());
+				i->second.serialize (entry);
+				peers_l.push_back (std::make_pair ("", entry));
+			}
+			response_l.add_child ("peers", peers_l);
+			response (response_l);
+		}
+		else
+		{
+			error_response (response, type_text.is_initialized () && type_index == rai::message_types ? "Invalid message type" : "Invalid sort");
+		}
+	}
+	else
+	{
+		error_response (response, "Invalid count limit");
+	}
+}
+
 void rai::rpc_handler::stop ()
 {
 	if (rpc.config.enable_control)
@@ -2235,6 +2344,25 @@ void rai::rpc_handler::stop ()
 	}
 }
 
+void rai::rpc_handler::traffic ()
+{
+	boost::property_tree::ptree response_l;
+	boost::property_tree::ptree incoming_l;
+	node.network.incoming.serialize (incoming_l);
+	response_l.add_child ("incoming", incoming_l);
+	boost::property_tree::ptree outgoing_l;
+	node.network.outgoing.serialize (outgoing_l);
+	response_l.add_child ("outgoing", outgoing_l);
+	boost::property_tree::ptree pulls_l;
+	node.pull_cache.serialize (pulls_l);
+	pulls_l.put ("served_refused", std::to_string (node.network.publish_req_limits.refused));
+	response_l.add_child ("pulls", pulls_l);
+	boost::property_tree::ptree channels_l;
+	node.channels.serialize (channels_l);
+	response_l.add_child ("channels", channels_l);
+	response (response_l);
+}
+
 void rai::rpc_handler::unchecked ()
 {
 	uint64_t count (std::numeric_limits <uint64_t>::max ());
@@ -2262,6 +2390,17 @@ void rai::rpc_handler::unchecked ()
 		block->serialize_json (contents);
 		unchecked.put(block->hash ().to_string (), contents);
 	}
+	// Blocks still held in memory by the block processor
+	if (unchecked.size () < count)
+	{
+		auto waiting (node.block_processor.dependencies.list (rai::block_hash (0), count - unchecked.size ()));
+		for (auto & i: waiting)
+		{
+			std::string contents;
+			i.second->serialize_json (contents);
+			unchecked.put (i.second->hash ().to_string (), contents);
+		}
+	}
 	response_l.add_child ("blocks", unchecked);
 	response (response_l);
 }
@@ -2271,7 +2410,7 @@ void rai::rpc_handler::unchecked_clear ()
 	if (rpc.config.enable_control)
 	{
 		rai::transaction transaction (node.store.environment, nullptr, true);
-		node.store.unchecked_clear (transaction);
+		node.block_processor.dependencies.clear (transaction);
 		boost::property_tree::ptree response_l;
 		response_l.put ("success", "");
 		response (response_l);
@@ -2290,8 +2429,15 @@ void rai::rpc_handler::unchecked_get ()
 	if (!error)
 	{
 		boost::property_tree::ptree response_l;
+		auto waiting (node.block_processor.dependencies.find (hash));
+		if (waiting != nullptr)
+		{
+			std::string contents;
+			waiting->serialize_json (contents);
+			response_l.put ("contents", contents);
+		}
 		rai::transaction transaction (node.store.environment, nullptr, false);
-		for (auto i (node.store.unchecked_begin (transaction)), n (node.store.unchecked_end ()); i != n; ++i)
+		for (auto i (node.store.unchecked_begin (transaction)), n (node.store.unchecked_end ()); response_l.empty () && i != n; ++i)
 		{
 			rai::bufferstream stream (reinterpret_cast <uint8_t const *> (i->second.mv_data), i->second.mv_size);
 			auto block (rai::deserialize_block (stream));
@@ -2350,23 +2496,53 @@ void rai::rpc_handler::unchecked_keys ()
 	}
 	boost::property_tree::ptree response_l;
 	boost::property_tree::ptree unchecked;
-	rai::transaction transaction (node.store.environment, nullptr, false);
-	for (auto i (node.store.unchecked_begin (transaction, key)), n (node.store.unchecked_end ()); i != n && unchecked.size () < count; ++i)
+	// Spilled entries and those still in memory, merged in key order
+	auto waiting (node.block_processor.dependencies.list (key, count));
+	auto waiting_i (waiting.begin ());
+	auto put_entry ([&unchecked] (rai::block_hash const & key_a, rai::block const & block_a)
 	{
 		boost::property_tree::ptree entry;
-		rai::bufferstream stream (reinterpret_cast <uint8_t const *> (i->second.mv_data), i->second.mv_size);
-		auto block (rai::deserialize_block (stream));
 		std::string contents;
-		block->serialize_json (contents);
-		entry.put ("key", rai::block_hash (i->first).to_string ());
-		entry.put ("hash", block->hash ().to_string ());
+		block_a.serialize_json (contents);
+		entry.put ("key", key_a.to_string ());
+		entry.put ("hash", block_a.hash ().to_string ());
 		entry.put ("contents", contents);
 		unchecked.push_back (std::make_pair ("", entry));
+	});
+	rai::transaction transaction (node.store.environment, nullptr, false);
+	for (auto i (node.store.unchecked_begin (transaction, key)), n (node.store.unchecked_end ()); i != n && unchecked.size () < count; ++i)
+	{
+		rai::block_hash key_l (i->first);
+		for (; waiting_i != waiting.end () && waiting_i->first < key_l && unchecked.size () < count; ++waiting_i)
+		{
+			put_entry (waiting_i->first, *waiting_i->second);
+		}
+		if (unchecked.size () < count)
+		{
+			rai::bufferstream stream (reinterpret_cast <uint8_t const *> (i->second.mv_data), i->second.mv_size);
+			auto block (rai::deserialize_block (stream));
+			put_entry (key_l, *block);
+		}
+	}
+	for (; waiting_i != waiting.end () && unchecked.size () < count; ++waiting_i)
+	{
+		put_entry (waiting_i->first, *waiting_i->second);
 	}
 	response_l.add_child ("unchecked", unchecked);
 	response (response_l);
 }
 
+void rai::rpc_handler::unchecked_stats ()
+{
+	auto & dependencies (node.block_processor.dependencies);
+	boost::property_tree::ptree response_l;
+	response_l.put ("waiting", std::to_string (dependencies.size ()));
+	response_l.put ("spilled", std::to_string (dependencies.spilled_count ()));
+	response_l.put ("depth", std::to_string (dependencies.depth ()));
+	response_l.put ("age", std::to_string (std::chrono::duration_cast <std::chrono::seconds> (dependencies.age ()).count ()));
+	response (response_l);
+}
+
 void rai::rpc_handler::version ()
 {
 	boost::property_tree::ptree response_l;
@@ -3461,6 +3637,10 @@ void rai::rpc_handler::process_request ()
 		{
 			chain ();
 		}
+		else if (action == "confirmation_stats")
+		{
+			confirmation_stats ();
+		}
 		else if (action == "delegators")
 		{
 			delegators ();
@@ -3597,10 +3777,22 @@ void rai::rpc_handler::process_request ()
 		{
 			send ();
 		}
+		else if (action == "send_queue")
+		{
+			send_queue ();
+		}
+		else if (action == "stats_peers")
+		{
+			stats_peers ();
+		}
 		else if (action == "stop")
 		{
 			stop ();
 		}
+		else if (action == "traffic")
+		{
+			traffic ();
+		}
 		else if (action == "unchecked")
 		{
 			unchecked ();
@@ -3617,6 +3809,10 @@ void rai::rpc_handler::process_request ()
 		{
 			unchecked_keys ();
 		}
+		else if (action == "unchecked_stats")
+		{
+			unchecked_stats ();
+		}
 		else if (action == "validate_account_number")
 		{
 			validate_account_number ();
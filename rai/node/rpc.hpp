@@ -116,6 +116,7 @@ public:
 	void bootstrap ();
 	void bootstrap_any ();
 	void chain ();
+	void confirmation_stats ();
 	void delegators ();
 	void delegators_count ();
 	void deterministic_key ();
@@ -150,12 +151,16 @@ public:
 	void search_pending ();
 	void search_pending_all ();
 	void send ();
+	void send_queue ();
+	void stats_peers ();
 	void stop ();
 	void successors ();
+	void traffic ();
 	void unchecked ();
 	void unchecked_clear ();
 	void unchecked_get ();
 	void unchecked_keys ();
+	void unchecked_stats ();
 	void validate_account_number ();
 	void version ();
 	void wallet_add ();
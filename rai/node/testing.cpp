@@ -6,6 +6,19 @@
 rai::system::system (uint16_t port_a, size_t count_a) :
 alarm (service),
 work (1, nullptr)
+{
+	initialize (port_a, count_a, [] (rai::node_config &) {});
+}
+
+rai::system::system (uint16_t port_a, size_t count_a, rai::simulated_link const & link_a, std::function <void (rai::node_config &)> const & configure_a) :
+alarm (service),
+work (1, nullptr)
+{
+	simulation.reset (new rai::simulated_network (service, link_a));
+	initialize (port_a, count_a, configure_a);
+}
+
+void rai::system::initialize (uint16_t port_a, size_t count_a, std::function <void (rai::node_config &)> const & configure_a)
 {
 	logging.init (rai::unique_path ());
     nodes.reserve (count_a);
@@ -13,6 +26,11 @@ work (1, nullptr)
     {
         rai::node_init init;
 		rai::node_config config (port_a + i, logging);
+		if (simulation != nullptr)
+		{
+			config.transport = simulation->transport (port_a + i);
+		}
+		configure_a (config);
         auto node (std::make_shared <rai::node> (init, service, rai::unique_path (), alarm, config, work));
         assert (!init.error ());
         node->start ();
@@ -21,19 +39,34 @@ work (1, nullptr)
 		node->wallets.create (wallet);
         nodes.push_back (node);
     }
-    for (auto i (nodes.begin ()), j (nodes.begin () + 1), n (nodes.end ()); j != n; ++i, ++j)
-    {
-        auto starting1 ((*i)->peers.size ());
-        auto new1 (starting1);
-        auto starting2 ((*j)->peers.size ());
-        auto new2 (starting2);
-        (*j)->network.send_keepalive ((*i)->network.endpoint ());
-        do {
-            poll ();
-            new1 = (*i)->peers.size ();
-            new2 = (*j)->peers.size ();
-        } while (new1 == starting1 || new2 == starting2);
-    }
+	if (simulation != nullptr)
+	{
+		// Simulated links don't need the io_service so introduce every neighbour at once rather than one pair at a time
+		for (auto i (nodes.begin ()), j (nodes.begin () + 1), n (nodes.end ()); j != n; ++i, ++j)
+		{
+			(*j)->network.send_keepalive ((*i)->network.endpoint ());
+		}
+		while (nodes.size () > 1 && std::any_of (nodes.begin (), nodes.end (), [] (std::shared_ptr <rai::node> const & node_a) {return node_a->peers.empty ();}))
+		{
+			poll ();
+		}
+	}
+	else
+	{
+		for (auto i (nodes.begin ()), j (nodes.begin () + 1), n (nodes.end ()); j != n; ++i, ++j)
+		{
+			auto starting1 ((*i)->peers.size ());
+			auto new1 (starting1);
+			auto starting2 ((*j)->peers.size ());
+			auto new2 (starting2);
+			(*j)->network.send_keepalive ((*i)->network.endpoint ());
+			do {
+				poll ();
+				new1 = (*i)->peers.size ();
+				new2 = (*j)->peers.size ();
+			} while (new1 == starting1 || new2 == starting2);
+		}
+	}
 	auto iterations1 (0);
 	while (std::any_of (nodes.begin (), nodes.end (), [] (std::shared_ptr <rai::node> const & node_a) {return node_a->bootstrap_initiator.in_progress ();}))
 	{
@@ -49,6 +82,10 @@ rai::system::~system ()
     {
         i->stop ();
     }
+	if (simulation != nullptr)
+	{
+		simulation->stop ();
+	}
 }
 
 std::shared_ptr <rai::wallet> rai::system::wallet (size_t index_a)
@@ -498,3 +535,423 @@ void rai::landing::distribute_ongoing ()
 
 std::chrono::seconds constexpr rai::landing::distribution_interval;
 std::chrono::seconds constexpr rai::landing::sleep_seconds;
+
+rai::simulated_link::simulated_link () :
+latency (std::chrono::milliseconds (50)),
+jitter (std::chrono::milliseconds (10)),
+loss (0.0),
+bandwidth (0)
+{
+}
+
+rai::simulated_network::simulated_network (boost::asio::io_service & service_a, rai::simulated_link const & link_a) :
+service (service_a),
+link (link_a),
+stopped (false),
+thread ([this] () { run (); })
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	random_pool.GenerateBlock (reinterpret_cast <uint8_t *> (random.s.data ()), random.s.size () * sizeof (uint64_t));
+}
+
+rai::simulated_network::~simulated_network ()
+{
+	stop ();
+}
+
+void rai::simulated_network::stop ()
+{
+	std::multimap <std::chrono::steady_clock::time_point, std::function <void ()>> events_l;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		stopped = true;
+		events_l.swap (events);
+		condition.notify_all ();
+	}
+	if (thread.joinable ())
+	{
+		thread.join ();
+	}
+}
+
+std::shared_ptr <rai::simulated_transport> rai::simulated_network::transport (uint16_t port_a)
+{
+	return std::make_shared <rai::simulated_transport> (*this, rai::endpoint (boost::asio::ip::address_v6::loopback (), port_a));
+}
+
+void rai::simulated_network::schedule (std::chrono::steady_clock::time_point const & time_a, std::function <void ()> const & action_a)
+{
+	if (!stopped)
+	{
+		auto existing (events.insert (std::make_pair (time_a, action_a)));
+		if (existing == events.begin ())
+		{
+			condition.notify_all ();
+		}
+	}
+}
+
+std::chrono::steady_clock::time_point rai::simulated_network::departure (rai::simulated_transport & transport_a, size_t size_a)
+{
+	auto result (std::max (std::chrono::steady_clock::now (), transport_a.uplink_free));
+	if (link.bandwidth != 0)
+	{
+		result += std::chrono::microseconds (size_a * 1000000 / link.bandwidth);
+	}
+	transport_a.uplink_free = result;
+	return result;
+}
+
+std::chrono::microseconds rai::simulated_network::delay ()
+{
+	auto result (link.latency);
+	if (link.jitter.count () > 0)
+	{
+		result += std::chrono::microseconds (random.next () % (link.jitter.count () + 1));
+	}
+	return result;
+}
+
+bool rai::simulated_network::lost ()
+{
+	// Top 53 bits as a uniform double in [0, 1)
+	return link.loss > 0.0 && (random.next () >> 11) * (1.0 / 9007199254740992.0) < link.loss;
+}
+
+void rai::simulated_network::run ()
+{
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!stopped)
+	{
+		if (events.empty ())
+		{
+			condition.wait (lock);
+		}
+		else
+		{
+			auto first (events.begin ());
+			if (first->first <= std::chrono::steady_clock::now ())
+			{
+				auto action (std::move (first->second));
+				events.erase (first);
+				action ();
+				// Captures may hold the last reference to a node, release them without mutex
+				lock.unlock ();
+				action = nullptr;
+				lock.lock ();
+			}
+			else
+			{
+				condition.wait_until (lock, first->first);
+			}
+		}
+	}
+}
+
+rai::simulated_transport::simulated_transport (rai::simulated_network & simulation_a, rai::endpoint const & local_a) :
+simulation (simulation_a),
+local (local_a),
+receiver (nullptr),
+uplink_free (std::chrono::steady_clock::now ()),
+bytes_sent (0),
+bytes_received (0),
+datagrams_sent (0),
+datagrams_received (0),
+datagrams_lost (0)
+{
+	std::lock_guard <std::mutex> lock (simulation.mutex);
+	simulation.nodes [local] = this;
+}
+
+rai::simulated_transport::~simulated_transport ()
+{
+	std::lock_guard <std::mutex> lock (simulation.mutex);
+	auto existing (simulation.nodes.find (local));
+	if (existing != simulation.nodes.end () && existing->second == this)
+	{
+		simulation.nodes.erase (existing);
+	}
+}
+
+void rai::simulated_transport::start (rai::network & network_a)
+{
+	std::lock_guard <std::mutex> lock (simulation.mutex);
+	receiver = &network_a;
+}
+
+void rai::simulated_transport::stop ()
+{
+	std::function <void (std::shared_ptr <rai::socket>)> listener_l;
+	{
+		std::lock_guard <std::mutex> lock (simulation.mutex);
+		receiver = nullptr;
+		listener_l.swap (listener);
+	}
+}
+
+void rai::simulated_transport::send (std::vector <rai::send_info> & sends_a)
+{
+	{
+		std::lock_guard <std::mutex> lock (simulation.mutex);
+		auto simulation_l (&simulation);
+		auto source (local);
+		for (auto & i: sends_a)
+		{
+			bytes_sent += i.size;
+			++datagrams_sent;
+			auto arrival (simulation.departure (*this, i.size) + simulation.delay ());
+			if (!simulation.lost ())
+			{
+				auto data (std::make_shared <std::vector <uint8_t>> (i.data, i.data + i.size));
+				auto destination (i.endpoint);
+				simulation.schedule (arrival, [simulation_l, data, source, destination] ()
+				{
+					auto existing (simulation_l->nodes.find (destination));
+					if (existing != simulation_l->nodes.end () && existing->second->receiver != nullptr)
+					{
+						existing->second->bytes_received += data->size ();
+						++existing->second->datagrams_received;
+						existing->second->receiver->receive_packet (data->data (), data->size (), source);
+					}
+				});
+			}
+			else
+			{
+				++datagrams_lost;
+			}
+		}
+	}
+	// Like UDP, a datagram counts as sent once it's handed over
+	for (auto & i: sends_a)
+	{
+		i.callback (boost::system::error_code (), i.size);
+	}
+}
+
+rai::endpoint rai::simulated_transport::endpoint ()
+{
+	return local;
+}
+
+std::shared_ptr <rai::socket> rai::simulated_transport::connection ()
+{
+	return std::make_shared <rai::simulated_socket> (simulation, local);
+}
+
+void rai::simulated_transport::listen (std::function <void (std::shared_ptr <rai::socket>)> listener_a)
+{
+	std::lock_guard <std::mutex> lock (simulation.mutex);
+	listener = listener_a;
+}
+
+rai::simulated_socket::simulated_socket (rai::simulated_network & simulation_a, rai::endpoint const & local_a) :
+simulation (simulation_a),
+local (local_a),
+read_data (nullptr),
+read_size (0),
+last_arrival (std::chrono::steady_clock::now ()),
+closed (false),
+peer_closed (false)
+{
+}
+
+void rai::simulated_socket::async_connect (rai::tcp_endpoint const & endpoint_a, std::function <void (boost::system::error_code const &)> callback_a)
+{
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		remote = endpoint_a;
+	}
+	auto this_l (shared_from_this ());
+	auto simulation_l (&simulation);
+	rai::endpoint destination (endpoint_a.address (), endpoint_a.port ());
+	std::lock_guard <std::mutex> lock (simulation.mutex);
+	auto latency (simulation.link.latency);
+	simulation.schedule (std::chrono::steady_clock::now () + latency, [this_l, simulation_l, destination, latency, callback_a] ()
+	{
+		auto existing (simulation_l->nodes.find (destination));
+		if (existing != simulation_l->nodes.end () && existing->second->listener != nullptr)
+		{
+			auto server (std::make_shared <rai::simulated_socket> (*simulation_l, destination));
+			server->remote = rai::tcp_endpoint (this_l->local.address (), this_l->local.port ());
+			server->peer = this_l;
+			{
+				std::lock_guard <std::mutex> lock (this_l->mutex);
+				this_l->peer = server;
+			}
+			auto listener (existing->second->listener);
+			simulation_l->service.post ([listener, server] ()
+			{
+				listener (server);
+			});
+			// The accept takes another trip back to the connecting side
+			simulation_l->schedule (std::chrono::steady_clock::now () + latency, [simulation_l, callback_a] ()
+			{
+				simulation_l->service.post ([callback_a] ()
+				{
+					callback_a (boost::system::error_code ());
+				});
+			});
+		}
+		else
+		{
+			simulation_l->service.post ([callback_a] ()
+			{
+				callback_a (boost::asio::error::connection_refused);
+			});
+		}
+	});
+}
+
+void rai::simulated_socket::async_read (uint8_t * data_a, size_t size_a, std::function <void (boost::system::error_code const &, size_t)> callback_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	if (!closed)
+	{
+		assert (read_callback == nullptr);
+		read_data = data_a;
+		read_size = size_a;
+		read_callback = callback_a;
+		fill ();
+	}
+	else
+	{
+		simulation.service.post ([callback_a] ()
+		{
+			callback_a (boost::asio::error::operation_aborted, 0);
+		});
+	}
+}
+
+void rai::simulated_socket::async_write (uint8_t const * data_a, size_t size_a, std::function <void (boost::system::error_code const &, size_t)> callback_a)
+{
+	std::shared_ptr <rai::simulated_socket> peer_l;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		if (!closed)
+		{
+			peer_l = peer.lock ();
+		}
+	}
+	if (peer_l != nullptr)
+	{
+		auto data (std::make_shared <std::vector <uint8_t>> (data_a, data_a + size_a));
+		auto simulation_l (&simulation);
+		std::lock_guard <std::mutex> lock (simulation.mutex);
+		auto now (std::chrono::steady_clock::now ());
+		auto departure (now);
+		auto existing (simulation.nodes.find (local));
+		if (existing != simulation.nodes.end ())
+		{
+			existing->second->bytes_sent += size_a;
+			departure = simulation.departure (*existing->second, size_a);
+		}
+		last_arrival = std::max (last_arrival, departure + simulation.link.latency);
+		simulation.schedule (departure, [simulation_l, callback_a, size_a] ()
+		{
+			simulation_l->service.post ([callback_a, size_a] ()
+			{
+				callback_a (boost::system::error_code (), size_a);
+			});
+		});
+		simulation.schedule (last_arrival, [simulation_l, peer_l, data] ()
+		{
+			auto existing (simulation_l->nodes.find (peer_l->local));
+			if (existing != simulation_l->nodes.end ())
+			{
+				existing->second->bytes_received += data->size ();
+			}
+			peer_l->arrive (*data);
+		});
+	}
+	else
+	{
+		simulation.service.post ([callback_a] ()
+		{
+			callback_a (boost::asio::error::broken_pipe, 0);
+		});
+	}
+}
+
+void rai::simulated_socket::close ()
+{
+	std::shared_ptr <rai::simulated_socket> peer_l;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		if (!closed)
+		{
+			closed = true;
+			peer_l = peer.lock ();
+			buffer.clear ();
+			if (read_callback != nullptr)
+			{
+				auto callback (read_callback);
+				read_callback = nullptr;
+				simulation.service.post ([callback] ()
+				{
+					callback (boost::asio::error::operation_aborted, 0);
+				});
+			}
+		}
+	}
+	if (peer_l != nullptr)
+	{
+		std::lock_guard <std::mutex> lock (simulation.mutex);
+		// Behind anything already written
+		last_arrival = std::max (last_arrival, std::chrono::steady_clock::now () + simulation.link.latency);
+		simulation.schedule (last_arrival, [peer_l] ()
+		{
+			peer_l->hang_up ();
+		});
+	}
+}
+
+rai::tcp_endpoint rai::simulated_socket::remote_endpoint ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	return remote;
+}
+
+void rai::simulated_socket::arrive (std::vector <uint8_t> const & data_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	if (!closed)
+	{
+		buffer.insert (buffer.end (), data_a.begin (), data_a.end ());
+		fill ();
+	}
+}
+
+void rai::simulated_socket::hang_up ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	peer_closed = true;
+	fill ();
+}
+
+void rai::simulated_socket::fill ()
+{
+	if (read_callback != nullptr)
+	{
+		if (buffer.size () >= read_size)
+		{
+			std::copy (buffer.begin (), buffer.begin () + read_size, read_data);
+			buffer.erase (buffer.begin (), buffer.begin () + read_size);
+			auto callback (read_callback);
+			auto size (read_size);
+			read_callback = nullptr;
+			simulation.service.post ([callback, size] ()
+			{
+				callback (boost::system::error_code (), size);
+			});
+		}
+		else if (peer_closed)
+		{
+			auto callback (read_callback);
+			read_callback = nullptr;
+			simulation.service.post ([callback] ()
+			{
+				callback (boost::asio::error::eof, 0);
+			});
+		}
+	}
+}
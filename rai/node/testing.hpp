@@ -1,13 +1,116 @@
 #pragma once
 
 #include <rai/node/node.hpp>
+#include <rai/node/xorshift.hpp>
+
+#include <map>
 
 namespace rai
 {
+// Conditions every datagram and stream write meets on a rai::simulated_network
+class simulated_link
+{
+public:
+	simulated_link ();
+	// One way delay, each datagram waits up to jitter longer at random
+	std::chrono::microseconds latency;
+	std::chrono::microseconds jitter;
+	// Chance a datagram is dropped, streams are reliable
+	double loss;
+	// Outbound bytes per second of each node, 0 is unlimited
+	uint64_t bandwidth;
+};
+class simulated_network;
+class simulated_transport : public rai::transport
+{
+public:
+	simulated_transport (rai::simulated_network &, rai::endpoint const &);
+	~simulated_transport ();
+	void start (rai::network &) override;
+	void stop () override;
+	void send (std::vector <rai::send_info> &) override;
+	rai::endpoint endpoint () override;
+	std::shared_ptr <rai::socket> connection () override;
+	void listen (std::function <void (std::shared_ptr <rai::socket>)>) override;
+	rai::simulated_network & simulation;
+	rai::endpoint local;
+	// Fields below are guarded by simulation.mutex
+	rai::network * receiver;
+	std::function <void (std::shared_ptr <rai::socket>)> listener;
+	// When everything queued on this node's uplink has left
+	std::chrono::steady_clock::time_point uplink_free;
+	std::atomic <uint64_t> bytes_sent;
+	std::atomic <uint64_t> bytes_received;
+	std::atomic <uint64_t> datagrams_sent;
+	std::atomic <uint64_t> datagrams_received;
+	std::atomic <uint64_t> datagrams_lost;
+};
+class simulated_socket : public rai::socket, public std::enable_shared_from_this <rai::simulated_socket>
+{
+public:
+	simulated_socket (rai::simulated_network &, rai::endpoint const &);
+	void async_connect (rai::tcp_endpoint const &, std::function <void (boost::system::error_code const &)>) override;
+	void async_read (uint8_t *, size_t, std::function <void (boost::system::error_code const &, size_t)>) override;
+	void async_write (uint8_t const *, size_t, std::function <void (boost::system::error_code const &, size_t)>) override;
+	void close () override;
+	rai::tcp_endpoint remote_endpoint () override;
+	// Bytes written by the other end have arrived
+	void arrive (std::vector <uint8_t> const &);
+	// The other end closed
+	void hang_up ();
+	// Complete the pending read if there's enough buffered, called with mutex held
+	void fill ();
+	rai::simulated_network & simulation;
+	rai::endpoint local;
+	std::mutex mutex;
+	rai::tcp_endpoint remote;
+	std::weak_ptr <rai::simulated_socket> peer;
+	std::deque <uint8_t> buffer;
+	uint8_t * read_data;
+	size_t read_size;
+	std::function <void (boost::system::error_code const &, size_t)> read_callback;
+	// Guarded by simulation.mutex, writes arrive in the order they were made
+	std::chrono::steady_clock::time_point last_arrival;
+	bool closed;
+	bool peer_closed;
+};
+// Carries datagrams and bootstrap streams between nodes in memory so a thousand nodes fit on one machine
+// Delivery runs on its own thread, stream callbacks are posted to the io_service, must outlive every node using it
+class simulated_network
+{
+public:
+	simulated_network (boost::asio::io_service &, rai::simulated_link const &);
+	~simulated_network ();
+	// Stop delivering and drop everything in flight
+	void stop ();
+	// Transport for a node reachable at loopback:port
+	std::shared_ptr <rai::simulated_transport> transport (uint16_t);
+	// Run action at the given time on the delivery thread with mutex held, called with mutex held
+	void schedule (std::chrono::steady_clock::time_point const &, std::function <void ()> const &);
+	// When size bytes sent now by a node have left its uplink, called with mutex held
+	std::chrono::steady_clock::time_point departure (rai::simulated_transport &, size_t);
+	// Latency plus random jitter, called with mutex held
+	std::chrono::microseconds delay ();
+	// Whether to drop a datagram, called with mutex held
+	bool lost ();
+	void run ();
+	boost::asio::io_service & service;
+	rai::simulated_link link;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::unordered_map <rai::endpoint, rai::simulated_transport *> nodes;
+	std::multimap <std::chrono::steady_clock::time_point, std::function <void ()>> events;
+	rai::xorshift1024star random;
+	bool stopped;
+	std::thread thread;
+};
 class system
 {
 public:
     system (uint16_t, size_t);
+	// Nodes talk over a rai::simulated_network instead of sockets, the function can change each node's config before it starts
+    system (uint16_t, size_t, rai::simulated_link const &, std::function <void (rai::node_config &)> const & = [] (rai::node_config &) {});
+	void initialize (uint16_t, size_t, std::function <void (rai::node_config &)> const &);
     ~system ();
     void generate_activity (rai::node &, std::vector <rai::account> &);
     void generate_mass_activity (uint32_t, rai::node &);
@@ -25,6 +128,8 @@ public:
     rai::account account (MDB_txn *, size_t);
 	void poll ();
 	void stop ();
+	// Declared first so it outlives handlers left in service that hold nodes
+	std::unique_ptr <rai::simulated_network> simulation;
     boost::asio::io_service service;
     rai::alarm alarm;
     std::vector <std::shared_ptr <rai::node>> nodes;
@@ -858,6 +858,7 @@ bool rai::wallet::enter_password (std::string const & password_a)
 {
 	rai::transaction transaction (store.environment, nullptr, false);
 	auto result (store.attempt_password (transaction, password_a));
+	representative_keys_load (transaction);
 	if (!result)
 	{
 		auto this_l (shared_from_this ());
@@ -870,6 +871,74 @@ bool rai::wallet::enter_password (std::string const & password_a)
 	return result;
 }
 
+bool rai::wallet::rekey (MDB_txn * transaction_a, std::string const & password_a)
+{
+	auto result (store.rekey (transaction_a, password_a));
+	representative_keys_load (transaction_a);
+	return result;
+}
+
+void rai::wallet::lock ()
+{
+	std::lock_guard <std::mutex> lock (representatives_mutex);
+	representative_keys.clear ();
+	rai::raw_key empty;
+	empty.data.clear ();
+	store.password.value_set (empty);
+}
+
+void rai::wallet::representative_keys_load (MDB_txn * transaction_a)
+{
+	std::lock_guard <std::mutex> lock (representatives_mutex);
+	representative_keys.clear ();
+	if (store.valid_password (transaction_a))
+	{
+		for (auto & i: representatives)
+		{
+			std::unique_ptr <rai::raw_key> prv (new rai::raw_key);
+			if (!store.fetch (transaction_a, i, *prv))
+			{
+				representative_keys [i] = std::move (prv);
+			}
+		}
+	}
+}
+
+void rai::wallet::compute_reps (MDB_txn * transaction_a)
+{
+	std::unordered_set <rai::account> representatives_l;
+	for (auto i (store.begin (transaction_a)), n (store.end ()); i != n; ++i)
+	{
+		rai::account account (i->first);
+		if (!node.ledger.weight (transaction_a, account).is_zero ())
+		{
+			representatives_l.insert (account);
+		}
+	}
+	std::lock_guard <std::mutex> lock (representatives_mutex);
+	for (auto i (representative_keys.begin ()), n (representative_keys.end ()); i != n;)
+	{
+		if (representatives_l.find (i->first) == representatives_l.end ())
+		{
+			i = representative_keys.erase (i);
+		}
+		else
+		{
+			++i;
+		}
+	}
+	representatives.swap (representatives_l);
+}
+
+void rai::wallet::representative_check (MDB_txn * transaction_a, rai::account const & account_a)
+{
+	if (!node.ledger.weight (transaction_a, account_a).is_zero ())
+	{
+		std::lock_guard <std::mutex> lock (representatives_mutex);
+		representatives.insert (account_a);
+	}
+}
+
 rai::public_key rai::wallet::deterministic_insert (MDB_txn * transaction_a)
 {
 	rai::public_key key (0);
@@ -877,6 +946,7 @@ rai::public_key rai::wallet::deterministic_insert (MDB_txn * transaction_a)
 	{
 		key = store.deterministic_insert (transaction_a);
 		work_ensure (transaction_a, key);
+		representative_check (transaction_a, key);
 	}
 	return key;
 }
@@ -895,6 +965,7 @@ rai::public_key rai::wallet::insert_adhoc (MDB_txn * transaction_a, rai::raw_key
 	{
 		key = store.insert_adhoc (transaction_a, key_a);
 		work_ensure (transaction_a, key);
+		representative_check (transaction_a, key);
 	}
 	return key;
 }
@@ -1359,6 +1430,7 @@ node (node_a)
 			auto wallet (std::make_shared <rai::wallet> (error, transaction, node_a, text));
 			if (!error)
 			{
+				wallet->compute_reps (transaction);
 				node_a.background ([wallet] ()
 				{
 					wallet->enter_initial_password ();
@@ -1376,6 +1448,7 @@ node (node_a)
 std::shared_ptr <rai::wallet> rai::wallets::open (rai::uint256_union const & id_a)
 {
     std::shared_ptr <rai::wallet> result;
+	std::lock_guard <std::mutex> lock (mutex);
     auto existing (items.find (id_a));
     if (existing != items.end ())
     {
@@ -1386,12 +1459,13 @@ std::shared_ptr <rai::wallet> rai::wallets::open (rai::uint256_union const & id_
 
 std::shared_ptr <rai::wallet> rai::wallets::create (rai::uint256_union const & id_a)
 {
-    assert (items.find (id_a) == items.end ());
     std::shared_ptr <rai::wallet> result;
     bool error;
 	{
 		rai::transaction transaction (node.store.environment, nullptr, true);
 		result = std::make_shared <rai::wallet> (error, transaction, node, id_a.to_string ());
+		std::lock_guard <std::mutex> lock (mutex);
+		assert (items.find (id_a) == items.end ());
         items [id_a] = result;
         result = result;
 	}
@@ -1429,10 +1503,14 @@ void rai::wallets::search_pending_all ()
 void rai::wallets::destroy (rai::uint256_union const & id_a)
 {
 	rai::transaction transaction (node.store.environment, nullptr, true);
-	auto existing (items.find (id_a));
-	assert (existing != items.end ());
-	auto wallet (existing->second);
-	items.erase (existing);
+	std::shared_ptr <rai::wallet> wallet;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		auto existing (items.find (id_a));
+		assert (existing != items.end ());
+		wallet = existing->second;
+		items.erase (existing);
+	}
 	wallet->store.destroy (transaction);
 }
 
@@ -1480,33 +1558,88 @@ void rai::wallets::queue_wallet_action (rai::account const & account_a, rai::uin
 
 void rai::wallets::foreach_representative (MDB_txn * transaction_a, std::function <void (rai::public_key const & pub_a, rai::raw_key const & prv_a)> const & action_a)
 {
+	std::lock_guard <std::mutex> lock (mutex);
     for (auto i (items.begin ()), n (items.end ()); i != n; ++i)
     {
         auto & wallet (*i->second);
-		for (auto j (wallet.store.begin (transaction_a)), m (wallet.store.end ()); j != m; ++j)
-        {
-			rai::account account (j->first);
-			if (!node.ledger.weight (transaction_a, account).is_zero ())
+		std::lock_guard <std::mutex> representatives_lock (wallet.representatives_mutex);
+		if (!wallet.representatives.empty ())
+		{
+			if (wallet.store.valid_password (transaction_a))
 			{
-				if (wallet.store.valid_password (transaction_a))
+				for (auto j (wallet.representatives.begin ()), m (wallet.representatives.end ()); j != m;)
 				{
-					rai::raw_key prv;
-					auto error (wallet.store.fetch (transaction_a, j->first, prv));
-					assert (!error);
-					action_a (j->first, prv);
-				}
-				else
-				{
-					BOOST_LOG (node.log) << boost::str (boost::format ("Skipping locked wallet %1% with account %2%") % i->first.to_string () % account.to_account ());
+					if (wallet.store.exists (transaction_a, *j))
+					{
+						if (!node.ledger.weight (transaction_a, *j).is_zero ())
+						{
+							auto & prv (wallet.representative_keys [*j]);
+							if (prv == nullptr)
+							{
+								prv.reset (new rai::raw_key);
+								auto error (wallet.store.fetch (transaction_a, *j, *prv));
+								assert (!error);
+							}
+							action_a (*j, *prv);
+						}
+						++j;
+					}
+					else
+					{
+						// Key was removed from the wallet since it was indexed
+						wallet.representative_keys.erase (*j);
+						j = wallet.representatives.erase (j);
+					}
 				}
 			}
-        }
+			else
+			{
+				wallet.representative_keys.clear ();
+				BOOST_LOG (node.log) << boost::str (boost::format ("Skipping locked wallet %1% with %2% representatives") % i->first.to_string () % wallet.representatives.size ());
+			}
+		}
     }
 }
 
+bool rai::wallets::have_representatives ()
+{
+	auto result (false);
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto i (items.begin ()), n (items.end ()); !result && i != n; ++i)
+	{
+		auto & wallet (*i->second);
+		std::lock_guard <std::mutex> representatives_lock (wallet.representatives_mutex);
+		result = !wallet.representatives.empty ();
+	}
+	return result;
+}
+
+void rai::wallets::compute_reps ()
+{
+	rai::transaction transaction (node.store.environment, nullptr, false);
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto i (items.begin ()), n (items.end ()); i != n; ++i)
+	{
+		i->second->compute_reps (transaction);
+	}
+}
+
+void rai::wallets::representative_check (MDB_txn * transaction_a, rai::account const & account_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto i (items.begin ()), n (items.end ()); i != n; ++i)
+	{
+		if (i->second->store.exists (transaction_a, account_a))
+		{
+			i->second->representative_check (transaction_a, account_a);
+		}
+	}
+}
+
 bool rai::wallets::exists (MDB_txn * transaction_a, rai::public_key const & account_a)
 {
 	auto result (false);
+	std::lock_guard <std::mutex> lock (mutex);
 	for (auto i (items.begin ()), n (items.end ()); !result && i != n; ++i)
 	{
 		result = i->second->store.exists (transaction_a, account_a);
@@ -152,7 +152,12 @@ public:
     wallet (bool &, rai::transaction &, rai::node &, std::string const &, std::string const &);
 	void enter_initial_password ();
     bool valid_password ();
+	// Unlock the wallet and decrypt the keys of its representatives
     bool enter_password (std::string const &);
+	// Change the password and decrypt representative keys again under it
+	bool rekey (MDB_txn *, std::string const &);
+	// Lock the wallet, decrypted representative keys are dropped with the password
+	void lock ();
 	rai::public_key insert_adhoc (rai::raw_key const &);
 	rai::public_key insert_adhoc (MDB_txn *, rai::raw_key const &);
 	rai::public_key deterministic_insert (MDB_txn *);
@@ -172,7 +177,16 @@ public:
 	void work_ensure (MDB_txn *, rai::account const &);
 	bool search_pending ();
 	void init_free_accounts (MDB_txn *);
+	void compute_reps (MDB_txn *);
+	void representative_check (MDB_txn *, rai::account const &);
+	// Drop decrypted representative keys and, if the wallet is unlocked, decrypt them again
+	void representative_keys_load (MDB_txn *);
 	std::unordered_set <rai::account> free_accounts;
+	// Accounts in this wallet that had voting weight when last checked
+	std::unordered_set <rai::account> representatives;
+	// Private keys of representatives, decrypted when the wallet is unlocked and dropped when it's locked
+	std::unordered_map <rai::account, std::unique_ptr <rai::raw_key>> representative_keys;
+	std::mutex representatives_mutex;
 	std::function <void (bool, bool)> lock_observer;
     rai::wallet_store store;
     rai::node & node;
@@ -190,9 +204,15 @@ public:
 	void do_wallet_actions (rai::account const &);
 	void queue_wallet_action (rai::account const &, rai::uint128_t const &, std::function <void ()> const &);
 	void foreach_representative (MDB_txn *, std::function <void (rai::public_key const &, rai::raw_key const &)> const &);
+	// Does any wallet hold a representative, doesn't check whether the wallets are unlocked
+	bool have_representatives ();
+	void compute_reps ();
+	void representative_check (MDB_txn *, rai::account const &);
 	bool exists (MDB_txn *, rai::public_key const &);
 	std::function <void (rai::account const &, bool)> observer;
 	std::unordered_map <rai::uint256_union, std::shared_ptr <rai::wallet>> items;
+	// Guards items so the periodic representative refresh doesn't iterate it while a wallet is created or destroyed
+	std::mutex mutex;
 	std::unordered_map <rai::account, std::multimap <rai::uint128_t, std::function <void ()>, std::greater <rai::uint128_t>>> pending_actions;
 	std::unordered_set <rai::account> current_actions;
 	std::mutex action_mutex;
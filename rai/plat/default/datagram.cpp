@@ -0,0 +1,36 @@
+#include <rai/node/common.hpp>
+
+bool rai::batched_io_supported ()
+{
+	return false;
+}
+
+size_t rai::receive_batch (boost::asio::ip::udp::socket & socket_a, rai::datagram * datagrams_a, size_t count_a, boost::system::error_code & ec_a)
+{
+	size_t result (0);
+	if (count_a > 0)
+	{
+		socket_a.non_blocking (true, ec_a);
+		if (!ec_a)
+		{
+			datagrams_a [0].size = socket_a.receive_from (boost::asio::buffer (datagrams_a [0].data, datagrams_a [0].size), datagrams_a [0].endpoint, 0, ec_a);
+			result = ec_a ? 0 : 1;
+		}
+	}
+	return result;
+}
+
+size_t rai::send_batch (boost::asio::ip::udp::socket & socket_a, rai::datagram const * datagrams_a, size_t count_a, boost::system::error_code & ec_a)
+{
+	size_t result (0);
+	if (count_a > 0)
+	{
+		socket_a.non_blocking (true, ec_a);
+		if (!ec_a)
+		{
+			socket_a.send_to (boost::asio::buffer (datagrams_a [0].data, datagrams_a [0].size), datagrams_a [0].endpoint, 0, ec_a);
+			result = ec_a ? 0 : 1;
+		}
+	}
+	return result;
+}
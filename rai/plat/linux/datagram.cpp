@@ -0,0 +1,71 @@
+#include <rai/node/common.hpp>
+
+#include <cerrno>
+
+#include <sys/socket.h>
+
+bool rai::batched_io_supported ()
+{
+	return true;
+}
+
+size_t rai::receive_batch (boost::asio::ip::udp::socket & socket_a, rai::datagram * datagrams_a, size_t count_a, boost::system::error_code & ec_a)
+{
+	std::vector <mmsghdr> messages (count_a);
+	std::vector <iovec> vectors (count_a);
+	for (size_t i (0); i < count_a; ++i)
+	{
+		vectors [i].iov_base = datagrams_a [i].data;
+		vectors [i].iov_len = datagrams_a [i].size;
+		messages [i].msg_hdr = msghdr ();
+		messages [i].msg_hdr.msg_name = datagrams_a [i].endpoint.data ();
+		messages [i].msg_hdr.msg_namelen = datagrams_a [i].endpoint.capacity ();
+		messages [i].msg_hdr.msg_iov = &vectors [i];
+		messages [i].msg_hdr.msg_iovlen = 1;
+	}
+	size_t result (0);
+	auto received (recvmmsg (socket_a.native_handle (), messages.data (), count_a, MSG_DONTWAIT, nullptr));
+	if (received >= 0)
+	{
+		result = received;
+		for (size_t i (0); i < result; ++i)
+		{
+			datagrams_a [i].size = messages [i].msg_len;
+			datagrams_a [i].endpoint.resize (messages [i].msg_hdr.msg_namelen);
+		}
+		ec_a = boost::system::error_code ();
+	}
+	else
+	{
+		ec_a = boost::system::error_code (errno, boost::asio::error::get_system_category ());
+	}
+	return result;
+}
+
+size_t rai::send_batch (boost::asio::ip::udp::socket & socket_a, rai::datagram const * datagrams_a, size_t count_a, boost::system::error_code & ec_a)
+{
+	std::vector <mmsghdr> messages (count_a);
+	std::vector <iovec> vectors (count_a);
+	for (size_t i (0); i < count_a; ++i)
+	{
+		vectors [i].iov_base = datagrams_a [i].data;
+		vectors [i].iov_len = datagrams_a [i].size;
+		messages [i].msg_hdr = msghdr ();
+		messages [i].msg_hdr.msg_name = const_cast <sockaddr *> (datagrams_a [i].endpoint.data ());
+		messages [i].msg_hdr.msg_namelen = datagrams_a [i].endpoint.size ();
+		messages [i].msg_hdr.msg_iov = &vectors [i];
+		messages [i].msg_hdr.msg_iovlen = 1;
+	}
+	size_t result (0);
+	auto sent (sendmmsg (socket_a.native_handle (), messages.data (), count_a, MSG_DONTWAIT));
+	if (sent >= 0)
+	{
+		result = sent;
+		ec_a = boost::system::error_code ();
+	}
+	else
+	{
+		ec_a = boost::system::error_code (errno, boost::asio::error::get_system_category ());
+	}
+	return result;
+}
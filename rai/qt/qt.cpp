@@ -735,7 +735,7 @@ std::string rai_qt::status::text ()
 	{
 		rai::transaction transaction (wallet.wallet_m->node.store.environment, nullptr, false);
 		auto size (wallet.wallet_m->node.store.block_count (transaction));
-		unchecked = wallet.wallet_m->node.store.unchecked_count (transaction);
+		unchecked = wallet.wallet_m->node.store.unchecked_count (transaction) + wallet.wallet_m->node.block_processor.dependencies.size ();
 		count_string = std::to_string (size.sum ());
 	}
 
@@ -1150,9 +1150,7 @@ void rai_qt::wallet::update_connected ()
 
 void rai_qt::wallet::empty_password ()
 {
-	rai::raw_key empty;
-	empty.data.clear ();
-	wallet_m->store.password.value_set (empty);
+	wallet_m->lock ();
 }
 
 void rai_qt::wallet::change_rendering_ratio (rai::uint128_t const & rendering_ratio_a)
@@ -1240,7 +1238,7 @@ wallet (wallet_a)
 			{
 				if (new_password->text () == retype_password->text ())
 				{
-					this->wallet.wallet_m->store.rekey (transaction, std::string (new_password->text ().toLocal8Bit ()));
+					this->wallet.wallet_m->rekey (transaction, std::string (new_password->text ().toLocal8Bit ()));
 					new_password->clear ();
 					retype_password->clear ();
 					retype_password->setPlaceholderText ("Retype password");
@@ -1348,9 +1346,7 @@ wallet (wallet_a)
 	{
 		if (password->text ().isEmpty())
 		{
-			rai::raw_key empty;
-			empty.data.clear ();
-			this->wallet.wallet_m->store.password.value_set (empty);
+			this->wallet.wallet_m->lock ();
 			update_locked (true, true);
 		}
 		else
@@ -241,6 +241,11 @@ void rai::send_block::block_work_set (uint64_t work_a)
     work = work_a;
 }
 
+rai::signature rai::send_block::block_signature () const
+{
+    return signature;
+}
+
 rai::send_hashables::send_hashables (rai::block_hash const & previous_a, rai::account const & destination_a, rai::amount const & balance_a) :
 previous (previous_a),
 destination (destination_a),
@@ -477,6 +482,13 @@ work (work_a)
 {
 }
 
+rai::receive_block::receive_block (rai::block_hash const & previous_a, rai::block_hash const & source_a, rai::signature const & signature_a, uint64_t work_a) :
+hashables (previous_a, source_a),
+signature (signature_a),
+work (work_a)
+{
+}
+
 rai::receive_block::receive_block (bool & error_a, rai::stream & stream_a) :
 hashables (error_a, stream_a)
 {
@@ -527,6 +539,11 @@ void rai::receive_block::block_work_set (uint64_t work_a)
     work = work_a;
 }
 
+rai::signature rai::receive_block::block_signature () const
+{
+    return signature;
+}
+
 bool rai::receive_block::operator == (rai::block const & other_a) const
 {
     auto other_l (dynamic_cast <rai::receive_block const *> (&other_a));
@@ -754,6 +771,13 @@ work (work_a)
 {
 }
 
+rai::send_block::send_block (rai::block_hash const & previous_a, rai::account const & destination_a, rai::amount const & balance_a, rai::signature const & signature_a, uint64_t work_a) :
+hashables (previous_a, destination_a, balance_a),
+signature (signature_a),
+work (work_a)
+{
+}
+
 rai::send_block::send_block (bool & error_a, rai::stream & stream_a) :
 hashables (error_a, stream_a)
 {
@@ -896,6 +920,13 @@ work (0)
 	signature.clear ();
 }
 
+rai::open_block::open_block (rai::block_hash const & source_a, rai::account const & representative_a, rai::account const & account_a, rai::signature const & signature_a, uint64_t work_a) :
+hashables (source_a, representative_a, account_a),
+signature (signature_a),
+work (work_a)
+{
+}
+
 rai::open_block::open_block (bool & error_a, rai::stream & stream_a) :
 hashables (error_a, stream_a)
 {
@@ -946,6 +977,11 @@ void rai::open_block::block_work_set (uint64_t work_a)
     work = work_a;
 }
 
+rai::signature rai::open_block::block_signature () const
+{
+    return signature;
+}
+
 rai::block_hash rai::open_block::previous () const
 {
     rai::block_hash result (0);
@@ -1122,6 +1158,13 @@ work (work_a)
 {
 }
 
+rai::change_block::change_block (rai::block_hash const & previous_a, rai::account const & representative_a, rai::signature const & signature_a, uint64_t work_a) :
+hashables (previous_a, representative_a),
+signature (signature_a),
+work (work_a)
+{
+}
+
 rai::change_block::change_block (bool & error_a, rai::stream & stream_a) :
 hashables (error_a, stream_a)
 {
@@ -1172,6 +1215,11 @@ void rai::change_block::block_work_set (uint64_t work_a)
     work = work_a;
 }
 
+rai::signature rai::change_block::block_signature () const
+{
+    return signature;
+}
+
 rai::block_hash rai::change_block::previous () const
 {
     return hashables.previous;
@@ -1536,6 +1584,8 @@ checksum (0)
 		error_a |= mdb_dbi_open (transaction, "unsynced", MDB_CREATE, &unsynced) != 0;
 		error_a |= mdb_dbi_open (transaction, "checksum", MDB_CREATE, &checksum) != 0;
 		error_a |= mdb_dbi_open (transaction, "sequence", MDB_CREATE, &sequence) != 0;
+		error_a |= mdb_dbi_open (transaction, "confirmation_height", MDB_CREATE, &confirmation_height) != 0;
+		error_a |= mdb_dbi_open (transaction, "block_heights", MDB_CREATE, &block_heights) != 0;
 		error_a |= mdb_dbi_open (transaction, "meta", MDB_CREATE, &meta) != 0;
 		if (!error_a)
 		{
@@ -1591,6 +1641,8 @@ void rai::block_store::do_upgrades (MDB_txn * transaction_a)
 		case 7:
 			upgrade_v7_to_v8 (transaction_a);
 		case 8:
+			upgrade_v8_to_v9 (transaction_a);
+		case 9:
 			break;
 		default:
 		assert (false);
@@ -1773,6 +1825,30 @@ void rai::block_store::upgrade_v7_to_v8 (MDB_txn * transaction_a)
 	mdb_dbi_open (transaction_a, "unchecked", MDB_CREATE | MDB_DUPSORT, &unchecked);
 }
 
+void rai::block_store::upgrade_v8_to_v9 (MDB_txn * transaction_a)
+{
+	version_put (transaction_a, 9);
+	std::deque <std::pair <rai::account, rai::account_info>> headers;
+	for (auto i (latest_begin (transaction_a)), n (latest_end ()); i != n; ++i)
+	{
+		headers.push_back (std::make_pair (rai::account (i->first), rai::account_info (i->second)));
+	}
+	for (auto i (headers.begin ()), n (headers.end ()); i != n; ++i)
+	{
+		auto height (i->second.block_count);
+		auto hash (i->second.head);
+		while (!hash.is_zero ())
+		{
+			assert (height > 0);
+			block_height_put (transaction_a, hash, i->first, height);
+			--height;
+			auto block (block_get (transaction_a, hash));
+			assert (block != nullptr);
+			hash = block->previous ();
+		}
+	}
+}
+
 void rai::block_store::clear (MDB_dbi db_a)
 {
 	rai::transaction transaction (environment, nullptr, true);
@@ -1993,6 +2069,7 @@ std::unique_ptr <rai::block> rai::block_store::block_get (MDB_txn * transaction_
 
 void rai::block_store::block_del (MDB_txn * transaction_a, rai::block_hash const & hash_a)
 {
+	block_height_del (transaction_a, hash_a);
 	auto status (mdb_del (transaction_a, send_blocks, hash_a.val (), nullptr));
     assert (status == 0 || status == MDB_NOTFOUND);
 	if (status != 0)
@@ -2510,6 +2587,62 @@ uint64_t rai::block_store::sequence_get (MDB_txn * transaction_a, rai::account c
 	return result;
 }
 
+uint64_t rai::block_store::confirmation_height_get (MDB_txn * transaction_a, rai::account const & account_a)
+{
+	uint64_t result (0);
+	MDB_val value;
+	auto status (mdb_get (transaction_a, confirmation_height, account_a.val (), &value));
+	assert (status == 0 || status == MDB_NOTFOUND);
+	if (status == 0)
+	{
+		rai::bufferstream stream (reinterpret_cast <uint8_t const *> (value.mv_data), value.mv_size);
+		auto error (rai::read (stream, result));
+		assert (!error);
+	}
+	return result;
+}
+
+void rai::block_store::confirmation_height_put (MDB_txn * transaction_a, rai::account const & account_a, uint64_t height_a)
+{
+	auto status (mdb_put (transaction_a, confirmation_height, account_a.val (), rai::mdb_val (sizeof (height_a), &height_a), 0));
+	assert (status == 0);
+}
+
+void rai::block_store::block_height_put (MDB_txn * transaction_a, rai::block_hash const & hash_a, rai::account const & account_a, uint64_t height_a)
+{
+	std::vector <uint8_t> vector;
+	{
+		rai::vectorstream stream (vector);
+		rai::write (stream, account_a.bytes);
+		rai::write (stream, height_a);
+	}
+	auto status (mdb_put (transaction_a, block_heights, hash_a.val (), rai::mdb_val (vector.size (), vector.data ()), 0));
+	assert (status == 0);
+}
+
+bool rai::block_store::block_height_get (MDB_txn * transaction_a, rai::block_hash const & hash_a, rai::account & account_a, uint64_t & height_a)
+{
+	MDB_val value;
+	auto status (mdb_get (transaction_a, block_heights, hash_a.val (), &value));
+	assert (status == 0 || status == MDB_NOTFOUND);
+	auto result (status != 0);
+	if (!result)
+	{
+		rai::bufferstream stream (reinterpret_cast <uint8_t const *> (value.mv_data), value.mv_size);
+		result = rai::read (stream, account_a.bytes);
+		assert (!result);
+		result = rai::read (stream, height_a);
+		assert (!result);
+	}
+	return result;
+}
+
+void rai::block_store::block_height_del (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+{
+	auto status (mdb_del (transaction_a, block_heights, hash_a.val (), nullptr));
+	assert (status == 0 || status == MDB_NOTFOUND);
+}
+
 uint64_t rai::block_store::sequence_current (MDB_txn * transaction_a, rai::account const & account_a)
 {
 	assert (!sequence_mutex.try_lock ());
@@ -2619,13 +2752,16 @@ namespace
 class ledger_processor : public rai::block_visitor
 {
 public:
-    ledger_processor (rai::ledger &, MDB_txn *);
+    ledger_processor (rai::ledger &, MDB_txn *, rai::account const &);
     void send_block (rai::send_block const &) override;
     void receive_block (rai::receive_block const &) override;
     void open_block (rai::open_block const &) override;
     void change_block (rai::change_block const &) override;
+	bool signature_invalid (rai::account const &, rai::block_hash const &, rai::signature const &);
     rai::ledger & ledger;
 	MDB_txn * transaction;
+	// Account the signature was checked against before processing, zero if unchecked
+	rai::account validated;
     rai::process_return result;
 };
 
@@ -2885,7 +3021,12 @@ rai::uint128_t rai::ledger::account_pending (MDB_txn * transaction_a, rai::accou
 
 rai::process_return rai::ledger::process (MDB_txn * transaction_a, rai::block const & block_a)
 {
-	ledger_processor processor (*this, transaction_a);
+	return process (transaction_a, block_a, rai::account (0));
+}
+
+rai::process_return rai::ledger::process (MDB_txn * transaction_a, rai::block const & block_a, rai::account const & validated_a)
+{
+	ledger_processor processor (*this, transaction_a, validated_a);
 	block_a.visit (processor);
 	return processor.result;
 }
@@ -2957,6 +3098,12 @@ void rai::ledger::rollback (MDB_txn * transaction_a, rai::block_hash const & blo
         auto block (store.block_get (transaction_a, info.head));
         block->visit (rollback);
     }
+	// A rolled back block can't stay confirmed, what's left of the chain is at most as high as the remaining block count
+	auto remaining (store.account_get (transaction_a, account_l, info) ? 0 : info.block_count);
+	if (store.confirmation_height_get (transaction_a, account_l) > remaining)
+	{
+		store.confirmation_height_put (transaction_a, account_l, remaining);
+	}
 }
 
 // Return account containing hash
@@ -2978,6 +3125,99 @@ rai::account rai::ledger::account (MDB_txn * transaction_a, rai::block_hash cons
 	return result;
 }
 
+uint64_t rai::ledger::height (MDB_txn * transaction_a, rai::block_hash const & hash_a, rai::account & account_a)
+{
+	assert (store.block_exists (transaction_a, hash_a));
+	uint64_t result;
+	if (store.block_height_get (transaction_a, hash_a, account_a, result))
+	{
+		result = height_walk (transaction_a, hash_a, account_a);
+	}
+	return result;
+}
+
+uint64_t rai::ledger::height_walk (MDB_txn * transaction_a, rai::block_hash const & hash_a, rai::account & account_a)
+{
+	// Count successors up to the head, the head's height is the account's block count
+	uint64_t above (0);
+	auto hash (hash_a);
+	rai::block_hash successor (store.block_successor (transaction_a, hash));
+	while (!successor.is_zero ())
+	{
+		hash = successor;
+		++above;
+		successor = store.block_successor (transaction_a, hash);
+	}
+	account_a = store.frontier_get (transaction_a, hash);
+	assert (!account_a.is_zero ());
+	rai::account_info info;
+	auto error (store.account_get (transaction_a, account_a, info));
+	assert (!error);
+	assert (info.block_count > above);
+	return info.block_count - above;
+}
+
+bool rai::ledger::confirmed (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+{
+	rai::account account_l;
+	auto height_l (height (transaction_a, hash_a, account_l));
+	return height_l <= store.confirmation_height_get (transaction_a, account_l);
+}
+
+uint64_t rai::ledger::confirm (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+{
+	std::vector <rai::block_hash> remaining (1, hash_a);
+	return confirm (transaction_a, remaining, std::numeric_limits <size_t>::max ());
+}
+
+uint64_t rai::ledger::confirm (MDB_txn * transaction_a, std::vector <rai::block_hash> & remaining_a, size_t max_a)
+{
+	uint64_t result (0);
+	size_t walked (0);
+	while (!remaining_a.empty () && walked < max_a)
+	{
+		auto hash (remaining_a.back ());
+		remaining_a.pop_back ();
+		if (store.block_exists (transaction_a, hash))
+		{
+			rai::account account_l;
+			auto height_l (height (transaction_a, hash, account_l));
+			auto confirmed_l (store.confirmation_height_get (transaction_a, account_l));
+			if (height_l > confirmed_l)
+			{
+				// Everything between the old height and this block becomes confirmed, and so do the sends they received from
+				std::vector <rai::block_hash> sources;
+				auto current (hash);
+				auto i (height_l);
+				for (; i > confirmed_l && walked < max_a; --i, ++walked)
+				{
+					auto block (store.block_get (transaction_a, current));
+					assert (block != nullptr);
+					auto source (block->source ());
+					if (!source.is_zero ())
+					{
+						sources.push_back (source);
+					}
+					current = block->previous ();
+				}
+				if (i == confirmed_l)
+				{
+					remaining_a.insert (remaining_a.end (), sources.begin (), sources.end ());
+					store.confirmation_height_put (transaction_a, account_l, height_l);
+					result += height_l - confirmed_l;
+				}
+				else
+				{
+					// Out of budget part way down the chain, confirm the lower part first and walk this block again after it
+					remaining_a.push_back (hash);
+					remaining_a.push_back (current);
+				}
+			}
+		}
+	}
+	return result;
+}
+
 // Return amount decrease or increase for block
 rai::uint128_t rai::ledger::amount (MDB_txn * transaction_a, rai::block_hash const & hash_a)
 {
@@ -3072,6 +3312,8 @@ void rai::ledger::change_latest (MDB_txn * transaction_a, rai::account const & a
         info.modified = store.now ();
 		info.block_count = block_count_a;
         store.account_put (transaction_a, account_a, info);
+		// The head's height is always the account's block count
+		store.block_height_put (transaction_a, hash_a, account_a, block_count_a);
         checksum_update (transaction_a, hash_a);
     }
     else
@@ -3138,7 +3380,7 @@ void ledger_processor::change_block (rai::change_block const & block_a)
 				auto latest_error (ledger.store.account_get (transaction, account, info));
 				assert (!latest_error);
 				assert (info.head == block_a.hashables.previous);
-				result.code = validate_message (account, hash, block_a.signature) ? rai::process_result::bad_signature : rai::process_result::progress; // Is this block signed correctly (Malformed)
+				result.code = signature_invalid (account, hash, block_a.signature) ? rai::process_result::bad_signature : rai::process_result::progress; // Is this block signed correctly (Malformed)
 				if (result.code == rai::process_result::progress)
 				{
 					ledger.store.block_put (transaction, hash, block_a);
@@ -3171,7 +3413,7 @@ void ledger_processor::send_block (rai::send_block const & block_a)
 			result.code = account.is_zero () ? rai::process_result::fork : rai::process_result::progress;
 			if (result.code == rai::process_result::progress)
 			{
-				result.code = validate_message (account, hash, block_a.signature) ? rai::process_result::bad_signature : rai::process_result::progress; // Is this block signed correctly (Malformed)
+				result.code = signature_invalid (account, hash, block_a.signature) ? rai::process_result::bad_signature : rai::process_result::progress; // Is this block signed correctly (Malformed)
 				if (result.code == rai::process_result::progress)
 				{
 					rai::account_info info;
@@ -3211,7 +3453,7 @@ void ledger_processor::receive_block (rai::receive_block const & block_a)
 			result.code = account.is_zero () ? rai::process_result::gap_previous : rai::process_result::progress;  //Have we seen the previous block? No entries for account at all (Harmless)
 			if (result.code == rai::process_result::progress)
 			{
-				result.code = rai::validate_message (account, hash, block_a.signature) ? rai::process_result::bad_signature : rai::process_result::progress; // Is the signature valid (Malformed)
+				result.code = signature_invalid (account, hash, block_a.signature) ? rai::process_result::bad_signature : rai::process_result::progress; // Is the signature valid (Malformed)
 				if (result.code == rai::process_result::progress)
 				{
 					rai::account_info info;
@@ -3259,7 +3501,7 @@ void ledger_processor::open_block (rai::open_block const & block_a)
         result.code = source_missing ? rai::process_result::gap_source : rai::process_result::progress; // Have we seen the source block? (Harmless)
         if (result.code == rai::process_result::progress)
         {
-			result.code = rai::validate_message (block_a.hashables.account, hash, block_a.signature) ? rai::process_result::bad_signature : rai::process_result::progress; // Is the signature valid (Malformed)
+			result.code = signature_invalid (block_a.hashables.account, hash, block_a.signature) ? rai::process_result::bad_signature : rai::process_result::progress; // Is the signature valid (Malformed)
 			if (result.code == rai::process_result::progress)
 			{
 				rai::account_info info;
@@ -3288,21 +3530,35 @@ void ledger_processor::open_block (rai::open_block const & block_a)
     }
 }
 
-ledger_processor::ledger_processor (rai::ledger & ledger_a, MDB_txn * transaction_a) :
+ledger_processor::ledger_processor (rai::ledger & ledger_a, MDB_txn * transaction_a, rai::account const & validated_a) :
 ledger (ledger_a),
-transaction (transaction_a)
+transaction (transaction_a),
+validated (validated_a)
+{
+}
+
+bool ledger_processor::signature_invalid (rai::account const & account_a, rai::block_hash const & hash_a, rai::signature const & signature_a)
 {
+	auto result (false);
+	if (validated.is_zero () || validated != account_a)
+	{
+		result = rai::validate_message (account_a, hash_a, signature_a);
+	}
+	return result;
 }
 
+size_t constexpr rai::vote::hashes_max;
+
 rai::vote::vote (rai::vote const & other_a) :
 sequence (other_a.sequence),
 block (other_a.block),
+hashes (other_a.hashes),
 account (other_a.account),
 signature (other_a.signature)
 {
 }
 
-rai::vote::vote (bool & error_a, rai::stream & stream_a, rai::block_type type_a)
+rai::vote::vote (bool & error_a, rai::stream & stream_a, rai::block_type type_a, size_t count_a)
 {
 	if (!error_a)
 	{
@@ -3315,8 +3571,21 @@ rai::vote::vote (bool & error_a, rai::stream & stream_a, rai::block_type type_a)
 				error_a = rai::read (stream_a, sequence);
 				if (!error_a)
 				{
-					block = rai::deserialize_block (stream_a, type_a);
-					error_a = block == nullptr;
+					if (type_a == rai::block_type::not_a_block)
+					{
+						error_a = count_a == 0 || count_a > hashes_max;
+						for (size_t i (0); !error_a && i < count_a; ++i)
+						{
+							rai::block_hash hash;
+							error_a = rai::read (stream_a, hash.bytes);
+							hashes.push_back (hash);
+						}
+					}
+					else
+					{
+						block = rai::deserialize_block (stream_a, type_a);
+						error_a = block == nullptr;
+					}
 				}
 			}
 		}
@@ -3331,12 +3600,34 @@ signature (rai::sign_message (prv_a, account_a, hash ()))
 {
 }
 
+rai::vote::vote (rai::account const & account_a, rai::raw_key const & prv_a, uint64_t sequence_a, std::vector <rai::block_hash> const & hashes_a) :
+sequence (sequence_a),
+hashes (hashes_a),
+account (account_a),
+signature (rai::sign_message (prv_a, account_a, hash ()))
+{
+	assert (!hashes.empty () && hashes.size () <= hashes_max);
+}
+
 rai::uint256_union rai::vote::hash () const
 {
     rai::uint256_union result;
     blake2b_state hash;
 	blake2b_init (&hash, sizeof (result.bytes));
-    blake2b_update (&hash, block->hash ().bytes.data (), sizeof (result.bytes));
+	if (hashes.empty ())
+	{
+		blake2b_update (&hash, block->hash ().bytes.data (), sizeof (result.bytes));
+	}
+	else
+	{
+		// Prefixed so a vote-by-hash signature can never be mistaken for a signature over a single block
+		std::string prefix ("vote ");
+		blake2b_update (&hash, reinterpret_cast <uint8_t const *> (prefix.data ()), prefix.size ());
+		for (auto & i: hashes)
+		{
+			blake2b_update (&hash, i.bytes.data (), sizeof (i.bytes));
+		}
+	}
     union {
         uint64_t qword;
         std::array <uint8_t, 8> bytes;
@@ -3382,6 +3673,7 @@ void rai::genesis::initialize (MDB_txn * transaction_a, rai::block_store & store
 	store_a.representation_put (transaction_a, genesis_account, std::numeric_limits <rai::uint128_t>::max ());
 	store_a.checksum_put (transaction_a, 0, 0, hash_l);
 	store_a.frontier_put (transaction_a, hash_l, genesis_account);
+	store_a.block_height_put (transaction_a, hash_l, genesis_account, 1);
 }
 
 rai::block_hash rai::genesis::hash () const
@@ -53,6 +53,7 @@ public:
 	// Previous block or account number for open blocks
 	virtual rai::block_hash root () const = 0;
 	virtual rai::account representative () const = 0;
+	virtual rai::signature block_signature () const = 0;
 	virtual void serialize (rai::stream &) const = 0;
 	virtual void serialize_json (std::string &) const = 0;
 	virtual void visit (rai::block_visitor &) const = 0;
@@ -85,6 +86,8 @@ class send_block : public rai::block
 {
 public:
 	send_block (rai::block_hash const &, rai::account const &, rai::amount const &, rai::raw_key const &, rai::public_key const &, uint64_t);
+	// Construct from fields that were already signed, such as ones read off the network
+	send_block (rai::block_hash const &, rai::account const &, rai::amount const &, rai::signature const &, uint64_t);
 	send_block (bool &, rai::stream &);
 	send_block (bool &, boost::property_tree::ptree const &);
 	using rai::block::hash;
@@ -95,6 +98,7 @@ public:
 	rai::block_hash source () const override;
 	rai::block_hash root () const override;
 	rai::account representative () const override;
+	rai::signature block_signature () const override;
 	void serialize (rai::stream &) const override;
 	void serialize_json (std::string &) const override;
 	bool deserialize (rai::stream &);
@@ -122,6 +126,7 @@ class receive_block : public rai::block
 {
 public:
 	receive_block (rai::block_hash const &, rai::block_hash const &, rai::raw_key const &, rai::public_key const &, uint64_t);
+	receive_block (rai::block_hash const &, rai::block_hash const &, rai::signature const &, uint64_t);
 	receive_block (bool &, rai::stream &);
 	receive_block (bool &, boost::property_tree::ptree const &);
 	using rai::block::hash;
@@ -132,6 +137,7 @@ public:
 	rai::block_hash source () const override;
 	rai::block_hash root () const override;
 	rai::account representative () const override;
+	rai::signature block_signature () const override;
 	void serialize (rai::stream &) const override;
 	void serialize_json (std::string &) const override;
 	bool deserialize (rai::stream &);
@@ -161,6 +167,7 @@ class open_block : public rai::block
 public:
 	open_block (rai::block_hash const &, rai::account const &, rai::account const &, rai::raw_key const &, rai::public_key const &, uint64_t);
 	open_block (rai::block_hash const &, rai::account const &, rai::account const &, std::nullptr_t);
+	open_block (rai::block_hash const &, rai::account const &, rai::account const &, rai::signature const &, uint64_t);
 	open_block (bool &, rai::stream &);
 	open_block (bool &, boost::property_tree::ptree const &);
 	using rai::block::hash;
@@ -171,6 +178,7 @@ public:
 	rai::block_hash source () const override;
 	rai::block_hash root () const override;
 	rai::account representative () const override;
+	rai::signature block_signature () const override;
 	void serialize (rai::stream &) const override;
 	void serialize_json (std::string &) const override;
 	bool deserialize (rai::stream &);
@@ -198,6 +206,7 @@ class change_block : public rai::block
 {
 public:
 	change_block (rai::block_hash const &, rai::account const &, rai::raw_key const &, rai::public_key const &, uint64_t);
+	change_block (rai::block_hash const &, rai::account const &, rai::signature const &, uint64_t);
 	change_block (bool &, rai::stream &);
 	change_block (bool &, boost::property_tree::ptree const &);
 	using rai::block::hash;
@@ -208,6 +217,7 @@ public:
 	rai::block_hash source () const override;
 	rai::block_hash root () const override;
 	rai::account representative () const override;
+	rai::signature block_signature () const override;
 	void serialize (rai::stream &) const override;
 	void serialize_json (std::string &) const override;
 	bool deserialize (rai::stream &);
@@ -396,6 +406,15 @@ public:
 	std::mutex sequence_mutex;
 	std::unordered_map <rai::account, uint64_t> sequence_cache;
 	
+	// Height of the highest confirmed block in the account chain, 0 when nothing is confirmed
+	uint64_t confirmation_height_get (MDB_txn *, rai::account const &);
+	void confirmation_height_put (MDB_txn *, rai::account const &, uint64_t);
+	
+	// Account and height of a block in the ledger, written alongside the account head so heights never have to be counted
+	void block_height_put (MDB_txn *, rai::block_hash const &, rai::account const &, uint64_t);
+	bool block_height_get (MDB_txn *, rai::block_hash const &, rai::account &, uint64_t &);
+	void block_height_del (MDB_txn *, rai::block_hash const &);
+	
 	void version_put (MDB_txn *, int);
 	int version_get (MDB_txn *);
 	void do_upgrades (MDB_txn *);
@@ -406,6 +425,7 @@ public:
 	void upgrade_v5_to_v6 (MDB_txn *);
 	void upgrade_v6_to_v7 (MDB_txn *);
 	void upgrade_v7_to_v8 (MDB_txn *);
+	void upgrade_v8_to_v9 (MDB_txn *);
 	
 	void clear (MDB_dbi);
 	
@@ -434,6 +454,10 @@ public:
 	MDB_dbi checksum;
 	// account -> uint64_t											// Highest vote sequence observed for account
 	MDB_dbi sequence;
+	// account -> uint64_t											// Height of the highest confirmed block in the account chain
+	MDB_dbi confirmation_height;
+	// block_hash -> account, uint64_t								// Account and height in the account chain of each block in the ledger
+	MDB_dbi block_heights;
 	// uint256_union -> ?											// Meta information about block store
 	MDB_dbi meta;
 };
@@ -468,17 +492,24 @@ class vote
 public:
 	vote () = default;
 	vote (rai::vote const &);
-	vote (bool &, rai::stream &, rai::block_type);
+	// Deserialize a vote, type not_a_block reads count block hashes instead of a block
+	vote (bool &, rai::stream &, rai::block_type, size_t);
 	vote (rai::account const &, rai::raw_key const &, uint64_t, std::shared_ptr <rai::block>);
+	vote (rai::account const &, rai::raw_key const &, uint64_t, std::vector <rai::block_hash> const &);
 	rai::uint256_union hash () const;
 	rai::vote_result validate (MDB_txn *, rai::block_store &) const;
 	// Vote round sequence number
 	uint64_t sequence;
+	// Block voted for, nullptr for a vote-by-hash until it's matched to a block we have
 	std::shared_ptr <rai::block> block;
+	// Blocks voted for by a vote-by-hash, empty for a vote carrying a block
+	std::vector <rai::block_hash> hashes;
 	// Account that's voting
 	rai::account account;
-	// Signature of sequence + block hash
+	// Signature of sequence + block hash, or of a prefix + hashes + sequence for a vote-by-hash
 	rai::signature signature;
+	// Maximum number of hashes in a vote-by-hash, the header's 4 bit count allows 15 but 12 hashes plus header, account, signature and sequence is 496 bytes and 13 wouldn't fit a 512 byte datagram
+	static size_t constexpr hashes_max = 12;
 };
 enum class tally_result
 {
@@ -520,7 +551,19 @@ public:
 	std::string block_text (rai::block_hash const &);
 	rai::uint128_t supply (MDB_txn *);
 	rai::process_return process (MDB_txn *, rai::block const &);
+	// Process a block whose signature was already checked against the given account
+	rai::process_return process (MDB_txn *, rai::block const &, rai::account const &);
 	void rollback (MDB_txn *, rai::block_hash const &);
+	// Mark a block, its predecessors and the sources it received from as confirmed, returns the number of blocks newly confirmed
+	uint64_t confirm (MDB_txn *, rai::block_hash const &);
+	// Same as above for the blocks in remaining, stopping once about max blocks were walked and leaving what's left in remaining
+	uint64_t confirm (MDB_txn *, std::vector <rai::block_hash> &, size_t);
+	// Is this block at or below its account's confirmation height
+	bool confirmed (MDB_txn *, rai::block_hash const &);
+	// Position of a block in its account chain starting from 1 for the open block
+	uint64_t height (MDB_txn *, rai::block_hash const &, rai::account &);
+	// Only blocks written straight to the store rather than through the ledger have no stored height and are counted this way
+	uint64_t height_walk (MDB_txn *, rai::block_hash const &, rai::account &);
 	void change_latest (MDB_txn *, rai::account const &, rai::block_hash const &, rai::account const &, rai::uint128_union const &, uint64_t);
 	void checksum_update (MDB_txn *, rai::block_hash const &);
 	rai::checksum checksum (MDB_txn *, rai::account const &, rai::account const &);
@@ -404,3 +404,572 @@ TEST (store, vote_load)
 		node.store.sequence_atomic_observe (transaction, 0, i);
 	}
 }
+
+TEST (vote_processor, throughput)
+{
+	rai::system system (24000, 1);
+	auto & node (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	auto send1 (std::make_shared <rai::send_block> (genesis.hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+	ASSERT_EQ (rai::process_result::progress, node.process (*send1).code);
+	{
+		rai::transaction transaction (node.store.environment, nullptr, true);
+		node.active.start (transaction, send1);
+	}
+	std::vector <rai::keypair> keys (64);
+	size_t count (20000);
+	std::vector <rai::vote> votes;
+	for (size_t i (0); i < count; ++i)
+	{
+		auto & key (keys [i % keys.size ()]);
+		votes.push_back (rai::vote (key.pub, key.prv, i + 1, send1));
+	}
+	std::vector <std::chrono::steady_clock::time_point> queued (count + 1);
+	std::mutex mutex;
+	std::chrono::steady_clock::duration latency (0);
+	size_t processed (0);
+	node.observers.vote.add ([&] (rai::vote const & vote_a, rai::endpoint const &)
+	{
+		auto now (std::chrono::steady_clock::now ());
+		std::lock_guard <std::mutex> lock (mutex);
+		latency += now - queued [vote_a.sequence];
+		++processed;
+	});
+	auto begin (std::chrono::steady_clock::now ());
+	for (auto & vote: votes)
+	{
+		{
+			std::lock_guard <std::mutex> lock (mutex);
+			queued [vote.sequence] = std::chrono::steady_clock::now ();
+		}
+		node.vote_processor.add (vote, rai::endpoint ());
+	}
+	node.vote_processor.flush ();
+	auto end (std::chrono::steady_clock::now ());
+	ASSERT_EQ (count, processed);
+	auto elapsed_ms (std::chrono::duration_cast <std::chrono::milliseconds> (end - begin).count ());
+	auto latency_us (std::chrono::duration_cast <std::chrono::microseconds> (latency).count () / processed);
+	std::cerr << "Votes: " << count << " ms: " << elapsed_ms << " votes/s: " << (count * 1000 / std::max <int64_t> (1, elapsed_ms)) << " average queue latency us: " << latency_us << std::endl;
+}
+
+TEST (signature_checker, throughput)
+{
+	rai::genesis genesis;
+	rai::keypair key1;
+	size_t count (16384);
+	std::vector <rai::signature_check> blocks;
+	rai::block_hash previous (genesis.hash ());
+	for (size_t i (0); i < count; ++i)
+	{
+		rai::send_block send (previous, key1.pub, rai::genesis_amount - i - 1, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+		previous = send.hash ();
+		blocks.push_back ({rai::test_genesis_key.pub, previous, send.signature, false});
+	}
+	std::vector <unsigned> thread_counts ({0, 1, 2, 4, 8});
+	thread_counts.push_back (std::thread::hardware_concurrency ());
+	for (auto threads: thread_counts)
+	{
+		rai::signature_checker checker (threads);
+		auto checks (blocks);
+		auto begin (std::chrono::steady_clock::now ());
+		checker.verify (checks);
+		auto elapsed_ms (std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now () - begin).count ());
+		for (auto & i: checks)
+		{
+			ASSERT_TRUE (i.valid);
+		}
+		// The calling thread verifies alongside the helpers
+		std::cerr << "Helper threads: " << threads << " blocks: " << count << " ms: " << elapsed_ms << " blocks/s: " << (count * 1000 / std::max <int64_t> (1, elapsed_ms)) << std::endl;
+	}
+}
+
+TEST (alarm, churn)
+{
+	boost::asio::io_service service;
+	rai::alarm alarm (service);
+	size_t outstanding (100000);
+	size_t rounds (10);
+	std::atomic <size_t> ran (0);
+	std::vector <uint64_t> handles;
+	auto begin (std::chrono::steady_clock::now ());
+	for (size_t i (0); i < outstanding; ++i)
+	{
+		handles.push_back (alarm.add (std::chrono::system_clock::now () + std::chrono::milliseconds (10000 + (i * 7919) % 60000), [&ran] () { ++ran; }));
+	}
+	auto added (std::chrono::steady_clock::now ());
+	// Each round cancels every timer and replaces it, like elections and requests being rescheduled
+	for (size_t round (0); round < rounds; ++round)
+	{
+		for (size_t i (0); i < outstanding; ++i)
+		{
+			ASSERT_FALSE (alarm.cancel (handles [i]));
+			handles [i] = alarm.add (std::chrono::system_clock::now () + std::chrono::milliseconds (10000 + (i * 7919 + round) % 60000), [&ran] () { ++ran; });
+		}
+	}
+	auto end (std::chrono::steady_clock::now ());
+	ASSERT_EQ (outstanding, alarm.size ());
+	auto add_us (std::chrono::duration_cast <std::chrono::microseconds> (added - begin).count ());
+	auto churn_us (std::chrono::duration_cast <std::chrono::microseconds> (end - added).count ());
+	std::cerr << "Outstanding: " << outstanding << " add ns: " << add_us * 1000 / outstanding << " cancel and add ns: " << churn_us * 1000 / (outstanding * rounds) << std::endl;
+	for (auto & handle: handles)
+	{
+		alarm.cancel (handle);
+	}
+	ASSERT_EQ (0, alarm.size ());
+	ASSERT_EQ (0, ran);
+}
+
+TEST (observer_set, contention)
+{
+	rai::observer_set <rai::block_hash const &> observers;
+	std::atomic <uint64_t> calls (0);
+	for (auto i (0); i < 4; ++i)
+	{
+		observers.add ([&calls] (rai::block_hash const &)
+		{
+			++calls;
+		});
+	}
+	size_t publishers (std::max (2u, std::thread::hardware_concurrency ()) * 2);
+	size_t notifications (200000);
+	std::vector <std::thread> threads;
+	auto begin (std::chrono::steady_clock::now ());
+	for (size_t i (0); i < publishers; ++i)
+	{
+		threads.push_back (std::thread ([&observers, notifications, i] ()
+		{
+			rai::block_hash hash (i);
+			for (size_t j (0); j < notifications; ++j)
+			{
+				observers (hash);
+			}
+		}));
+	}
+	// Keep adding while publishers run, each add replaces the snapshot
+	for (auto i (0); i < 100; ++i)
+	{
+		observers.add ([] (rai::block_hash const &) {});
+	}
+	for (auto & i: threads)
+	{
+		i.join ();
+	}
+	auto end (std::chrono::steady_clock::now ());
+	ASSERT_EQ (publishers * notifications * 4, calls);
+	auto elapsed_ms (std::chrono::duration_cast <std::chrono::milliseconds> (end - begin).count ());
+	std::cerr << "Publishers: " << publishers << " notifications: " << publishers * notifications << " ms: " << elapsed_ms << " notifications/s: " << (publishers * notifications * 1000 / std::max <int64_t> (1, elapsed_ms)) << std::endl;
+}
+
+// Contacts from known peers racing with the readers used for every broadcast
+TEST (peer_container, contention)
+{
+	auto loopback (boost::asio::ip::address_v6::loopback ());
+	rai::peer_container container (rai::endpoint (loopback, 24000));
+	size_t peer_count (1000);
+	for (size_t i (0); i < peer_count; ++i)
+	{
+		container.contacted (rai::endpoint (loopback, 24001 + i), 0);
+	}
+	size_t writers (std::max (2u, std::thread::hardware_concurrency ()));
+	size_t readers (writers);
+	size_t operations (100000);
+	std::atomic <uint64_t> reads (0);
+	std::vector <std::thread> threads;
+	auto begin (std::chrono::steady_clock::now ());
+	for (size_t i (0); i < writers; ++i)
+	{
+		threads.push_back (std::thread ([&container, &loopback, peer_count, operations, i] ()
+		{
+			for (size_t j (0); j < operations; ++j)
+			{
+				container.contacted (rai::endpoint (loopback, 24001 + (i * operations + j) % peer_count), 0);
+			}
+		}));
+	}
+	for (size_t i (0); i < readers; ++i)
+	{
+		threads.push_back (std::thread ([&container, &reads, operations] ()
+		{
+			std::array <rai::endpoint, 8> target;
+			for (size_t j (0); j < operations; ++j)
+			{
+				reads += container.list_sqrt ().size ();
+				container.random_fill (target);
+			}
+		}));
+	}
+	for (auto & i: threads)
+	{
+		i.join ();
+	}
+	auto end (std::chrono::steady_clock::now ());
+	ASSERT_EQ (peer_count, container.size ());
+	auto elapsed_ms (std::chrono::duration_cast <std::chrono::milliseconds> (end - begin).count ());
+	auto total ((writers + readers) * operations);
+	std::cerr << "Writers: " << writers << " readers: " << readers << " operations: " << total << " ms: " << elapsed_ms << " operations/s: " << (total * 1000 / std::max <int64_t> (1, elapsed_ms)) << std::endl;
+}
+
+// Flood a node with keepalives from several local senders and report how many it parses per second
+TEST (network, receive_flood)
+{
+	auto senders (std::max (4u, std::thread::hardware_concurrency ()));
+	size_t per_sender (50000);
+	rai::keepalive message;
+	std::vector <uint8_t> bytes;
+	{
+		rai::vectorstream stream (bytes);
+		message.serialize (stream);
+	}
+	for (auto sockets: {1u, senders})
+	{
+		rai::system system (24000, 0);
+		rai::node_init init;
+		rai::node_config config (24000, system.logging);
+		config.peering_sockets = sockets;
+		auto node (std::make_shared <rai::node> (init, system.service, rai::unique_path (), system.alarm, config, system.work));
+		node->start ();
+		rai::thread_runner runner (system.service, config.io_threads);
+		auto target (node->network.endpoint ());
+		auto begin (std::chrono::steady_clock::now ());
+		std::vector <std::thread> threads;
+		for (unsigned i (0); i < senders; ++i)
+		{
+			threads.push_back (std::thread ([&system, &bytes, target, per_sender] ()
+			{
+				boost::asio::ip::udp::socket socket (system.service, rai::endpoint (boost::asio::ip::address_v6::loopback (), 0));
+				for (size_t j (0); j < per_sender; ++j)
+				{
+					boost::system::error_code ec;
+					socket.send_to (boost::asio::buffer (bytes.data (), bytes.size ()), target, 0, ec);
+				}
+			}));
+		}
+		for (auto & i: threads)
+		{
+			i.join ();
+		}
+		// Datagrams the kernel dropped never arrive, stop once the count settles
+		uint64_t last (0);
+		do
+		{
+			last = node->network.incoming.keepalive;
+			std::this_thread::sleep_for (std::chrono::milliseconds (100));
+		} while (node->network.incoming.keepalive != last);
+		auto elapsed_ms (std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now () - begin).count () - 100);
+		std::cerr << "Sockets: " << sockets << " sent: " << senders * per_sender << " received: " << last << " packets/s: " << (last * 1000 / std::max <int64_t> (1, elapsed_ms)) << std::endl;
+		node->stop ();
+		system.service.stop ();
+		runner.join ();
+	}
+}
+
+// Compare system calls and CPU time per datagram with and without recvmmsg and sendmmsg
+TEST (network, batched_io_cost)
+{
+	size_t senders (4);
+	size_t per_sender (50000);
+	size_t fanout (200);
+	rai::keepalive message;
+	std::vector <uint8_t> bytes;
+	{
+		rai::vectorstream stream (bytes);
+		message.serialize (stream);
+	}
+	for (auto batched: {false, true})
+	{
+		rai::system system (24000, 0);
+		rai::node_init init;
+		rai::node_config config (24000, system.logging);
+		config.batched_io = batched;
+		auto node (std::make_shared <rai::node> (init, system.service, rai::unique_path (), system.alarm, config, system.work));
+		node->start ();
+		rai::thread_runner runner (system.service, config.io_threads);
+		auto target (node->network.endpoint ());
+		auto cpu_begin (std::clock ());
+		std::vector <std::thread> threads;
+		for (size_t i (0); i < senders; ++i)
+		{
+			threads.push_back (std::thread ([&system, &bytes, target, per_sender] ()
+			{
+				boost::asio::ip::udp::socket socket (system.service, rai::endpoint (boost::asio::ip::address_v6::loopback (), 0));
+				for (size_t j (0); j < per_sender; ++j)
+				{
+					boost::system::error_code ec;
+					socket.send_to (boost::asio::buffer (bytes.data (), bytes.size ()), target, 0, ec);
+				}
+			}));
+		}
+		for (auto & i: threads)
+		{
+			i.join ();
+		}
+		uint64_t last (0);
+		do
+		{
+			last = node->network.datagrams_received;
+			std::this_thread::sleep_for (std::chrono::milliseconds (100));
+		} while (node->network.datagrams_received != last);
+		// Fan each message out to many endpoints like republishing a block does
+		boost::asio::ip::udp::socket sink (system.service, rai::endpoint (boost::asio::ip::address_v6::loopback (), 0));
+		auto sink_endpoint (sink.local_endpoint ());
+		std::atomic <size_t> completed (0);
+		auto sent_begin (node->network.datagrams_sent.load ());
+		auto syscalls_begin (node->network.send_syscalls.load ());
+		for (size_t i (0); i < per_sender / fanout; ++i)
+		{
+			for (size_t j (0); j < fanout; ++j)
+			{
+				node->network.send_buffer (bytes.data (), bytes.size (), sink_endpoint, [&completed] (boost::system::error_code const &, size_t) { ++completed; });
+			}
+		}
+		while (completed < (per_sender / fanout) * fanout)
+		{
+			std::this_thread::sleep_for (std::chrono::milliseconds (10));
+		}
+		auto cpu_ms ((std::clock () - cpu_begin) * 1000 / CLOCKS_PER_SEC);
+		auto received (node->network.datagrams_received.load ());
+		auto sent (node->network.datagrams_sent - sent_begin);
+		std::cerr << (batched ? "Batched" : "Unbatched") << " received: " << received << " per receive call: " << received / std::max <uint64_t> (1, node->network.receive_syscalls) << " sent: " << sent << " per send call: " << sent / std::max <uint64_t> (1, node->network.send_syscalls - syscalls_begin) << " cpu us per datagram: " << cpu_ms * 1000 / std::max <uint64_t> (1, received + sent) << std::endl;
+		node->stop ();
+		system.service.stop ();
+		runner.join ();
+	}
+}
+
+// Publish one send across a thousand nodes on a simulated network and report how long it takes every node to see and confirm it
+TEST (simulated_network, convergence)
+{
+	rai::simulated_link link;
+	link.latency = std::chrono::milliseconds (50);
+	link.jitter = std::chrono::milliseconds (20);
+	link.loss = 0.01;
+	link.bandwidth = 1024 * 1024;
+	size_t node_count (1000);
+	rai::system system (24000, node_count, link);
+	rai::thread_runner runner (system.service, std::max (4u, std::thread::hardware_concurrency ()));
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	std::vector <std::shared_ptr <rai::simulated_transport>> transports;
+	uint64_t bytes_begin (0);
+	for (auto & i: system.nodes)
+	{
+		transports.push_back (std::static_pointer_cast <rai::simulated_transport> (i->network.transport));
+		bytes_begin += transports.back ()->bytes_sent;
+	}
+	rai::keypair key;
+	auto begin (std::chrono::steady_clock::now ());
+	auto block (system.wallet (0)->send_action (rai::test_genesis_key.pub, key.pub, 100));
+	ASSERT_NE (nullptr, block);
+	// Milliseconds until each node had the block and until its election finished, -1 while waiting
+	std::vector <int64_t> received (node_count, -1);
+	std::vector <int64_t> confirmed (node_count, -1);
+	auto remaining (node_count);
+	while (remaining > 0 && std::chrono::steady_clock::now () - begin < std::chrono::minutes (5))
+	{
+		auto elapsed (std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now () - begin).count ());
+		for (size_t i (0); i < node_count; ++i)
+		{
+			auto & node (*system.nodes [i]);
+			if (confirmed [i] == -1 && node.ledger.block_exists (block->hash ()))
+			{
+				if (received [i] == -1)
+				{
+					received [i] = elapsed;
+				}
+				if (!node.active.active (*block))
+				{
+					confirmed [i] = elapsed;
+					--remaining;
+				}
+			}
+		}
+		std::this_thread::sleep_for (std::chrono::milliseconds (10));
+	}
+	auto elapsed_ms (std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now () - begin).count ());
+	ASSERT_EQ (0, remaining);
+	uint64_t bytes (0);
+	uint64_t lost (0);
+	for (auto & i: transports)
+	{
+		bytes += i->bytes_sent;
+		lost += i->datagrams_lost;
+	}
+	bytes -= bytes_begin;
+	std::sort (received.begin (), received.end ());
+	std::sort (confirmed.begin (), confirmed.end ());
+	std::cerr << "Nodes: " << node_count << " converged ms: " << received.back () << " confirmed ms median: " << confirmed [node_count / 2] << " max: " << confirmed.back () << " bytes per node: " << bytes / node_count << " bytes/s per node: " << bytes * 1000 / node_count / std::max <int64_t> (1, elapsed_ms) << " datagrams lost: " << lost << std::endl;
+	system.stop ();
+	system.service.stop ();
+	runner.join ();
+}
+
+namespace
+{
+// Sends a chain of blocks through a simulated network and returns the bytes every node sent between the first send and the last node confirming the last block
+void confirmed_block_bytes (bool announce_a, size_t node_count_a, size_t block_count_a, uint64_t & bytes_a)
+{
+	rai::simulated_link link;
+	link.latency = std::chrono::milliseconds (50);
+	link.jitter = std::chrono::milliseconds (20);
+	link.bandwidth = 1024 * 1024;
+	// Set before the nodes start so nothing is sent with the default
+	rai::system system (24000, node_count_a, link, [announce_a] (rai::node_config & config_a)
+	{
+		config_a.announce_blocks = announce_a;
+	});
+	rai::thread_runner runner (system.service, std::max (4u, std::thread::hardware_concurrency ()));
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	std::vector <std::shared_ptr <rai::simulated_transport>> transports;
+	uint64_t bytes_begin (0);
+	for (auto & i: system.nodes)
+	{
+		transports.push_back (std::static_pointer_cast <rai::simulated_transport> (i->network.transport));
+		bytes_begin += transports.back ()->bytes_sent;
+	}
+	rai::keypair key;
+	std::vector <std::shared_ptr <rai::block>> blocks;
+	for (size_t i (0); i < block_count_a; ++i)
+	{
+		auto block (system.wallet (0)->send_action (rai::test_genesis_key.pub, key.pub, 1));
+		ASSERT_NE (nullptr, block);
+		blocks.push_back (std::move (block));
+	}
+	auto begin (std::chrono::steady_clock::now ());
+	auto done (false);
+	while (!done && std::chrono::steady_clock::now () - begin < std::chrono::minutes (5))
+	{
+		done = true;
+		for (auto i (system.nodes.begin ()), n (system.nodes.end ()); done && i != n; ++i)
+		{
+			for (auto j (blocks.begin ()), m (blocks.end ()); done && j != m; ++j)
+			{
+				done = (*i)->ledger.block_exists ((*j)->hash ()) && !(*i)->active.active (**j);
+			}
+		}
+		std::this_thread::sleep_for (std::chrono::milliseconds (10));
+	}
+	ASSERT_TRUE (done);
+	bytes_a = 0;
+	for (auto & i: transports)
+	{
+		bytes_a += i->bytes_sent;
+	}
+	bytes_a -= bytes_begin;
+	system.stop ();
+	system.service.stop ();
+	runner.join ();
+}
+}
+
+TEST (simulated_network, bytes_per_block)
+{
+	size_t node_count (200);
+	size_t block_count (20);
+	uint64_t publish_bytes (0);
+	ASSERT_NO_FATAL_FAILURE (confirmed_block_bytes (false, node_count, block_count, publish_bytes));
+	uint64_t announce_bytes (0);
+	ASSERT_NO_FATAL_FAILURE (confirmed_block_bytes (true, node_count, block_count, announce_bytes));
+	std::cerr << "Nodes: " << node_count << " blocks: " << block_count << " bytes per confirmed block with publish: " << publish_bytes / block_count << " with announce: " << announce_bytes / block_count << std::endl;
+	ASSERT_LT (announce_bytes, publish_bytes);
+}
+
+namespace
+{
+class channel_loss_result
+{
+public:
+	uint64_t datagrams_lost;
+	uint64_t confirm_reqs;
+	uint64_t bytes;
+	std::chrono::milliseconds duration;
+};
+// Confirms a chain of blocks over a lossy simulated network, optionally with every node holding a realtime channel to the representative
+void channel_loss_confirm (bool channels_a, size_t node_count_a, size_t block_count_a, channel_loss_result & result_a)
+{
+	rai::simulated_link link;
+	link.latency = std::chrono::milliseconds (50);
+	link.jitter = std::chrono::milliseconds (20);
+	link.loss = 0.05;
+	rai::system system (24000, node_count_a, link);
+	rai::thread_runner runner (system.service, std::max (4u, std::thread::hardware_concurrency ()));
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	auto & representative (*system.nodes [0]);
+	if (channels_a)
+	{
+		for (auto i (system.nodes.begin () + 1), n (system.nodes.end ()); i != n; ++i)
+		{
+			(*i)->channels.connect (representative.network.endpoint ());
+		}
+		auto begin (std::chrono::steady_clock::now ());
+		while (representative.channels.size () < node_count_a - 1 && std::chrono::steady_clock::now () - begin < std::chrono::seconds (30))
+		{
+			std::this_thread::sleep_for (std::chrono::milliseconds (10));
+		}
+		ASSERT_EQ (node_count_a - 1, representative.channels.size ());
+	}
+	std::vector <std::shared_ptr <rai::simulated_transport>> transports;
+	uint64_t lost_begin (0);
+	uint64_t confirm_reqs_begin (0);
+	uint64_t bytes_begin (0);
+	for (auto & i: system.nodes)
+	{
+		transports.push_back (std::static_pointer_cast <rai::simulated_transport> (i->network.transport));
+		lost_begin += transports.back ()->datagrams_lost;
+		bytes_begin += transports.back ()->bytes_sent;
+		confirm_reqs_begin += i->network.outgoing.confirm_req;
+	}
+	rai::keypair key;
+	std::vector <std::shared_ptr <rai::block>> blocks;
+	auto begin (std::chrono::steady_clock::now ());
+	for (size_t i (0); i < block_count_a; ++i)
+	{
+		auto block (system.wallet (0)->send_action (rai::test_genesis_key.pub, key.pub, 1));
+		ASSERT_NE (nullptr, block);
+		blocks.push_back (std::move (block));
+	}
+	auto done (false);
+	while (!done && std::chrono::steady_clock::now () - begin < std::chrono::minutes (5))
+	{
+		done = true;
+		for (auto i (system.nodes.begin ()), n (system.nodes.end ()); done && i != n; ++i)
+		{
+			for (auto j (blocks.begin ()), m (blocks.end ()); done && j != m; ++j)
+			{
+				done = (*i)->ledger.block_exists ((*j)->hash ()) && !(*i)->active.active (**j);
+			}
+		}
+		std::this_thread::sleep_for (std::chrono::milliseconds (10));
+	}
+	ASSERT_TRUE (done);
+	result_a.duration = std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now () - begin);
+	result_a.datagrams_lost = 0;
+	result_a.confirm_reqs = 0;
+	result_a.bytes = 0;
+	for (size_t i (0); i < transports.size (); ++i)
+	{
+		result_a.datagrams_lost += transports [i]->datagrams_lost;
+		result_a.bytes += transports [i]->bytes_sent;
+		result_a.confirm_reqs += system.nodes [i]->network.outgoing.confirm_req;
+	}
+	result_a.datagrams_lost -= lost_begin;
+	result_a.bytes -= bytes_begin;
+	result_a.confirm_reqs -= confirm_reqs_begin;
+	system.stop ();
+	system.service.stop ();
+	runner.join ();
+}
+}
+
+TEST (simulated_network, channel_loss)
+{
+	size_t node_count (64);
+	size_t block_count (20);
+	channel_loss_result udp;
+	ASSERT_NO_FATAL_FAILURE (channel_loss_confirm (false, node_count, block_count, udp));
+	channel_loss_result channels;
+	ASSERT_NO_FATAL_FAILURE (channel_loss_confirm (true, node_count, block_count, channels));
+	std::cerr << "Nodes: " << node_count << " blocks: " << block_count << " with 5% loss" << std::endl;
+	std::cerr << "UDP lost: " << udp.datagrams_lost << " confirm_req: " << udp.confirm_reqs << " bytes: " << udp.bytes << " ms: " << udp.duration.count () << std::endl;
+	std::cerr << "Channels lost: " << channels.datagrams_lost << " confirm_req: " << channels.confirm_reqs << " bytes: " << channels.bytes << " ms: " << channels.duration.count () << std::endl;
+	ASSERT_LT (channels.datagrams_lost, udp.datagrams_lost);
+}
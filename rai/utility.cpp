@@ -13,6 +13,12 @@ boost::filesystem::path rai::unique_path ()
 	return result;
 }
 
+rai::buffer_reader::buffer_reader (uint8_t const * data_a, size_t size_a) :
+data (data_a),
+remaining (size_a)
+{
+}
+
 std::string rai::to_string_hex (uint64_t value_a)
 {
     std::stringstream stream;
@@ -811,6 +817,11 @@ bool rai::validate_message (rai::public_key const & public_key, rai::uint256_uni
     return result;
 }
 
+void rai::validate_message_batch (unsigned char const ** messages_a, size_t * lengths_a, unsigned char const ** public_keys_a, unsigned char const ** signatures_a, size_t count_a, int * valid_a)
+{
+	ed25519_sign_open_batch (messages_a, lengths_a, public_keys_a, signatures_a, count_a, valid_a);
+}
+
 void rai::open_or_create (std::fstream & stream_a, std::string const & path_a)
 {
 	stream_a.open (path_a, std::ios_base::in);
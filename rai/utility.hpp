@@ -3,7 +3,9 @@
 #include <array>
 #include <atomic>
 #include <condition_variable>
+#include <cstring>
 #include <type_traits>
+#include <vector>
 
 #include <blake2/blake2.h>
 
@@ -47,6 +49,121 @@ void write (rai::stream & stream_a, T const & value)
 	auto amount_written (stream_a.sputn (reinterpret_cast <uint8_t const *> (&value), sizeof (value)));
 	assert (amount_written == sizeof (value));
 }
+// Reads raw values straight out of a buffer with memcpy, an alternative to bufferstream on hot paths where the length is checked first
+class buffer_reader
+{
+public:
+	buffer_reader (uint8_t const *, size_t);
+	// Read a raw value the size of `T', returns true if the buffer is too short
+	template <typename T>
+	bool read (T & value)
+	{
+		static_assert (std::is_pod <T>::value, "Can't read non-standard layout types");
+		auto result (remaining < sizeof (value));
+		if (!result)
+		{
+			std::memcpy (&value, data, sizeof (value));
+			data += sizeof (value);
+			remaining -= sizeof (value);
+		}
+		return result;
+	}
+	uint8_t const * data;
+	size_t remaining;
+};
+// Per thread free lists of allocations of one size, for objects created and released at a high rate
+// Memory released on another thread than it was allocated on moves to that thread's list
+template <size_t Size>
+class fixed_pool
+{
+public:
+	static void * allocate ()
+	{
+		auto & entries (list ().entries);
+		void * result;
+		if (!entries.empty ())
+		{
+			result = entries.back ();
+			entries.pop_back ();
+		}
+		else
+		{
+			result = ::operator new (Size);
+		}
+		return result;
+	}
+	static void release (void * data_a)
+	{
+		auto & entries (list ().entries);
+		if (entries.size () < max)
+		{
+			entries.push_back (data_a);
+		}
+		else
+		{
+			::operator delete (data_a);
+		}
+	}
+	// Allocations each thread keeps for reuse
+	static size_t constexpr max = 1024;
+private:
+	class free_list
+	{
+	public:
+		~free_list ()
+		{
+			for (auto i: entries)
+			{
+				::operator delete (i);
+			}
+		}
+		std::vector <void *> entries;
+	};
+	static free_list & list ()
+	{
+		static thread_local free_list result;
+		return result;
+	}
+};
+template <size_t Size>
+size_t constexpr fixed_pool <Size>::max;
+// Allocator drawing single objects from a fixed_pool, for use with std::allocate_shared
+template <typename T>
+class pool_allocator
+{
+public:
+	using value_type = T;
+	pool_allocator () = default;
+	template <typename U>
+	pool_allocator (pool_allocator <U> const &)
+	{
+	}
+	T * allocate (size_t count_a)
+	{
+		return static_cast <T *> (count_a == 1 ? rai::fixed_pool <sizeof (T)>::allocate () : ::operator new (count_a * sizeof (T)));
+	}
+	void deallocate (T * data_a, size_t count_a)
+	{
+		if (count_a == 1)
+		{
+			rai::fixed_pool <sizeof (T)>::release (data_a);
+		}
+		else
+		{
+			::operator delete (data_a);
+		}
+	}
+	template <typename U>
+	bool operator == (pool_allocator <U> const &) const
+	{
+		return true;
+	}
+	template <typename U>
+	bool operator != (pool_allocator <U> const &) const
+	{
+		return false;
+	}
+};
 // C++ stream are absolutely horrible so I need this helper function to do the most basic operation of creating a file if it doesn't exist or truntacing it.
 void open_or_create (std::fstream &, std::string const &);
 // Reads a json object from the stream and if was changed, write the object back to the stream
@@ -269,6 +386,8 @@ union uint512_union
 using signature = uint512_union;
 rai::uint512_union sign_message (rai::raw_key const &, rai::public_key const &, rai::uint256_union const &);
 bool validate_message (rai::public_key const &, rai::uint256_union const &, rai::uint512_union const &);
+// Verify count signatures at once, valid [i] is set nonzero for each one that verifies
+void validate_message_batch (unsigned char const **, size_t *, unsigned char const **, unsigned char const **, size_t, int *);
 }
 namespace std
 {